@@ -70,15 +70,30 @@
 #include "RWS_UNO.h"    // https://github.com/sellensr/RWS_UNO
 #include <Servo.h>
 /****************SET INSTRUMENTATION TYPES HERE****************************/
-// define only one source for P or else you will get a redefinition of 'xxx' error
-//#define P_NONE          ///< there is no patient pressure sensor
-//#define P_BME280        ///< use the paired BME280s as the patient pressure sensors
-#define P_PX137         ///< use a PX137 as the patient pressure sensor
-
-// define only one source for Q or else you will get a redefinition of 'xxx' error
-//#define Q_NONE          ///< there is no patient flow sensor
-//#define Q_PX137         ///< use a PX137 as the flow sensor
-#define Q_CAP2          ///< use 2 Capillary sensors, one on CPAP side, one on PEEP, diff is flow
+#define VENT_MODEL 3      ///< hardware model, picks the sensors from vent_model_traits below
+
+#define P_NONE   0        ///< pressure source: there is no patient pressure sensor
+#define P_BME280 1        ///< pressure source: the paired BME280s
+#define P_PX137  2        ///< pressure source: a PX137
+
+#define Q_NONE   0        ///< flow source: there is no patient flow sensor
+#define Q_PX137  1        ///< flow source: a PX137 across the venturi
+#define Q_CAP2   2        ///< flow source: 2 Capillary sensors, one on CPAP side, one on PEEP, diff is flow
+
+// The sensors fitted to each model, as in the YGKMV library. getP(), getQ()
+// and setup branch on these constants and the compiler drops the others.
+// No model has the paired BME280s, name P_BME280 in a model's traits to
+// use them. An undefined model will not compile.
+template <int model> struct vent_model_traits;
+template <> struct vent_model_traits<2> {   ///< Model 2: single servo and venturi
+  static const int pSource = P_PX137;
+  static const int qSource = Q_PX137;
+};
+template <> struct vent_model_traits<3> {   ///< Model 3: flow elements in both feeds
+  static const int pSource = P_PX137;
+  static const int qSource = Q_CAP2;
+};
+typedef vent_model_traits<VENT_MODEL> vent_model;  ///< traits of the model being built
 
 // define only one hardware prototype -- config details to be resolved for production
 //#define YGK_MCL       ///< McLaughlin Hall Prototype -- Avoid using, may conflict with config file setup
@@ -75,27 +75,40 @@ void setupFlash(){
 int writeCalFlash(){
   delCalFlash();   // delete the old file
   // Create a calibration file in the vent directory and write data to it.
-  File writeFile = fatfs.open("/vent/cal.txt", FILE_WRITE);
-  if (!writeFile) {
+  // Fields are formatted straight into the stream buffer, no sprintf.
+  StdioStream writeFile;
+  if (!writeFile.fopen("/vent/cal.txt", "w+")) {
     Serial.println("Error, failed to open cal.txt for writing!");
     return -1;
   }
   Serial.println("Opened file /vent/cal.txt for writing/appending...");
-  char sc[MAX_COMMAND_LENGTH] = {0};
+  float c[6];
+  int32_t n[6];
   // write a calibration constants line
-  sprintf(sc,"C%7.4f,%7.4f,%7.4f,%7.2f,%7.2f,%7.2f\n",p_pOffset,p_qOffsetCPAP,p_qOffsetPEEP,p_pScale,p_qScaleCPAP,p_qScalePEEP);
-  writeFile.print(sc);
-  PR(sc);
+  c[0] = p_pOffset; c[1] = p_qOffsetCPAP; c[2] = p_qOffsetPEEP;
+  c[3] = p_pScale;  c[4] = p_qScaleCPAP;  c[5] = p_qScalePEEP;
+  writeFile.putc('C');
+  writeFile.printFields(c, 3, 4, ',', ',');
+  writeFile.printFields(c + 3, 3, 2, ',', '\n');
   // write a servo angles line
-  sprintf(sc,"S%d,%d,%d,%d,%d,%d\n",aMinCPAP,aMaxCPAP,aMinPEEP,aMaxPEEP,aCloseCPAP,aClosePEEP);
-  writeFile.print(sc);
-  PR(sc);
+  n[0] = aMinCPAP; n[1] = aMaxCPAP; n[2] = aMinPEEP;
+  n[3] = aMaxPEEP; n[4] = aCloseCPAP; n[5] = aClosePEEP;
+  writeFile.putc('S');
+  writeFile.printFields(n, 6, ',', '\n');
   // write a model / serial numbers line
-  sprintf(sc,"M%d,%d\n", p_modelNumber, p_serialNumber);
-  writeFile.print(sc);
-  PR(sc);
-  // Close the file when finished writing.
-  writeFile.close();
+  n[0] = p_modelNumber; n[1] = p_serialNumber;
+  writeFile.putc('M');
+  writeFile.printFields(n, 2, ',', '\n');
+  // read back what was written for the console, then close the file
+  char sc[MAX_COMMAND_LENGTH];
+  bool ok = !writeFile.ferror();
+  if (writeFile.rewind()) {
+    while (writeFile.fgets(sc, sizeof(sc))) PR(sc);
+  }
+  if (writeFile.fclose() || !ok) {
+    Serial.println("Error, failed writing /vent/cal.txt!");
+    return -1;
+  }
   Serial.println("Wrote to file /vent/cal.txt!");
   return 0;
 }
@@ -19,10 +19,23 @@
   critical to life or health, or protection of property.
 */
 /**************************************************************************/
-#ifdef P_BME280
-#include <Adafruit_Sensor.h>
-#include <Adafruit_BME280.h>
-Adafruit_BME280 bmeA, bmeV; // I2C
+RWS_BME280 bmeA, bmeV; // I2C, free running so getP() never waits for a conversion, only started for P_BME280
+
+/**************************************************************************/
+/*!
+    @brief Report a BME280 that could not be found
+    @param id the sensor ID that was read, 0 for none
+    @return none
+*/
+/**************************************************************************/
+void reportBME(unsigned id){
+  Serial.println("Could not find a valid BME280 sensor, check wiring, address, sensor ID!");
+  Serial.print("SensorID was: 0x"); Serial.println(id,16);
+  Serial.print("        ID of 0xFF probably means a bad address, a BMP 180 or BMP 085\n");
+  Serial.print("   ID of 0x56-0x58 represents a BMP 280,\n");
+  Serial.print("        ID of 0x60 represents a BME 280.\n");
+  Serial.print("        ID of 0x61 represents a BME 680.\n");
+}
 
 /**************************************************************************/
 /*!
@@ -32,75 +45,44 @@ Adafruit_BME280 bmeA, bmeV; // I2C
 */
 /**************************************************************************/
 void setupP(){  // do any setup required for pressure measurement
-  unsigned status = bmeA.begin(0x77);  
-  PR("bmeA started\n");
-  if (!status) {
-      Serial.println("Could not find a valid BME280 sensor, check wiring, address, sensor ID!");
-      Serial.print("SensorID was: 0x"); Serial.println(bmeA.sensorID(),16);
-      Serial.print("        ID of 0xFF probably means a bad address, a BMP 180 or BMP 085\n");
-      Serial.print("   ID of 0x56-0x58 represents a BMP 280,\n");
-      Serial.print("        ID of 0x60 represents a BME 280.\n");
-      Serial.print("        ID of 0x61 represents a BME 680.\n");
-  }
-  status = bmeV.begin(0x76);  
-  if (!status) {
-      Serial.println("Could not find a valid BME280 sensor, check wiring, address, sensor ID!");
-      Serial.print("SensorID was: 0x"); Serial.println(bmeV.sensorID(),16);
-      Serial.print("        ID of 0xFF probably means a bad address, a BMP 180 or BMP 085\n");
-      Serial.print("   ID of 0x56-0x58 represents a BMP 280,\n");
-      Serial.print("        ID of 0x60 represents a BME 280.\n");
-      Serial.print("        ID of 0x61 represents a BME 680.\n");
+  if(vent_model::pSource == P_BME280){
+    if (!bmeA.begin(0x77)) reportBME(bmeA.sensorID());
+    else PR("bmeA started\n");
+    if (!bmeV.begin(0x76)) reportBME(bmeV.sensorID());
   }
 }
  
 /**************************************************************************/
 /*!
-    @brief Get a new value for patient pressure. Be sure to use pull up
-    resistors of about 10K on both SDA and SCL, especially if lines get
-    longer or stray close to things like servo motors!
+    @brief Get a new value for patient pressure from the model's sensor.
+    For the BME280s, be sure to use pull up resistors of about 10K on both
+    SDA and SCL, especially if lines get longer or stray close to things
+    like servo motors! Each call does at most one short burst read,
+    alternating between the sensors, and only when that sensor has a new
+    measurement ready.
     @param none
     @return the current value for patient pressure in cm H20
 */
 /**************************************************************************/
 double getP(){  // return the current value for patient pressure in cm H20
-  static double dP = 0.0;
-  double TA = 0, PA = 0, TV = 0, PV = 0;
-  // Measure current state
-  TA = bmeA.readTemperature();
-  PA = bmeA.readPressure(); // Pa
-  TV = bmeV.readTemperature();
-  PV = bmeV.readPressure(); // Pa
-  //P(PA);PCSL(PV);
-  dP = dP * 0.9 + (PV - PA - 0.0) * 0.1; 
-  return dP * 100 / 998 / 9.81;    // cm H2O   
-}
-#endif
-
-#ifdef P_PX137
-void setupP(){  // do any setup required for pressure measurement
-  
-}
- 
-double getP(){  // return the current value for patient pressure in cm H20
-  double v = uno.getV(A_PX137); // instantaneous voltage
-  double w = v_tauW; // weighting factor for exponential smoothing
-  v_px137v = v_px137v * (1-w) + v * w; // smoothed voltage
-  double p = (v_px137v - p_pOffset) * p_pScale;
-  return p;   
-}
-#endif
-
-#ifdef P_NONE
-void setupP(){  // do any setup required for pressure measurement
-  
-}
- 
-double getP(){  // return the current value for patient pressure in cm H20
-  return 0.42;   
+  if(vent_model::pSource == P_BME280){
+    static double dP = 0.0;
+    static bool pollV = false;
+    bool fresh = pollV ? bmeV.poll() : bmeA.poll();
+    pollV = !pollV;
+    if(fresh) dP = dP * 0.9 + (bmeV.pressure() - bmeA.pressure() - 0.0) * 0.1;  // Pa
+    return dP * 100 / 998 / 9.81;    // cm H2O   
+  }
+  if(vent_model::pSource == P_PX137){
+    double v = uno.getV(A_PX137); // instantaneous voltage
+    double w = v_tauW; // weighting factor for exponential smoothing
+    v_px137v = v_px137v * (1-w) + v * w; // smoothed voltage
+    double p = (v_px137v - p_pOffset) * p_pScale;
+    return p;   
+  }
+  return 0.42;
 }
-#endif
 
-#ifdef Q_NONE
 /**************************************************************************/
 /*!
     @brief Do any setup required for patient flow measurement
@@ -109,60 +91,50 @@ double getP(){  // return the current value for patient pressure in cm H20
 */
 /**************************************************************************/
 void setupQ(){  // do any setup required for flow measurement
-  
+  if(vent_model::qSource == Q_CAP2){
+    for(int i = 0; i < 100; i++){
+      v_CPAPv = uno.getV(A_CAP_CPAP);  
+      v_PEEPv = uno.getV(A_CAP_PEEP);  
+    }
+  }
 }
 
 /**************************************************************************/
 /*!
-    @brief Get a new value for patient flow
+    @brief Get a new value for patient flow from the model's sensors
     @param none
     @return the current value for patient flow in litres / minute
 */
 /**************************************************************************/
 double getQ(){  // return the current value for patient flow in litres / minute
-  return 0.42;
-}
-#endif
-
-#ifdef Q_PX137
-void setupQ(){  // do any setup required for flow measurement
-  
-}
-
-double getQ(){  // return the current value for patient flow in litres / minute
-  double v = uno.getV(A_VENTURI); // instantaneous voltage
-  double w = v_tauW; // weighting factor for exponential smoothing
-  v_venturiv = v_venturiv * (1-w) + v * w; // smoothed voltage
-  double p = (v_venturiv - OFFSET_VENTURI) * PSCALE_VENTURI;
-  double q = pow(abs(p),0.5) * QSCALE_VENTURI; 
-  // do this supression somewhere else like at the display
-  // if(q < MINQ_VENTURI) q = 0; // supress small noisy values for optics!
-  return q;
-}
-#endif
-
-#ifdef Q_CAP2
-void setupQ(){  // do any setup required for flow measurement
-  for(int i = 0; i < 100; i++){
-    v_CPAPv = uno.getV(A_CAP_CPAP);  
-    v_PEEPv = uno.getV(A_CAP_PEEP);  
+  if(vent_model::qSource == Q_PX137){
+    double v = uno.getV(A_VENTURI); // instantaneous voltage
+    double w = v_tauW; // weighting factor for exponential smoothing
+    v_venturiv = v_venturiv * (1-w) + v * w; // smoothed voltage
+    double p = (v_venturiv - OFFSET_VENTURI) * PSCALE_VENTURI;
+    double q = sqrt(fabs(p)) * QSCALE_VENTURI;   // sqrt() is much cheaper than pow(p, 0.5)
+    // do this supression somewhere else like at the display
+    // if(q < MINQ_VENTURI) q = 0; // supress small noisy values for optics!
+    return q;
   }
+  if(vent_model::qSource == Q_CAP2){
+    double w = v_tauW; // weighting factor for exponential smoothing
+    double v = uno.getV(A_CAP_CPAP); // instantaneous voltage
+    v_CPAPv = v_CPAPv * (1-w) + v * w; // smoothed voltage
+    v = uno.getV(A_CAP_PEEP); // instantaneous voltage
+    v_PEEPv = v_PEEPv * (1-w) + v * w; // smoothed voltage
+    v_qCPAP = (v_CPAPv - p_qOffsetCPAP) * p_qScaleCPAP;  // flow on the CPAP side
+    v_qPEEP = (v_PEEPv - p_qOffsetPEEP) * p_qScalePEEP;  // minus return flow on the PEEP side
+    return v_qCPAP - v_qPEEP;
+  }
+  return 0.42;
 }
 
-double getQ(){  // return the current value for patient flow in litres / minute
-  double w = v_tauW; // weighting factor for exponential smoothing
-  double v = uno.getV(A_CAP_CPAP); // instantaneous voltage
-  v_CPAPv = v_CPAPv * (1-w) + v * w; // smoothed voltage
-  v = uno.getV(A_CAP_PEEP); // instantaneous voltage
-  v_PEEPv = v_PEEPv * (1-w) + v * w; // smoothed voltage
-  v_qCPAP = (v_CPAPv - p_qOffsetCPAP) * p_qScaleCPAP;  // flow on the CPAP side
-  v_qPEEP = (v_PEEPv - p_qOffsetPEEP) * p_qScalePEEP;  // minus return flow on the PEEP side
-  return v_qCPAP - v_qPEEP;
-}
-double getQCPAP(){  // return the instantaneous value for CPAP side flow in litres / minute
+double getQCPAP(){  // return the instantaneous value for CPAP side flow in litres / minute, 0 without the capillaries
+  if(vent_model::qSource != Q_CAP2) return 0.0;
   return (uno.getV(A_CAP_CPAP) - p_qOffsetCPAP) * p_qScaleCPAP;  // flow on the CPAP side
 }
-double getQPEEP(){  // return the instantaneous value for PEEP side flow in litres / minute
+double getQPEEP(){  // return the instantaneous value for PEEP side flow in litres / minute, 0 without the capillaries
+  if(vent_model::qSource != Q_CAP2) return 0.0;
   return (uno.getV(A_CAP_PEEP) - p_qOffsetPEEP) * p_qScalePEEP;  // flow on the PEEP side
 }
-#endif
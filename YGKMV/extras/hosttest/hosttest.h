@@ -0,0 +1,84 @@
+// Host test support for YGKMV.
+//
+// Each test_*.cpp is a separate program built by run.sh against the real
+// library sources, with the Arduino core, Servo, Wire, SPI and the flash
+// chip replaced by the stand-ins in stub/. sim.cpp keeps a simulated clock
+// that only moves when the code under test reads the ADC, talks on the bus,
+// calls delay() or the test calls simAdvance(), so timing results are
+// repeatable and independent of the host.
+//
+// Tests print one line per check and return the number that failed.
+#pragma once
+#include <Arduino.h>
+#include <Servo.h>
+#include <Wire.h>
+#include <SPI.h>
+#include <functional>
+#include <vector>
+#include <chrono>
+
+#define private public  // tests look at the ventilator state directly
+#define protected public
+#include "YGKMV.h"
+#undef private
+#undef protected
+
+extern uint64_t simMicros;         // [us] since power up
+extern unsigned long simAdcTime;   // [us] taken by each analogRead(), the SAMD core needs about 40
+extern unsigned long simAdcReads;  // analogRead() calls since power up
+extern int simAdcBits;             // resolution set by analogReadResolution()
+extern int simAnalogOut[];         // last analogWrite() value on each pin
+
+// Input voltage on an analog pin at the current simulated time. Returns
+// 0.0 V for every pin until a test sets it.
+extern std::function<double(uint8_t pin)> simVolts;
+
+// Advance the clock, running any simEvery() handlers that fall due on the way.
+void simAdvance(unsigned long us);
+
+// Call fn every us microseconds of simulated time, like a timer interrupt.
+// Handlers do not nest. An interval of 0 removes all handlers.
+void simEvery(unsigned long us, std::function<void()> fn);
+
+// Drive a digital input, running its attachInterrupt() handler if the core
+// would have attached one.
+void simPin(uint8_t pin, int level);
+
+// Put an empty FAT16 file system on the RAM flash chip.
+void simFlashFormat(uint32_t blocks = 4096);
+
+// SD card for the YGKMV_SD_LOG builds, held in RAM like the flash chip.
+// Put an empty FAT16 file system on it, 4 block clusters, before begin().
+extern uint8_t *simCard;
+extern uint32_t simCardBlocks;
+void simCardFormat(uint32_t blocks);
+
+// [us] the card stays busy programming after the given number of blocks
+// of a multi-block write, 500 us if not set. simCardStalls counts the
+// card calls that had to wait for it.
+extern std::function<unsigned long(unsigned long blocks)> simCardBusy;
+extern unsigned long simCardStalls;
+
+// Record one check, printing it if it failed or verbose is set.
+extern int simFailures;
+extern bool simVerbose;
+bool check(bool ok, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Send a console command line and run it the way loop() does.
+void simCommand(YGKMV &v, const char *line);
+
+// Host wall clock time for benchmarks [ns].
+inline double hostNs() {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Host cycle counter for benchmarks, 0 where there isn't one to read.
+inline uint64_t hostCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,85 @@
+// A simulated patient circuit for the host tests that run the whole
+// ventilator. The blower and valves are taken to hold the circuit at
+// v_pSet through a resistance rc, a leak of conductance k sits at the
+// pressure sensor, and the patient is a resistance rp in series with a
+// compliance c and an optional muscle effort. Both flow elements see the
+// patient flow plus the leak, split by direction. The model is stepped
+// every 100 us of simulated time and keeps the true volumes.
+#pragma once
+#include "hosttest.h"
+#include <random>
+
+struct Lung {
+  double rc = 0.10;      // drive to sensor resistance [cm H2O / (l/min)]
+  double rp = 0.15;      // patient airway resistance [cm H2O / (l/min)]
+  double c = 30.0;       // compliance [ml / cm H2O]
+  double k = 0.0;        // leak conductance [(l/min) / cm H2O]
+  double noiseP = 0.0;   // rms pressure sensor noise [cm H2O]
+  double noiseQ = 0.0;   // rms flow sensor noise [l/min]
+  std::function<double(double t)> effort;  // muscle pressure at t [s], negative to inhale
+
+  double pL = 0.0;       // elastic pressure in the lung [cm H2O]
+  double p = 0.0;        // pressure at the sensor [cm H2O]
+  double q = 0.0;        // flow into the patient [l/min]
+  double ql = 0.0;       // leak flow [l/min]
+  double vIn = 0.0, vOut = 0.0, vLeak = 0.0;  // true volumes since the last clear [ml]
+  std::mt19937 rng{1};
+
+  YGKMV *vent = NULL;
+
+  void step(double dt) {  // dt [s]
+    double drive = vent->p_stopped ? 0.0 : vent->v_pSet;
+    double pA = pL + (effort ? effort(simMicros / 1e6) : 0.0);
+    p = (drive + rc * pA / rp) / (1.0 + rc / rp + rc * k);
+    q = (p - pA) / rp;
+    ql = k * max(p, 0.0);
+    pL += q / 60.0 * dt * 1000.0 / c;
+    if (q > 0) vIn += q / 60.0 * dt * 1000.0;
+    else vOut -= q / 60.0 * dt * 1000.0;
+    vLeak += ql / 60.0 * dt * 1000.0;
+  }
+
+  double noise(double rms) { return rms > 0 ? std::normal_distribution<double>(0.0, rms)(rng) : 0.0; }
+
+  double volts(uint8_t pin) {
+    double qs = q + ql;  // through the flow elements
+    if (pin == vent->aPins[PATIENT]) return vent->offset[PATIENT] + (p + noise(noiseP)) / vent->scale[PATIENT];
+    if (pin == vent->aPins[CPAP]) return vent->offset[CPAP] + (max(qs, 0.0) + noise(noiseQ)) / vent->scale[CPAP];
+    if (pin == vent->aPins[PEEP]) return vent->offset[PEEP] + (max(-qs, 0.0) + noise(noiseQ)) / vent->scale[PEEP];
+    return 0.0;
+  }
+
+  // Start the ventilator on this circuit: sensors scaled to fit the ADC,
+  // breathing 20 / 5 cm H2O, 1 s inspiration and 2 s expiration.
+  void begin(YGKMV &v) {
+    vent = &v;
+    simFlashFormat();
+    simVolts = [this](uint8_t pin) { return volts(pin); };
+    simEvery(0, nullptr);
+    simEvery(100, [this]() { step(100e-6); });
+    v.begin();
+    v.offset[PATIENT] = 0.5;  v.scale[PATIENT] = 20.0;   // 0 to 56 cm H2O
+    v.offset[CPAP] = 0.5;     v.scale[CPAP] = 100.0;     // 0 to 280 l/min
+    v.offset[PEEP] = 0.5;     v.scale[PEEP] = 100.0;
+    v.buildCalTables();
+    v.p_iph = 20.0;  v.p_ipl = 10.0;
+    v.p_epl = 5.0;   v.p_eph = 10.0;
+    v.p_it = 1000;   v.p_et = 2000;
+    v.setRun();
+    pL = 5.0;
+  }
+
+  // Call run() every loop [us] for ms of simulated time, calling each(),
+  // if given, after every pass.
+  void run(unsigned long ms, unsigned long loop, std::function<void()> each = nullptr) {
+    uint64_t end = simMicros + ms * 1000ULL;
+    while (simMicros < end) {
+      uint64_t next = simMicros + loop;
+      vent->run();
+      if (each) each();
+      if (next > simMicros) simAdvance(next - simMicros);
+    }
+  }
+
+  void clear() { vIn = vOut = vLeak = 0.0; }
+};
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Build and run the YGKMV host tests on a PC with g++, see hosttest.h.
+#   ./run.sh                   every test_*.cpp in this directory
+#   ./run.sh test_alarm.cpp    just the named tests
+# VERBOSE=1 prints every check rather than just the failures.
+#
+# A test is built once for each "// CONFIGS:" line it contains, with the
+# flags on that line, or once with the defaults if it has none. The library
+# objects for each set of flags are kept under build/ and always rebuilt,
+# so header changes are picked up.
+cd "$(dirname "$0")" || exit 1
+L=../../../libraries
+S=../../src
+F=$L/SdFat_-_Adafruit_Fork/src/FatLib
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++11 -O2 -g -w -fpermissive -DARDUINO=10809 -DARDUINO_ARCH_SAMD"
+INC="-Istub -I. -I$S -I$L/RWS_UNO/src -I$L/Time -I$L/RTClib -I$L/SdFat_-_Adafruit_Fork/src"
+SRC="sim.cpp $S/*.cpp $L/RWS_UNO/src/*.cpp $L/Time/*.cpp $L/RTClib/RTClib.cpp
+  $F/FatFile.cpp $F/FatFileLFN.cpp $F/FatFileSFN.cpp $F/FatFilePrint.cpp
+  $F/FatVolume.cpp $F/FatLineReader.cpp $F/FmtNumber.cpp $F/StdioStream.cpp"
+
+built=""
+lib() {  # lib <dir> <flags>: library objects for one configuration
+  case " $built " in *" $1 "*) return 0 ;; esac
+  mkdir -p "$1"
+  for f in $SRC; do
+    $CXX $FLAGS $2 $INC -c "$f" -o "$1/$(basename "$f" .cpp).o" &
+  done
+  wait
+  built="$built $1"
+}
+
+TESTS=${*:-test_*.cpp}
+fail=0
+for t in $TESTS; do
+  n=$(basename "$t" .cpp)
+  grep -q '^// CONFIGS:' "$t" && cfgs=$(sed -n 's|^// CONFIGS: *||p' "$t") || cfgs="-DDEFAULT"
+  while read -r cfg; do
+    d=build/$(echo "$cfg" | cksum | cut -d' ' -f1)
+    lib "$d" "$cfg"
+    if ! $CXX $FLAGS $cfg $INC "$t" "$d"/*.o -o "$d/$n"; then
+      echo "BUILD FAILED $n $cfg"
+      fail=1
+    elif "$d/$n"; then
+      echo "passed $n $cfg"
+    else
+      echo "FAILED $n $cfg"
+      fail=1
+    fi
+  done <<END
+$cfgs
+END
+done
+exit $fail
@@ -0,0 +1,283 @@
+// Simulated Feather M0 for the host tests, see hosttest.h.
+#include "hosttest.h"
+#include <stdarg.h>
+
+HardwareSerial Serial, Serial1;
+TwoWire Wire;
+SPIClass SPI, SPI1;
+
+uint64_t simMicros = 0;
+unsigned long simAdcTime = 40;
+unsigned long simAdcReads = 0;
+int simAdcBits = 10;
+int simAnalogOut[PIN_COUNT];
+std::function<double(uint8_t pin)> simVolts;
+int simFailures = 0;
+bool simVerbose = getenv("VERBOSE") && atoi(getenv("VERBOSE"));
+uint8_t *simFlash = NULL;
+uint32_t simFlashBlocks = 0;
+uint8_t *simCard = NULL;
+uint32_t simCardBlocks = 0;
+std::function<unsigned long(unsigned long blocks)> simCardBusy;
+unsigned long simCardStalls = 0;
+
+// Feather M0 external interrupt lines from the Adafruit SAMD variant.
+// Pin 4 is PA08, which is wired to the NMI and can't take attachInterrupt().
+const PinDescription g_APinDescription[PIN_COUNT] = {
+    {EXTERNAL_INT_11}, {EXTERNAL_INT_10}, {EXTERNAL_INT_14}, {EXTERNAL_INT_9},   // 0-3
+    {EXTERNAL_INT_NMI}, {EXTERNAL_INT_15}, {EXTERNAL_INT_4}, {EXTERNAL_INT_5},   // 4-7
+    {EXTERNAL_INT_6}, {EXTERNAL_INT_7}, {EXTERNAL_INT_2}, {EXTERNAL_INT_0},      // 8-11
+    {EXTERNAL_INT_3}, {EXTERNAL_INT_1}, {EXTERNAL_INT_2}, {EXTERNAL_INT_8},      // 12-A1
+    {EXTERNAL_INT_9}, {EXTERNAL_INT_4}, {EXTERNAL_INT_5}, {EXTERNAL_INT_2},      // A2-A5
+    {NOT_AN_INTERRUPT}, {NOT_AN_INTERRUPT}, {NOT_AN_INTERRUPT},                  // 20-22
+    {NOT_AN_INTERRUPT}, {NOT_AN_INTERRUPT}, {NOT_AN_INTERRUPT}};                 // 23-25
+
+static int pinLevel[PIN_COUNT];
+static voidFuncPtr pinIsr[PIN_COUNT];
+static uint32_t pinIsrMode[PIN_COUNT];
+
+struct SimTimer {
+  unsigned long period;
+  uint64_t next;
+  std::function<void()> fn;
+};
+static std::vector<SimTimer> timers;
+static bool inTimer = false;
+
+void simAdvance(unsigned long us) {
+  uint64_t end = simMicros + us;
+  if (!inTimer) {
+    for (;;) {  // run the earliest due handler until none fall before end
+      SimTimer *due = NULL;
+      for (auto &t : timers)
+        if (t.next <= end && (!due || t.next < due->next)) due = &t;
+      if (!due) break;
+      if (due->next > simMicros) simMicros = due->next;
+      due->next += due->period;
+      inTimer = true;
+      due->fn();  // may itself advance the clock
+      inTimer = false;
+      if (simMicros > end) end = simMicros;
+    }
+  }
+  if (end > simMicros) simMicros = end;
+}
+
+void simEvery(unsigned long us, std::function<void()> fn) {
+  if (us == 0) {
+    timers.clear();
+    return;
+  }
+  timers.push_back({us, simMicros + us, fn});
+}
+
+void simPin(uint8_t pin, int level) {
+  int old = pinLevel[pin];
+  pinLevel[pin] = level;
+  voidFuncPtr f = pinIsr[pin];
+  if (!f || old == level) return;
+  uint32_t m = pinIsrMode[pin];
+  if (m == CHANGE || (m == FALLING && !level) || (m == RISING && level)) f();
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+static void put32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = v >> (8 * i);
+}
+
+// An empty FAT16 file system on a zeroed image.
+static void format(uint8_t *b, uint32_t blocks, uint8_t perCluster) {
+  b[0] = 0xEB;
+  b[1] = 0x3C;
+  b[2] = 0x90;
+  put16(b + 11, 512);                // bytes per sector
+  b[13] = perCluster;                // sectors per cluster
+  put16(b + 14, 1);                  // reserved sectors
+  b[16] = 1;                         // FATs
+  put16(b + 17, 512);                // root directory entries
+  b[21] = 0xF8;                      // media
+  put16(b + 22, blocks / perCluster * 2 / 512 + 1);  // sectors per FAT
+  put32(b + 32, blocks);             // total sectors
+  b[510] = 0x55;
+  b[511] = 0xAA;
+}
+
+void simFlashFormat(uint32_t blocks) {
+  free(simFlash);
+  simFlash = (uint8_t *)calloc(blocks, 512);
+  simFlashBlocks = blocks;
+  format(simFlash, blocks, 1);
+}
+
+void simCardFormat(uint32_t blocks) {
+  free(simCard);
+  simCard = (uint8_t *)calloc(blocks, 512);
+  simCardBlocks = blocks;
+  format(simCard, blocks, 4);
+}
+
+bool check(bool ok, const char *fmt, ...) {
+  if (!ok) simFailures++;
+  if (ok && !simVerbose) return ok;
+  va_list ap;
+  va_start(ap, fmt);
+  printf("%s: ", ok ? "ok  " : "FAIL");
+  vprintf(fmt, ap);
+  printf("\n");
+  va_end(ap);
+  return ok;
+}
+
+void simCommand(YGKMV &v, const char *line) { v.doConsoleCommand(String(line)); }
+
+//------------------------------------------------------------------------------
+// Arduino core
+unsigned long millis() { return (uint32_t)(simMicros / 1000); }
+unsigned long micros() { return (uint32_t)simMicros; }
+void delay(unsigned long ms) { simAdvance(ms * 1000); }
+void delayMicroseconds(unsigned int us) { simAdvance(us); }
+void yield() {}
+
+int analogRead(uint8_t pin) {
+  simAdcReads++;
+  double v = simVolts ? simVolts(pin) : 0.0;  // sampled at the start of the conversion
+  simAdvance(simAdcTime);
+  long max = (1L << simAdcBits) - 1;
+  long c = lround(v / 3.3 * max);
+  return constrain(c, 0L, max);
+}
+void analogReadResolution(int bits) { simAdcBits = bits; }
+void analogWrite(uint8_t pin, int val) {
+  if (pin < PIN_COUNT) simAnalogOut[pin] = val;
+}
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < PIN_COUNT && mode == INPUT_PULLUP) pinLevel[pin] = HIGH;
+}
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < PIN_COUNT) pinLevel[pin] = val;
+}
+int digitalRead(uint8_t pin) { return pin < PIN_COUNT ? pinLevel[pin] : LOW; }
+
+void attachInterrupt(uint32_t pin, voidFuncPtr callback, uint32_t mode) {
+  if (pin >= PIN_COUNT) return;
+  EExt_Interrupts in = g_APinDescription[pin].ulExtInt;
+  if (in == NOT_AN_INTERRUPT || in == EXTERNAL_INT_NMI) return;  // as the SAMD core does
+  pinIsr[pin] = callback;
+  pinIsrMode[pin] = mode;
+}
+void detachInterrupt(uint32_t pin) {
+  if (pin < PIN_COUNT) pinIsr[pin] = NULL;
+}
+
+static uint32_t rng = 1;
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  rng = rng * 1664525 + 1013904223;
+  return (rng >> 8) % howbig;
+}
+long random(long howsmall, long howbig) { return howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) { rng = seed; }
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) return print('-') + print((unsigned long)-n, base);
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[8 * sizeof(long) + 1];
+  char *p = buf + sizeof(buf) - 1;
+  *p = 0;
+  if (base < 2) base = 10;
+  do {
+    int d = n % base;
+    *--p = d < 10 ? '0' + d : 'A' + d - 10;
+    n /= base;
+  } while (n);
+  return write(p);
+}
+
+size_t Print::print(double n, int digits) {  // same rounding as the Arduino core
+  if (isnan(n)) return print("nan");
+  if (isinf(n)) return print("inf");
+  if (n > 4294967040.0 || n < -4294967040.0) return print("ovf");
+  size_t k = 0;
+  if (n < 0.0) {
+    k += print('-');
+    n = -n;
+  }
+  double r = 0.5;
+  for (int i = 0; i < digits; i++) r /= 10.0;
+  n += r;
+  unsigned long whole = (unsigned long)n;
+  double rem = n - whole;
+  k += print(whole);
+  if (digits > 0) k += print('.');
+  while (digits-- > 0) {
+    rem *= 10.0;
+    unsigned d = (unsigned)rem;
+    k += print(d);
+    rem -= d;
+  }
+  return k;
+}
+
+//------------------------------------------------------------------------------
+// SD card, the SdSpiCard calls the SD log makes on a card held in RAM. A
+// multi-block write takes 350 us to send each block, about 512 bytes at
+// 12 MHz, and the card is then busy programming it for simCardBusy() us.
+static uint32_t cardNext;          // next block of a multi-block write
+static unsigned long cardWritten;  // blocks of it sent so far
+static uint64_t cardBusyUntil;     // [us] simMicros when programming ends
+
+static void cardWait() {
+  if (simMicros >= cardBusyUntil) return;
+  simCardStalls++;
+  simAdvance(cardBusyUntil - simMicros);
+}
+
+bool SdSpiCard::begin(SdSpiDriver *, uint8_t, SPISettings) {
+  cardBusyUntil = 0;
+  return simCard != NULL;
+}
+bool SdSpiCard::isBusy() { return simMicros < cardBusyUntil; }
+bool SdSpiCard::erase(uint32_t first, uint32_t last) {
+  if (first > last || last >= simCardBlocks) return false;
+  memset(simCard + 512 * first, 0xFF, 512 * (last - first + 1));
+  return true;
+}
+bool SdSpiCard::writeStart(uint32_t block) {
+  cardWait();
+  cardNext = block;
+  cardWritten = 0;
+  return block < simCardBlocks;
+}
+bool SdSpiCard::writeData(const uint8_t *src) {
+  cardWait();  // as the library does, waits out the last block
+  if (cardNext >= simCardBlocks) return false;
+  memcpy(simCard + 512 * cardNext++, src, 512);
+  simAdvance(350);
+  cardWritten++;
+  cardBusyUntil = simMicros + (simCardBusy ? simCardBusy(cardWritten) : 500);
+  return true;
+}
+bool SdSpiCard::writeStop() {
+  cardWait();
+  return true;
+}
+bool SdSpiCard::readBlock(uint32_t b, uint8_t *dst) { return readBlocks(b, dst, 1); }
+bool SdSpiCard::readBlocks(uint32_t b, uint8_t *dst, size_t n) {
+  cardWait();
+  if (b + n > simCardBlocks) return false;
+  memcpy(dst, simCard + 512 * b, 512 * n);
+  return true;
+}
+bool SdSpiCard::writeBlock(uint32_t b, const uint8_t *src) { return writeBlocks(b, src, 1); }
+bool SdSpiCard::writeBlocks(uint32_t b, const uint8_t *src, size_t n) {
+  cardWait();
+  if (b + n > simCardBlocks) return false;
+  memcpy(simCard + 512 * b, src, 512 * n);
+  return true;
+}
@@ -0,0 +1,40 @@
+// Host stand-in for Adafruit_SPIFlash, a 2 MB flash chip held in RAM.
+// simFlashFormat() in sim.cpp puts an empty FAT16 file system on it.
+#pragma once
+#include <SPI.h>
+#include <SdFat.h>
+
+extern uint8_t *simFlash;          // image, NULL until simFlashFormat()
+extern uint32_t simFlashBlocks;    // image size in 512 byte blocks
+
+enum {
+  SFLASH_BLOCK_SIZE  = 64 * 1024,
+  SFLASH_SECTOR_SIZE = 4 * 1024,
+  SFLASH_PAGE_SIZE   = 256,
+};
+
+class Adafruit_FlashTransport_SPI {
+ public:
+  Adafruit_FlashTransport_SPI(uint8_t, SPIClass *) {}
+};
+
+class Adafruit_SPIFlash : public BaseBlockDriver {
+ public:
+  Adafruit_SPIFlash(Adafruit_FlashTransport_SPI *) {}
+  bool begin() { return simFlash != NULL; }
+  uint32_t getJEDECID() { return 0xC84015; }
+  uint32_t size() { return simFlashBlocks * 512; }
+  bool readBlock(uint32_t b, uint8_t *dst) { return readBlocks(b, dst, 1); }
+  bool writeBlock(uint32_t b, const uint8_t *src) { return writeBlocks(b, src, 1); }
+  bool syncBlocks() { return true; }
+  bool readBlocks(uint32_t b, uint8_t *dst, size_t n) {
+    if (b + n > simFlashBlocks) return false;
+    memcpy(dst, simFlash + 512 * b, 512 * n);
+    return true;
+  }
+  bool writeBlocks(uint32_t b, const uint8_t *src, size_t n) {
+    if (b + n > simFlashBlocks) return false;
+    memcpy(simFlash + 512 * b, src, 512 * n);
+    return true;
+  }
+};
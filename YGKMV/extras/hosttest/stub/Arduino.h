@@ -0,0 +1,229 @@
+// Host stand-in for the Adafruit SAMD core, just enough for YGKMV, RWS_UNO,
+// SdFat, Time and RTClib to build and run on a PC. Time, pin levels, analog
+// inputs, interrupts and the serial ports are driven by sim.cpp, see
+// hosttest.h.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef void (*voidFuncPtr)(void);
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 2
+#define FALLING 3
+#define RISING 4
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define PIN_COUNT 26
+#define LED_BUILTIN 13
+#define PI 3.1415926535897932384626433832795
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+#define SS 10
+#define SS1 10
+#define SPI_INTERFACES_COUNT 1
+#define F(s) (s)
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define PGM_P const char *
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define interrupts()
+#define noInterrupts()
+class __FlashStringHelper;
+
+using std::min;
+using std::max;
+template <class T, class U> auto min(T a, U b) -> decltype(a + b) { return a < b ? a : b; }
+template <class T, class U> auto max(T a, U b) -> decltype(a + b) { return a > b ? a : b; }
+#define constrain(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
+inline long map(long x, long a, long b, long c, long d) { return (x - a) * (d - c) / (b - a) + c; }
+
+// External interrupt lines as in the SAMD core. The NMI pin is reported
+// but attachInterrupt() ignores it, as the real core does.
+typedef enum _EExt_Interrupts {
+  EXTERNAL_INT_0 = 0, EXTERNAL_INT_1, EXTERNAL_INT_2, EXTERNAL_INT_3,
+  EXTERNAL_INT_4, EXTERNAL_INT_5, EXTERNAL_INT_6, EXTERNAL_INT_7,
+  EXTERNAL_INT_8, EXTERNAL_INT_9, EXTERNAL_INT_10, EXTERNAL_INT_11,
+  EXTERNAL_INT_12, EXTERNAL_INT_13, EXTERNAL_INT_14, EXTERNAL_INT_15,
+  EXTERNAL_INT_NMI,
+  EXTERNAL_NUM_INTERRUPTS,
+  NOT_AN_INTERRUPT = -1,
+  EXTERNAL_INT_NONE = NOT_AN_INTERRUPT,
+} EExt_Interrupts;
+typedef struct _PinDescription {
+  EExt_Interrupts ulExtInt;
+} PinDescription;
+extern const PinDescription g_APinDescription[];  // Feather M0 table in sim.cpp
+#define digitalPinToInterrupt(P) (P)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+int analogRead(uint8_t pin);
+void analogReadResolution(int bits);
+void analogWrite(uint8_t pin, int val);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint32_t pin, voidFuncPtr callback, uint32_t mode);
+void detachInterrupt(uint32_t pin);
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+class String {
+  std::string s;
+
+ public:
+  String(const char *c = "") : s(c ? c : "") {}
+  String(const std::string &x) : s(x) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(double v, int d = 2) {
+    char b[40];
+    snprintf(b, sizeof(b), "%.*f", d, v);
+    s = b;
+  }
+  unsigned length() const { return s.size(); }
+  String substring(int a, int b = -1) const {
+    if (b < 0 || b > (int)s.size()) b = s.size();
+    if (a > (int)s.size()) a = s.size();
+    if (b < a) b = a;
+    return s.substr(a, b - a);
+  }
+  int indexOf(char c) const {
+    size_t p = s.find(c);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  float toFloat() const { return atof(s.c_str()); }
+  long toInt() const { return atol(s.c_str()); }
+  void trim() {
+    size_t a = s.find_first_not_of(" \t\r\n");
+    size_t b = s.find_last_not_of(" \t\r\n");
+    s = a == std::string::npos ? "" : s.substr(a, b - a + 1);
+  }
+  char charAt(unsigned i) const { return i < s.size() ? s[i] : 0; }
+  const char *c_str() const { return s.c_str(); }
+  void reserve(unsigned n) { s.reserve(n); }
+  String &operator+=(char c) { s += c; return *this; }
+  String &operator+=(const String &o) { s += o.s; return *this; }
+  bool operator==(const char *c) const { return s == c; }
+  bool operator!=(const char *c) const { return s != c; }
+  char operator[](unsigned i) const { return s[i]; }
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *b, size_t n) {
+    size_t k = 0;
+    while (n--) k += write(*b++);
+    return k;
+  }
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+  size_t write(const char *b, size_t n) { return write((const uint8_t *)b, n); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(long long n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned long long n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(double n, int digits = 2);
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(T v) { size_t k = print(v); return k + println(); }
+  template <class T> size_t println(T v, int f) { size_t k = print(v, f); return k + println(); }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long) {}
+  // True once target has been read, false when the input runs out first.
+  bool find(const char *target) {
+    size_t k = 0;
+    int c;
+    while (target[k] && (c = read()) >= 0) k = c == target[k] ? k + 1 : c == target[0];
+    return !target[k];
+  }
+  String readStringUntil(char t) {
+    std::string r;
+    int c;
+    while ((c = read()) >= 0 && c != t) r += (char)c;
+    return r;
+  }
+  long parseInt() {
+    String r = readStringUntil('\n');
+    return r.toInt();
+  }
+  size_t readBytes(char *b, size_t n) {
+    size_t k = 0;
+    int c;
+    while (k < n && (c = read()) >= 0) b[k++] = c;
+    return k;
+  }
+};
+
+// A serial port with its input queued by the test and its output captured.
+class HardwareSerial : public Stream {
+ public:
+  std::string in;     // host: characters waiting to be read
+  std::string out;    // host: everything written since the last clear
+  bool echo = false;  // host: also copy output to stdout
+  void begin(unsigned long) {}
+  void end() {}
+  int available() { return (int)in.size(); }
+  int read() {
+    if (in.empty()) return -1;
+    int c = (uint8_t)in[0];
+    in.erase(0, 1);
+    return c;
+  }
+  int peek() { return in.empty() ? -1 : (uint8_t)in[0]; }
+  int availableForWrite() { return 64; }
+  size_t write(uint8_t c) {
+    out += (char)c;
+    if (echo) fputc(c, stdout);
+    return 1;
+  }
+  using Print::write;
+  operator bool() { return true; }
+};
+extern HardwareSerial Serial, Serial1;
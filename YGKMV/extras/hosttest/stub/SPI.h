@@ -0,0 +1,18 @@
+// Host stand-in for the Arduino SPI library, nothing is attached.
+#pragma once
+#include <Arduino.h>
+#define SPI_MODE0 0
+#define MSBFIRST 1
+struct SPISettings {
+  SPISettings() {}
+  SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+class SPIClass {
+ public:
+  void begin() {}
+  void beginTransaction(SPISettings) {}
+  void endTransaction() {}
+  uint8_t transfer(uint8_t) { return 0xFF; }
+  void transfer(void *, size_t) {}
+};
+extern SPIClass SPI, SPI1;
@@ -0,0 +1,26 @@
+// Host stand-in for the Servo library. Keeps the last pulse width and
+// counts the writes that reached the timer.
+#pragma once
+#include <Arduino.h>
+#define MIN_PULSE_WIDTH 544
+#define MAX_PULSE_WIDTH 2400
+class Servo {
+ public:
+  int pin = -1;         // host: attached pin, -1 if none
+  int us = 1500;        // host: last pulse width [us]
+  unsigned long writes = 0;  // host: number of pulse width changes written
+  uint8_t attach(int p) { pin = p; return 0; }
+  uint8_t attach(int p, int, int) { pin = p; return 0; }
+  void detach() { pin = -1; }
+  void write(int a) {
+    if (a < MIN_PULSE_WIDTH) {
+      a = constrain(a, 0, 180);
+      a = MIN_PULSE_WIDTH + (long)a * (MAX_PULSE_WIDTH - MIN_PULSE_WIDTH) / 180;
+    }
+    writeMicroseconds(a);
+  }
+  void writeMicroseconds(int u) { us = u; writes++; }
+  int read() { return (int)((us - MIN_PULSE_WIDTH) * 180L / (MAX_PULSE_WIDTH - MIN_PULSE_WIDTH)); }
+  int readMicroseconds() { return us; }
+  bool attached() { return pin >= 0; }
+};
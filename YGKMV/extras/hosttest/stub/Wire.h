@@ -0,0 +1,61 @@
+// Host stand-in for the Arduino Wire library. Each device on the bus is a
+// 256 byte register map with an auto-incrementing register pointer, which
+// is how the BME280 and DS3231 behave. Transfers advance the simulated
+// clock at the bus speed.
+#pragma once
+#include <Arduino.h>
+
+void simAdvance(unsigned long us);  // sim.cpp
+
+class TwoWire : public Stream {
+ public:
+  uint8_t *dev[128] = {};  // host: register map of each device present, NULL if none
+  uint8_t reg[128] = {};   // host: register pointer of each device
+  unsigned long transactions = 0;  // host: bus transactions since the last clear
+  unsigned long bytes = 0;         // host: bytes moved since the last clear
+  uint32_t clock = 100000;         // [Hz]
+
+  void begin() {}
+  void setClock(uint32_t hz) { clock = hz; }
+  void beginTransmission(uint8_t a) {
+    txAddr = a & 0x7F;
+    txLen = 0;
+  }
+  size_t write(uint8_t c) {
+    if (txLen < sizeof(tx)) tx[txLen++] = c;
+    return 1;
+  }
+  using Print::write;
+  uint8_t endTransmission(bool stop = true) {
+    (void)stop;
+    bus(txLen);
+    if (!dev[txAddr]) return 2;  // address NACK
+    if (txLen > 0) reg[txAddr] = tx[0];
+    for (uint8_t i = 1; i < txLen; i++) dev[txAddr][reg[txAddr]++] = tx[i];
+    return 0;
+  }
+  uint8_t requestFrom(uint8_t a, uint8_t n, bool stop = true) {
+    (void)stop;
+    a &= 0x7F;
+    bus(n);
+    rxLen = rxPos = 0;
+    if (!dev[a]) return 0;
+    while (rxLen < n && rxLen < sizeof(rx)) rx[rxLen++] = dev[a][reg[a]++];
+    return rxLen;
+  }
+  uint8_t requestFrom(int a, int n) { return requestFrom((uint8_t)a, (uint8_t)n); }
+  int available() { return rxLen - rxPos; }
+  int read() { return rxPos < rxLen ? rx[rxPos++] : -1; }
+  int peek() { return rxPos < rxLen ? rx[rxPos] : -1; }
+  void onReceive(void (*)(int)) {}
+
+ private:
+  uint8_t txAddr = 0, txLen = 0, rxLen = 0, rxPos = 0;
+  uint8_t tx[32], rx[32];
+  void bus(uint8_t n) {  // address byte, data bytes, 9 clocks each
+    transactions++;
+    bytes += n;
+    simAdvance((n + 1) * 9 * 1000000UL / clock);
+  }
+};
+extern TwoWire Wire;
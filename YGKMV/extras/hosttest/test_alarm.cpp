@@ -0,0 +1,133 @@
+// Alarm rule table and updateAlarms() detection and clearing latency. The
+// safety alarms must stay close to the original code, which raised them on
+// the first pass that saw the condition.
+#include "hosttest.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+static const unsigned long PASS = 10;     // [ms] between run() passes
+static const unsigned long BREATH = 3000; // [ms] per breath, 20 bpm
+
+static void reset() {
+  vent.v_alarm = vent.v_alarmRaw = 0;
+  vent.v_breaths = 0;
+  for (int i = 0; i < YGKMV_ALARM_RULES; i++) {
+    vent.v_alarmSince[i] = vent.v_alarmSinceBreath[i] = 0;
+    vent.v_alarmCount[i] = 0;
+  }
+  simAdvance(100000);
+}
+
+// Run for ms with present(t) giving the condition t ms from the start. Per
+// breath conditions are only tested as each breath starts, like run() does.
+// Returns the time the bit first changed to want, or -1.
+static long runFor(const ygkmv_alarm_rule_t &r, unsigned long ms, bool perBreath,
+                   std::function<bool(unsigned long)> present, bool want) {
+  long seen = -1;
+  for (unsigned long t = 0; t < ms; t += PASS) {
+    bool start = millis() % BREATH < PASS;  // a breath starts this pass
+    if (start) vent.v_breaths++;
+    unsigned long tested = (perBreath && !start) ? 0 : r.bit;
+    vent.updateAlarms(tested, present(t) ? r.bit : 0);
+    if (seen < 0 && ((vent.v_alarm & r.bit) != 0) == want) seen = t;
+    simAdvance(PASS * 1000);
+  }
+  return seen;
+}
+
+static bool perBreath(unsigned long bit) {
+  return bit & (YGKMV_ITS_ERROR | YGKMV_ITL_ERROR | YGKMV_ETS_ERROR | YGKMV_ETL_ERROR);
+}
+
+static void testTable() {
+  unsigned long bits = 0;
+  bool unique = true;
+  for (int i = 0; i < YGKMV_ALARM_RULES; i++) {
+    const ygkmv_alarm_rule_t &r = YGKMV::alarmRules[i];
+    check(!(bits & r.bit), "alarm %lu has one rule", r.bit);
+    bits |= r.bit;
+    for (int j = 0; j < i; j++)
+      if (YGKMV::alarmRules[j].priority == r.priority) unique = false;
+  }
+  check(unique, "every alarm has its own priority");
+  check((bits & YGKMV_BUZ_ERROR) == (YGKMV_BUZ_ERROR & ~YGKMV_EXT_ERROR), "every buzzer alarm has a rule");
+  vent.v_alarm = YGKMV_SLOW_ERROR | YGKMV_MEM_ERROR;
+  check(vent.alarmTop() == YGKMV_SLOW_ERROR, "SLOW outranks MEM");
+  vent.v_alarm = YGKMV_IPL_ERROR | YGKMV_DISP_ERROR | YGKMV_EXT_ERROR;
+  check(vent.alarmTop() == YGKMV_IPL_ERROR, "IPL outranks DISP and EXT");
+  vent.v_alarm = 0;
+}
+
+// Detection and clear latency of every rule for a condition that starts
+// mid breath and lasts about 20 s, then goes away for good. Per breath
+// conditions start and end as a breath starts.
+static void testLatency() {
+  printf("    Alarm  Priority   Detect [ms]   Clear [ms]\n");
+  for (int i = 0; i < YGKMV_ALARM_RULES; i++) {
+    const ygkmv_alarm_rule_t &r = YGKMV::alarmRules[i];
+    bool pb = perBreath(r.bit);
+    reset();
+    simAdvance((BREATH - millis() % BREATH + BREATH / 2) * 1000);  // mid breath
+    if (pb) simAdvance(BREATH / 2 * 1000);                         // at a breath start
+    long on = runFor(r, pb ? 7 * BREATH : 20000, pb, [](unsigned long) { return true; }, true);
+    long off = runFor(r, 20000, pb, [](unsigned long) { return false; }, false);
+    printf("    %5lu  %8u  %12ld  %11ld\n", r.bit, r.priority, on, off);
+    long expect = max((long)r.onDelay, (long)(r.breaths * BREATH - (pb ? 0 : BREATH / 2)));
+    check(on >= expect - (long)PASS && on <= expect + (long)PASS, "alarm %lu detected in %ld ms, expected %ld",
+          r.bit, on, expect);
+    if (r.latching) {
+      check(off < 0, "alarm %lu latches", r.bit);
+      continue;
+    }
+    expect = r.offDelay;
+    if (pb) expect = (r.offDelay + BREATH - 1) / BREATH * BREATH;  // next test after offDelay
+    check(off >= expect - (long)PASS && off <= expect + (long)PASS, "alarm %lu cleared in %ld ms, expected %ld",
+          r.bit, off, expect);
+  }
+}
+
+static const ygkmv_alarm_rule_t &rule(unsigned long bit) {
+  for (int i = 0; i < YGKMV_ALARM_RULES; i++)
+    if (YGKMV::alarmRules[i].bit == bit) return YGKMV::alarmRules[i];
+  return YGKMV::alarmRules[0];
+}
+
+static int count(unsigned long bit) {
+  for (int i = 0; i < YGKMV_ALARM_RULES; i++)
+    if (YGKMV::alarmRules[i].bit == bit) return vent.v_alarmCount[i];
+  return -1;
+}
+
+static void testScenarios() {
+  const ygkmv_alarm_rule_t &iph = rule(YGKMV_IPH_ERROR), &ipl = rule(YGKMV_IPL_ERROR);
+  reset();
+  runFor(iph, 2000, false, [](unsigned long t) { return t >= 500 && t < 550; }, true);
+  check(count(YGKMV_IPH_ERROR) == 0, "a 50 ms pressure spike is not an alarm");
+  runFor(iph, 2000, false, [](unsigned long t) { return t >= 500 && t < 800; }, true);
+  check(count(YGKMV_IPH_ERROR) == 1, "a 300 ms high pressure is an alarm");
+
+  // Low for a moment in every breath, shorter than ALARM_ONSET_LOW_P.
+  reset();
+  runFor(ipl, 60000, false, [](unsigned long t) { return t % BREATH < ALARM_ONSET_LOW_P - 4 * PASS; }, true);
+  check(count(YGKMV_IPL_ERROR) == 0, "a short low pressure in each breath is not an alarm");
+
+  // A disconnect alarms within its first breath, at the slowest breathing.
+  check(ipl.breaths == 0 && rule(YGKMV_EPL_ERROR).breaths == 0 && ipl.onDelay < PB_MIN * INF_DEF,
+        "low pressure onset %u ms, under one inspiration", ipl.onDelay);
+  reset();
+  long on = runFor(ipl, 30000, false, [](unsigned long t) { return t >= 1000; }, true);
+  check(on > 0 && on - 1000 <= ALARM_ONSET_LOW_P + (long)PASS, "disconnect alarmed %ld ms after it started",
+        on - 1000);
+
+  // Holds through a recovery shorter than offDelay, and isn't counted twice.
+  runFor(ipl, 20000, false, [](unsigned long t) { return t < 3000 || t > 5000; }, false);
+  check((vent.v_alarm & YGKMV_IPL_ERROR) && count(YGKMV_IPL_ERROR) == 1,
+        "low pressure alarm holds through a 2 s recovery, set %d times", count(YGKMV_IPL_ERROR));
+}
+
+int main() {
+  testTable();
+  testLatency();
+  testScenarios();
+  return simFailures;
+}
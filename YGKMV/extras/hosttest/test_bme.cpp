@@ -0,0 +1,180 @@
+// RWS_BME280 on a mock I2C bus: the integer compensation against the
+// datasheet example and floating point formulas, the free running poll()
+// against a sensor converting on its own schedule, and the bus time per
+// getP() call compared with the blocking reads it replaced in Vent_5.
+#include "hosttest.h"
+
+// Datasheet example calibration and readings, BST-BME280-DS002 section 8.1.
+static const uint16_t T1 = 27504, P1 = 36477;
+static const int16_t T2 = 26435, T3 = -1000, P2 = -10685, P3 = 3024, P4 = 2855, P5 = 140, P6 = -7,
+                     P7 = 15500, P8 = -14600, P9 = 6000;
+static const int32_t ADC_T = 519888, ADC_P = 415148;
+
+// A BME280 register map at addr with the datasheet calibration.
+struct MockBME {
+  uint8_t r[256] = {};
+  unsigned long conversions = 0;
+  void attach(uint8_t addr, uint8_t id = 0x60) {
+    Wire.dev[addr] = r;
+    r[0xD0] = id;
+    const int16_t c[12] = {(int16_t)T1, T2, T3, (int16_t)P1, P2, P3, P4, P5, P6, P7, P8, P9};
+    for (int i = 0; i < 12; i++) {
+      r[0x88 + 2 * i] = c[i] & 0xFF;
+      r[0x89 + 2 * i] = (c[i] >> 8) & 0xFF;
+    }
+    set(0x80000, 0x80000);  // reset value until the first conversion
+  }
+  void set(int32_t adcT, int32_t adcP) {
+    r[0xF7] = adcP >> 12;
+    r[0xF8] = adcP >> 4;
+    r[0xF9] = (adcP & 0xF) << 4;
+    r[0xFA] = adcT >> 12;
+    r[0xFB] = adcT >> 4;
+    r[0xFC] = (adcT & 0xF) << 4;
+  }
+};
+
+// Floating point compensation from the datasheet, section 8.1.
+static void floatComp(int32_t adcT, int32_t adcP, double *t, double *p) {
+  double v1 = (adcT / 16384.0 - T1 / 1024.0) * T2;
+  double v2 = (adcT / 131072.0 - T1 / 8192.0) * (adcT / 131072.0 - T1 / 8192.0) * T3;
+  double tFine = v1 + v2;
+  *t = tFine / 5120.0;
+  v1 = tFine / 2.0 - 64000.0;
+  v2 = v1 * v1 * P6 / 32768.0;
+  v2 = v2 + v1 * P5 * 2.0;
+  v2 = v2 / 4.0 + P4 * 65536.0;
+  v1 = (P3 * v1 * v1 / 524288.0 + P2 * v1) / 524288.0;
+  v1 = (1.0 + v1 / 32768.0) * P1;
+  double q = 1048576.0 - adcP;
+  q = (q - v2 / 4096.0) * 6250.0 / v1;
+  v1 = P9 * q * q / 2147483648.0;
+  v2 = q * P8 / 32768.0;
+  *p = q + (v1 + v2 + P7) / 16.0;
+}
+
+static MockBME mockA, mockV;
+
+static void testBegin() {
+  RWS_BME280 none;
+  check(!none.begin(0x76) && none.sensorID() == 0 && !none.poll(), "no sensor at 0x76");
+  mockA.attach(0x77, 0x61);
+  RWS_BME280 bme680;
+  check(!bme680.begin(0x77), "BME680 ID 0x61 refused");
+  mockA.attach(0x77);
+  RWS_BME280 bme;
+  Wire.transactions = Wire.bytes = 0;
+  check(bme.begin(0x77) && bme.sensorID() == 0x60, "BME280 found at 0x77");
+  check(mockA.r[0xF4] == BMX_CTRL_MEAS_NORMAL && mockA.r[0xF5] == BMX_CONFIG_FAST && mockA.r[0xF2] == 0,
+        "normal mode set, ctrl_meas 0x%02X config 0x%02X", mockA.r[0xF4], mockA.r[0xF5]);
+  check(bme.poll() == false, "no reading before the first conversion");
+}
+
+static void testCompensation() {
+  RWS_BME280 bme;
+  mockA.attach(0x77);
+  bme.begin(0x77);
+  bme.compensate(ADC_T, ADC_P);
+  printf("    datasheet example: %.2f C, %.2f Pa\n", bme.temperature(), bme.pressure());
+  check(fabs(bme.temperature() - 25.08) < 0.005, "temperature %.2f C, datasheet 25.08", bme.temperature());
+  check(fabs(bme.pressure() - 100653.27) < 0.3, "pressure %.2f Pa, datasheet 100653.27", bme.pressure());
+
+  // Across the sensor's range the integers follow the float formulas.
+  double worstT = 0, worstP = 0;
+  for (int32_t adcT = 350000; adcT <= 650000; adcT += 15000) {
+    for (int32_t adcP = 200000; adcP <= 600000; adcP += 5000) {
+      double t, p;
+      floatComp(adcT, adcP, &t, &p);
+      bme.compensate(adcT, adcP);
+      worstT = max(worstT, fabs(bme.temperature() - t));
+      worstP = max(worstP, fabs(bme.pressure() - p));
+    }
+  }
+  printf("    integer against float compensation: worst %.3f C, %.3f Pa\n", worstT, worstP);
+  check(worstT < 0.01 && worstP < 1.0, "integer compensation within %.3f C and %.3f Pa", worstT, worstP);
+}
+
+// Blocking reads as the Adafruit driver made them, the old Vent_5 getP():
+// readTemperature() then readPressure(), which reads the temperature again.
+static uint32_t read24(uint8_t addr, uint8_t reg) {
+  Wire.beginTransmission(addr);
+  Wire.write(reg);
+  Wire.endTransmission();
+  Wire.requestFrom(addr, (uint8_t)3);
+  uint32_t v = Wire.read();
+  v = (v << 8) | Wire.read();
+  return (v << 8) | Wire.read();
+}
+static void oldGetP() {
+  for (uint8_t a : {0x77, 0x76}) {
+    read24(a, 0xFA);
+    read24(a, 0xFA);
+    read24(a, 0xF7);
+  }
+}
+
+// Both sensors converting every 12 ms, the typical cycle for the settings
+// in begin(), with a slowly changing pressure, polled the way the new
+// Vent_5 getP() does, alternating, once per 1 ms loop. BMX_PERIOD_US
+// allows for the longest cycle, so a few conversions go unread, but every
+// reading poll() reports as new should be a fresh conversion.
+static void testThroughput() {
+  mockA.attach(0x77);
+  mockV.attach(0x76);
+  RWS_BME280 bmeA, bmeV;
+  bmeA.begin(0x77);
+  bmeV.begin(0x76);
+  int32_t adcP = ADC_P;
+  simEvery(0, nullptr);
+  simEvery(12000, [&]() {
+    adcP -= 3;   // pressure rising a little each conversion
+    mockA.set(ADC_T, adcP);
+    mockV.set(ADC_T, adcP - 50);
+    mockA.conversions++;
+  });
+  const unsigned long loops = 10000, loop = 1000;
+  unsigned long fresh = 0, stale = 0, worst = 0;
+  double last = 0, busUs = 0;
+  Wire.transactions = Wire.bytes = 0;
+  bool pollV = false;
+  for (unsigned long i = 0; i < loops; i++) {
+    uint64_t t0 = simMicros;
+    bool got = pollV ? bmeV.poll() : bmeA.poll();
+    if (got && !pollV) {
+      fresh++;
+      if (bmeA.pressure() == last) stale++;
+      last = bmeA.pressure();
+    }
+    pollV = !pollV;
+    unsigned long us = simMicros - t0;
+    busUs += us;
+    worst = max(worst, us);
+    if (t0 + loop > simMicros) simAdvance(t0 + loop - simMicros);
+  }
+  double dP = bmeV.pressure() - bmeA.pressure();
+  simEvery(0, nullptr);
+  printf("    poll(): %.0f us of bus per 1 ms loop on average, %lu us worst, %lu transactions,"
+         " %lu of %lu conversions read, %lu stale\n",
+         busUs / loops, worst, Wire.transactions, fresh, mockA.conversions, stale);
+  check(stale == 0, "%lu stale readings reported as new", stale);
+  check(fresh >= mockA.conversions * 0.8, "%lu of %lu conversions read", fresh, mockA.conversions);
+  double t, pA, pV;
+  floatComp(ADC_T, adcP, &t, &pA);
+  floatComp(ADC_T, adcP - 50, &t, &pV);
+  check(fabs(dP - (pV - pA)) < 1.0, "differential pressure %.2f Pa from both sensors, true %.2f", dP, pV - pA);
+
+  Wire.transactions = 0;
+  uint64_t t0 = simMicros;
+  oldGetP();
+  unsigned long oldUs = simMicros - t0;
+  printf("    blocking reads: %lu us of bus per getP(), %lu transactions\n", oldUs, Wire.transactions);
+  check(worst * 3 < oldUs, "worst poll() %lu us, blocking getP() %lu us", worst, oldUs);
+  check(busUs / loops * 20 < oldUs, "average poll() %.0f us, blocking getP() %lu us", busUs / loops, oldUs);
+}
+
+int main() {
+  testBegin();
+  testCompensation();
+  testThroughput();
+  return simFailures;
+}
@@ -0,0 +1,185 @@
+// Button capture (setupButtons(), loopButtons()) with simulated contact
+// bounce: one event per press and release however the contacts bounce, no
+// events for short glitches, timing from the first edge, long presses, and
+// presses made while run() is away. On the Feather M0 the red button's pin
+// is the NMI line, so it is sampled rather than interrupt driven.
+#include "hosttest.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+static const uint8_t pins[BUTTONS] = {BLUE_BUTTON_PIN, YELLOW_BUTTON_PIN, RED_BUTTON_PIN};
+static const char *names[BUTTONS] = {"blue", "yellow", "red"};
+
+struct Edge {
+  uint64_t t;   // [us]
+  uint8_t pin;
+  int level;
+};
+static std::vector<Edge> edges;
+
+// A push (level LOW) or release at t with n bounces spaced gap us apart.
+static void bounce(uint64_t t, uint8_t pin, int level, int n = 6, unsigned long gap = 300) {
+  for (int i = 0; i < n; i++) edges.push_back({t + i * gap, pin, i % 2 ? !level : level});
+  edges.push_back({t + n * gap, pin, level});
+}
+
+struct Event {
+  uint64_t t;   // [us] when it was reported
+  int button, type;
+};
+
+// Play the edges, calling loopButtons() every loop us, and return the
+// button events reported.
+static std::vector<Event> play(unsigned long ms, unsigned long loop) {
+  std::vector<Event> ev;
+  unsigned long head = vent.traceHead;
+  uint64_t end = simMicros + ms * 1000ULL, next = simMicros;
+  while (simMicros < end) {
+    for (auto &e : edges)
+      if (e.t == simMicros) simPin(e.pin, e.level);
+    if (simMicros >= next) {
+      vent.loopButtons();
+      next += loop;
+    }
+    simAdvance(100);
+  }
+  for (; head != vent.traceHead; head++) {
+    ygkmv_trace_t *r = &vent.traceRing[head & (TRACE_SIZE - 1)];
+    if (r->type == TRACE_BUTTON) ev.push_back({r->t, r->arg / 16, r->arg % 16});
+  }
+  edges.clear();
+  return ev;
+}
+
+static int count(const std::vector<Event> &ev, int b, int type) {
+  int n = 0;
+  for (auto &e : ev) n += e.button == b && e.type == type;
+  return n;
+}
+
+static const Event *find(const std::vector<Event> &ev, int b, int type) {
+  for (auto &e : ev)
+    if (e.button == b && e.type == type) return &e;
+  return NULL;
+}
+
+static uint64_t at(unsigned long ms) { return (simMicros / 100000 + 1) * 100000 + ms * 1000ULL; }
+
+static void testPolled() {
+  check(!vent.btnPolled[BUTTON_BLUE] && !vent.btnPolled[BUTTON_YELLOW], "blue and yellow have interrupts");
+  check(vent.btnPolled[BUTTON_RED], "red on pin 4, the NMI, is polled");
+}
+
+// A bouncy 200 ms push on each button, with run() every 10 ms.
+static void testBounce() {
+  for (int b = 0; b < BUTTONS; b++) {
+    uint64_t t0 = at(0);
+    bounce(t0, pins[b], LOW);
+    bounce(t0 + 200000, pins[b], HIGH, 8, 250);
+    auto ev = play(400, 10000);
+    check(count(ev, b, BUTTON_EV_PRESS) == 1 && count(ev, b, BUTTON_EV_RELEASE) == 1 && ev.size() == 2,
+          "%s: one press and one release from %zu events", names[b], ev.size());
+    const Event *p = find(ev, b, BUTTON_EV_PRESS), *r = find(ev, b, BUTTON_EV_RELEASE);
+    if (!p || !r) continue;
+    double lat = (p->t - t0) / 1000., first = vent.btnPressT[b] - t0 / 1000.;
+    printf("    %s: press reported %.1f ms after the first edge, timed %.0f ms from it, release %.1f ms\n",
+           names[b], lat, first, (r->t - t0 - 200000) / 1000.);
+    check(lat <= 2 + BUTTON_DEBOUNCE + 10 + 0.1, "%s press reported %.1f ms after the first edge", names[b], lat);
+    check(fabs(first) <= (vent.btnPolled[b] ? 10 : 0), "%s press timed %.0f ms from the first edge", names[b],
+          first);
+    check(!vent.btnDown[b], "%s up again", names[b]);
+  }
+}
+
+// Glitches shorter than BUTTON_DEBOUNCE, bouncing or not, are ignored.
+static void testGlitch() {
+  for (int b = 0; b < BUTTONS; b++) {
+    uint64_t t0 = at(0);
+    bounce(t0, pins[b], LOW, 4, 200);
+    bounce(t0 + 5000, pins[b], HIGH, 4, 200);
+    bounce(t0 + 100000, pins[b], LOW, 0);
+    bounce(t0 + 100300, pins[b], HIGH, 0);
+    auto ev = play(300, 10000);
+    check(ev.empty(), "%s: %zu events from glitches", names[b], ev.size());
+  }
+}
+
+static void testLong() {
+  uint64_t t0 = at(0);
+  bounce(t0, pins[BUTTON_BLUE], LOW);
+  bounce(t0 + 2000000, pins[BUTTON_BLUE], HIGH);
+  auto ev = play(2200, 10000);
+  const Event *l = find(ev, BUTTON_BLUE, BUTTON_EV_LONG);
+  check(ev.size() == 3 && l && count(ev, BUTTON_BLUE, BUTTON_EV_RELEASE) == 1, "press, long press and release");
+  if (l)
+    check(fabs((l->t - t0) / 1000. - BUTTON_LONG) <= 10, "long press at %.0f ms", (l->t - t0) / 1000.);
+}
+
+// With run() away for 300 ms at a time, a 100 ms push on an interrupt pin
+// is still seen, timed from its first edge. The polled red button can't be.
+static void testSlowLoop() {
+  uint64_t t0 = at(0) + 20000;
+  for (int b = 0; b < BUTTONS; b++) {
+    bounce(t0, pins[b], LOW);
+    bounce(t0 + 100000, pins[b], HIGH);
+  }
+  auto ev = play(1000, 300000);
+  for (int b = 0; b < 2; b++) {
+    check(count(ev, b, BUTTON_EV_PRESS) == 1 && count(ev, b, BUTTON_EV_RELEASE) == 1,
+          "%s: 100 ms push seen with run() every 300 ms", names[b]);
+    check(vent.btnPressT[b] == t0 / 1000, "%s push timed from its first edge", names[b]);
+  }
+  printf("    with run() every 300 ms: red saw %d presses of 1\n", count(ev, BUTTON_RED, BUTTON_EV_PRESS));
+
+  // A long push made entirely while run() was away still gets its long press.
+  t0 = at(0) + 20000;
+  bounce(t0, pins[BUTTON_BLUE], LOW);
+  bounce(t0 + 1800000, pins[BUTTON_BLUE], HIGH);
+  ev = play(2500, 2400000);
+  check(ev.size() == 3 && ev[0].type == BUTTON_EV_PRESS && ev[1].type == BUTTON_EV_LONG &&
+            ev[2].type == BUTTON_EV_RELEASE, "press, long press and release of a 1.8 s push between run() calls");
+}
+
+// More edges than BUTTON_QUEUE between run() calls: the pins are read again
+// and the state still comes out right.
+static void testOverflow() {
+  uint64_t t0 = at(0);
+  bounce(t0, pins[BUTTON_YELLOW], LOW, 3 * BUTTON_QUEUE, 100);
+  auto ev = play(300, 50000);
+  check(count(ev, BUTTON_YELLOW, BUTTON_EV_PRESS) == 1 && ev.size() == 1 && vent.btnDown[BUTTON_YELLOW],
+        "one press after %d edges", 3 * BUTTON_QUEUE + 1);
+  bounce(at(0), pins[BUTTON_YELLOW], HIGH, 3 * BUTTON_QUEUE, 100);
+  ev = play(300, 50000);
+  check(count(ev, BUTTON_YELLOW, BUTTON_EV_RELEASE) == 1 && ev.size() == 1 && !vent.btnDown[BUTTON_YELLOW],
+        "one release after %d edges", 3 * BUTTON_QUEUE + 1);
+}
+
+// The blue press goes through run() to start ventilating.
+static void testRun() {
+  vent.p_stopped = true;
+  uint64_t t0 = at(0);
+  bounce(t0, pins[BUTTON_BLUE], LOW);
+  bounce(t0 + 100000, pins[BUTTON_BLUE], HIGH);
+  for (uint64_t end = t0 + 200000; simMicros < end;) {
+    for (auto &e : edges)
+      if (e.t == simMicros) simPin(e.pin, e.level);
+    vent.run();
+    simAdvance(100 - simMicros % 100);
+  }
+  edges.clear();
+  check(!vent.p_stopped && vent.p_trigEnabled, "blue press through run() starts ventilating");
+}
+
+int main() {
+  simFlashFormat();
+  vent.begin();
+  simAdvance(100 - simMicros % 100);   // edges are played on a 100 us grid
+  testPolled();
+  testBounce();
+  testGlitch();
+  testLong();
+  testSlowLoop();
+  testOverflow();
+  testRun();
+  return simFailures;
+}
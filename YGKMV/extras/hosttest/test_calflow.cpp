@@ -0,0 +1,99 @@
+// Flow lookup tables (buildCalTables(), calFlow()) against the float
+// formulas they replace: interpolation error by flow band, and the host
+// time per conversion.
+// CONFIGS: -DYGKMV_MODEL=2
+// CONFIGS: -DYGKMV_MODEL=3
+#include "hosttest.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+static const double OFFSET = 0.5, SCALE = 100.0;
+
+static double formula(double v) {
+  if (YGKMV_MODEL == 2) return sqrt(fabs((v - OFFSET) * SCALE)) * VENTURI_QSCALE;
+  return (v - OFFSET) * SCALE;
+}
+
+// Worst error in each flow band at every voltage the SAMD21's 12 bit ADC
+// can give, as RWS_UNO scales it to ADC_RESOLUTION bits.
+static void sweep(const char *what, double limit[4]) {
+  const double edge[5] = {0, 5, 20, 60, 1e9};
+  double worst[4] = {-1, -1, -1, -1};  // -1 for no codes in the band
+  double vRef = vent.uno.getVRef(), top = (1UL << ADC_RESOLUTION) - 1;
+  for (long c = 0; c <= top; c += 1L << (ADC_RESOLUTION - 12)) {
+    double v = c * vRef / top;
+    double q = formula(v), e = fabs(vent.calFlow(CPAP, v) - q);
+    for (int b = 0; b < 4; b++)
+      if (fabs(q) >= edge[b] && fabs(q) < edge[b + 1]) worst[b] = max(worst[b], e);
+  }
+  printf("    %-28s", what);
+  for (int b = 0; b < 4; b++) printf(worst[b] < 0 ? "          -" : " %10.3f", worst[b]);
+  printf("\n");
+  for (int b = 0; b < 4; b++)
+    if (limit && worst[b] >= 0)
+      check(worst[b] <= limit[b], "%s: worst error %.3f l/min for flows %.0f to %.0f, limit %.3f", what, worst[b],
+            edge[b], edge[b + 1], limit[b]);
+}
+
+static void testError() {
+  vent.offset[CPAP] = OFFSET;
+  vent.scale[CPAP] = SCALE;
+  vent.calPts[0].n = 0;
+  vent.buildCalTables();
+  printf("    Worst error [l/min] for flows   under 5    5 to 20   20 to 60    over 60\n");
+  if (YGKMV_MODEL == 2) {
+    vent.calFineOn = false;  // the main table alone, as before the fine table
+    sweep("venturi, equal steps only", NULL);
+    vent.calFineOn = true;
+    double limit[4] = {0.1, 0.05, 0.05, 0.05};  // the offset is placed to half a table position
+    sweep("venturi, with the fine table", limit);
+    check(vent.calFlow(CPAP, OFFSET) == 0.0, "zero flow at the offset");
+    double first = vent.calFlow(CPAP, OFFSET + vent.uno.getVRef() / 4095);
+    check(fabs(first - formula(OFFSET + vent.uno.getVRef() / 4095)) < 0.05, "one ADC count above the offset %.3f l/min",
+          first);
+  } else {
+    double limit[4] = {0.01, 0.01, 0.01, 0.01};  // half a table position at 100 l/min / V
+    sweep("linear", limit);
+  }
+
+  // Measured points: the table follows the piecewise line between them.
+  vent.addCalPoint(CPAP, 0.6, 1.0);
+  vent.addCalPoint(CPAP, 1.0, 20.0);
+  vent.addCalPoint(CPAP, 2.0, 60.0);
+  double worst = 0;
+  for (double v = 0.6; v <= 2.0; v += 1e-5) {
+    double q = v < 1.0 ? 1.0 + (v - 0.6) / 0.4 * 19.0 : 20.0 + (v - 1.0) * 40.0;
+    worst = max(worst, fabs(vent.calFlow(CPAP, v) - q));
+  }
+  check(worst < 0.05, "measured points followed within %.3f l/min", worst);
+  check(!vent.calFineOn, "measured points don't use the venturi fine table");
+  vent.addCalPoint(CPAP, -1, 0);
+}
+
+// Host time and cycles per conversion against the float formula. On the
+// SAMD21 the formula is a soft-float square root or multiply, and the table
+// is integer operations apart from finding the position.
+static void benchmark() {
+  const int N = 2000000;
+  std::vector<double> v(1024);
+  for (size_t i = 0; i < v.size(); i++) v[i] = OFFSET + (i * 2.5 / v.size()) * (i & 1 ? 1 : 0.01);
+  volatile double sink = 0;
+  double t0 = hostNs();
+  uint64_t c0 = hostCycles();
+  for (int i = 0; i < N; i++) sink = sink + vent.calFlow(CPAP, v[i & 1023]);
+  double cTable = (double)(hostCycles() - c0) / N, tTable = (hostNs() - t0) / N;
+  t0 = hostNs();
+  c0 = hostCycles();
+  for (int i = 0; i < N; i++) sink = sink + formula(v[i & 1023]);
+  double cFormula = (double)(hostCycles() - c0) / N, tFormula = (hostNs() - t0) / N;
+  printf("    model %d per conversion on the host: calFlow() %.1f ns %.0f cycles, float formula %.1f ns %.0f cycles\n",
+         YGKMV_MODEL, tTable, cTable, tFormula, cFormula);
+}
+
+int main() {
+  simFlashFormat();
+  vent.begin();
+  testError();
+  benchmark();
+  return simFailures;
+}
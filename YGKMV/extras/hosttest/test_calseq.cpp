@@ -0,0 +1,202 @@
+// The automatic calibration sequencer (startCalibration(), calStep(),
+// calReference()) run end to end through run() on a bench rig with the
+// patient port capped, sensors that are off from the firmware's offsets and
+// scales, and valves that close at angles the firmware doesn't know. The
+// test plays the reference meters, answering each c2 prompt with the true
+// flow and pressure.
+// CONFIGS: -DYGKMV_MODEL=2
+// CONFIGS: -DYGKMV_MODEL=3
+#include "hosttest.h"
+#include <random>
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+// Blower into the CPAP valve, through the capped patient tee and out the
+// PEEP valve. Each valve is a conductance that opens linearly from its
+// closed angle to its open angle, with the Dual valve closing one side or
+// the other, in series with both flow elements.
+struct Rig {
+  double offP = 0.48, offC = 0.52, offE = 0.47;   // true sensor offsets [V]
+  double scP = 18.0, scC = 90.0, scE = 110.0;     // true scales [cm H2O / V], [l/min / V]
+  double shutC = 64, openC = 140;                 // CPAP valve [degrees]
+  double shutE = 120, openE = 40;                 // PEEP valve
+  double dualC = 50, dualE = 130;                 // Dual valve closing CPAP, closing PEEP
+  double q = 0.0, p = 0.0;                        // true flow [l/min] and tee pressure [cm H2O]
+  double noise = 0.001;                           // rms sensor noise [V]
+  std::mt19937 rng{3};
+
+  static double opening(Servo &s, double shut, double open) {
+    if (!s.attached()) return 1.0;
+    double a = (s.readMicroseconds() - MIN_PULSE_WIDTH) * 180.0 / (MAX_PULSE_WIDTH - MIN_PULSE_WIDTH);
+    return constrain((a - shut) / (open - shut), 0.0, 1.0);
+  }
+
+  void update() {
+    double pb = max(0.0, (simAnalogOut[BLOWER_SPEED_PIN] - 300) * 0.05);  // blower pressure [cm H2O]
+    double dual = 1.0, dualPEEP = 1.0;
+    if (vent.servoDual.attached()) {
+      dual = opening(vent.servoDual, dualC, dualC + 30);
+      dualPEEP = opening(vent.servoDual, dualE, dualE - 30);
+    }
+    double gC = max(6.0 * opening(vent.servoCPAP, shutC, openC) * dual, 1e-3);  // [l/min / cm H2O]
+    double gE = max(8.0 * opening(vent.servoPEEP, shutE, openE) * dualPEEP, 1e-3);
+    q = pb / (1 / gC + 1 / gE);
+    p = q / gE;
+  }
+
+  double volts(uint8_t pin) {
+    update();
+    double n = noise > 0 ? std::normal_distribution<double>(0.0, noise)(rng) : 0.0;
+    if (pin == vent.aPins[PATIENT]) return offP + p / scP + n;
+    if (pin == vent.aPins[CPAP]) {
+      if (YGKMV_MODEL == 2) return offC + pow(q / VENTURI_QSCALE, 2) / scC + n;
+      return offC + q / scC + n;
+    }
+    if (pin == vent.aPins[PEEP]) return offE + q / scE + n;
+    return 0.0;
+  }
+} rig;
+
+static const int angles0[6] = {70, 140, 110, 40, 60, 120};  // firmware's aMinCPAP ... aClosePEEP to start
+
+static void setup() {
+  simFlashFormat();
+  simVolts = [](uint8_t pin) { return rig.volts(pin); };
+  vent.begin();
+  for (int ch : {PATIENT, CPAP, PEEP}) vent.offset[ch] = 0.5;
+  vent.scale[PATIENT] = 20.0;
+  vent.scale[CPAP] = vent.scale[PEEP] = 100.0;
+  vent.aMinCPAP = angles0[0];   vent.aMaxCPAP = angles0[1];
+  vent.aMinPEEP = angles0[2];   vent.aMaxPEEP = angles0[3];
+  vent.aCloseCPAP = angles0[4]; vent.aClosePEEP = angles0[5];
+  vent.aMid = 90;
+  vent.buildCalTables();
+}
+
+// Call run() every 10 ms until the sequencer goes idle or ms pass, playing
+// the reference meters if answer. Returns the longest pass [us].
+static unsigned long runCal(unsigned long ms, bool answer, int *readings = NULL) {
+  unsigned long longest = 0;
+  uint64_t end = simMicros + ms * 1000ULL;
+  while (simMicros < end && vent.calState != CAL_IDLE) {
+    uint64_t t0 = simMicros;
+    vent.run();
+    longest = max(longest, (unsigned long)(simMicros - t0));
+    if (answer && vent.calWaiting) {
+      rig.update();
+      char line[40];
+      snprintf(line, sizeof line, "c2,%.3f,%.3f", rig.q, rig.p);
+      simCommand(vent, line);
+      if (readings) (*readings)++;
+    }
+    if (t0 + 10000 > simMicros) simAdvance(t0 + 10000 - simMicros);
+  }
+  return longest;
+}
+
+static void testSequence() {
+  setup();
+  simCommand(vent, "c1");
+  check(vent.calState == CAL_ZERO, "c1 starts the sequence");
+  uint64_t t0 = simMicros;
+  int readings = 0;
+  unsigned long longest = runCal(600000, true, &readings);
+  printf("    model %d: calibrated in %.0f s of run() every 10 ms, longest pass %.1f ms, %d reference readings\n",
+         YGKMV_MODEL, (simMicros - t0) / 1e6, longest / 1000., readings);
+  check(vent.calState == CAL_IDLE, "sequence finished");
+  check(readings == CAL_MATCH_STEPS, "%d reference readings", readings);
+  check(longest < 20000, "longest run() %.1f ms while calibrating", longest / 1000.);
+
+  check(fabs(vent.offset[PATIENT] - rig.offP) < 0.002, "patient offset %.4f V, true %.4f", vent.offset[PATIENT], rig.offP);
+  check(fabs(vent.offset[CPAP] - rig.offC) < 0.002, "CPAP offset %.4f V, true %.4f", vent.offset[CPAP], rig.offC);
+  check(fabs(vent.scale[PATIENT] / rig.scP - 1) < 0.02, "patient scale %.2f, true %.2f", vent.scale[PATIENT], rig.scP);
+  check(fabs(vent.scale[CPAP] / rig.scC - 1) < 0.02, "CPAP scale %.2f, true %.2f", vent.scale[CPAP], rig.scC);
+  if (YGKMV_MODEL == 3) {
+    check(fabs(vent.offset[PEEP] - rig.offE) < 0.002, "PEEP offset %.4f V, true %.4f", vent.offset[PEEP], rig.offE);
+    check(fabs(vent.scale[PEEP] / rig.scE - 1) < 0.02, "PEEP scale %.2f, true %.2f", vent.scale[PEEP], rig.scE);
+    check(fabs(vent.aMinCPAP - rig.shutC) <= 4, "CPAP valve closed at %d, shuts at %.0f", vent.aMinCPAP, rig.shutC);
+    check(fabs(vent.aMinPEEP - rig.shutE) <= 4, "PEEP valve closed at %d, shuts at %.0f", vent.aMinPEEP, rig.shutE);
+  } else {
+    check(vent.aMinCPAP == angles0[0] && vent.aMinPEEP == angles0[2], "unfitted valves left alone");
+  }
+  check(fabs(vent.aCloseCPAP - rig.dualC) <= 4, "Dual valve closes CPAP at %d, shuts at %.0f", vent.aCloseCPAP, rig.dualC);
+  check(fabs(vent.aClosePEEP - rig.dualE) <= 4, "Dual valve closes PEEP at %d, shuts at %.0f", vent.aClosePEEP, rig.dualE);
+  check(vent.aMid == (vent.aCloseCPAP + vent.aClosePEEP) / 2, "aMid between the Dual closed angles");
+
+  // The flow readings now match the rig across the blower range.
+  double worst = 0;
+  rig.noise = 0.0;
+  for (int b = BLOWER_MIN; b <= BLOWER_MAX; b += 50) {
+    simAnalogOut[BLOWER_SPEED_PIN] = b;
+    rig.update();
+    double q = vent.calFlow(CPAP, rig.volts(vent.aPins[CPAP]));
+    worst = max(worst, fabs(q - rig.q) / rig.q);
+  }
+  rig.noise = 0.001;
+  check(worst < 0.03, "CPAP flow within %.1f%% of the rig after calibration", worst * 100);
+
+  // What was written to cal.txt comes back at the next power up.
+  double off[3], sc[3];
+  for (int i = 0; i < 3; i++) {
+    off[i] = vent.offset[i];
+    sc[i] = vent.scale[i];
+    vent.offset[i] = vent.scale[i] = 0;
+  }
+  int aC = vent.aCloseCPAP, aE = vent.aClosePEEP;
+  vent.aCloseCPAP = vent.aClosePEEP = 0;
+  vent.setupFlash();
+  bool same = true;
+  for (int i = 0; i < 3; i++)
+    same = same && fabs(vent.offset[i] - off[i]) < 1e-4 && fabs(vent.scale[i] - sc[i]) < 0.01;
+  check(same, "offsets and scales read back from cal.txt");
+  check(vent.aCloseCPAP == aC && vent.aClosePEEP == aE, "closed angles read back from cal.txt");
+}
+
+static bool restored() {
+  int a[6] = {vent.aMinCPAP, vent.aMaxCPAP, vent.aMinPEEP, vent.aMaxPEEP, vent.aCloseCPAP, vent.aClosePEEP};
+  for (int i = 0; i < 6; i++)
+    if (a[i] != angles0[i]) return false;
+  return vent.offset[CPAP] == 0.5 && vent.scale[CPAP] == 100.0 && vent.scale[PATIENT] == 20.0 && vent.aMid == 90;
+}
+
+// Stopping partway puts everything back, whether by command or by leaving
+// stop mode, and c2 or c3 out of turn change nothing.
+static void testAbort() {
+  setup();
+  simCommand(vent, "c2,40,10");
+  simCommand(vent, "c3");
+  check(vent.calState == CAL_IDLE && restored(), "c2 and c3 ignored while idle");
+
+  simCommand(vent, "c1");
+  runCal(20000, false);
+  check(vent.calState == CAL_SWEEP, "sweeping after 20 s");
+  simCommand(vent, "c2,40,10");
+  check(vent.calState == CAL_SWEEP && vent.calSxx[CPAP] == 0, "c2 ignored while sweeping");
+  simCommand(vent, "c-1");
+  check(vent.calState == CAL_IDLE && restored(), "c-1 restores the offsets, scales and angles");
+
+  simCommand(vent, "c1");
+  runCal(10000, false);
+  vent.setRun();
+  vent.run();
+  check(vent.calState == CAL_IDLE && restored(), "leaving stop mode restores them too");
+  vent.p_stopped = true;
+
+  // Finishing early with c3 keeps the offsets and angles and leaves the
+  // scales with no readings alone.
+  simCommand(vent, "c1");
+  runCal(600000, false);
+  check(vent.calWaiting, "waiting for the first reference reading");
+  runCal(5000, false);
+  check(vent.calWaiting && vent.calSteps == 0, "still waiting, run() keeps going");
+  simCommand(vent, "c3");
+  check(vent.calState == CAL_IDLE, "c3 finishes");
+  check(vent.scale[CPAP] == 100.0 && vent.scale[PATIENT] == 20.0, "scales unchanged without readings");
+  check(fabs(vent.offset[CPAP] - rig.offC) < 0.002, "offsets kept");
+}
+
+int main() {
+  testSequence();
+  testAbort();
+  return simFailures;
+}
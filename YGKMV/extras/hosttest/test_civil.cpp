@@ -0,0 +1,254 @@
+// Civil date conversion in Time (breakTime(), makeTime()) and RTClib
+// (DateTime(uint32_t), date2days() behind unixtime()), against the year
+// and month loops they replaced, kept here as they were: every day of the
+// 32 bit time range at five times of day, every second of its first and
+// last days, every year, month and day 1 to 31 makeTime() and DateTime()
+// take, and breakTime() against gmtime(). RTClib keeps its every fourth
+// year rule to 2255 and must match the old code there too. Then the time
+// of each call, old and new, for dates from 2020 to 2040.
+#include "hosttest.h"
+#include <TimeLib.h>
+#include <RTClib.h>
+#include <time.h>
+
+//------------------------------------------------------------------------------
+// Time.cpp before the civil calendar formulas.
+#define LEAP_YEAR(Y)     ( ((1970+(Y))>0) && !((1970+(Y))%4) && ( ((1970+(Y))%100) || !((1970+(Y))%400) ) )
+static const uint8_t monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+static void oldBreakTime(uint32_t timeInput, tmElements_t &tm) {
+  uint8_t year;
+  uint8_t month, monthLength;
+  uint32_t time;
+  unsigned long days;
+
+  time = (uint32_t)timeInput;
+  tm.Second = time % 60;
+  time /= 60;
+  tm.Minute = time % 60;
+  time /= 60;
+  tm.Hour = time % 24;
+  time /= 24;
+  tm.Wday = ((time + 4) % 7) + 1;
+
+  year = 0;
+  days = 0;
+  while ((unsigned)(days += (LEAP_YEAR(year) ? 366 : 365)) <= time) {
+    year++;
+  }
+  tm.Year = year;
+
+  days -= LEAP_YEAR(year) ? 366 : 365;
+  time -= days;
+
+  days = 0;
+  month = 0;
+  monthLength = 0;
+  for (month = 0; month < 12; month++) {
+    if (month == 1) {
+      if (LEAP_YEAR(year)) {
+        monthLength = 29;
+      } else {
+        monthLength = 28;
+      }
+    } else {
+      monthLength = monthDays[month];
+    }
+    if (time >= monthLength) {
+      time -= monthLength;
+    } else {
+      break;
+    }
+  }
+  tm.Month = month + 1;
+  tm.Day = time + 1;
+}
+
+static uint32_t oldMakeTime(const tmElements_t &tm) {
+  int i;
+  uint32_t seconds;
+
+  seconds = tm.Year * (SECS_PER_DAY * 365);
+  for (i = 0; i < tm.Year; i++) {
+    if (LEAP_YEAR(i)) {
+      seconds += SECS_PER_DAY;
+    }
+  }
+  for (i = 1; i < tm.Month; i++) {
+    if ((i == 2) && LEAP_YEAR(tm.Year)) {
+      seconds += SECS_PER_DAY * 29;
+    } else {
+      seconds += SECS_PER_DAY * monthDays[i - 1];
+    }
+  }
+  seconds += (tm.Day - 1) * SECS_PER_DAY;
+  seconds += tm.Hour * SECS_PER_HOUR;
+  seconds += tm.Minute * SECS_PER_MIN;
+  seconds += tm.Second;
+  return seconds;
+}
+
+//------------------------------------------------------------------------------
+// RTClib.cpp before the 1461 day cycles.
+static const uint8_t daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30};
+
+static uint16_t oldDate2days(uint16_t y, uint8_t m, uint8_t d) {
+  if (y >= 2000) y -= 2000;
+  uint16_t days = d;
+  for (uint8_t i = 1; i < m; ++i) days += daysInMonth[i - 1];
+  if (m > 2 && y % 4 == 0) ++days;
+  return days + 365 * y + (y + 3) / 4 - 1;
+}
+
+struct OldDateTime {
+  uint8_t yOff, m, d, hh, mm, ss;
+  OldDateTime(uint32_t t) {
+    t -= SECONDS_FROM_1970_TO_2000;
+    ss = t % 60;
+    t /= 60;
+    mm = t % 60;
+    t /= 60;
+    hh = t % 24;
+    uint16_t days = t / 24;
+    uint8_t leap;
+    for (yOff = 0;; ++yOff) {
+      leap = yOff % 4 == 0;
+      if (days < 365 + leap) break;
+      days -= 365 + leap;
+    }
+    for (m = 1; m < 12; ++m) {
+      uint8_t daysPerMonth = daysInMonth[m - 1];
+      if (leap && m == 2) ++daysPerMonth;
+      if (days < daysPerMonth) break;
+      days -= daysPerMonth;
+    }
+    d = days + 1;
+  }
+};
+
+//------------------------------------------------------------------------------
+static bool sameTm(const tmElements_t &a, const tmElements_t &b) {
+  return a.Second == b.Second && a.Minute == b.Minute && a.Hour == b.Hour && a.Wday == b.Wday && a.Day == b.Day &&
+         a.Month == b.Month && a.Year == b.Year;
+}
+
+static bool sameDt(const DateTime &a, const OldDateTime &b) {
+  return a.year() - 2000 == b.yOff && a.month() == b.m && a.day() == b.d && a.hour() == b.hh &&
+         a.minute() == b.mm && a.second() == b.ss;
+}
+
+static unsigned long checks = 0;
+
+// breakTime() and DateTime(t) for time t, both ways, and against gmtime().
+static int compareAt(uint32_t t) {
+  int bad = 0;
+  tmElements_t a, b;
+  breakTime(t, a);
+  oldBreakTime(t, b);
+  bad += !sameTm(a, b);
+  time_t tt = t;
+  struct tm g;
+  gmtime_r(&tt, &g);
+  bad += a.Year + 70 != g.tm_year || a.Month != g.tm_mon + 1 || a.Day != g.tm_mday || a.Wday != g.tm_wday + 1 ||
+         a.Hour != g.tm_hour || a.Minute != g.tm_min || a.Second != g.tm_sec;
+  bad += !sameDt(DateTime(t), OldDateTime(t));
+  checks += 3;
+  return bad;
+}
+
+static void testBreak() {
+  unsigned long c0 = checks;
+  int bad = 0;
+  const uint32_t times[] = {0, 1, 43199, 61261, 86399};  // seconds into each day
+  for (uint32_t day = 0; day <= 0xFFFFFFFFUL / 86400; day++) {
+    for (uint32_t s : times) {
+      uint64_t t = (uint64_t)day * 86400 + s;
+      if (t <= 0xFFFFFFFFUL) bad += compareAt(t);
+    }
+  }
+  for (uint32_t s = 0; s < 86400; s++) bad += compareAt(s) + compareAt(0xFFFFFFFFUL - s);
+  printf("    breakTime() and DateTime(t): %lu checks of every day to 2106 and every second of the first and"
+         " last\n", checks - c0);
+  check(bad == 0, "%d differ from the old code or gmtime()", bad);
+}
+
+static void testMake() {
+  unsigned long c0 = checks;
+  int bad = 0, round = 0;
+  for (int y = 0; y < 256; y++) {
+    for (int m = 1; m <= 12; m++) {
+      for (int d = 1; d <= 31; d++) {
+        tmElements_t tm = {};
+        tm.Year = y;
+        tm.Month = m;
+        tm.Day = d;
+        tm.Hour = d % 24;
+        tm.Minute = (y + d) % 60;
+        tm.Second = m * 5 - 1;
+        uint32_t t = makeTime(tm);
+        bad += t != oldMakeTime(tm);
+        // Real dates before 2106 come back from breakTime().
+        int len = m == 2 ? 28 + LEAP_YEAR(y) : monthDays[m - 1];
+        if (d <= len && y + 1970 < 2106) {
+          tmElements_t back;
+          breakTime(t, back);
+          round += back.Year != y || back.Month != m || back.Day != d || back.Hour != tm.Hour;
+        }
+        // RTClib, from both the 2 digit and 4 digit year.
+        for (int yy : {y, 2000 + y}) {
+          DateTime dt(yy, m, d, tm.Hour, tm.Minute, tm.Second);
+          long want = ((oldDate2days(yy, m, d) * 24L + tm.Hour) * 60 + tm.Minute) * 60 + tm.Second;
+          bad += dt.secondstime() != want || dt.unixtime() != (uint32_t)want + SECONDS_FROM_1970_TO_2000;
+        }
+        checks += 3;
+      }
+    }
+  }
+  printf("    makeTime() and date2days(): %lu checks of years 1970 to 2225 and 2000 to 2255, months 1 to 12,"
+         " days 1 to 31\n", checks - c0);
+  check(bad == 0, "%d differ from the old code", bad);
+  check(round == 0, "%d real dates not given back by breakTime()", round);
+}
+
+// Old and new, dates from 2020 to 2040.
+static void testSpeed() {
+  const int n = 200000;
+  std::vector<uint32_t> ts(n);
+  std::vector<tmElements_t> tms(n);
+  uint32_t t0 = 1577836800UL, span = 2209075200UL - t0;
+  for (int i = 0; i < n; i++) {
+    ts[i] = t0 + (uint32_t)((uint64_t)span * i / n);
+    breakTime(ts[i], tms[i]);
+  }
+  volatile uint32_t sink = 0;
+  double ns[8];
+  tmElements_t tm;
+  double t = hostNs();
+  for (int i = 0; i < n; i++) oldBreakTime(ts[i], tm), sink += tm.Day;
+  ns[0] = hostNs() - t, t = hostNs();
+  for (int i = 0; i < n; i++) breakTime(ts[i], tm), sink += tm.Day;
+  ns[1] = hostNs() - t, t = hostNs();
+  for (int i = 0; i < n; i++) sink += oldMakeTime(tms[i]);
+  ns[2] = hostNs() - t, t = hostNs();
+  for (int i = 0; i < n; i++) sink += makeTime(tms[i]);
+  ns[3] = hostNs() - t, t = hostNs();
+  for (int i = 0; i < n; i++) sink += OldDateTime(ts[i]).d;
+  ns[4] = hostNs() - t, t = hostNs();
+  for (int i = 0; i < n; i++) sink += DateTime(ts[i]).day();
+  ns[5] = hostNs() - t, t = hostNs();
+  for (int i = 0; i < n; i++) sink += oldDate2days(tms[i].Year + 1970, tms[i].Month, tms[i].Day) * 86400L;
+  ns[6] = hostNs() - t, t = hostNs();
+  for (int i = 0; i < n; i++) sink += DateTime(tms[i].Year + 1970, tms[i].Month, tms[i].Day).secondstime();
+  ns[7] = hostNs() - t;
+  printf("    host ns a call, old -> new: breakTime %.1f -> %.1f, makeTime %.1f -> %.1f, DateTime(t) %.1f -> %.1f,"
+         " date2days %.1f -> %.1f (through secondstime())\n", ns[0] / n, ns[1] / n, ns[2] / n, ns[3] / n,
+         ns[4] / n, ns[5] / n, ns[6] / n, ns[7] / n);
+  check(ns[1] < ns[0] && ns[3] < ns[2] && ns[5] < ns[4], "breakTime(), makeTime() and DateTime(t) are faster");
+}
+
+int main() {
+  testBreak();
+  testMake();
+  testSpeed();
+  return simFailures;
+}
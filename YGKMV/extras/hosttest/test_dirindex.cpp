@@ -0,0 +1,184 @@
+// The directory name index (USE_DIR_NAME_INDEX) behind FatFile::open() and
+// exists(): the same answers as the directory holds through random creates,
+// removes and renames across more directories than it indexes, and open
+// latency in directories of 10, 100 and 1000 files with and without it, in
+// host time and blocks read from the simulated flash. The first build holds
+// the largest directory and has the separate FAT cache of an ARM build, so
+// following a directory's clusters doesn't push its block out of the cache.
+// The second has the default DIR_INDEX_DIM, which leaves the bigger
+// directories to the full scan.
+// CONFIGS: -DUSE_DIR_NAME_INDEX=1 -DDIR_INDEX_DIM=2048 -DUSE_SEPARATE_FAT_CACHE=1
+// CONFIGS: -DUSE_DIR_NAME_INDEX=1
+#include "hosttest.h"
+#include <random>
+#include <set>
+#include <string>
+
+// The flash stub counting the blocks read.
+struct CountingFlash : public Adafruit_SPIFlash {
+  unsigned long reads = 0;
+  CountingFlash() : Adafruit_SPIFlash(NULL) {}
+  bool readBlocks(uint32_t b, uint8_t *dst, size_t n) {
+    reads += n;
+    return Adafruit_SPIFlash::readBlocks(b, dst, n);
+  }
+};
+
+static CountingFlash drv;
+static FatFileSystem fs;
+
+// Start dir over with no index, or keep it from being indexed, so opens
+// scan it as they did before.
+static void resetIndex(FatFile &dir, bool use) {
+  dir.m_vol->dirIndexClear(dir.m_firstCluster);
+  if (!use) dir.m_vol->dirIndexNew(dir.m_firstCluster)->state = DIR_INDEX_FULL;
+}
+
+static bool indexed(FatFile &dir) {
+  dir_index_t *dx = dir.m_vol->dirIndexFind(dir.m_firstCluster);
+  return dx && dx->state == DIR_INDEX_VALID;
+}
+
+static bool create(FatFile &dir, const char *name) {
+  FatFile f;
+  return f.open(&dir, name, O_RDWR | O_CREAT | O_EXCL) && f.close();
+}
+
+// Long and 8.3 names, looked up in upper, lower or the original case.
+static std::string poolName(int i) {
+  char s[24];
+  if (i % 2) snprintf(s, sizeof s, "Breath log %02d.txt", i);
+  else snprintf(s, sizeof s, "CAL%02d.CSV", i);
+  return s;
+}
+static std::string recase(std::string s, int how) {
+  for (auto &c : s) c = how == 1 ? toupper(c) : how == 2 ? tolower(c) : c;
+  return s;
+}
+
+// Random creates, removes and renames in three directories, two of which
+// the index can hold at once, each followed by lookups of random names.
+static void testChurn() {
+  const int dirs = 3, pool = 24;
+  FatFile dir[dirs];
+  std::set<std::string> live[dirs];   // lower case names
+  for (int d = 0; d < dirs; d++) {
+    char s[8];
+    snprintf(s, sizeof s, "churn%d", d);
+    check(dir[d].mkdir(fs.vwd(), s), "mkdir %s", s);
+  }
+  std::mt19937 rng(7);
+  int lookups = 0, wrong = 0, viaIndex = 0, opsFailed = 0;
+  for (int i = 0; i < 3000; i++) {
+    int d = rng() % dirs;
+    std::string a = poolName(rng() % pool), b = poolName(rng() % pool);
+    std::string la = recase(a, 2), lb = recase(b, 2);
+    bool ok = true;
+    switch (rng() % 3) {
+      case 0:
+        if (!live[d].count(la)) ok = create(dir[d], a.c_str()), live[d].insert(la);
+        break;
+      case 1:
+        if (live[d].count(la)) ok = FatFile::remove(&dir[d], recase(a, rng() % 3).c_str()), live[d].erase(la);
+        break;
+      case 2:
+        if (live[d].count(la) && !live[d].count(lb)) {
+          FatFile f;
+          ok = f.open(&dir[d], a.c_str(), O_RDWR) && f.rename(&dir[d], b.c_str()) && f.close();
+          live[d].erase(la);
+          live[d].insert(lb);
+        }
+        break;
+    }
+    opsFailed += !ok;
+    for (int k = 0; k < 3; k++) {
+      int e = rng() % dirs;
+      std::string n = poolName(rng() % pool);
+      bool there = dir[e].exists(recase(n, rng() % 3).c_str());
+      viaIndex += indexed(dir[e]);
+      wrong += there != (live[e].count(recase(n, 2)) > 0);
+      lookups++;
+    }
+  }
+  printf("    %d lookups after random changes, %d through the index\n", lookups, viaIndex);
+  check(opsFailed == 0, "%d creates, removes or renames failed", opsFailed);
+  check(wrong == 0, "%d of %d lookups wrong", wrong, lookups);
+  check(viaIndex > lookups / 2, "%d of %d lookups through the index", viaIndex, lookups);
+
+  // A directory made over a removed one's cluster starts with none of its
+  // names, and finds the ones made in it.
+  FatFile &old = dir[0];
+  for (auto &n : std::set<std::string>(live[0])) FatFile::remove(&old, n.c_str());
+  check(old.exists("x") == false && old.rmdir(), "rmdir churn0");
+  FatFile fresh;
+  check(fresh.mkdir(fs.vwd(), "fresh"), "mkdir fresh");
+  bool none = true;
+  for (int i = 0; i < pool; i++) none = none && !fresh.exists(poolName(i).c_str());
+  check(none, "no old names in a new directory");
+  check(create(fresh, poolName(1).c_str()) && fresh.exists(poolName(1).c_str()), "new name found");
+}
+
+// Directories of n long names, opened at random with the index and
+// without, and a name that isn't there looked up with exists().
+static void testLatency() {
+  for (int n : {10, 100, 1000}) {
+    char s[32];
+    FatFile dir;
+    snprintf(s, sizeof s, "files%d", n);
+    check(dir.mkdir(fs.vwd(), s), "mkdir %s", s);
+    bool made = true;
+    for (int i = 0; i < n; i++) {
+      snprintf(s, sizeof s, "Pressure log %04d.txt", i);
+      made = made && create(dir, s);
+    }
+    check(made, "%d files made", n);
+
+    const int reps = 2000;
+    double ns[2], missNs[2], reads[2], missReads[2];
+    int found[2] = {0, 0};
+    bool idx[2];
+    for (int use = 0; use < 2; use++) {
+      std::mt19937 rng(n);   // the same names both ways
+      resetIndex(dir, use);
+      dir.exists("warm up");
+      idx[use] = indexed(dir);
+      unsigned long r0 = drv.reads;
+      double t0 = hostNs();
+      for (int i = 0; i < reps; i++) {
+        FatFile f;
+        snprintf(s, sizeof s, "Pressure log %04d.txt", (int)(rng() % n));
+        found[use] += f.open(&dir, s, O_RDONLY);
+        f.close();
+      }
+      ns[use] = (hostNs() - t0) / reps;
+      reads[use] = (drv.reads - r0) / (double)reps;
+      r0 = drv.reads;
+      t0 = hostNs();
+      for (int i = 0; i < reps; i++) dir.exists("Pressure log 9999.txt");
+      missNs[use] = (hostNs() - t0) / reps;
+      missReads[use] = (drv.reads - r0) / (double)reps;
+    }
+    printf("    %4d files%s: open %.2f -> %.2f us, %.1f -> %.2f blocks read; missing name %.2f -> %.2f us,"
+           " %.1f -> %.1f blocks\n", n, idx[1] ? "" : " (too big to index)", ns[0] / 1000, ns[1] / 1000,
+           reads[0], reads[1], missNs[0] / 1000, missNs[1] / 1000, missReads[0], missReads[1]);
+    check(found[0] == reps && found[1] == reps, "%d files: %d and %d of %d opens found", n, found[0], found[1], reps);
+    check(idx[1] == (2 * n <= DIR_INDEX_DIM), "%d files indexed %d with DIR_INDEX_DIM %d", n, idx[1],
+          DIR_INDEX_DIM);
+    if (idx[1]) {
+      // One block for each open, two for the names that straddle blocks.
+      check(reads[1] < 1.2 && missReads[1] == 0, "%d files: %.2f blocks per open, %.2f per miss with the index",
+            n, reads[1], missReads[1]);
+    } else {
+      check(reads[1] == reads[0], "%d files: scanned as before", n);
+    }
+    dir.close();
+  }
+}
+
+int main() {
+  simFlashFormat(4096);
+  check(fs.begin(&drv), "mounts");
+  testChurn();
+  testLatency();
+  return simFailures;
+}
@@ -0,0 +1,185 @@
+// FatVolume::freeClusterCount() and allocContiguous() on synthetic
+// fragmented FAT16 and FAT32 volumes, against the entry at a time loops
+// they replaced: same answers, and host entries scanned per microsecond
+// before and after. The 2 MB flash on the Feather is FAT12, which keeps the
+// per cluster path, so this is for larger volumes such as an SD card.
+// Built without auto-vectorization, which is closer to a Cortex-M0 than a
+// host compiler turning the old loops into SIMD.
+// CONFIGS: -fno-tree-vectorize
+#include "hosttest.h"
+#include <random>
+
+static Adafruit_SPIFlash drv(NULL);
+static FatFileSystem fs;
+
+// FAT16 from simFlashFormat(), or FAT32 written over it: 1 block clusters,
+// 32 reserved blocks, one FAT, root directory in cluster 2.
+static void format(bool fat32, uint32_t blocks) {
+  simFlashFormat(blocks);
+  if (!fat32) {
+    uint16_t *fat = (uint16_t *)(simFlash + 512);
+    fat[0] = 0xFFF8;
+    fat[1] = fat[2] = 0xFFFF;
+    return;
+  }
+  uint8_t *b = simFlash;
+  uint32_t fatBlocks = (blocks * 4 + 511) / 512;
+  b[14] = 32; b[15] = 0;       // reserved sectors
+  b[17] = b[18] = 0;           // no FAT16 root directory
+  b[22] = b[23] = 0;           // no FAT16 sectors per FAT
+  for (int i = 0; i < 4; i++) {
+    b[32 + i] = blocks >> (8 * i);
+    b[36 + i] = fatBlocks >> (8 * i);
+    b[44 + i] = i ? 0 : 2;     // root cluster
+  }
+  uint32_t *fat = (uint32_t *)(simFlash + 32 * 512);
+  fat[0] = 0x0FFFFFF8;
+  fat[1] = fat[2] = 0x0FFFFFFF;
+}
+
+// Runs of used and free clusters up to maxRun long, with the last tail
+// clusters free, straight into the FAT image. Returns the free count.
+static uint32_t fragment(int maxRun, uint32_t tail, uint32_t seed) {
+  std::mt19937 rng(seed);
+  uint32_t last = fs.vol()->m_lastCluster, free = 0;
+  uint8_t *fat = simFlash + fs.vol()->m_fatStartBlock * 512;
+  bool used = true;
+  for (uint32_t c = 3; c <= last;) {
+    uint32_t n = 1 + rng() % maxRun;
+    for (; n && c <= last; n--, c++) {
+      bool u = used && c + tail <= last;
+      if (fs.vol()->fatType() == 16) ((uint16_t *)fat)[c] = u ? 0xFFFF : 0;
+      else ((uint32_t *)fat)[c] = u ? 0x0FFFFFFF : 0;
+      free += !u;
+    }
+    used = !used;
+  }
+  fs.vol()->m_cache.invalidate();
+#if USE_SEPARATE_FAT_CACHE
+  fs.vol()->m_fatCache.invalidate();
+#endif
+  return free;
+}
+
+// freeClusterCount() as it was, one entry at a time.
+static int32_t countOld(FatVolume *v) {
+  uint32_t free = 0, lba = v->m_fatStartBlock, todo = v->m_lastCluster + 1;
+  while (todo) {
+    cache_t *pc = v->cacheFetchFat(lba++, FatCache::CACHE_FOR_READ);
+    uint16_t n = v->fatType() == 16 ? 256 : 128;
+    if (todo < n) n = todo;
+    if (v->fatType() == 16) {
+      for (uint16_t i = 0; i < n; i++)
+        if (pc->fat16[i] == 0) free++;
+    } else {
+      for (uint16_t i = 0; i < n; i++)
+        if (pc->fat32[i] == 0) free++;
+    }
+    todo -= n;
+  }
+  return free;
+}
+
+// allocContiguous() as it was, fatGet() for every cluster.
+static bool allocOld(FatVolume *v, uint32_t count, uint32_t *first, uint32_t start) {
+  bool setStart = start == 0;
+  uint32_t bgn = start ? start : v->m_allocSearchStart + 1, end = bgn;
+  while (1) {
+    if (end > v->m_lastCluster) return false;
+    uint32_t f;
+    int8_t fg = v->fatGet(end, &f);
+    if (fg < 0) return false;
+    if (f || fg == 0) {
+      if (start) return false;
+      if (bgn != end) setStart = false;
+      bgn = end + 1;
+    } else if (end - bgn + 1 == count) {
+      break;
+    }
+    end++;
+  }
+  if (setStart) v->m_allocSearchStart = end;
+  if (!v->fatPutEOC(end)) return false;
+  for (; end > bgn; end--)
+    if (!v->fatPut(end - 1, end)) return false;
+  v->updateFreeClusterCount(-count);
+  *first = bgn;
+  return true;
+}
+
+// Just the block reads both counts make, to take out of their times.
+static void fetchOnly(FatVolume *v) {
+  uint32_t lba = v->m_fatStartBlock, todo = v->m_lastCluster + 1;
+  for (uint16_t n = v->fatType() == 16 ? 256 : 128; todo; todo -= min(todo, (uint32_t)n))
+    v->cacheFetchFat(lba++, FatCache::CACHE_FOR_READ);
+}
+
+static void testVolume(bool fat32) {
+  const char *name = fat32 ? "FAT32" : "FAT16";
+  format(fat32, fat32 ? 67000 : 60000);
+  check(fs.begin(&drv), "%s mounts", name);
+  FatVolume *v = fs.vol();
+  check(v->fatType() == (fat32 ? 32 : 16), "%s is FAT%d", name, v->fatType());
+  uint32_t entries = v->m_lastCluster - 1;
+
+  for (int maxRun : {1, 8, 40}) {
+    uint32_t free = fragment(maxRun, 1000, maxRun);
+    int32_t nNew = v->freeClusterCount(), nOld = countOld(v);
+    check(nNew == (int32_t)free && nOld == (int32_t)free, "%s runs to %d: %d and %d free, %u expected", name, maxRun,
+          nNew, nOld, free);
+  }
+
+  // Count a mostly used FAT many times, old and new.
+  const int reps = 50;
+  double old = 1e30, now = 1e30, fetch = 1e30, t0;
+  for (int k = 0; k < 5; k++) {   // best of five, alternating
+    t0 = hostNs();
+    for (int i = 0; i < reps; i++) countOld(v);
+    old = min(old, (hostNs() - t0) / reps);
+    t0 = hostNs();
+    for (int i = 0; i < reps; i++) v->freeClusterCount();
+    now = min(now, (hostNs() - t0) / reps);
+    t0 = hostNs();
+    for (int i = 0; i < reps; i++) fetchOnly(v);
+    fetch = min(fetch, (hostNs() - t0) / reps);
+  }
+  printf("    %s freeClusterCount(): %.0f -> %.0f entries/us over %u entries, %.0f -> %.0f without the block reads\n",
+         name, entries / old * 1000, entries / now * 1000, entries, entries / max(old - fetch, 1.0) * 1000,
+         entries / max(now - fetch, 1.0) * 1000);
+
+  // Allocations from a sequence of search starts and sizes give the same
+  // first cluster and next search start both ways, then are freed again.
+  std::mt19937 rng(5);
+  int same = 0, tries = 0;
+  double tOld = 0, tNew = 0;
+  for (int i = 0; i < 200; i++) {
+    uint32_t count = 1 + rng() % 48, start = 2 + rng() % (entries - 2);
+    uint32_t fixed = i % 4 == 3 ? start : 0;   // some at a fixed start cluster
+    uint32_t a = 0, b = 0;
+    v->m_allocSearchStart = start;
+    t0 = hostNs();
+    bool okA = allocOld(v, count, &a, fixed);
+    tOld += hostNs() - t0;
+    uint32_t sA = v->m_allocSearchStart;
+    if (okA) v->freeChain(a);
+    v->m_allocSearchStart = start;
+    t0 = hostNs();
+    bool okB = v->allocContiguous(count, &b, fixed);
+    tNew += hostNs() - t0;
+    uint32_t sB = v->m_allocSearchStart;
+    if (okB) v->freeChain(b);
+    tries++;
+    same += okA == okB && a == b && sA == sB;
+  }
+  check(same == tries, "%s allocContiguous() matches the old search in %d of %d", name, same, tries);
+  check(v->freeClusterCount() == countOld(v) && countOld(v) == (int32_t)fragment(40, 1000, 40),
+        "%s all allocations freed again", name);
+  printf("    %s allocContiguous(): %.1f -> %.1f us per call with runs up to 40\n", name, tOld / tries / 1000,
+         tNew / tries / 1000);
+}
+
+int main() {
+  testVolume(false);
+  testVolume(true);
+  return simFailures;
+}
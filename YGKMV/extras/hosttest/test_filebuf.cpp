@@ -0,0 +1,171 @@
+// The file read-ahead and write-behind buffer (FatFile::setBuffer()):
+// random mixes of reads, writes, seeks, syncs, truncates and reopens on a
+// buffered file and an unbuffered one giving the same bytes, positions and
+// sizes as each other and as a copy kept in memory, with the bytes on the
+// volume after each sync and close the same too. Then sequential append
+// and read throughput for buffers of 0 to 16 blocks, in host MB/s and in
+// device commands, costed at 20 us a command and 64 us a block as a guide
+// to the SPI flash. The second build has the separate FAT cache of an ARM
+// build.
+// CONFIGS: -DUSE_FILE_BUFFER=1
+// CONFIGS: -DUSE_FILE_BUFFER=1 -DUSE_SEPARATE_FAT_CACHE=1
+#include "hosttest.h"
+#include <random>
+#include <vector>
+
+// The flash stub counting commands and the blocks they move.
+struct CountingFlash : public Adafruit_SPIFlash {
+  unsigned long commands = 0, blocks = 0;
+  CountingFlash() : Adafruit_SPIFlash(NULL) {}
+  bool readBlocks(uint32_t b, uint8_t *dst, size_t n) {
+    commands++;
+    blocks += n;
+    return Adafruit_SPIFlash::readBlocks(b, dst, n);
+  }
+  bool writeBlocks(uint32_t b, const uint8_t *src, size_t n) {
+    commands++;
+    blocks += n;
+    return Adafruit_SPIFlash::writeBlocks(b, src, n);
+  }
+  double deviceUs() { return 20.0 * commands + 64.0 * blocks; }
+};
+
+static CountingFlash drv;
+static FatFileSystem fs;
+static uint8_t fileBuf[16 * 512];
+
+static void format() {
+  if (fs.fatType()) fs.cacheSync();
+  simFlashFormat(4096);
+  check(fs.begin(&drv), "mounts");
+}
+
+// The whole file read back by a new unbuffered file object.
+static std::vector<uint8_t> contents(const char *name) {
+  FatFile f;
+  std::vector<uint8_t> v;
+  if (!f.open(fs.vwd(), name, O_RDONLY)) return v;
+  v.resize(f.fileSize());
+  if (f.read(v.data(), v.size()) != (int)v.size()) v.clear();
+  f.close();
+  return v;
+}
+
+static bool reopen(FatFile &f, const char *name, int blocks) {
+  return f.open(fs.vwd(), name, O_RDWR) && (!blocks || f.setBuffer(fileBuf, blocks));
+}
+
+// Each change made to a file without a buffer, one with a buffer of
+// blocks and the copy in memory.
+static void testSame(int blocks) {
+  format();
+  FatFile plain, buf;
+  check(plain.open(fs.vwd(), "plain.bin", O_RDWR | O_CREAT) && buf.open(fs.vwd(), "buf.bin", O_RDWR | O_CREAT) &&
+        buf.setBuffer(fileBuf, blocks), "%d blocks: files open", blocks);
+  std::mt19937 rng(blocks);
+  std::vector<uint8_t> model, a(4000), b(4000);
+  uint32_t pos = 0;
+  int ops = 6000, wrong = 0, synced = 0, onVolume = 0, failed = 0;
+  unsigned long c0 = drv.commands;
+  for (int i = 0; i < ops; i++) {
+    int op = rng() % 16;
+    // Lengths up to a few bytes, a block or several blocks.
+    size_t n = 1 + rng() % (op & 1 ? 20 : op & 2 ? 600 : 3000);
+    if (op < 6) {
+      for (size_t k = 0; k < n; k++) a[k] = rng();
+      failed += plain.write(a.data(), n) != (int)n;
+      failed += buf.write(a.data(), n) != (int)n;
+      if (pos + n > model.size()) model.resize(pos + n);
+      memcpy(model.data() + pos, a.data(), n);
+      pos += n;
+    } else if (op < 11) {
+      int ra = plain.read(a.data(), n), rb = buf.read(b.data(), n);
+      size_t want = pos < model.size() ? std::min(n, model.size() - pos) : 0;
+      wrong += ra != (int)want || rb != (int)want || memcmp(a.data(), model.data() + pos, want) ||
+               memcmp(b.data(), model.data() + pos, want);
+      pos += want;
+    } else if (op < 13) {
+      pos = rng() % (model.size() + 1);
+      failed += !plain.seekSet(pos) || !buf.seekSet(pos);
+    } else if (op == 13) {
+      // Writes then a sync leave the file on the volume.
+      failed += !plain.sync() || !buf.sync();
+      std::vector<uint8_t> v = contents("buf.bin");
+      onVolume += v != model;
+      synced++;
+    } else if (op == 14) {
+      failed += !plain.close() || !buf.close() || !reopen(plain, "plain.bin", 0) ||
+                !reopen(buf, "buf.bin", blocks);
+      pos = 0;
+    } else if (rng() % 4 == 0) {
+      uint32_t len = rng() % (model.size() + 1);
+      failed += !plain.truncate(len) || !buf.truncate(len);
+      model.resize(len);
+      pos = std::min<uint32_t>(pos, len);
+    }
+    wrong += plain.curPosition() != pos || buf.curPosition() != pos || plain.fileSize() != model.size() ||
+             buf.fileSize() != model.size();
+  }
+  unsigned long commands = drv.commands - c0;
+  failed += !plain.close() || !buf.close();
+  bool same = contents("plain.bin") == model && contents("buf.bin") == model;
+  printf("    %2d blocks: %d changes to a %zu byte file, %d syncs checked on the volume, %lu device commands\n",
+         blocks, ops, model.size(), synced, commands);
+  check(failed == 0, "%d blocks: %d calls failed", blocks, failed);
+  check(wrong == 0, "%d blocks: %d reads, positions or sizes differ", blocks, wrong);
+  check(onVolume == 0, "%d blocks: volume differs after %d of %d syncs", blocks, onVolume, synced);
+  check(same, "%d blocks: both files hold the same bytes after close", blocks);
+}
+
+// Append 1 MB in 100 byte writes, as a log is written, then read it back
+// in 64 byte reads, with a buffer of blocks or none.
+static void testThroughput() {
+  const uint32_t total = 1 << 20;
+  std::vector<uint8_t> data(total), back(total);
+  std::mt19937 rng(1);
+  for (auto &x : data) x = rng();
+  double appendCmds0 = 0, readCmds0 = 0;
+  for (int blocks : {0, 1, 4, 8, 16}) {
+    format();
+    FatFile f;
+    check(f.open(fs.vwd(), "log.bin", O_RDWR | O_CREAT | O_APPEND) && (!blocks || f.setBuffer(fileBuf, blocks)),
+          "%d blocks: log open", blocks);
+    unsigned long c0 = drv.commands;
+    double dev0 = drv.deviceUs(), t0 = hostNs();
+    bool ok = true;
+    for (uint32_t at = 0; at < total; at += 100) {
+      size_t n = std::min<uint32_t>(100, total - at);
+      ok = ok && f.write(data.data() + at, n) == (int)n;
+    }
+    ok = f.close() && ok;
+    double appendNs = hostNs() - t0, appendDev = drv.deviceUs() - dev0;
+    unsigned long appendCmds = drv.commands - c0;
+
+    ok = ok && reopen(f, "log.bin", blocks);
+    c0 = drv.commands;
+    dev0 = drv.deviceUs();
+    t0 = hostNs();
+    for (uint32_t at = 0; at < total; at += 64) ok = ok && f.read(back.data() + at, 64) == 64;
+    double readNs = hostNs() - t0, readDev = drv.deviceUs() - dev0;
+    unsigned long readCmds = drv.commands - c0;
+    f.close();
+
+    printf("    %2d blocks: append %5lu commands, %4.0f MB/s host, %.1f MB/s device;"
+           " read %5lu commands, %4.0f MB/s host, %.1f MB/s device\n", blocks, appendCmds, total / appendNs * 1e3,
+           total / appendDev, readCmds, total / readNs * 1e3, total / readDev);
+    check(ok && back == data && contents("log.bin") == data, "%d blocks: 1 MB appended and read back", blocks);
+    if (!blocks) {
+      appendCmds0 = appendCmds;
+      readCmds0 = readCmds;
+    } else if (blocks >= 4) {
+      check(appendCmds < appendCmds0 / 3 && readCmds < readCmds0 / 3, "%d blocks: %lu and %lu commands against %.0f"
+            " and %.0f without", blocks, appendCmds, readCmds, appendCmds0, readCmds0);
+    }
+  }
+}
+
+int main() {
+  for (int blocks : {1, 2, 3, 8, 16}) testSame(blocks);
+  testThroughput();
+  return simFailures;
+}
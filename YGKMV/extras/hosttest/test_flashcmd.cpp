@@ -0,0 +1,214 @@
+// Command files read from flash (doFlashCommands(), FatLineReader): random
+// files of LF and CR/LF lines up to three blocks long, some lines across
+// block boundaries and some files without a final newline, read through
+// buffers of 3 to 1000 bytes against a plain split of the same bytes;
+// then doFlashCommands() skipping a line too long for its buffer rather
+// than running its pieces. Last, the time and heap allocations to load a
+// calibration file, against the readStringUntil() loop it replaced. Heap
+// use is counted through operator new, so Strings short enough for the
+// host std::string's own buffer don't count, unlike on the board.
+#include "hosttest.h"
+#include <new>
+#include <random>
+#include <string>
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+extern FatFileSystem fatfs;
+
+static unsigned long heapAllocs, heapBytes;
+void *operator new(size_t n) {
+  heapAllocs++;
+  heapBytes += n;
+  void *p = malloc(n);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static bool writeFile(const char *name, const std::string &s) {
+  FatFile f;
+  return f.open(fatfs.vwd(), name, O_RDWR | O_CREAT | O_TRUNC) && f.write(s.data(), s.size()) == (int)s.size() &&
+         f.close();
+}
+
+// The lines in s, split at LF with one CR before it removed.
+static std::vector<std::string> split(const std::string &s) {
+  std::vector<std::string> v;
+  size_t at = 0;
+  while (at < s.size()) {
+    size_t nl = s.find('\n', at);
+    size_t end = nl == std::string::npos ? s.size() : nl;
+    std::string line = s.substr(at, end - at);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    v.push_back(line);
+    at = end + 1;
+  }
+  return v;
+}
+
+// The lines of a file through the reader, joining pieces.
+static std::vector<std::string> readLines(const char *name, size_t size, int *pieces) {
+  std::vector<std::string> v;
+  std::vector<char> buf(size);
+  FatFile f;
+  if (!f.open(fatfs.vwd(), name, O_RDONLY)) return v;
+  FatLineReader lines(&f, buf.data(), size);
+  const char *line;
+  size_t len;
+  bool more = false;
+  while ((line = lines.next(&len))) {
+    if (strlen(line) != len) v.push_back("length wrong");
+    if (more) v.back() += line;
+    else v.push_back(line);
+    more = lines.partial();
+    *pieces += more;
+  }
+  f.close();
+  return v;
+}
+
+static std::string randomFile(std::mt19937 &rng) {
+  std::string s;
+  int n = rng() % 40;
+  for (int i = 0; i < n; i++) {
+    // Mostly command sized lines, some longer than a block, some blank.
+    int kind = rng() % 10;
+    size_t len = kind < 6 ? rng() % 60 : kind < 8 ? rng() % 1500 : kind < 9 ? 500 + rng() % 24 : 0;
+    for (size_t k = 0; k < len; k++) {
+      int c = 32 + rng() % 95;
+      s += rng() % 50 ? (char)c : '\r';   // a stray CR inside a line now and then
+    }
+    if (i < n - 1 || rng() % 2) s += rng() % 2 ? "\r\n" : "\n";
+  }
+  return s;
+}
+
+// Random files, plus a line ending across each of the first few block
+// boundaries, through buffers from 3 bytes to twice the product's.
+static void testReader() {
+  std::mt19937 rng(46);
+  int files = 0, wrong = 0, pieces = 0, noNewline = 0, straddles = 0;
+  for (int i = 0; i < 300; i++) {
+    std::string s = randomFile(rng);
+    if (i % 10 == 0) {
+      // A CR/LF split by a block boundary and by the product's buffer.
+      s = std::string(510, 'a') + "\r\n" + std::string(509, 'b') + "\r\n" + "c\r";
+    }
+    noNewline += !s.empty() && s.back() != '\n';
+    for (size_t b = 512; b < s.size(); b += 512) {
+      size_t nl = s.find('\n', b - 80);
+      straddles += nl != std::string::npos && nl > b && s.rfind('\n', b - 1) < b - 1;
+    }
+    check(writeFile("lines.txt", s), "file %d written", i);
+    std::vector<std::string> want = split(s);
+    for (size_t size : {3, 4, 7, 64, 100, 511, 512, 513, 1000}) {
+      std::vector<std::string> got = readLines("lines.txt", size, &pieces);
+      if (got != want && wrong++ < 3) {
+        printf("    file %d, %zu byte buffer: %zu lines, %zu expected\n", i, size, got.size(), want.size());
+      }
+      files++;
+    }
+  }
+  printf("    %d reads of 300 files, %d without a final newline, %d lines across block boundaries, %d pieces joined\n",
+         files, noNewline, straddles, pieces);
+  check(wrong == 0, "%d of %d reads differ from the split file", wrong, files);
+  check(pieces > 1000 && straddles > 100 && noNewline > 50, "long lines, block boundaries and missing newlines");
+}
+
+// A command file with CR/LF and LF lines, a blank line, a line far longer
+// than the buffer whose second piece would be a command, a line across a
+// block boundary, and no final newline.
+static void testCommands() {
+  std::string s = "D0.2\r\n\r\ni1100\n";
+  s += "D0.3" + std::string(FLASH_READ_BUFFER - 5, ' ') + "D0.9 in a line too long\r\n";
+  s += "e" + std::string(1030 - s.size(), ' ') + "2500\r\n";   // across the second block boundary
+  s += "D0.4";
+  check(writeFile("/vent/cmds.txt", s), "command file written");
+  vent.p_tau = 0.1;
+  vent.p_it = 1000;
+  vent.p_et = 2000;
+  File f = fatfs.open("/vent/cmds.txt", FILE_READ);
+  Serial.out.clear();
+  int n = vent.doFlashCommands(&f);
+  f.close();
+  if (simVerbose) printf("%s", Serial.out.c_str());
+  check(n == 4, "%d commands run", n);
+  check(vent.p_it == 1100 && vent.p_et == 2500, "i and e across the block boundary set %.0f and %.0f",
+        (double)vent.p_it, (double)vent.p_et);
+  check(vent.p_tau == (float)0.4, "D from the last line without a newline, not the long line's piece: %.2f",
+        vent.p_tau);
+  check(Serial.out.find("Skipping a line longer than 511 characters") != std::string::npos, "long line reported");
+  check(Serial.out.find("Executed 4 lines") != std::string::npos, "count printed");
+}
+
+// Load the calibration file the way readCalFlash() did before: a String
+// per line from readStringUntil(), which reads a byte at a time.
+static int oldLoad(File &f) {
+  int n = 0;
+  String line = f.readStringUntil('\n');
+  while (line.length()) {
+    P("From File: "); PL(line);
+    vent.doConsoleCommand(line);
+    n++;
+    line = f.readStringUntil('\n');
+  }
+  return n;
+}
+
+// The line reading alone and the whole load, each per line.
+static void testLoadCost() {
+  vent.writeCalFlash();
+  const int reps = 200;
+  int lines = 0;
+  double readNs[2] = {0, 0}, loadNs[2] = {0, 0};
+  unsigned long readAllocs[2] = {0, 0}, loadAllocs[2] = {0, 0}, loadBytes[2] = {0, 0};
+  Serial.out.reserve(1 << 24);
+  for (int rep = 0; rep < reps; rep++) {
+    for (int use = 0; use < 2; use++) {
+      File f = fatfs.open("/vent/cal.txt", FILE_READ);
+      unsigned long a0 = heapAllocs;
+      double t0 = hostNs();
+      int n = 0;
+      if (use) {
+        char buf[FLASH_READ_BUFFER];
+        FatLineReader r(&f, buf, sizeof buf);
+        while (r.next()) n++;
+      } else {
+        while (f.readStringUntil('\n').length()) n++;
+      }
+      readNs[use] += hostNs() - t0;
+      readAllocs[use] += heapAllocs - a0;
+      lines = n;
+      f.rewind();
+      Serial.out.clear();
+      a0 = heapAllocs;
+      unsigned long b0 = heapBytes;
+      t0 = hostNs();
+      if (use) vent.doFlashCommands(&f);
+      else oldLoad(f);
+      loadNs[use] += hostNs() - t0;
+      loadAllocs[use] += heapAllocs - a0;
+      loadBytes[use] += heapBytes - b0;
+      f.close();
+    }
+  }
+  double per = (double)reps * lines;
+  printf("    cal.txt, %d lines: reading %.2f -> %.2f us and %.1f -> %.1f allocations a line;"
+         " load %.1f -> %.1f us, %.1f -> %.1f allocations and %.0f -> %.0f bytes a line\n", lines,
+         readNs[0] / per / 1000, readNs[1] / per / 1000, readAllocs[0] / per, readAllocs[1] / per,
+         loadNs[0] / per / 1000, loadNs[1] / per / 1000, loadAllocs[0] / per, loadAllocs[1] / per,
+         loadBytes[0] / per, loadBytes[1] / per);
+  check(lines > 5, "%d calibration lines", lines);
+  check(readAllocs[1] == 0, "the reader allocates nothing");
+  check(loadAllocs[1] < loadAllocs[0], "the load allocates less");
+}
+
+int main() {
+  simFlashFormat();
+  vent.begin();
+  testReader();
+  testCommands();
+  testLoadCost();
+  return simFailures;
+}
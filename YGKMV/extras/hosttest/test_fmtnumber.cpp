@@ -0,0 +1,138 @@
+// SdFat's number formatting and scanning (FmtNumber.cpp) against the C
+// library: every value from -99.99 to 999.99 at 2 decimals, as the
+// calibration and patient files hold them, through fmtFixed(), both
+// fmtFloat()s and scanFloat() against printf() and strtof(); then random
+// floats at 0 to 9 decimals, where floatScaled() rounds the mantissa times
+// a power of ten in 64 bits, against the exact product. Last, the time of
+// each call against the C library's.
+#include "hosttest.h"
+#include <FatLib/FmtNumber.h>
+#include <math.h>
+#include <random>
+#include <string>
+
+static char out[40];
+
+static std::string fixed(int32_t v, uint8_t prec) {
+  out[sizeof out - 1] = 0;
+  return fmtFixed(v, out + sizeof out - 1, prec);
+}
+
+static std::string flt(float v, uint8_t prec) {
+  out[sizeof out - 1] = 0;
+  return fmtFloat(v, out + sizeof out - 1, prec);
+}
+
+static std::string fltField(float v, uint8_t prec) {
+  out[sizeof out - 1] = 0;
+  return fmtFloat(v, out + sizeof out - 1, prec, 0);
+}
+
+static std::string printed(double v, int prec) {
+  char s[40];
+  snprintf(s, sizeof s, "%.*f", prec, v);
+  return s;
+}
+
+static bool sameBits(float a, float b) { return !memcmp(&a, &b, sizeof a); }
+
+// Each hundredth from -99.99 to 999.99.
+static void testSweep() {
+  int n = 0, badFixed = 0, badFloat = 0, badField = 0, badScan = 0, badEnd = 0;
+  for (int32_t k = -9999; k <= 99999; k++, n++) {
+    std::string s = printed(k / 100.0, 2);
+    float f = strtof(s.c_str(), NULL);
+    std::string want = printed(f, 2);
+    if (fixed(k, 2) != s && badFixed++ < 3) printf("    fmtFixed(%d, 2) gave %s\n", k, out);
+    if (flt(f, 2) != want && badFloat++ < 3) printf("    fmtFloat(%s) gave %s\n", s.c_str(), out);
+    if (fltField(f, 2) != want && badField++ < 3) printf("    fmtFloat(%s, 0) gave %s\n", s.c_str(), out);
+    char *end;
+    float g = scanFloat(s.c_str(), &end);
+    if (!sameBits(g, f) && badScan++ < 3) printf("    scanFloat(%s) gave %.9g, strtof %.9g\n", s.c_str(), g, f);
+    badEnd += end != s.c_str() + s.size();
+  }
+  printf("    %d values from -99.99 to 999.99\n", n);
+  check(badFixed == 0, "fmtFixed() differs from printf() on %d", badFixed);
+  check(badFloat == 0 && badField == 0, "fmtFloat() differs from printf() on %d and %d", badFloat, badField);
+  check(badScan == 0 && badEnd == 0, "scanFloat() differs from strtof() on %d, end wrong on %d", badScan, badEnd);
+}
+
+// Random floats whose scaled value fits in 32 bits, every precision.
+// value*10^prec is exact in a long double, so ties, which floatScaled()
+// rounds up and printf() to even, are checked against that instead.
+static void testRandom() {
+  std::mt19937 rng(47);
+  int n = 0, ties = 0, bad = 0, badScaled = 0;
+  for (int i = 0; i < 2000000; i++) {
+    uint8_t prec = i % 10;
+    uint32_t bits = rng();
+    float f;
+    memcpy(&f, &bits, sizeof f);
+    if (i & 1) f = ldexpf((float)(bits & 0xFFFFFF), -(int)(rng() % 40));   // mostly small magnitudes
+    if (!isfinite(f)) continue;
+    long double x = fabsl((long double)f * powl(10, prec));
+    if (x >= 4294967295.5L) continue;
+    n++;
+    bool tie = x - floorl(x) == 0.5L;
+    uint32_t want = tie ? (uint32_t)floorl(x) + 1 : (uint32_t)llrintl(x);
+    uint32_t got;
+    if (!floatScaled(f, prec, &got) || got != want) {
+      if (badScaled++ < 3) printf("    floatScaled(%.9g, %u) gave %u, want %u\n", f, prec, got, want);
+    }
+    ties += tie;
+    if (!tie && flt(f, prec) != printed(f, prec) && bad++ < 3) {
+      printf("    fmtFloat(%.9g, %u) gave %s, printf %s\n", f, prec, out, printed(f, prec).c_str());
+    }
+  }
+  printf("    %d random floats at 0 to 9 decimals, %d ties\n", n, ties);
+  check(badScaled == 0, "floatScaled() differs from the exact rounding on %d", badScaled);
+  check(bad == 0, "fmtFloat() differs from printf() on %d", bad);
+  uint32_t got = 1;
+  check(floatScaled(4294967040.0f, 0, &got) && got == 4294967040U, "largest float below 2^32: %u", got);
+  check(!floatScaled(4294967296.0f, 0, &got) && !floatScaled(42949676.0f, 2, &got), "2^32 and more refused");
+  check(floatScaled(1e-30f, 9, &got) && got == 0 && floatScaled(1e-45f, 9, &got) && got == 0, "tiny values are 0");
+  check(!floatScaled(INFINITY, 2, &got) && !floatScaled(NAN, 2, &got), "inf and nan refused");
+}
+
+// Per call times, over the values of the sweep.
+static void testSpeed() {
+  const int reps = 20;
+  std::vector<float> values;
+  std::vector<std::string> strings;
+  for (int32_t k = -9999; k <= 99999; k += 7) {
+    strings.push_back(printed(k / 100.0, 2));
+    values.push_back(strtof(strings.back().c_str(), NULL));
+  }
+  double ns[5] = {0, 0, 0, 0, 0};
+  volatile unsigned sink = 0;
+  char s[40];
+  for (int rep = 0; rep < reps; rep++) {
+    double t0 = hostNs();
+    for (size_t i = 0; i < values.size(); i++) sink += *fmtFixed(i * 7 - 9999, out + sizeof out - 1, 2);
+    double t1 = hostNs();
+    for (float v : values) sink += *fmtFloat(v, out + sizeof out - 1, 2);
+    double t2 = hostNs();
+    for (float v : values) sink += snprintf(s, sizeof s, "%.2f", v);
+    double t3 = hostNs();
+    for (auto &str : strings) sink += scanFloat(str.c_str(), NULL) > 0;
+    double t4 = hostNs();
+    for (auto &str : strings) sink += strtof(str.c_str(), NULL) > 0;
+    double t5 = hostNs();
+    ns[0] += t1 - t0;
+    ns[1] += t2 - t1;
+    ns[2] += t3 - t2;
+    ns[3] += t4 - t3;
+    ns[4] += t5 - t4;
+  }
+  double per = (double)reps * values.size();
+  printf("    host ns a call: fmtFixed %.1f, fmtFloat %.1f, snprintf %.1f; scanFloat %.1f, strtof %.1f\n",
+         ns[0] / per, ns[1] / per, ns[2] / per, ns[3] / per, ns[4] / per);
+  check(ns[1] < ns[2], "fmtFloat() faster than snprintf()");
+}
+
+int main() {
+  testSweep();
+  testRandom();
+  testSpeed();
+  return simFailures;
+}
@@ -0,0 +1,158 @@
+// The SdFat_format example run on a blank 2 MB NOR flash: f_mkfs() from
+// its copy of FatFs, then the layout it prints. The volume is mounted
+// through a model of the Adafruit_SPIFlash write cache, which holds one
+// 4 KB erase sector and erases it when another is written or on sync. In
+// the erase aligned mode the FAT, root directory, data and every cluster
+// must start on an erase sector. Writing and syncing a file a cluster at
+// a time must cost the erases the example reports, and never erase the
+// boot sector.
+// CONFIGS: -DERASE_ALIGNED=1
+// CONFIGS: -DERASE_ALIGNED=0
+#include "hosttest.h"
+#include <string>
+#include <vector>
+
+#include "../../../libraries/Adafruit_SPIFlash/examples/SdFat_format/ff.h"
+#include "../../../libraries/Adafruit_SPIFlash/examples/SdFat_format/diskio.h"
+// The sketch's flash and fatfs would clash with the firmware's. The
+// prototypes are the ones the Arduino build makes for it.
+namespace sketch {
+void printBlock(const char *name, uint32_t block);
+void printLayout();
+#include "../../../libraries/Adafruit_SPIFlash/examples/SdFat_format/SdFat_format.ino"
+}
+#include "../../../libraries/Adafruit_SPIFlash/examples/SdFat_format/ff.c"
+
+const uint32_t eraseBlocks = SFLASH_SECTOR_SIZE / 512;
+
+// The flash with Adafruit_FlashCache's one sector write cache, counting
+// the erases of each sector.
+struct NorFlash : public Adafruit_SPIFlash {
+  static const uint32_t NONE = 0xFFFFFFFF;
+  uint32_t cached = NONE;
+  uint8_t buf[SFLASH_SECTOR_SIZE];
+  std::vector<unsigned long> erases = std::vector<unsigned long>(4096 / eraseBlocks);
+  NorFlash() : Adafruit_SPIFlash(NULL) {}
+  bool readBlocks(uint32_t b, uint8_t *dst, size_t n) {
+    for (; n; n--, b++, dst += 512) {
+      if (b / eraseBlocks == cached) memcpy(dst, buf + 512 * (b % eraseBlocks), 512);
+      else if (!Adafruit_SPIFlash::readBlocks(b, dst, 1)) return false;
+    }
+    return true;
+  }
+  bool writeBlocks(uint32_t b, const uint8_t *src, size_t n) {
+    for (; n; n--, b++, src += 512) {
+      if (b / eraseBlocks != cached) {
+        syncBlocks();
+        cached = b / eraseBlocks;
+        memcpy(buf, simFlash + SFLASH_SECTOR_SIZE * cached, SFLASH_SECTOR_SIZE);
+      }
+      memcpy(buf + 512 * (b % eraseBlocks), src, 512);
+    }
+    return true;
+  }
+  bool syncBlocks() {
+    if (cached == NONE) return true;
+    erases[cached]++;
+    memcpy(simFlash + SFLASH_SECTOR_SIZE * cached, buf, SFLASH_SECTOR_SIZE);
+    cached = NONE;
+    return true;
+  }
+};
+
+static NorFlash nor;
+static FatFileSystem fs;
+
+// The number after what in the report, or -1.
+static double reported(const std::string &report, const char *what) {
+  size_t at = report.find(what);
+  return at == std::string::npos ? -1 : atof(report.c_str() + at + strlen(what));
+}
+
+static bool says(const std::string &report, const char *name, uint32_t block) {
+  char s[80];
+  snprintf(s, sizeof s, "%s block %u, %s\r\n", name, block, block % eraseBlocks ? "not erase aligned" : "erase aligned");
+  return report.find(s) != std::string::npos;
+}
+
+static std::string format() {
+  simFlashFormat(4096);
+  memset(simFlash, 0xFF, 512 * simFlashBlocks);   // a blank chip
+  Serial.out.clear();
+  Serial.in = "OK\n";
+  sketch::setup();
+  if (simVerbose) printf("%s", Serial.out.c_str());
+  check(Serial.out.find("successfully formatted") != std::string::npos, "the example formats the flash");
+  return Serial.out;
+}
+
+// The layout on the volume against the alignment asked for and the report.
+static void testLayout(const std::string &report) {
+  check(fs.begin(&nor), "mounts");
+  uint32_t bpc = fs.blocksPerCluster();
+  printf("    FAT%d, %u clusters of %u bytes: FAT at block %u, root directory %u, data %u\n", fs.fatType(),
+         fs.clusterCount(), 512 * bpc, fs.fatStartBlock(), fs.rootDirStart(), fs.dataStartBlock());
+  check(fs.fatType() == 12, "the 2 MB flash is FAT12");
+  check(fs.fatStartBlock() % eraseBlocks == 0, "the FAT starts on an erase sector, not in the boot sector's");
+  if (ERASE_ALIGNED) {
+    check(512 * bpc == SFLASH_SECTOR_SIZE, "clusters are %u bytes", 512 * bpc);
+    check(fs.rootDirStart() % eraseBlocks == 0 && fs.dataStartBlock() % eraseBlocks == 0,
+          "root directory and data start on erase sectors");
+    bool all = true;
+    for (uint32_t c = 2; c <= fs.m_lastCluster; c++) all = all && fs.clusterFirstBlock(c) % eraseBlocks == 0;
+    check(all, "all %u clusters start on an erase sector", fs.clusterCount());
+  }
+  check(says(report, "FAT start", fs.fatStartBlock()) && says(report, "Root directory", fs.rootDirStart()) &&
+        says(report, "Data start", fs.dataStartBlock()), "the report gives the layout");
+}
+
+// A file written and synced a cluster at a time, as the logs grow, once
+// its directory entry and first cluster exist.
+static void testErases(const std::string &report) {
+  const uint32_t bytes = 512 * fs.blocksPerCluster();
+  const int clusters = 64;
+  std::vector<uint8_t> data(bytes * clusters);
+  for (size_t i = 0; i < data.size(); i++) data[i] = i * 7 + i / 511;
+  FatFile f;
+  check(f.open(fs.vwd(), "log.bin", O_RDWR | O_CREAT) && f.write(data.data(), bytes) == (int)bytes && f.sync(),
+        "log.bin written");
+  nor.syncBlocks();
+  std::vector<unsigned long> e0 = nor.erases;
+  bool ok = true;
+  for (int i = 1; i < clusters; i++) ok = ok && f.write(data.data() + i * bytes, bytes) == (int)bytes && f.sync();
+  nor.syncBlocks();
+  check(ok && f.close(), "%d clusters written", clusters - 1);
+
+  // Count the erases by region.
+  unsigned long boot = 0, fat = 0, dir = 0, dat = 0, total = 0;
+  for (uint32_t s = 0; s < nor.erases.size(); s++) {
+    unsigned long n = nor.erases[s] - e0[s];
+    uint32_t b = s * eraseBlocks;
+    total += n;
+    if (s == 0) boot += n;
+    if (b + eraseBlocks > fs.fatStartBlock() && b < fs.rootDirStart()) fat += n;
+    if (b + eraseBlocks > fs.rootDirStart() && b < fs.dataStartBlock()) dir += n;
+    if (b + eraseBlocks > fs.dataStartBlock()) dat += n;
+  }
+  double each = (double)total / (clusters - 1), expect = reported(report, "Expected erases per cluster write: ");
+  double per4k = each * SFLASH_SECTOR_SIZE / bytes, expect4k = reported(report, "Expected erases per 4 KB written: ");
+  printf("    %d cluster writes: %.2f erases each (%lu data, %lu FAT, %lu directory, %lu boot), %.1f per 4 KB;"
+         " reported %.0f and %.1f\n", clusters - 1, each, dat, fat, dir, boot, per4k, expect, expect4k);
+  check(expect > 0 && expect4k > 0, "the report gives the expected erases");
+  check(each <= expect && (!ERASE_ALIGNED || each == expect), "%.2f erases per cluster write, %.0f reported", each,
+        expect);
+  check(per4k <= expect4k + 0.05, "%.1f erases per 4 KB, %.1f reported", per4k, expect4k);
+  check(boot == 0, "boot sector erased %lu times", boot);
+
+  std::vector<uint8_t> back(data.size());
+  check(f.open(fs.vwd(), "log.bin", O_RDONLY) && f.read(back.data(), back.size()) == (int)back.size() &&
+        back == data, "log.bin reads back");
+  f.close();
+}
+
+int main() {
+  std::string report = format();
+  testLayout(report);
+  testErases(report);
+  return simFailures;
+}
@@ -0,0 +1,238 @@
+// The free cluster bitmap (setFreeClusterBitmap(), freeMapUpdate()) behind
+// allocateCluster() and freeClusterCount(): the bitmap agreeing with a walk
+// of the whole FAT and with the count scanned without it through random
+// chain creates, extends, truncations and deletes, allocation picking the
+// same clusters as the FAT scan, and the mount and allocation cost with and
+// without it on the 2 MB (FAT12) and an 8 MB (FAT16) volume, in host time
+// and blocks read from the simulated flash. The first build has the
+// separate FAT cache of an ARM build.
+// CONFIGS: -DUSE_FREE_CLUSTER_BITMAP=1 -DUSE_SEPARATE_FAT_CACHE=1
+// CONFIGS: -DUSE_FREE_CLUSTER_BITMAP=1
+#include "hosttest.h"
+#include <random>
+#include <vector>
+
+// The flash stub counting the blocks read.
+struct CountingFlash : public Adafruit_SPIFlash {
+  unsigned long reads = 0;
+  CountingFlash() : Adafruit_SPIFlash(NULL) {}
+  bool readBlocks(uint32_t b, uint8_t *dst, size_t n) {
+    reads += n;
+    return Adafruit_SPIFlash::readBlocks(b, dst, n);
+  }
+};
+
+static CountingFlash drv;
+static FatFileSystem fs;
+
+// simFlashFormat() with FAT entries 0 and 1 reserved, as a formatter
+// leaves them, so the FAT16 count scanned from entry 0 has no extra two.
+// The last volume's dirty blocks are written out first: begin() syncs
+// the cache, which would put them on the new image.
+static void format(uint32_t blocks) {
+  if (fs.fatType()) fs.cacheSync();
+  simFlashFormat(blocks);
+  static const uint8_t fat12[] = {0xF8, 0xFF, 0xFF}, fat16[] = {0xF8, 0xFF, 0xFF, 0xFF};
+  if (blocks < 8192) memcpy(simFlash + 512, fat12, sizeof fat12);
+  else memcpy(simFlash + 512, fat16, sizeof fat16);
+}
+
+static uint32_t mapWords() { return (fs.clusterCount() + 33) / 32; }
+
+static bool freeBit(const uint32_t *map, uint32_t c) { return map[c >> 5] >> (c & 31) & 1; }
+
+// The bitmap against a walk of every FAT entry, its count against the
+// bits and the count scanned with the bitmap off, and a bitmap built
+// from the FAT against the one kept up to date. Leaves map attached.
+static bool verify(std::vector<uint32_t> &map, uint32_t used, const char *when) {
+  uint32_t wrong = 0, bits = 0, walked = 0;
+  for (uint32_t c = 2; c <= fs.m_lastCluster; c++) {
+    uint32_t v;
+    bool free = fs.fatGet(c, &v) == 1 && v == 0;
+    walked += free;
+    bits += freeBit(map.data(), c);
+    wrong += free != freeBit(map.data(), c);
+  }
+  uint32_t counted = fs.freeClusterCount();
+  check(fs.setFreeClusterBitmap(NULL, 0) == false && fs.m_freeMap == NULL, "bitmap detached");
+  uint32_t scanned = fs.freeClusterCount();
+  std::vector<uint32_t> built(map.size());
+  bool rebuilt = fs.setFreeClusterBitmap(built.data(), built.size()) && built == map;
+  fs.setFreeClusterBitmap(map.data(), map.size());
+  bool ok = check(wrong == 0, "%s: %u clusters where the bitmap and FAT differ", when, wrong);
+  ok &= check(bits == walked && counted == walked && scanned == walked,
+              "%s: %u free in the FAT, %u bits, count %u, %u scanned without the bitmap", when, walked, bits,
+              counted, scanned);
+  ok &= check(walked + used == fs.clusterCount(), "%s: %u free and %u in chains of %u", when, walked, used,
+              fs.clusterCount());
+  ok &= check(rebuilt, "%s: bitmap rebuilt from the FAT matches", when);
+  return ok;
+}
+
+// Random chain changes: two new chains, one extended, one cut short and
+// one deleted in five, through the FatVolume calls FatFile uses. Records every cluster
+// allocated in order. Checks the bitmap every 200 changes if map is given.
+static std::vector<uint32_t> churn(uint32_t seed, int ops, std::vector<uint32_t> *map, const char *name) {
+  std::mt19937 rng(seed);
+  std::vector<std::vector<uint32_t>> chains;
+  std::vector<uint32_t> got;
+  uint32_t used = 0;
+  int failed = 0, full = 0, checks = 0;
+  bool ok = true;
+  for (int i = 1; i <= ops; i++) {
+    int op = rng() % 5;
+    size_t k = chains.empty() ? 0 : rng() % chains.size();
+    if (chains.empty()) op = 0;
+    if (op < 3) {
+      // Grow a new chain or an old one by up to 1/50 of the volume, so it
+      // fills after a few hundred changes and then stays nearly full.
+      if (op < 2) chains.push_back(std::vector<uint32_t>()), k = chains.size() - 1;
+      std::vector<uint32_t> &ch = chains[k];
+      for (int n = rng() % (fs.clusterCount() / 50) + 1; n > 0; n--) {
+        uint32_t c;
+        if (!fs.allocateCluster(ch.empty() ? 0 : ch.back(), &c)) {
+          full++;
+          break;
+        }
+        ch.push_back(c);
+        got.push_back(c);
+        used++;
+      }
+      if (ch.empty()) chains.erase(chains.begin() + k);
+    } else if (op == 3 && chains[k].size() > 1) {
+      std::vector<uint32_t> &ch = chains[k];
+      size_t keep = rng() % (ch.size() - 1) + 1;
+      failed += !fs.fatPutEOC(ch[keep - 1]) || !fs.freeChain(ch[keep]);
+      used -= ch.size() - keep;
+      ch.resize(keep);
+    } else if (op == 4) {
+      failed += !fs.freeChain(chains[k][0]);
+      used -= chains[k].size();
+      chains.erase(chains.begin() + k);
+    }
+    if (map && i % 200 == 0) {
+      char when[48];
+      snprintf(when, sizeof when, "%s after %d changes", name, i);
+      ok = ok && verify(*map, used, when);
+      checks++;
+    }
+  }
+  check(failed == 0, "%s: %d frees failed", name, failed);
+  if (map) {
+    printf("    %s: %d changes, %zu clusters allocated, %d allocations found it full, %d checks %s\n", name, ops,
+           got.size(), full, checks, ok ? "passed" : "FAILED");
+    check(full > 0, "%s: the volume filled up", name);
+  }
+  return got;
+}
+
+// Consistency, then the same changes from the same empty volume with the
+// bitmap and without, which should allocate the same clusters.
+static void testChurn(uint32_t blocks, const char *name) {
+  format(blocks);
+  check(fs.begin(&drv), "%s mounts", name);
+  std::vector<uint32_t> map(mapWords());
+  check(fs.setFreeClusterBitmap(map.data(), map.size()), "%s bitmap attached", name);
+  check(fs.setFreeClusterBitmap(map.data(), map.size() - 2) == false, "%s refuses a short bitmap", name);
+  fs.setFreeClusterBitmap(map.data(), map.size());
+  check(verify(map, 0, name), "%s empty", name);
+  churn(blocks, 3000, &map, name);
+
+  format(blocks);
+  fs.begin(&drv);
+  fs.setFreeClusterBitmap(map.data(), map.size());
+  std::vector<uint32_t> with = churn(blocks + 1, 1500, NULL, name);
+  format(blocks);
+  fs.begin(&drv);
+  std::vector<uint32_t> without = churn(blocks + 1, 1500, NULL, name);
+  check(with == without, "%s: %zu clusters allocated with the bitmap, %zu the same without", name, with.size(),
+        without.size());
+}
+
+// A volume with the first nine tenths in use and every fourth cluster of
+// the rest free, so the first allocation after mounting searches past
+// most of the FAT, as appending to a log on a nearly full flash does.
+static uint32_t fragment() {
+  uint32_t last = fs.m_lastCluster, start = 2 + fs.clusterCount() * 9 / 10, prev = 0, free = 0;
+  for (uint32_t c = 2; c <= last; c++) {
+    if (c >= start && c % 4 == 0) {
+      free++;
+      continue;
+    }
+    if (prev) fs.fatPut(prev, c);
+    prev = c;
+  }
+  fs.fatPutEOC(prev);
+  fs.cacheSync();
+  return free;
+}
+
+// Mount, the free count and allocation, each with and without the bitmap.
+static void testCost(uint32_t blocks, const char *name) {
+  const int reps = 20;
+  std::vector<uint32_t> map(16384 / 32 + 1);
+  format(blocks);
+  fs.begin(&drv);
+  const int holes = fragment(), allocs = holes / 2;
+  double mountNs = 0, buildNs = 0, countNs[2] = {0, 0}, firstNs[2] = {0, 0}, allocNs[2] = {0, 0};
+  double buildReads = 0, countReads[2] = {0, 0}, firstReads[2] = {0, 0}, allocReads[2] = {0, 0};
+  uint32_t count[2] = {0, 0}, first[2] = {0, 0};
+  int failed = 0;
+  std::vector<uint8_t> image(simFlash, simFlash + 512 * blocks);
+  for (int rep = 0; rep < reps; rep++) {
+    for (int use = 0; use < 2; use++) {
+      fs.cacheSync();
+      memcpy(simFlash, image.data(), image.size());
+      double t0 = hostNs();
+      fs.begin(&drv);
+      mountNs += hostNs() - t0;
+      unsigned long r0 = drv.reads;
+      t0 = hostNs();
+      if (use) {
+        fs.setFreeClusterBitmap(map.data(), mapWords());
+        buildNs += hostNs() - t0;
+        buildReads += drv.reads - r0;
+        r0 = drv.reads;
+        t0 = hostNs();
+      }
+      count[use] = fs.freeClusterCount();
+      countNs[use] += hostNs() - t0;
+      countReads[use] += drv.reads - r0;
+      r0 = drv.reads;
+      t0 = hostNs();
+      fs.allocateCluster(0, &first[use]);
+      firstNs[use] += hostNs() - t0;
+      firstReads[use] += drv.reads - r0;
+      // New one cluster files, as the logs are opened, through the holes.
+      r0 = drv.reads;
+      t0 = hostNs();
+      for (int i = 0; i < allocs; i++) {
+        uint32_t c;
+        failed += !fs.allocateCluster(0, &c);
+      }
+      allocNs[use] += hostNs() - t0;
+      allocReads[use] += drv.reads - r0;
+    }
+  }
+  fs.setFreeClusterBitmap(NULL, 0);
+  printf("    %s, %u clusters, %d free in holes: mount %.0f us, bitmap build %.0f us %.0f blocks read\n", name,
+         fs.clusterCount(), holes, mountNs / (2 * reps) / 1000, buildNs / reps / 1000, buildReads / reps);
+  printf("      free count %.1f -> %.2f us, %.0f -> %.0f blocks; first allocation %.2f -> %.2f us, %.1f -> %.1f"
+         " blocks; then %.3f -> %.3f us, %.3f -> %.3f blocks each\n", countNs[0] / reps / 1000,
+         countNs[1] / reps / 1000, countReads[0] / reps, countReads[1] / reps, firstNs[0] / reps / 1000,
+         firstNs[1] / reps / 1000, firstReads[0] / reps, firstReads[1] / reps, allocNs[0] / reps / allocs / 1000,
+         allocNs[1] / reps / allocs / 1000, allocReads[0] / reps / allocs, allocReads[1] / reps / allocs);
+  check(count[0] == count[1] && first[0] == first[1], "%s: same count %u and first cluster %u both ways", name,
+        count[1], first[1]);
+  check(failed == 0, "%s: %d allocations failed", name, failed);
+  check(countReads[1] == 0 && firstReads[1] == reps && allocReads[1] <= allocReads[0],
+        "%s: with the bitmap the count reads no blocks and allocation only the entry it writes", name);
+}
+
+int main() {
+  testChurn(4096, "2 MB FAT12");
+  testChurn(16384, "8 MB FAT16");
+  testCost(4096, "2 MB FAT12");
+  testCost(16384, "8 MB FAT16");
+  return simFailures;
+}
@@ -0,0 +1,110 @@
+// Leak conductance estimate v_leakK, leak flow v_ql and leak compensation
+// of the breath volumes, against a simulated patient with a known leak.
+#include "lung.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+static Lung lung;
+
+struct Breath {
+  double vIn, vOut, leak;  // true volumes [ml] and mean leak flow [l/min]
+  double v, ve, ql, k;     // the ventilator's v_v, v_ve, v_ql and v_leakK
+};
+
+// Breathe for ms with run() every 10 ms from the sample timer, and return
+// the true and reported values for each complete breath.
+static std::vector<Breath> breathe(unsigned long ms) {
+  std::vector<Breath> b;
+  unsigned long breaths = vent.v_breaths;
+  double in0 = lung.vIn, out0 = lung.vOut, leak0 = lung.vLeak;
+  uint64_t t0 = simMicros;
+  bool first = true;
+  lung.run(ms, 10000, [&]() {
+    if (vent.v_breaths == breaths) return;
+    breaths = vent.v_breaths;
+    if (!first)
+      b.push_back({lung.vIn - in0, lung.vOut - out0, (lung.vLeak - leak0) * 60. / ((simMicros - t0) / 1000.),
+                   vent.v_v, vent.v_ve, vent.v_ql, vent.v_leakK});
+    first = false;
+    in0 = lung.vIn;
+    out0 = lung.vOut;
+    leak0 = lung.vLeak;
+    t0 = simMicros;
+  });
+  return b;
+}
+
+static void start(double k, bool comp) {
+  lung.k = k;
+  lung.begin(vent);
+  vent.sampleTimer = true;
+  simEvery(SAMPLE_US, []() { vent.sampleTick(); });
+  vent.v_leakK = 0.0;
+  vent.p_leakComp = comp;
+}
+
+static void testNoLeak() {
+  start(0.0, true);
+  breathe(60000);
+  check(vent.v_leakK < 0.01, "no leak estimated as %.4f l/min / cm H2O", vent.v_leakK);
+}
+
+// Estimate, then compensate: the leak shows up as inspired volume that never
+// comes back until it is taken out sample by sample.
+static void testLeak(double k) {
+  start(k, false);
+  std::vector<Breath> b = breathe(60000);
+  const Breath &u = b.back();
+  printf("    leak %.2f l/min / cm H2O, not compensated: v_leakK %.3f, v_ql %.2f true %.2f l/min,"
+         " v_v %.0f true %.0f ml\n", k, u.k, u.ql, u.leak, u.v, u.vIn);
+  check(fabs(u.k - k) < 0.05 * k, "leak %.2f estimated as %.3f", k, u.k);
+  check(fabs(u.ql - u.leak) < 0.05 * u.leak, "leak flow %.2f reported as %.2f l/min", u.leak, u.ql);
+  check(u.v > u.vIn * 1.05, "uncompensated v_v %.0f includes the leak, true %.0f ml", u.v, u.vIn);
+
+  vent.p_leakComp = true;
+  b = breathe(30000);
+  double worst = 0;
+  for (size_t i = 1; i < b.size(); i++)  // the first breath straddles the switch
+    worst = max(worst, max(fabs(b[i].v - b[i].vIn) / b[i].vIn, fabs(b[i].ve - b[i].vOut) / b[i].vOut));
+  const Breath &c = b.back();
+  printf("    leak %.2f l/min / cm H2O, compensated: v_leakK %.3f, v_ql %.2f true %.2f l/min,"
+         " v_v %.0f true %.0f ml, v_ve %.0f true %.0f ml\n", k, c.k, c.ql, c.leak, c.v, c.vIn, c.ve, c.vOut);
+  check(worst < 0.01, "compensated volumes within %.1f%% of the patient's", worst * 100);
+  check(fabs(c.k - k) < 0.05 * k, "estimate holds at %.3f with compensation on", c.k);
+}
+
+// A leak that opens up mid run, e.g. a mask shifting.
+static void testStep() {
+  start(0.2, true);
+  breathe(60000);
+  lung.k = 0.8;
+  std::vector<Breath> b = breathe(60000);
+  int n = 0;
+  while (n < (int)b.size() && fabs(b[n].k - 0.8) > 0.1 * 0.8) n++;
+  printf("    leak 0.2 to 0.8 l/min / cm H2O: within 10%% after %d breaths\n", n + 1);
+  check(n + 1 <= 12, "stepped leak tracked within 10%% in %d breaths", n + 1);
+  check(fabs(b.back().k - 0.8) < 0.04, "stepped leak settles at %.3f", b.back().k);
+}
+
+// The line for the display unit keeps the 22 fields it has always had, and
+// the leak flow is reported by the L command instead.
+static void testOutput() {
+  simAdvance((OUTPUT_INTERVAL + 1) * 1000);
+  vent.publishSnapshot();
+  Serial.out.clear();
+  vent.loopOut();
+  std::string line = Serial.out;
+  check(std::count(line.begin(), line.end(), ',') == 21, "display line has %d fields",
+        (int)std::count(line.begin(), line.end(), ',') + 1);
+  Serial.out.clear();
+  simCommand(vent, "L");
+  check(Serial.out.find("last breath leak") != std::string::npos, "L reports the leak flow");
+}
+
+int main() {
+  testNoLeak();
+  testLeak(0.3);
+  testLeak(1.0);
+  testStep();
+  testOutput();
+  return simFailures;
+}
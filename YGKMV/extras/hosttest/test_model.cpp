@@ -0,0 +1,127 @@
+// Sensors and valves picked at compile time by YGKMV_MODEL: each model reads
+// only its own sensors and drives only its own servos, with the cost per
+// sample and of getP() and getQ() for each build. The ventilator stays
+// stopped if the sketch or the calibration file names another model.
+// CONFIGS: -DYGKMV_MODEL=0
+// CONFIGS: -DYGKMV_MODEL=2
+// CONFIGS: -DYGKMV_MODEL=3
+#include "hosttest.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+static void setup() {
+  simFlashFormat();
+  simVolts = [](uint8_t pin) {
+    if (pin == vent.aPins[PATIENT]) return 1.5;
+    if (pin == vent.aPins[CPAP]) return 1.0;
+    if (pin == vent.aPins[PEEP]) return 0.7;
+    return 0.0;
+  };
+  Serial.out.clear();
+  vent.begin();
+  check(Serial.out.find("ERROR") == std::string::npos, "model %d starts without a model error", YGKMV_MODEL);
+  for (int i : {PATIENT, CPAP, PEEP}) vent.offset[i] = 0.5;
+  vent.scale[PATIENT] = 20.0;
+  vent.scale[CPAP] = vent.scale[PEEP] = 100.0;
+  vent.buildCalTables();
+}
+
+static void testSensors() {
+  unsigned long reads = simAdcReads;
+  vent.sampleTick();
+  int expect = (ygkmv_model::pSource != YGKMV_P_NONE) + (ygkmv_model::qSource != YGKMV_Q_NONE) +
+               (ygkmv_model::qSource == YGKMV_Q_CAP2);
+  check(simAdcReads - reads == (unsigned long)expect, "model %d reads %lu channels per sample", YGKMV_MODEL,
+        simAdcReads - reads);
+  for (int i = 0; i < 50; i++) {
+    simAdvance(2000);
+    vent.loopSamples();
+  }
+  double p = vent.getP(), q = vent.getQ();
+  double pWant = 0, qWant = 0;
+  if (YGKMV_MODEL == 2) {
+    pWant = 20.0;
+    qWant = sqrt(50.0) * VENTURI_QSCALE;  // venturi law
+  } else if (YGKMV_MODEL == 3) {
+    pWant = 20.0;
+    qWant = 50.0 - 20.0;  // CPAP less PEEP
+  }
+  check(fabs(p - pWant) < 0.05, "model %d getP() %.3f, expected %.3f", YGKMV_MODEL, p, pWant);
+  check(fabs(q - qWant) < 0.01 * qWant + 0.05, "model %d getQ() %.3f, expected %.3f", YGKMV_MODEL, q, qWant);
+}
+
+static void testServos() {
+  const char *names[] = {"CPAP", "PEEP", "Dual"};
+  unsigned long w[3];
+  for (int i = 0; i < 3; i++) w[i] = vent.servos[i]->writes;
+  vent.resetServos();
+  vent.writeServos(30, 60, 120);
+  for (int i = 0; i < 3; i++) {
+    bool fitted = ygkmv_model::servos & (1 << i);
+    check(vent.servos[i]->attached() == fitted && (vent.servos[i]->writes > w[i]) == fitted,
+          "model %d %s servo %s", YGKMV_MODEL, names[i], fitted ? "attached and written" : "left alone");
+  }
+}
+
+// Host time to process one queued sample, and for getP() and getQ().
+static void benchmark() {
+  const int N = 200000;
+  vent.sampleTimer = true;  // loopSamples() only drains the ring
+  double tSample = 0;
+  for (int i = 0; i < N; i += SAMPLE_QUEUE / 2) {
+    for (int j = 0; j < SAMPLE_QUEUE / 2; j++) {
+      volatile ygkmv_sample_t *s = &vent.sampleRing[vent.sampleHead & (SAMPLE_QUEUE - 1)];
+      s->t = micros() + j * SAMPLE_US;
+      s->a[CPAP] = 20000 + j;
+      s->a[PEEP] = 14000 + j;
+      s->a[PATIENT] = 30000 + j;
+      vent.sampleHead = vent.sampleHead + 1;
+    }
+    simAdvance(SAMPLE_QUEUE / 2 * SAMPLE_US);
+    double t0 = hostNs();
+    vent.loopSamples();
+    tSample += hostNs() - t0;
+  }
+  volatile double sink = 0;
+  double t0 = hostNs();
+  for (int i = 0; i < N; i++) sink = sink + vent.getP() + vent.getQ();
+  double tGet = (hostNs() - t0) / N;
+  printf("    model %d: %.1f ns per sample in loopSamples(), %.1f ns for getP() and getQ()\n", YGKMV_MODEL,
+         tSample / N, tGet);
+  check(vent.sampleDropped == 0, "no samples dropped while benchmarking");
+}
+
+// A model number that doesn't match keeps it stopped, through the R command
+// and the automatic return to run mode, until M puts it right.
+static void testMismatch() {
+  const int other = YGKMV_MODEL == 3 ? 2 : 3;
+  simCommand(vent, "X");
+  simCommand(vent, ("M" + std::to_string(other)).c_str());
+  check(!vent.modelMatches(), "model number %d doesn't match", other);
+  Serial.out.clear();
+  simCommand(vent, "R");
+  check(vent.p_stopped && Serial.out.find("Refused") != std::string::npos, "R refused for model number %d", other);
+  vent.v_patientSet = true;
+  simAdvance(max(0L, (long)ALARM_HOLIDAY - (long)millis() + 10) * 1000);
+  vent.run();
+  check(vent.p_stopped, "stays stopped with a patient after ALARM_HOLIDAY");
+  if (YGKMV_MODEL > 0) simCommand(vent, ("M" + std::to_string(YGKMV_MODEL)).c_str());
+  else vent.p_modelNumber = YGKMV_MODEL;   // M only takes 1 to 99
+  vent.run();
+  check(!vent.p_stopped, "runs once M %d puts the model number right", YGKMV_MODEL);
+
+  simCommand(vent, "X");
+  vent.modelAsked = other;
+  vent.setRun();
+  check(vent.p_stopped, "stays stopped when the sketch asks for model %d", other);
+  vent.modelAsked = YGKMV_MODEL;
+}
+
+int main() {
+  setup();
+  testSensors();
+  testServos();
+  benchmark();
+  testMismatch();
+  return simFailures;
+}
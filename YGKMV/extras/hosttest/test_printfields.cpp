@@ -0,0 +1,217 @@
+// The calibration and patient files written by writeCalFlash() and
+// writePatFlash() with StdioStream::printFields(), against the sprintf()
+// and File::print() code they replaced, kept here as it was. For settings
+// at the decimals the files hold, the bytes must be the same apart from
+// the %7.2f padding the old code added and a -0.0 setting, now written as
+// 0.00 rather than -0.00. For arbitrary doubles, which
+// printFields() rounds as floats, any field that differs may only be one
+// in its last digit. Then the bytes written a microsecond both ways, the
+// console echo included.
+#include "hosttest.h"
+#include <random>
+#include <string>
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+extern FatFileSystem fatfs;
+
+// writeCalFlash() before printFields().
+static int oldWriteCalFlash() {
+  vent.delCalFlash();
+  File writeFile = fatfs.open("/vent/cal.txt", FILE_WRITE);
+  if (!writeFile) return -8;
+  char sc[MAX_COMMAND_LENGTH] = {0};
+  sprintf(sc, "C%7.4f,%7.4f,%7.4f,%7.2f,%7.2f,%7.2f\n",
+    vent.offset[PATIENT], vent.offset[CPAP], vent.offset[PEEP],
+    vent.scale[PATIENT],  vent.scale[CPAP],  vent.scale[PEEP]);
+  writeFile.print(sc);
+  PR(sc);
+  for (int j = 0; j < 2; j++) {
+    int ch = j ? PEEP : CPAP;
+    sprintf(sc, "K%d,-1\n", ch + 1);
+    writeFile.print(sc);
+    PR(sc);
+    for (int i = 0; i < vent.calPts[j].n; i++) {
+      sprintf(sc, "K%d,%.4f,%.3f\n", ch + 1, vent.calPts[j].v[i], vent.calPts[j].q[i]);
+      writeFile.print(sc);
+      PR(sc);
+    }
+  }
+  sprintf(sc, "S%d,%d,%d,%d,%d,%d\n", vent.aMinCPAP, vent.aMaxCPAP, vent.aMinPEEP, vent.aMaxPEEP, vent.aCloseCPAP,
+          vent.aClosePEEP);
+  writeFile.print(sc);
+  PR(sc);
+  sprintf(sc, "V%d,%d,%d,%d\n", vent.slewProfile, vent.slewTime, vent.ieTime, vent.eiTime);
+  writeFile.print(sc);
+  PR(sc);
+  sprintf(sc, "M%d,%d\n", vent.p_modelNumber, vent.p_serialNumber);
+  writeFile.print(sc);
+  PR(sc);
+  writeFile.close();
+  return 0;
+}
+
+// writePatFlash() before printFields().
+static int oldWritePatFlash() {
+  vent.delPatFlash();
+  File writeFile = fatfs.open("/vent/patient.txt", FILE_WRITE);
+  if (!writeFile) return -8;
+  char sc[MAX_COMMAND_LENGTH] = {0};
+  sprintf(sc, "I%7.2f,%7.2f,%7.2f\n", vent.p_iph, vent.p_ipl, vent.p_iphTol);
+  writeFile.print(sc);
+  PR(sc);
+  sprintf(sc, "E%7.2f,%7.2f,%7.2f\n", vent.p_eph, vent.p_epl, vent.p_eplTol);
+  writeFile.print(sc);
+  PR(sc);
+  sprintf(sc, "i%d,%d,%d\n", vent.p_it, vent.p_ith, vent.p_itl);
+  writeFile.print(sc);
+  PR(sc);
+  sprintf(sc, "e%d,%d,%d\n", vent.p_et, vent.p_eth, vent.p_etl);
+  writeFile.print(sc);
+  PR(sc);
+  sprintf(sc, "T%d,%.2f,%.2f\n", vent.p_trigEnabled ? 1 : -1, vent.p_trigQ, vent.p_trigDQ);
+  writeFile.print(sc);
+  PR(sc);
+  sprintf(sc, "L%d\n", vent.p_leakComp ? 1 : -1);
+  writeFile.print(sc);
+  PR(sc);
+  writeFile.close();
+  return 0;
+}
+
+static std::string contents(const char *name) {
+  std::string s;
+  File f = fatfs.open(name, FILE_READ);
+  int c;
+  while ((c = f.read()) >= 0) s += (char)c;
+  f.close();
+  return s;
+}
+
+static std::string unpadded(std::string s) {
+  s.erase(std::remove(s.begin(), s.end(), ' '), s.end());
+  return s;
+}
+
+// A value in [lo, hi), at dec decimals if settings, else any double.
+static double value(std::mt19937 &rng, double lo, double hi, int dec, bool settings) {
+  double v = lo + (hi - lo) * (rng() / 4294967296.0);
+  if (!settings) return v;
+  double p = pow(10, dec);
+  return round(v * p) / p;
+}
+
+static void randomSettings(std::mt19937 &rng, bool settings) {
+  for (int c : {PATIENT, CPAP, PEEP}) {
+    vent.offset[c] = value(rng, -2, 2, 4, settings);
+    vent.scale[c] = value(rng, -50, 500, 2, settings);
+  }
+  for (int j = 0; j < 2; j++) {
+    vent.calPts[j].n = rng() % (CAL_POINTS + 1);
+    for (int i = 0; i < vent.calPts[j].n; i++) {
+      vent.calPts[j].v[i] = value(rng, 0, 3.3, 4, settings);
+      vent.calPts[j].q[i] = value(rng, -10, 120, 3, settings);
+    }
+  }
+  vent.aMinCPAP = rng() % 181;
+  vent.aClosePEEP = -(int)(rng() % 10);
+  vent.slewTime = rng() % 1000;
+  vent.p_serialNumber = YGKMV_MODEL * 10000000 + rng() % 10000000;
+  vent.p_iph = value(rng, 0, IP_MAX, 2, settings);
+  vent.p_ipl = value(rng, 0, 20, 2, settings);
+  vent.p_iphTol = value(rng, 0, 5, 2, settings);
+  vent.p_eph = value(rng, 0, EP_MAX, 2, settings);
+  vent.p_epl = value(rng, -5, 20, 2, settings);
+  vent.p_eplTol = value(rng, 0, 5, 2, settings);
+  vent.p_it = 500 + rng() % 3000;
+  vent.p_et = 500 + rng() % 5000;
+  vent.p_trigEnabled = rng() & 1;
+  vent.p_trigQ = value(rng, 0, 20, 2, settings);
+  vent.p_trigDQ = value(rng, 0, 100, 2, settings);
+  vent.p_leakComp = rng() & 1;
+}
+
+// Fields of two files that differ, by whether they read back the same
+// (-0.00 against 0.00), are one in the last digit apart, or neither.
+static void differences(const std::string &a, const std::string &b, int *zero, int *oneOff, int *wrong) {
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    size_t ie = a.find_first_of(",\n", i), je = b.find_first_of(",\n", j);
+    std::string fa = a.substr(i, ie - i), fb = b.substr(j, je - j);
+    if (fa != fb) {
+      size_t dot = fa.find('.');
+      double unit = dot == std::string::npos ? 1 : pow(10, -(double)(fa.size() - dot - 1));
+      size_t k = isalpha(fa[0]) ? 1 : 0;   // past the command letter
+      double va = atof(fa.c_str() + k), vb = atof(fb.c_str() + k);
+      if ((!k || fa[0] == fb[0]) && va == vb) {
+        (*zero)++;
+      } else if (fa.size() == fb.size() && fa[0] == fb[0] && fabs(va - vb) < 1.5 * unit) {
+        (*oneOff)++;
+      } else if ((*wrong)++ < 3) {
+        printf("    %s written as %s\n", fa.c_str(), fb.c_str());
+      }
+    }
+    i = ie + 1;
+    j = je + 1;
+  }
+  if (a.size() - i != b.size() - j) (*wrong)++;
+}
+
+static void testSame(bool settings) {
+  std::mt19937 rng(48 + settings);
+  int files = 0, same = 0, zero = 0, oneOff = 0, wrong = 0;
+  for (int rep = 0; rep < 2000; rep++) {
+    randomSettings(rng, settings);
+    for (int pat = 0; pat < 2; pat++) {
+      const char *name = pat ? "/vent/patient.txt" : "/vent/cal.txt";
+      Serial.out.clear();
+      if (pat ? oldWritePatFlash() : oldWriteCalFlash()) wrong++;
+      std::string old = unpadded(contents(name));
+      if (pat ? vent.writePatFlash() : vent.writeCalFlash()) wrong++;
+      std::string now = contents(name);
+      files++;
+      same += now == old;
+      if (now != old) differences(old, now, &zero, &oneOff, &wrong);
+      if (rep == 0 && simVerbose) printf("%s%s", old.c_str(), now.c_str());
+    }
+  }
+  const char *what = settings ? "settings at the file's decimals" : "arbitrary doubles";
+  printf("    %s: %d of %d files the same but for padding; %d fields -0 written as 0, %d one off in the last"
+         " digit\n", what, same, files, zero, oneOff);
+  check(wrong == 0, "%s: %d fields differ by more than one in the last digit", what, wrong);
+  if (settings) check(oneOff == 0, "%s: %d fields differ", what, oneOff);
+}
+
+// Bytes of file a microsecond, each way.
+static void testSpeed() {
+  std::mt19937 rng(1);
+  randomSettings(rng, true);
+  const int reps = 2000;
+  Serial.out.reserve(1 << 20);
+  for (int pat = 0; pat < 2; pat++) {
+    const char *name = pat ? "/vent/patient.txt" : "/vent/cal.txt";
+    double ns[2] = {0, 0};
+    size_t bytes[2] = {0, 0};
+    for (int rep = 0; rep < reps; rep++) {
+      for (int use = 0; use < 2; use++) {
+        Serial.out.clear();
+        double t0 = hostNs();
+        if (use) pat ? vent.writePatFlash() : vent.writeCalFlash();
+        else pat ? oldWritePatFlash() : oldWriteCalFlash();
+        ns[use] += hostNs() - t0;
+        if (!rep) bytes[use] = contents(name).size();
+      }
+    }
+    printf("    %s, %zu -> %zu bytes: sprintf %.1f B/us, printFields %.1f B/us, %.1f -> %.1f us a file\n", name,
+           bytes[0], bytes[1], bytes[0] * reps / (ns[0] / 1000), bytes[1] * reps / (ns[1] / 1000),
+           ns[0] / reps / 1000, ns[1] / reps / 1000);
+  }
+}
+
+int main() {
+  simFlashFormat();
+  vent.begin();
+  testSame(true);
+  testSame(false);
+  testSpeed();
+  return simFailures;
+}
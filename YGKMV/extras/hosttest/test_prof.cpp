@@ -0,0 +1,100 @@
+// run() section profiler: histograms, percentiles, the p command, the
+// cost of a profMark() probe and of the sample interrupt.
+#include "lung.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+static Lung lung;
+
+static std::string command(const char *line) {
+  Serial.out.clear();
+  simCommand(vent, line);
+  return Serial.out;
+}
+
+// Known section times: 900 passes of 100 us and 100 of 5000 us.
+static void testHistogram() {
+  vent.resetProfile();
+  for (int i = 0; i < 1000; i++) {
+    vent.profMark(PROF_OTHER);
+    simAdvance(i % 10 ? 100 : 5000);
+    vent.profMark(PROF_SENSE);
+  }
+  const ygkmv_prof_t &s = vent.prof[PROF_SENSE];
+  double mean = s.total / (double)s.count / PROF_TICKS_PER_US;
+  check(s.count == 1000, "section counted %lu times", s.count);
+  check(fabs(mean - 590) < 1, "section mean %.1f us, expected 590", mean);
+  check(s.max / PROF_TICKS_PER_US == 5000, "section max %lu us", s.max / PROF_TICKS_PER_US);
+  double p50 = vent.profPercentile(PROF_SENSE, 50), p99 = vent.profPercentile(PROF_SENSE, 99);
+  check(p50 >= 100 && p50 < 200, "p50 %.0f us bounds 100 us within a log2 bucket", p50);
+  check(p99 >= 5000 && p99 < 10000, "p99 %.0f us bounds 5000 us within a log2 bucket", p99);
+  unsigned long other = 0;
+  for (int b = 0; b < PROF_BUCKETS; b++) other += vent.prof[PROF_OTHER].hist[b];
+  check(other == 1000 && vent.prof[PROF_OTHER].max <= 1, "time between passes charged to other, %lu", other);
+}
+
+// Every section of a running ventilator shows up, and p-1 clears them.
+static void testCommand() {
+  lung.begin(vent);
+  lung.run(5000, 10000);
+  std::string out = command("p");
+  check(out.find("ACK run() section timing") == 0, "p is acknowledged");
+  const char *names[] = {"other", "flash", "console", "sense", "breath", "valves", "alarms", "out"};
+  for (int i = 0; i < PROF_SECTIONS; i++) {
+    check(vent.prof[i].count >= 400, "%s section timed %lu times in 5 s", names[i], vent.prof[i].count);
+    check(out.find(std::string("    ") + names[i]) != std::string::npos, "p lists %s", names[i]);
+  }
+  check(out.find("Probe overhead") != std::string::npos && out.find("loop() window") != std::string::npos,
+        "p shows the probe overhead and loop() window");
+  out = command("p-1");
+  bool clear = true;
+  for (int i = 0; i < PROF_SECTIONS; i++) clear = clear && vent.prof[i].count == 0;
+  check(clear && out.find("Profile reset") != std::string::npos, "p-1 clears every section");
+  check(vent.uno.dtStats.count() == 0, "p-1 clears the loop() statistics");
+}
+
+// Host time per probe, as a check that a probe is only a timer read and
+// a few integer operations. The target figure is in the p command output.
+static void testOverhead() {
+  const int N = 1000000;
+  double t0 = hostNs();
+  for (int i = 0; i < N; i++) vent.profMark(i & 7);
+  double ns = (hostNs() - t0) / N;
+  printf("    profMark() on the host: %.1f ns\n", ns);
+  check(ns < 100, "profMark() %.1f ns on the host", ns);
+}
+
+// setupSamples() times sampleTick() and stretches the timer interval so
+// the interrupt stays under 1 / SAMPLE_LOAD of the CPU, with the fast ADC
+// set up by the Adafruit core and with the slowest ADC clock.
+static void testSampleCost() {
+  for (unsigned long adc : {40UL, 430UL}) {
+    simAdcTime = adc;
+    unsigned long reads = simAdcReads;
+    vent.setupSamples();
+    unsigned long tick = (simAdcReads - reads) / 4 * adc;   // [us] per sampleTick()
+    unsigned long want = constrain(tick * SAMPLE_LOAD, (unsigned long)SAMPLE_US, (unsigned long)SAMPLE_US_MAX);
+    check(vent.samplePeriod == want, "%lu us analogRead(): samples every %lu us, expected %lu", adc,
+          vent.samplePeriod, want);
+    vent.sampleTimer = true;
+    simEvery(vent.samplePeriod, []() { vent.sampleTick(); });
+    lung.run(3000, 10000);
+    simEvery(0, nullptr);
+    std::string out = command("p");
+    double load = 100.0 * vent.sampleBusy / vent.sampleBusyN / vent.samplePeriod;
+    printf("    %lu us analogRead(): sampleTick() %lu us max, every %lu us, %.1f%% of the CPU\n", adc,
+           vent.sampleBusyMax, vent.samplePeriod, load);
+    check(vent.sampleBusyMax == tick && load <= 100.0 / SAMPLE_LOAD, "sampleTick() %lu us, %.1f%% of the CPU",
+          vent.sampleBusyMax, load);
+    check(out.find("of the CPU") != std::string::npos, "p shows the sample cost");
+  }
+  simAdcTime = 40;
+  vent.setupSamples();
+}
+
+int main() {
+  testHistogram();
+  testCommand();
+  testSampleCost();
+  testOverhead();
+  return simFailures;
+}
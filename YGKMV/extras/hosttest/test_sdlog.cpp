@@ -0,0 +1,89 @@
+// The SD card log (YGKMVlog.cpp) on the simulated card: 150 byte output
+// lines at 20 Hz through logLine(), with loopLog() every millisecond as
+// run() calls it, while the card takes a scripted time to program each
+// block: a steady 1 ms, stalls of 250 and 500 ms every 32 blocks, which the
+// four block queue should ride out, and one 2 s stall, which must drop
+// whole lines and count them. loopLog() must never wait on the card, and
+// after stopLog() the file must hold exactly the lines logged, in order
+// and complete. Reports the queue depth, lines dropped and longest wait
+// for each.
+// CONFIGS: -DYGKMV_SD_LOG=1
+#include "hosttest.h"
+#include <string>
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+extern SdFat logSd;
+
+// The log file's lines by their numbers, and how many were incomplete or
+// out of order.
+static std::vector<unsigned long> readLog(int *bad) {
+  std::vector<unsigned long> seq;
+  FatFile f;
+  if (!f.open(logSd.vwd(), LOG_FILE, O_RDONLY)) {
+    (*bad)++;
+    return seq;
+  }
+  std::string s(f.fileSize(), 0);
+  if (f.read(&s[0], s.size()) != (int)s.size()) (*bad)++;
+  f.close();
+  size_t at = 0;
+  while (at < s.size()) {
+    size_t nl = s.find('\n', at);
+    if (nl == std::string::npos || nl - at != 148 || s.compare(at + 10, 2, ", ")) {
+      (*bad)++;
+      break;
+    }
+    unsigned long n = strtoul(s.c_str() + at, NULL, 10);
+    if (!seq.empty() && n <= seq.back()) (*bad)++;
+    seq.push_back(n);
+    at = nl + 1;
+  }
+  return seq;
+}
+
+static void logFor(const char *name, std::function<unsigned long(unsigned long)> busy, int seconds, bool drops) {
+  vent.stopLog();
+  simCardBusy = busy;
+  check(vent.setupLog() == 0 && vent.logStat.state == LOG_RUN, "%s: log started", name);
+  unsigned long stalls = simCardStalls, n = 0;
+  uint64_t end = simMicros + seconds * 1000000ULL, next = simMicros;
+  char sc[MAX_COMMAND_LENGTH];
+  while (simMicros < end) {
+    if (simMicros >= next) {  // an output line as run() makes them
+      int k = sprintf(sc, "%10lu", ++n);
+      while (k < 148) k += sprintf(sc + k, ", %5.2f", (n % 997) / 10.0);
+      sc[148] = '\n';
+      vent.logLine(sc, 149);
+      next += 50000;
+    }
+    vent.loopLog();
+    simAdvance(1000);
+  }
+  ygkmv_log_t l = vent.logStat;
+  stalls = simCardStalls - stalls;
+  vent.stopLog();
+  int bad = 0;
+  std::vector<unsigned long> seq = readLog(&bad);
+  printf("    %s: %lu lines, %lu dropped, queue depth max %d of %d, block wait max %.1f ms, writeData() max %lu"
+         " us, card busy %lu times\n", name, n, l.dropped, l.depthMax, LOG_QUEUE, l.waitMax / 1000.0, l.writeMax,
+         l.busy);
+  check(stalls == 0 && l.writeMax < 1000, "%s: loopLog() waited on the card %lu times, %lu us at most", name,
+        stalls, l.writeMax);
+  check(drops ? l.dropped > 0 : l.dropped == 0, "%s: %lu lines dropped", name, l.dropped);
+  check(l.lines + l.dropped == n, "%s: %lu logged and %lu dropped of %lu", name, l.lines, l.dropped, n);
+  check(vent.logStat.state == LOG_OFF, "%s: stopped", name);
+  check(bad == 0 && seq.size() == l.lines && (seq.empty() || seq.back() == n),
+        "%s: file holds %zu whole lines in order, %d bad", name, seq.size(), bad);
+}
+
+int main() {
+  simFlashFormat();
+  simCardFormat(49152);
+  vent.begin();
+  check(vent.logStat.state == LOG_RUN, "begin() started the log");
+  logFor("1 ms a block", [](unsigned long) { return 1000UL; }, 60, false);
+  logFor("250 ms every 32 blocks", [](unsigned long b) { return b % 32 ? 1000UL : 250000UL; }, 120, false);
+  logFor("500 ms every 32 blocks", [](unsigned long b) { return b % 32 ? 1000UL : 500000UL; }, 120, false);
+  logFor("2 s once", [](unsigned long b) { return b == 20 ? 2000000UL : 1000UL; }, 30, true);
+  return simFailures;
+}
@@ -0,0 +1,147 @@
+// Valve slew profiles and the V command (writeServos(), doConsoleCommand()).
+#include "hosttest.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+static const double PASS = 5.0;  // [ms] between run() passes
+static std::vector<int> track;   // CPAP servo pulse width after each pass [us]
+
+static int us(double deg) { return SERVO_US_MIN + (SERVO_US_MAX - SERVO_US_MIN) * deg / 180.; }
+
+// Start at rest at deg, with the given profile and slew time.
+static void start(int profile, int time, double deg) {
+  vent.slewProfile = profile;
+  vent.slewTime = time;
+  vent.resetServos();
+  vent.writeServos(deg, deg, deg);
+  track.assign(1, vent.servoCPAP.us);
+}
+
+// One run() pass PASS ms later with a new target.
+static void pass(double deg) {
+  simAdvance(PASS * 1000);
+  vent.writeServos(deg, deg, deg);
+  track.push_back(vent.servoCPAP.us);
+}
+
+// [ms] from the start of the track until it reaches and stays at target.
+static double arrival(int target) {
+  size_t i = track.size();
+  while (i > 0 && track[i - 1] == target) i--;
+  return i * PASS;
+}
+
+static bool monotonic() {
+  for (size_t i = 1; i < track.size(); i++)
+    if ((track[i] - track[i - 1]) * (track.back() - track[0]) < 0) return false;
+  return true;
+}
+
+// Largest change in per-pass step over the track [us], a measure of acceleration.
+static int jerk() {
+  int m = 0;
+  for (size_t i = 2; i < track.size(); i++)
+    m = max(m, abs((track[i] - track[i - 1]) - (track[i - 1] - track[i - 2])));
+  return m;
+}
+
+static void command(const char *line) {
+  Serial.out.clear();
+  simCommand(vent, line);
+}
+
+static void testCommand() {
+  command("V2,150,250,250");
+  check(vent.slewProfile == SLEW_LINEAR && vent.slewTime == 150 && vent.ieTime == 250 && vent.eiTime == 250
+        && Serial.out.find("ACK Valve") == 0, "V2,150,250,250 accepted");
+  const char *bad[] = {"V4", "V-1", "V2,2000", "V2,-5", "V0,0,1500", "V0,0,0,600", "V0,0,-1"};
+  for (const char *b : bad) {
+    command(b);
+    check(vent.slewProfile == SLEW_LINEAR && vent.slewTime == 150 && vent.ieTime == 250 && vent.eiTime == 250
+          && Serial.out.find("NOACK") == 0, "%s rejected with a message, nothing changed", b);
+  }
+  command("V0,0,900,450");  // I/E may be longer than IT_MIN, it is inside expiration
+  check(vent.slewProfile == SLEW_LINEAR && vent.slewTime == 150 && vent.ieTime == 900 && vent.eiTime == 450,
+        "V0,0,900,450 sets only the transitions, got %d / %d", vent.ieTime, vent.eiTime);
+  command("V3,0,0,0");
+  check(vent.slewProfile == SLEW_SCURVE && vent.slewTime == 150, "V3 sets only the profile");
+}
+
+static void testStep() {
+  start(SLEW_STEP, 200, 0);
+  pass(90);
+  check(track.back() == us(90), "step arrives in one pass");
+  unsigned long w = vent.servoCPAP.writes;
+  for (int i = 0; i < 20; i++) pass(90);
+  check(vent.servoCPAP.writes == w, "no writes while the target is steady, %lu", vent.servoCPAP.writes - w);
+}
+
+static void testLinear() {
+  start(SLEW_LINEAR, 200, 0);
+  for (int i = 0; i < 60; i++) pass(90);
+  double t = arrival(us(90));
+  check(t >= 190 && t <= 210 && monotonic(), "linear 0 to 90 arrives in %.0f ms", t);
+
+  // A target that keeps moving carries the move on rather than restarting
+  // it, which would take until 100 + 200 ms.
+  start(SLEW_LINEAR, 200, 0);
+  for (int i = 0; i < 80; i++) pass(i < 20 ? 80 + i * 0.5 : 90);
+  t = arrival(us(90));
+  check(t <= 250 && monotonic(), "linear with a target moving for 100 ms arrives in %.0f ms", t);
+  bool slowed = false;  // speed never drops before arrival
+  for (size_t i = 2; i < track.size() && track[i] != us(90); i++)
+    if (track[i] - track[i - 1] < track[i - 1] - track[i - 2] - 1) slowed = true;
+  check(!slowed, "linear speed never drops during the move");
+
+  unsigned long w = vent.servoCPAP.writes;
+  for (int i = 0; i < 20; i++) pass(90);
+  check(vent.servoCPAP.writes == w, "linear makes no writes after arriving");
+
+  // A target that jitters every pass, e.g. from pressure control, is still
+  // reached on time. Restarting each pass would still be 1/e short at 200 ms.
+  for (int profile = SLEW_LINEAR; profile <= SLEW_SCURVE; profile++) {
+    start(profile, 200, 0);
+    for (int i = 0; i < 42; i++) pass(90 + (i & 1 ? 0.3 : -0.3));
+    int e = abs(track.back() - us(90));
+    check(e <= 4, "%s with a jittering target is %d us off at 210 ms",
+          profile == SLEW_LINEAR ? "linear" : "s-curve", e);
+  }
+}
+
+static void testSCurve() {
+  const int T = 200, D = us(90) - us(0);
+  start(SLEW_SCURVE, T, 0);
+  for (int i = 0; i < 60; i++) pass(90);
+  double t = arrival(us(90));
+  int peak = 0;
+  for (size_t i = 1; i < track.size(); i++) peak = max(peak, track[i] - track[i - 1]);
+  double vmax = 2.0 * D / T * PASS;  // [us / pass] at the middle of the move
+  check(t >= 180 && t <= 220 && monotonic(), "s-curve 0 to 90 arrives in %.0f ms", t);
+  check(peak <= vmax * 1.1, "s-curve peak speed %d us / pass, limit %.1f", peak, vmax);
+  double dv = 4.0 * D / T / T * PASS * PASS;  // acceleration [us / pass^2]
+  check(jerk() <= dv + 2, "s-curve speed changes at most %d us / pass^2, limit %.1f", jerk(), dv);
+
+  // Retarget further away mid-move: keeps going without a jump in speed.
+  start(SLEW_SCURVE, T, 0);
+  for (int i = 0; i < 12; i++) pass(90);
+  for (int i = 0; i < 60; i++) pass(135);
+  t = arrival(us(135));
+  dv = 4.0 * (us(135) - track[12]) / T / T * PASS * PASS;
+  check(t <= 60 + T * 1.1 && monotonic(), "s-curve retargeted at 60 ms arrives in %.0f ms", t);
+  check(jerk() <= dv + 2, "s-curve retarget changes speed at most %d us / pass^2, limit %.1f", jerk(), dv);
+
+  // Reverse mid-move: slows, turns and stops at the new target without overshoot.
+  start(SLEW_SCURVE, T, 0);
+  for (int i = 0; i < 20; i++) pass(90);
+  for (int i = 0; i < 80; i++) pass(30);
+  int lo = *std::min_element(track.begin() + 20, track.end());
+  check(track.back() == us(30) && lo >= us(30), "s-curve reversal settles at %d us, lowest %d", track.back(), lo);
+}
+
+int main() {
+  testCommand();
+  testStep();
+  testLinear();
+  testSCurve();
+  return simFailures;
+}
@@ -0,0 +1,138 @@
+// The snapshot seqlock (publishSnapshot(), getSnapshot()): nothing before
+// the first publish, giving up after SNAP_TRIES reads of an odd count when
+// the writer can't finish (a reader in an interrupt that stopped it part
+// way), retrying past an odd count that the writer completes, and never
+// returning a copy torn by a writer interrupting the read. Host timer
+// signals stand in for the interrupts.
+#include "hosttest.h"
+#include <signal.h>
+#include <sys/time.h>
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+// Run fn from SIGALRM us from now, and every us after that if repeat is
+// set. An interval of 0 stops the timer.
+static void timer(long us, bool repeat, void (*fn)(int)) {
+  signal(SIGALRM, fn);
+  itimerval it = {{0, repeat ? us : 0}, {0, us}};
+  setitimer(ITIMER_REAL, &it, NULL);
+}
+
+// Publish state whose fields all hold k, so a mixed copy shows.
+static void publish(int k) {
+  vent.v_p = vent.v_q = vent.v_vr = k;
+  vent.publishSnapshot();
+}
+static bool whole(const ygkmv_snap_t &s) { return s.p == s.q && s.q == s.vr; }
+
+static void testEmpty() {
+  ygkmv_snap_t s;
+  check(!vent.getSnapshot(&s), "no snapshot before the first publish");
+  Serial.out.clear();
+  simCommand(vent, "g");
+  check(Serial.out.find("No consistent snapshot") != std::string::npos, "g says there is none");
+  publish(1);
+  bool got = vent.getSnapshot(&s);
+  check(got && s.seq == 1 && s.p == 1, "first snapshot seq %lu", (unsigned long)s.seq);
+}
+
+// The writer stopped part way with the count odd: every try sees it, the
+// copy is left alone, and the next read after it finishes is the new state.
+static void testExhausted() {
+  publish(2);
+  ygkmv_snap_t s;
+  memset(&s, 0x55, sizeof s);
+  vent.snapSeq++;
+  vent.snapBuf.p = 3;
+  double t0 = hostNs();
+  bool got = vent.getSnapshot(&s);
+  double ns = hostNs() - t0;
+  check(!got && s.p != 3 && s.seq == 0x55555555, "gives up on an odd count without copying");
+  printf("    %d tries at an odd count took %.0f ns\n", SNAP_TRIES, ns);
+  vent.snapBuf.q = vent.snapBuf.vr = 3;
+  vent.snapSeq++;
+  check(vent.getSnapshot(&s) && whole(s) && s.p == 3, "reads the state once the writer finishes");
+
+  // The display line is skipped rather than sent from a torn copy.
+  vent.snapSeq++;
+  simAdvance((OUTPUT_INTERVAL + 1) * 1000);
+  Serial.out.clear();
+  vent.loopOut();
+  check(Serial.out.empty(), "no display line while the count is odd");
+  vent.snapSeq++;
+}
+
+// The writer left part way, finishing from a timer interrupt while the
+// reader retries. A read that started on an odd count and still returned
+// a copy has retried past it.
+static volatile bool finished;
+static void finish(int) {
+  vent.snapBuf.q = vent.snapBuf.vr = vent.snapBuf.p;
+  __asm__ __volatile__("" ::: "memory");
+  vent.snapSeq++;
+  finished = true;
+}
+static void testRetry() {
+  int trials = 50, retried = 0, gaveUp = 0, wrong = 0;
+  for (int i = 0; i < trials; i++) {
+    publish(0);
+    vent.snapSeq++;
+    vent.snapBuf.p = 100 + i;
+    finished = false;
+    timer(200, false, finish);
+    ygkmv_snap_t s;
+    uint32_t seq;
+    bool got;
+    do {
+      seq = vent.snapSeq;
+      got = vent.getSnapshot(&s);
+      gaveUp += !got;
+    } while (!got);
+    retried += seq & 1;
+    wrong += !(whole(s) && s.p == 100 + i);
+    while (!finished) {}
+  }
+  timer(0, false, SIG_DFL);
+  printf("    writer finished by interrupt %d times: %d reads retried past the odd count, %d gave up first\n",
+         trials, retried, gaveUp);
+  check(wrong == 0, "%d reads returned the unfinished state", wrong);
+  check(retried > 0, "%d of %d reads retried past an odd count", retried, trials);
+  check(gaveUp > 0, "reads give up while the writer is held off");
+}
+
+// Publishes from a fast timer interrupt while the reader copies flat out.
+// Every copy returned must be from one publish.
+static volatile int published;
+static void publisher(int) { publish(++published); }
+static void testTorn() {
+  published = 0;
+  timer(20, true, publisher);
+  long reads = 0, got = 0, torn = 0;
+  uint32_t last = 0;
+  int backwards = 0;
+  double t0 = hostNs();
+  while (published < 20000 && hostNs() - t0 < 10e9) {
+    ygkmv_snap_t s;
+    reads++;
+    if (!vent.getSnapshot(&s)) continue;
+    got++;
+    torn += !whole(s);
+    backwards += s.seq < last;
+    last = s.seq;
+  }
+  timer(0, false, SIG_DFL);
+  printf("    %d publishes from an interrupt during %ld reads: %ld copies, %.0f ns per read\n", published, reads,
+         got, (hostNs() - t0) / reads);
+  check(published >= 20000, "%d publishes", published);
+  check(torn == 0, "%ld torn copies", torn);
+  check(backwards == 0, "sequence went backwards %d times", backwards);
+  check(got > reads / 2, "%ld of %ld reads returned a copy", got, reads);
+}
+
+int main() {
+  testEmpty();
+  testExhausted();
+  testRetry();
+  testTorn();
+  return simFailures;
+}
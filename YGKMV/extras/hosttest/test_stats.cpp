@@ -0,0 +1,137 @@
+// RWS_Stats window and percentile estimates against synthetic loop timing
+// traces, and the slow loop alarm that uses RWS_UNO::dtStats.
+#include "lung.h"
+#include <random>
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+static std::mt19937 rng(3);
+
+// Exact window statistics for the samples RWS_Stats should be holding: the
+// partial current block and the blocks - 1 full ones before it.
+static void windowOf(const std::vector<double> &x, unsigned bs, unsigned blocks, double *lo, double *hi,
+                     double *mean, size_t *n) {
+  size_t cur = x.empty() ? 0 : (x.size() - 1) % bs + 1;
+  size_t keep = min(x.size(), cur + (blocks - 1) * (size_t)bs);
+  double s = 0;
+  *lo = 1e300;
+  *hi = 0;
+  for (size_t i = x.size() - keep; i < x.size(); i++) {
+    s += x[i];
+    *lo = min(*lo, x[i]);
+    *hi = max(*hi, x[i]);
+  }
+  *mean = keep ? s / keep : 0;
+  *n = keep;
+}
+
+static double exact(std::vector<double> x, double pc) {
+  std::sort(x.begin(), x.end());
+  return x[min(x.size() - 1, (size_t)(pc / 100 * x.size()))];
+}
+
+// A trace with a stall, then a change of loop rate, checked every sample.
+static void testWindow() {
+  RWS_Stats st(50, 8);
+  std::vector<double> x;
+  bool ok = true;
+  for (int i = 0; i < 2000; i++) {
+    double v = i == 300 ? 250000 : (i < 1000 ? 2000 : 8000) + std::uniform_real_distribution<double>(-500, 500)(rng);
+    st.add(v);
+    x.push_back(v);
+    double lo, hi, mean;
+    size_t n;
+    windowOf(x, 50, 8, &lo, &hi, &mean, &n);
+    bool same = fabs(st.min() - lo) < 1e-6 * lo && fabs(st.max() - hi) < 1e-6 * hi;  // blocks keep floats
+    if (!same || fabs(st.mean() - mean) > 1e-6 * mean || st.windowCount() != n) {
+      if (ok) check(false, "window at sample %d: min %.0f / %.0f, max %.0f / %.0f, mean %.1f / %.1f, n %lu / %zu", i,
+                    st.min(), lo, st.max(), hi, st.mean(), mean, st.windowCount(), n);
+      ok = false;
+    }
+  }
+  check(ok, "window min, max, mean and count match the last 351 to 400 samples throughout");
+  check(st.percentile(100) == 250000 && st.count() == 2000, "the stall stays in the histogram until reset()");
+  st.reset();
+  check(st.count() == 0 && st.windowCount() == 0 && st.max() == 0 && st.percentile(50) == 0, "reset() clears");
+}
+
+// Percentile estimates are within 25% for a range of loop time shapes.
+static void testPercentiles() {
+  struct Trace {
+    const char *name;
+    std::function<double()> next;
+  } traces[] = {
+      {"uniform 1 to 2 ms", []() { return std::uniform_real_distribution<double>(1000, 2000)(rng); }},
+      {"lognormal around 3 ms", []() { return std::lognormal_distribution<double>(log(3000.), 0.5)(rng); }},
+      {"2 ms, 5% at 50 ms", []() { return std::uniform_real_distribution<double>()(rng) < 0.05 ? 50000. : 2000.; }},
+      {"steady 10 ms with jitter", []() { return 10000 + std::normal_distribution<double>(0, 30)(rng); }},
+  };
+  printf("    Trace                        p50 exact / est     p90 exact / est     p99 exact / est\n");
+  for (auto &t : traces) {
+    RWS_Stats st(100, 10);
+    std::vector<double> x;
+    for (int i = 0; i < 20000; i++) {
+      double v = t.next();
+      st.add(v);
+      x.push_back(v);
+    }
+    char row[128];
+    int k = snprintf(row, sizeof(row), "    %-26s", t.name);
+    for (double pc : {50., 90., 99.}) {
+      double e = exact(x, pc), g = st.percentile(pc);
+      k += snprintf(row + k, sizeof(row) - k, " %9.0f / %7.0f", e, g);
+      check(fabs(g - e) <= 0.25 * e, "%s p%.0f estimated %.0f, exact %.0f", t.name, pc, g, e);
+    }
+    printf("%s\n", row);
+  }
+}
+
+static bool slow() { return vent.v_alarmRaw & YGKMV_SLOW_ERROR; }
+static bool alarmed() { return vent.v_alarm & YGKMV_SLOW_ERROR; }
+
+// The slow loop condition follows the window and the latest loop, so a
+// startup stall is forgotten, and the alarm rule's onDelay keeps a single
+// slow loop from being an alarm while a sustained one is caught quickly.
+// One loop more than five times too slow still alarms at once, as it
+// always has.
+static void testSlowAlarm() {
+  static Lung lung;
+  lung.begin(vent);
+  vent.uno.run(true);
+  lung.run(5000, 5000);
+  check(!slow(), "5 ms loops are not slow");
+  simAdvance(ALARM_DELAY_LOOP * 4 * 1000);  // one loop 4 times too slow
+  lung.run(1, 5000);
+  check(slow() && !alarmed(), "a %d ms stall is slow, but not an alarm", ALARM_DELAY_LOOP * 4);
+  lung.run(100, 5000);
+  simAdvance(1000000);  // one 1 s stall
+  lung.run(1, 5000);
+  check(slow() && alarmed(), "a 1 s stall alarms at once");
+  lung.run(100, 5000);
+  check(!slow() && alarmed(), "and is forgotten on the next pass, window mean %.1f ms, while the alarm holds",
+        vent.uno.dtStats.mean() / 1000);
+  check(vent.uno.dtAvg() / 1000 > 5.5, "while the old average still shows it, %.1f ms", vent.uno.dtAvg() / 1000);
+  unsigned long t0 = millis();
+  while (alarmed() && millis() - t0 < 60000) lung.run(5, 5000);
+  check(!alarmed() && millis() - t0 <= ALARM_CLEAR_P, "the stall's alarm clears after %lu ms", millis() - t0);
+  t0 = millis();
+  while (!alarmed() && millis() - t0 < 60000) lung.run(150, 150000);
+  check(alarmed() && millis() - t0 <= 1500, "150 ms loops alarm after %lu ms", millis() - t0);
+  t0 = millis();
+  while (alarmed() && millis() - t0 < 60000) lung.run(5, 5000);
+  check(!alarmed() && millis() - t0 <= 5100, "back to 5 ms loops clears after %lu ms", millis() - t0);
+
+  // Every fifth loop at 490 ms keeps the mean over 100 ms, though most are fast.
+  vent.uno.run(true);
+  t0 = millis();
+  int i = 0;
+  while (!alarmed() && millis() - t0 < 60000) lung.run(1, i++ % 5 ? 5000 : 490000);
+  check(alarmed(), "intermittent 490 ms loops alarm after %lu ms, window mean %.0f ms", millis() - t0,
+        vent.uno.dtStats.mean() / 1000);
+}
+
+int main() {
+  testWindow();
+  testPercentiles();
+  testSlowAlarm();
+  return simFailures;
+}
@@ -0,0 +1,164 @@
+// The event trace ring (trace(), dumpTrace()) and its binary dump read back
+// by extras/tracetojson: the ring keeping the newest TRACE_SIZE events in
+// order as it wraps, arguments cut to 16 bits, the YGKT layout sent by the
+// B command, and the converter's JSON for a capture that crosses the 32 bit
+// micros() rollover.
+#include "hosttest.h"
+#include <string>
+#include <stddef.h>
+
+#define main tracetojson    // the converter's main(), run on files below
+#include "../tracetojson/tracetojson.cpp"
+#undef main
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+
+// The entries of the last dump in out, checking its header and trailer.
+static std::vector<ygkmv_trace_t> parseDump(const std::string &out) {
+  std::vector<ygkmv_trace_t> v;
+  size_t at = out.rfind(TRACE_MAGIC);
+  if (!check(at != std::string::npos && out.size() >= at + 8, "dump starts with %s", TRACE_MAGIC)) return v;
+  uint16_t hdr[2];
+  memcpy(hdr, out.data() + at + 4, sizeof(hdr));
+  check(hdr[0] == 8, "entry size %u", hdr[0]);
+  size_t end = at + 8 + (size_t)hdr[0] * hdr[1];
+  if (!check(out.size() >= end + 1, "%zu bytes for %u entries", out.size() - at, hdr[1])) return v;
+  check(out[end] == '\n', "dump ends with a newline");
+  v.resize(hdr[1]);
+  memcpy(v.data(), out.data() + at + 8, end - at - 8);
+  return v;
+}
+
+// The converter's entry must lay out the same as the firmware's.
+static void testLayout() {
+  check(sizeof(ygkmv_trace_t) == 8 && sizeof(trace_t) == 8, "entries are 8 bytes");
+  check(offsetof(ygkmv_trace_t, t) == offsetof(trace_t, t) && offsetof(ygkmv_trace_t, type) == offsetof(trace_t, type)
+        && offsetof(ygkmv_trace_t, arg) == offsetof(trace_t, arg), "entry fields line up with tracetojson");
+}
+
+// More events than the ring holds: the dump has the newest TRACE_SIZE,
+// oldest first, and the B command says how many.
+static void testWrap() {
+  vent.traceHead = 0;
+  Serial.out.clear();
+  vent.dumpTrace();
+  check(parseDump(Serial.out).empty(), "empty ring dumps no entries");
+
+  const int extra = 37;
+  for (int i = 0; i < TRACE_SIZE + extra; i++) {
+    simAdvance(10);
+    vent.trace(TRACE_OUTPUT, i);
+  }
+  Serial.out.clear();
+  vent.dumpTrace();
+  std::vector<ygkmv_trace_t> v = parseDump(Serial.out);
+  check(v.size() == TRACE_SIZE, "%zu entries after %d events", v.size(), TRACE_SIZE + extra);
+  bool order = v.size() == TRACE_SIZE;
+  for (size_t i = 0; order && i < v.size(); i++) {
+    order = v[i].type == TRACE_OUTPUT && v[i].arg == (int)i + extra && (i == 0 || v[i].t - v[i - 1].t == 10);
+  }
+  check(order, "newest %d events oldest first", TRACE_SIZE);
+
+  Serial.out.clear();
+  simCommand(vent, "B");
+  char ack[64];
+  snprintf(ack, sizeof ack, "%d events\n", TRACE_SIZE);
+  check(Serial.out.find(ack) < Serial.out.find(TRACE_MAGIC), "B announces the dump");
+  v = parseDump(Serial.out);
+  check(v.size() == TRACE_SIZE && v.back().type == TRACE_COMMAND && v.back().arg == 'B',
+        "B dump ends with its own command");
+}
+
+// Arguments keep their low 16 bits, so alarm bits up to YGKMV_EXT_ERROR
+// come back through tracetojson's unsigned print and phases keep their sign.
+static void testArgs() {
+  vent.traceHead = 0;
+  vent.trace(TRACE_ALARM_SET, YGKMV_EXT_ERROR);
+  vent.trace(TRACE_PHASE, -1);
+  vent.trace(TRACE_OUTPUT, 70000);
+  check(vent.traceRing[0].arg == -32768 && (uint16_t)vent.traceRing[0].arg == YGKMV_EXT_ERROR,
+        "alarm bit %u stored as %d", YGKMV_EXT_ERROR, vent.traceRing[0].arg);
+  check(vent.traceRing[1].arg == -1, "phase -1 kept");
+  check(vent.traceRing[2].arg == 70000 - 65536, "70000 cut to %d", vent.traceRing[2].arg);
+}
+
+static std::string readFile(const char *name) {
+  std::string s;
+  FILE *f = fopen(name, "rb");
+  if (!f) return s;
+  char b[4096];
+  size_t n;
+  while ((n = fread(b, 1, sizeof b, f)) > 0) s.append(b, n);
+  fclose(f);
+  return s;
+}
+
+static int count(const std::string &s, const std::string &what) {
+  int n = 0;
+  for (size_t at = s.find(what); at != std::string::npos; at = s.find(what, at + 1)) n++;
+  return n;
+}
+
+// A capture holding an older dump, console text and a dump of one breath
+// of each kind of event, starting 1 ms before micros() rolls over.
+static void testJson() {
+  vent.traceHead = 0;
+  vent.trace(TRACE_OUTPUT, 1);
+  Serial.out.clear();
+  PL("ACK old dump");
+  vent.dumpTrace();
+  PL("ACK console text between dumps");
+
+  vent.traceHead = 0;
+  simMicros = 0xffffffffULL - 1000;
+  uint64_t t0 = simMicros;
+  vent.trace(TRACE_PHASE, 1);
+  simAdvance(200);
+  vent.trace(TRACE_ALARM_SET, YGKMV_EXT_ERROR);
+  vent.trace(TRACE_COMMAND, 'R');
+  vent.trace(TRACE_FLASH_START, 1);
+  simAdvance(600);
+  vent.trace(TRACE_FLASH_END, 1);
+  vent.trace(TRACE_BUTTON, 2 * 16 + BUTTON_EV_LONG);
+  simAdvance(1000);   // past the rollover
+  vent.trace(TRACE_PHASE, -1);
+  simAdvance(500);
+  vent.trace(TRACE_TRIGGER, TRIG_P);
+  vent.trace(TRACE_ALARM_CLR, YGKMV_EXT_ERROR);
+  vent.trace(TRACE_PHASE, 1);
+  vent.dumpTrace();
+
+  const char *cap = "build/trace_capture.bin", *json = "build/trace.json";
+  FILE *f = fopen(cap, "wb");
+  fwrite(Serial.out.data(), 1, Serial.out.size(), f);
+  fclose(f);
+  char *argv[] = {(char *)"tracetojson", (char *)cap, (char *)json, NULL};
+  check(tracetojson(3, argv) == 0, "tracetojson converts the capture");
+  std::string j = readFile(json);
+  if (simVerbose) printf("%s", j.c_str());
+
+  check(j.compare(0, 40, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n") == 0 && j.size() > 5 &&
+        j.compare(j.size() - 4, 4, "\n]}\n") == 0, "JSON wrapper");
+  check(count(j, "\"ts\":") == 12 && count(j, "\"bytes\":1") == 0, "%d events from the last dump only",
+        count(j, "\"ts\":"));
+  check(count(j, "alarm 32768 set") == 1 && count(j, "alarm 32768 clear") == 1, "alarm bit 32768 set and cleared");
+  check(count(j, "command R") == 1 && count(j, "red long press") == 1 && count(j, "trigger pressure") == 1,
+        "command, button and trigger named");
+  check(count(j, "{\"name\":\"write patient.txt\",\"ph\":\"B\"") == 1 &&
+        count(j, "{\"name\":\"write patient.txt\",\"ph\":\"E\"") == 1, "flash write begins and ends");
+  // Two inspirations and an expiration begin, and the first two end.
+  check(count(j, "\"ph\":\"B\",\"ts\"") == 4 && count(j, "{\"name\":\"inspiration\",\"ph\":\"E\"") == 1 &&
+        count(j, "{\"name\":\"expiration\",\"ph\":\"E\"") == 1, "phases begin and end");
+  char ts[64];
+  snprintf(ts, sizeof ts, "{\"name\":\"expiration\",\"ph\":\"B\",\"ts\":%llu,", (unsigned long long)(t0 + 1800));
+  check(j.find(ts) != std::string::npos, "expiration at %llu us, unwrapped past the rollover",
+        (unsigned long long)(t0 + 1800));
+}
+
+int main() {
+  testLayout();
+  testWrap();
+  testArgs();
+  testJson();
+  return simFailures;
+}
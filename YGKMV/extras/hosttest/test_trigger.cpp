@@ -0,0 +1,131 @@
+// Patient trigger detection (sampleTrigger()) against noise and simulated
+// efforts, and the trigger latency v_tl reported by run() and the T command.
+#include "lung.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+static std::mt19937 rng(7);
+
+static double gauss(double rms) { return std::normal_distribution<double>(0.0, rms)(rng); }
+
+static void arm() {
+  vent.p_trigArmed = true;
+  vent.p_epl = 5.0;
+  vent.p_eplTol = 2.0;
+  vent.p_trigQ = 2.0;
+  vent.p_trigDQ = 30.0;
+  vent.v_trigTime = 0;
+}
+
+// Feed samples every dt us for ms, counting triggers and restarting after each.
+static int feed(unsigned long ms, unsigned long dt, std::function<double(double)> p,
+                std::function<double(double)> q) {
+  int n = 0;
+  for (unsigned long t = 0; t < ms * 1000; t += dt) {
+    simAdvance(dt);
+    if (vent.sampleTrigger(p(t / 1e6), q(t / 1e6), micros())) {
+      n++;
+      vent.v_trigTime = 0;
+    }
+  }
+  return n;
+}
+
+static void testNoise() {
+  arm();
+  // Pressure noise with a one sample dip below the trigger level every 200 ms.
+  int n = feed(60000, 2000, [](double t) { return fmod(t, 0.2) < 0.002 ? 2.0 : 5.0 + gauss(0.3); },
+               [](double) { return gauss(0.7); });
+  check(n == 0, "%d false triggers in 60 s of noisy samples with 300 single sample dips", n);
+}
+
+static double percentile(std::vector<double> v, double f) {
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(f * (v.size() - 1))];
+}
+
+// Efforts ramping through the threshold at a known time, with noise. The
+// latency is from the true crossing to the sample that triggered, and the
+// reported v_trigTime should be close to the true crossing.
+static void testEfforts(bool flow, unsigned long dt) {
+  std::vector<double> detect, report;
+  int missed = 0;
+  for (int i = 0; i < 200; i++) {
+    arm();
+    feed(500, dt, [](double) { return 5.0 + gauss(0.2); }, [](double) { return gauss(0.3); });
+    unsigned long t0 = micros();
+    double cross;  // [s] from t0
+    std::function<double(double)> p, q;
+    if (flow) {    // 60 l/min/s rise crosses 2 l/min at 33 ms
+      cross = 2.0 / 60.0;
+      p = [](double) { return 5.0 + gauss(0.2); };
+      q = [](double t) { return 60.0 * t + gauss(0.3); };
+    } else {       // 20 cm H2O/s fall crosses 3 cm H2O at 100 ms
+      cross = 0.1;
+      p = [](double t) { return 5.0 - 20.0 * t + gauss(0.2); };
+      q = [](double) { return gauss(0.3); };
+    }
+    int n = 0;
+    for (unsigned long t = 0; t < 200000 && !n; t += dt) {
+      simAdvance(dt);
+      n = vent.sampleTrigger(p(t / 1e6), q(t / 1e6), micros());
+    }
+    if (!n) {
+      missed++;
+      continue;
+    }
+    double tc = t0 + cross * 1e6;
+    detect.push_back((micros() - tc) / 1000.);
+    report.push_back(((double)vent.v_trigTime - tc) / 1000.);
+    check(vent.v_trigSource == (flow ? TRIG_Q : TRIG_P), "trigger source");
+  }
+  const char *what = flow ? "flow" : "pressure";
+  printf("    %s efforts sampled every %lu us: detected %.1f / %.1f / %.1f ms after crossing (median / 95%% / max),"
+         " v_trigTime %.1f / %.1f ms\n", what, dt, percentile(detect, 0.5), percentile(detect, 0.95),
+         percentile(detect, 1.0), percentile(report, 0.5), percentile(report, 0.95));
+  check(missed == 0, "%s efforts all detected, %d missed", what, missed);
+  check(percentile(detect, 0.95) <= 50.0, "%s detection 95%% latency %.1f ms", what, percentile(detect, 0.95));
+  check(fabs(percentile(report, 0.5)) <= 2.0 * dt / 1000. + 5, "%s v_trigTime within %.1f ms of the crossing", what,
+        percentile(report, 0.5));
+}
+
+// The whole ventilator, triggered by a patient effort partway through each
+// expiration. v_tl runs from the first triggering sample to the valve
+// command, so it covers the samples needed to confirm the effort.
+static void testRun() {
+  static Lung lung;
+  lung.effort = [](double) { return vent.v_ieEntered == -1 && vent.v_etr > 1500 ? -8.0 : 0.0; };
+  lung.begin(vent);
+  vent.p_trigEnabled = true;
+  vent.p_trigQ = 0.0;
+  const unsigned long loop = 5000;
+  std::vector<double> tl;
+  unsigned long breaths = vent.v_breaths;
+  lung.run(20000, loop, [&]() {
+    if (vent.v_breaths != breaths) {
+      breaths = vent.v_breaths;
+      if (vent.v_trigSource == TRIG_P) tl.push_back(vent.v_tl);
+    }
+  });
+  check(tl.size() >= 4, "%zu triggered breaths in 20 s", tl.size());
+  if (tl.empty()) return;
+  double lo = *std::min_element(tl.begin(), tl.end()), hi = *std::max_element(tl.begin(), tl.end());
+  printf("    run() every %lu us: v_tl %.1f to %.1f ms\n", loop, lo, hi);
+  check(lo >= (TRIG_SAMPLES - 1) * loop / 1000. && hi <= (TRIG_SAMPLES + 1) * loop / 1000.,
+        "v_tl %.1f to %.1f ms spans the confirming samples", lo, hi);
+
+  // The T command reports it. The display unit's line doesn't carry it.
+  vent.v_trigSource = TRIG_P;
+  Serial.out.clear();
+  simCommand(vent, "T");
+  check(Serial.out.find("pressure triggered, latency") != std::string::npos, "T reports the trigger latency");
+}
+
+int main() {
+  testNoise();
+  testEfforts(false, 2000);
+  testEfforts(false, 10000);
+  testEfforts(true, 2000);
+  testEfforts(true, 10000);
+  testRun();
+  return simFailures;
+}
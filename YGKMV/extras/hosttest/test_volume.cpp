@@ -0,0 +1,57 @@
+// Inspired and expired volumes from loopSamples() and integrateQ() against
+// the true volumes of a simulated patient, with the sample timer and with
+// one sample per run() pass, at several loop() periods.
+#include "lung.h"
+
+YGKMV vent(YGKMV_MODEL, NULL, 115200);
+static Lung lung;
+
+// Breathe for 30 s with run() every loop us and return the worst error in
+// the inspired and expired volume of a single breath, and in the totals,
+// as a percentage of the true volume.
+static void breathe(bool timer, unsigned long loop, double *breathErr, double *totalErr) {
+  lung.begin(vent);
+  if (timer) {
+    vent.sampleTimer = true;
+    simEvery(SAMPLE_US, []() { vent.sampleTick(); });
+  }
+  lung.run(6000, loop);  // settle
+  unsigned long breaths = vent.v_breaths;
+  double in0 = 0, out0 = 0, inSum = 0, outSum = 0, vSum = 0, veSum = 0;
+  int n = -1;
+  *breathErr = 0;
+  lung.run(30000, loop, [&]() {
+    if (vent.v_breaths == breaths) return;
+    breaths = vent.v_breaths;
+    if (n >= 0) {  // v_v and v_ve are for the breath since the last start
+      double in = lung.vIn - in0, out = lung.vOut - out0;
+      *breathErr = max(*breathErr, fabs(vent.v_v - in) / in * 100);
+      *breathErr = max(*breathErr, fabs(vent.v_ve - out) / out * 100);
+      inSum += in;
+      outSum += out;
+      vSum += vent.v_v;
+      veSum += vent.v_ve;
+    }
+    n++;
+    in0 = lung.vIn;
+    out0 = lung.vOut;
+  });
+  *totalErr = max(fabs(vSum - inSum) / inSum, fabs(veSum - outSum) / outSum) * 100;
+  check(n >= 8, "%d breaths in 30 s", n);
+}
+
+int main() {
+  printf("    Sampling      loop() [ms]   worst breath [%%]   total [%%]\n");
+  for (int timer = 1; timer >= 0; timer--) {
+    for (unsigned long loop : {2000UL, 10000UL, 30000UL, 80000UL}) {
+      double b, t;
+      breathe(timer, loop, &b, &t);
+      printf("    %-12s %12.0f %18.2f %11.2f\n", timer ? "timer" : "each pass", loop / 1000., b, t);
+      if (timer || loop <= 2000)
+        check(b < 2.0 && t < 1.0, "%s at %lu ms: breath volumes within %.2f%%, totals within %.2f%%",
+              timer ? "timer samples" : "one sample per pass", loop / 1000, b, t);
+    }
+  }
+  check(vent.sampleDropped == 0, "no samples dropped, %lu", vent.sampleDropped);
+  return simFailures;
+}
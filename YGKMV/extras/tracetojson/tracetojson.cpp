@@ -0,0 +1,146 @@
+// Convert a YGKMV binary event trace to Chrome trace JSON.
+//
+// Capture the console output after sending a B command, e.g. with
+//   cat /dev/ttyACM0 > capture.bin
+// then build and run on the host:
+//   g++ -o tracetojson tracetojson.cpp
+//   ./tracetojson capture.bin trace.json
+// and open trace.json in chrome://tracing or https://ui.perfetto.dev
+//
+// The last dump in the capture is used. Phases and flash writes become
+// duration events, everything else instant events. Times are micros()
+// from the ventilator, unwrapped across the 32 bit rollover.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// These must match YGKMV.h
+#define TRACE_MAGIC "YGKT"
+#define TRACE_PHASE       1
+#define TRACE_TRIGGER     2
+#define TRACE_ALARM_SET   3
+#define TRACE_ALARM_CLR   4
+#define TRACE_COMMAND     5
+#define TRACE_FLASH_START 6
+#define TRACE_FLASH_END   7
+#define TRACE_OUTPUT      8
+#define TRACE_BUTTON      9
+
+struct trace_t {
+  uint32_t t;
+  uint8_t type;
+  uint8_t spare;
+  int16_t arg;
+};
+
+static const char *phaseName(int ie) {
+  if (ie > 0) return "inspiration";
+  if (ie < 0) return "expiration";
+  return "stopped";
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    printf("missing arguments:\n");
+    printf("%s captureFile jsonFile\n", argv[0]);
+    return 1;
+  }
+  FILE *source = fopen(argv[1], "rb");
+  if (!source) {
+    printf("open failed for %s\n", argv[1]);
+    return 1;
+  }
+  fseek(source, 0, SEEK_END);
+  long size = ftell(source);
+  fseek(source, 0, SEEK_SET);
+  uint8_t *buf = (uint8_t *) malloc(size);
+  if (!buf || fread(buf, 1, size, source) != (size_t) size) {
+    printf("read failed for %s\n", argv[1]);
+    return 1;
+  }
+  fclose(source);
+  long start = -1;
+  for (long i = 0; i + 8 <= size; i++) {
+    if (memcmp(buf + i, TRACE_MAGIC, 4) == 0) start = i;
+  }
+  if (start < 0) {
+    printf("no trace dump found in %s\n", argv[1]);
+    return 1;
+  }
+  uint16_t hdr[2];
+  memcpy(hdr, buf + start + 4, sizeof(hdr));
+  if (hdr[0] != sizeof(trace_t) || start + 8 + (long) hdr[1] * hdr[0] > size) {
+    printf("trace dump is truncated or from a different version\n");
+    return 1;
+  }
+  FILE *destination = fopen(argv[2], "w");
+  if (!destination) {
+    printf("open failed for %s\n", argv[2]);
+    return 1;
+  }
+  fprintf(destination, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  uint64_t wrap = 0;
+  uint32_t tLast = 0;
+  int ie = 0;
+  bool inPhase = false;
+  const char *sep = "";
+  for (unsigned i = 0; i < hdr[1]; i++) {
+    trace_t e;
+    memcpy(&e, buf + start + 8 + i * sizeof(trace_t), sizeof(trace_t));
+    if (i > 0 && e.t < tLast) wrap += 1ULL << 32;
+    tLast = e.t;
+    unsigned long long ts = wrap + e.t;
+    switch (e.type) {
+    case TRACE_PHASE:
+      if (inPhase) {
+        fprintf(destination, "%s{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%llu,\"pid\":1,\"tid\":1}",
+                sep, phaseName(ie), ts);
+        sep = ",\n";
+      }
+      ie = e.arg;
+      fprintf(destination, "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%llu,\"pid\":1,\"tid\":1}",
+              sep, phaseName(ie), ts);
+      inPhase = true;
+      break;
+    case TRACE_TRIGGER:
+      fprintf(destination, "%s{\"name\":\"trigger %s\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%llu,\"pid\":1,\"tid\":1}",
+              sep, e.arg == 1 ? "pressure" : "flow", ts);
+      break;
+    case TRACE_ALARM_SET:
+    case TRACE_ALARM_CLR:
+      fprintf(destination, "%s{\"name\":\"alarm %u %s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":2}",
+              sep, (uint16_t) e.arg, e.type == TRACE_ALARM_SET ? "set" : "clear", ts);
+      break;
+    case TRACE_COMMAND:
+      fprintf(destination, "%s{\"name\":\"command %c\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":3}",
+              sep, e.arg > 32 && e.arg < 127 ? e.arg : '?', ts);
+      break;
+    case TRACE_FLASH_START:
+    case TRACE_FLASH_END:
+      fprintf(destination, "%s{\"name\":\"write %s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":1,\"tid\":4}",
+              sep, e.arg ? "patient.txt" : "cal.txt", e.type == TRACE_FLASH_START ? "B" : "E", ts);
+      break;
+    case TRACE_OUTPUT:
+      fprintf(destination, "%s{\"name\":\"output\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":5,\"args\":{\"bytes\":%d}}",
+              sep, ts, e.arg);
+      break;
+    case TRACE_BUTTON: {
+      static const char *buttons[] = {"blue", "yellow", "red"};
+      static const char *events[] = {"?", "press", "long press", "release"};
+      fprintf(destination, "%s{\"name\":\"%s %s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":7}",
+              sep, buttons[(e.arg >> 4) % 3], events[e.arg & 3], ts);
+      break;
+    }
+    default:
+      fprintf(destination, "%s{\"name\":\"type %u\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":6,\"args\":{\"arg\":%d}}",
+              sep, e.type, ts, e.arg);
+      break;
+    }
+    sep = ",\n";
+  }
+  fprintf(destination, "\n]}\n");
+  fclose(destination);
+  printf("%u events written to %s\n", hdr[1], argv[2]);
+  return 0;
+}
@@ -20,7 +20,9 @@
     @brief Construction and Initialization of YGKMV System for communication
             with a display unit and / or other console on a serial connection.
     @param model  Hardware model to be initialized. Model 3 is the prototype
-                  shipped on 2020-04-15.
+                  shipped on 2020-04-15. The sensors and valves are fixed at
+                  compile time by YGKMV_MODEL, and the ventilator will not
+                  leave stop mode if this differs.
     @param disp   Serial connection for the display unit or NULL if the display
                   unit will use the USB Serial port.
     @param spd    Baud rate for Serial connections.
@@ -33,8 +35,7 @@ YGKMV::YGKMV(int model, HardwareSerial *disp, unsigned long spd) {
   baud = min(2000000UL,baud);
   displaySpeed = consoleSpeed = baud;   // same speed setting for both
   display = disp;
-  // change hardware setting to match models other than 3
-  
+  modelAsked = model;   // hardware settings come from ygkmv_model at compile time
   }
   
 YGKMV::~YGKMV() {}
@@ -47,32 +48,44 @@ YGKMV::~YGKMV() {}
 */
 /**************************************************************************/
 int YGKMV::begin(){
+  uno.paintStack();   // as early as possible, so stackUnused() sees everything after this
   pinMode(BUTTON_PIN, INPUT_PULLUP);
-  pinMode(BLUE_BUTTON_PIN, INPUT_PULLUP);
-  pinMode(YELLOW_BUTTON_PIN, INPUT_PULLUP);
-  pinMode(RED_BUTTON_PIN, INPUT_PULLUP);
+  setupButtons();
   pinMode(aPins[ALARM], OUTPUT);
   pinMode(BLOWER_SPEED_PIN, OUTPUT);
   analogWrite(BLOWER_SPEED_PIN,BLOWER_MIN);
   uno.begin(consoleSpeed);
+  resetProfile();
   if(display){ 
     display->begin(displaySpeed);
     while(!*display && millis() < 5000);
   }
-  servoCPAP.attach(dPins[CPAP]);   ///< actuates CPAP valve only 11
-  servoPEEP.attach(dPins[PEEP]);   ///< actuates PEEP valve only 10
-  servoDual.attach(dPins[DUAL]);   ///< actuates both valve bodies alternately 9
+  if(ygkmv_model::servos & (1 << CPAP)) servoCPAP.attach(dPins[CPAP]);   ///< actuates CPAP valve only 11
+  if(ygkmv_model::servos & (1 << PEEP)) servoPEEP.attach(dPins[PEEP]);   ///< actuates PEEP valve only 10
+  if(ygkmv_model::servos & (1 << DUAL)) servoDual.attach(dPins[DUAL]);   ///< actuates both valve bodies alternately 9
   PR("\n\nYGK Modular Ventilator\n\nFirmware Library Version: "); PL(YGKMV_VERSION); 
+  buildCalTables();        // defaults, rebuilt by any calibration lines in the file
   int fl = setupFlash();   // reads all the calibration data, hardware model and serial numbers
   PR("setupFlash() returns "); PL(fl);
   if(fl > 0) v_patientSet = true;  ///< a patient data file was found
   if(fl < 0){ ///< no calibration file was found
     v_calFile = false;  
   } else v_calFile = true;
+#if YGKMV_SD_LOG
+  int lg = setupLog();     // erases the log area, can take a few seconds
+  PR("setupLog() returns "); PL(lg);
+#endif
   PR("Hardware Model: "); PR(p_modelNumber); PR("    Serial Number: "); PR(p_serialNumber);
   PR("\n\n");
+  if(!modelMatches()){
+    PR("ERROR: firmware was built for hardware model "); PR(YGKMV_MODEL);
+    PR(", the sketch asks for "); PR(modelAsked); PR(" and the calibration file has "); PR(p_modelNumber);
+    PR(".\nThe ventilator will stay stopped until they match. Load the right firmware, or\n");
+    PR("correct the stored number with M "); PR(YGKMV_MODEL); PR(" and save it with w.\n\n");
+  }
   setupP();
   setupQ();
+  setupSamples();
   servoDual.write(aMid);
   servoPEEP.write(aMaxPEEP); 
   servoCPAP.write(aMaxCPAP);  
@@ -105,12 +118,26 @@ int YGKMV::status(){
 
 /**************************************************************************/
 /*!
-    @brief Go to Run mode by setting the appropriate state parameter flags.
+    @brief Check the model the sketch constructed this for and the model
+            number from the calibration file against YGKMV_MODEL.
+    @param none
+    @return true if both match the hardware model the firmware was built for
+*/
+/**************************************************************************/
+bool YGKMV::modelMatches(){
+  return modelAsked == YGKMV_MODEL && p_modelNumber == YGKMV_MODEL;
+}
+
+/**************************************************************************/
+/*!
+    @brief Go to Run mode by setting the appropriate state parameter flags,
+            unless the hardware model doesn't match the firmware.
     @param none
     @return none
 */
 /**************************************************************************/
 void YGKMV::setRun(){
+    if(!modelMatches()) return;     // the sensors and valves may not be the ones this was built for
     p_closeCPAP = false;
     p_openAll = false;
     p_stopped = false;
@@ -132,17 +159,15 @@ void YGKMV::setupP(){  // do any setup required for pressure measurement
  
 /**************************************************************************/
 /*!
-    @brief 
+    @brief Smoothed patient pressure from the samples processed so far by
+            loopSamples(). Does not read the sensor.
     @param none
-    @return none
+    @return patient pressure [cm H2O]
 */
 /**************************************************************************/
 double YGKMV::getP(){  // return the current value for patient pressure in cm H20
-  double v = uno.getV(aPins[PATIENT]); // instantaneous voltage
-  double w = v_tauW; // weighting factor for exponential smoothing
-  v_px137v = v_px137v * (1-w) + v * w; // smoothed voltage
-  double p = (v_px137v - offset[PATIENT]) * scale[PATIENT];
-  return p;   
+  if(ygkmv_model::pSource == YGKMV_P_NONE) return 0.0;
+  return (v_px137v - offset[PATIENT]) * scale[PATIENT];
 }
 
 /**************************************************************************/
@@ -153,27 +178,30 @@ double YGKMV::getP(){  // return the current value for patient pressure in cm H2
 */
 /**************************************************************************/
 void YGKMV::setupQ(){  // do any setup required for flow measurement
+  if(ygkmv_model::qSource == YGKMV_Q_NONE) return;
   for(int i = 0; i < 100; i++){
-    v_CPAPv = uno.getV(aPins[CPAP]);  
-    v_PEEPv = uno.getV(aPins[PEEP]);  
+    v_CPAPv = readV(aPins[CPAP]);  
+    if(ygkmv_model::qSource == YGKMV_Q_CAP2) v_PEEPv = readV(aPins[PEEP]);  
   }
 }
 
+
+
 /**************************************************************************/
 /*!
-    @brief 
+    @brief Smoothed patient flow from the samples processed so far by
+            loopSamples(), less the leak estimate if p_leakComp. Also sets
+            v_qCPAP and v_qPEEP. Does not read the sensors.
     @param none
-    @return none
+    @return patient flow [l/min]
 */
 /**************************************************************************/
 double YGKMV::getQ(){  // return the current value for patient flow in litres / minute
-  double w = v_tauW; // weighting factor for exponential smoothing
-  double v = uno.getV(aPins[CPAP]); // instantaneous voltage
-  v_CPAPv = v_CPAPv * (1-w) + v * w; // smoothed voltage
-  v = uno.getV(aPins[PEEP]); // instantaneous voltage
-  v_PEEPv = v_PEEPv * (1-w) + v * w; // smoothed voltage
-  v_qCPAP = (v_CPAPv - offset[CPAP]) * scale[CPAP];  // flow on the CPAP side
-  v_qPEEP = (v_PEEPv - offset[PEEP]) * scale[PEEP];  // minus return flow on the PEEP side
+  if(ygkmv_model::qSource == YGKMV_Q_NONE) return 0.0;
+  v_qCPAP = calFlow(CPAP, v_CPAPv);  // flow on the CPAP side
+  v_qPEEP = 0.0;
+  if(ygkmv_model::qSource == YGKMV_Q_CAP2) v_qPEEP = calFlow(PEEP, v_PEEPv);  // minus return flow on the PEEP side
+  if(p_leakComp) return v_qCPAP - v_qPEEP - v_qLeak;
   return v_qCPAP - v_qPEEP;
 }
 
@@ -185,7 +213,8 @@ double YGKMV::getQ(){  // return the current value for patient flow in litres /
 */
 /**************************************************************************/
 double YGKMV::getQCPAP(){  // return the instantaneous value for CPAP side flow in litres / minute
-  return (uno.getV(aPins[CPAP]) - offset[CPAP]) * scale[CPAP];  // flow on the CPAP side
+  if(ygkmv_model::qSource == YGKMV_Q_NONE) return 0.0;
+  return calFlow(CPAP, readV(aPins[CPAP]));  // flow on the CPAP side
 }
 
 /**************************************************************************/
@@ -196,5 +225,95 @@ double YGKMV::getQCPAP(){  // return the instantaneous value for CPAP side flow
 */
 /**************************************************************************/
 double YGKMV::getQPEEP(){  // return the instantaneous value for PEEP side flow in litres / minute
-  return (uno.getV(aPins[PEEP]) - offset[PEEP]) * scale[PEEP];  // flow on the PEEP side
+  if(ygkmv_model::qSource != YGKMV_Q_CAP2) return 0.0;
+  return calFlow(PEEP, readV(aPins[PEEP]));  // flow on the PEEP side
+}
+
+/**************************************************************************/
+/*!
+    @brief Look for a patient effort in the unsmoothed samples, either a
+            drop in pressure below p_epl - p_eplTol or flow over p_trigQ that
+            is rising faster than p_trigDQ. The flow slope is taken across
+            the last TRIG_SAMPLES intervals, and a condition has to hold for
+            TRIG_SAMPLES samples in a row, so one noisy sample can't start a
+            breath. Call for every new sample. Only detects while
+            p_trigArmed, and keeps the time of the first sample of the
+            effort until run() starts the breath and clears v_trigTime.
+    @param p unsmoothed patient pressure [cm H2O]
+    @param q unsmoothed patient flow [l/min]
+    @param t micros() when the sample was taken
+    @return true if this sample triggered a breath
+*/
+/**************************************************************************/
+bool YGKMV::sampleTrigger(double p, double q, unsigned long t){
+  static double qHist[TRIG_SAMPLES + 1];        // recent flow samples, oldest at next
+  static unsigned long tHist[TRIG_SAMPLES + 1]; // and their times
+  static int next = 0;                          // oldest entry, overwritten by this sample
+  static int nP = 0, nQ = 0;                    // samples in a row meeting each condition
+  static unsigned long tP = 0, tQ = 0;          // time of the first of them
+  double dq = 0.0;                              // rate of change of flow [l/min / s]
+  if(tHist[next] != 0 && t != tHist[next])
+    dq = (q - qHist[next]) * 1000000. / (unsigned long)(t - tHist[next]);
+  qHist[next] = q;
+  tHist[next] = t;
+  next = (next + 1) % (TRIG_SAMPLES + 1);
+  if(!p_trigArmed || v_trigTime){
+    nP = nQ = 0;
+    return false;
+  }
+  if((p > 1.0) && (p < p_epl - p_eplTol)){
+    if(nP++ == 0) tP = t;
+  } else nP = 0;
+  if(p_trigQ > 0 && q > p_trigQ && dq > p_trigDQ){
+    if(nQ++ == 0) tQ = t;
+  } else nQ = 0;
+  if(nP >= TRIG_SAMPLES){
+    v_trigSource = TRIG_P;
+    v_trigTime = tP;
+  } else if(nQ >= TRIG_SAMPLES){
+    v_trigSource = TRIG_Q;
+    v_trigTime = tQ;
+  } else return false;
+  if(!v_trigTime) v_trigTime = 1;   // 0 means no trigger
+  nP = nQ = 0;
+  trace(TRACE_TRIGGER, v_trigSource);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Integrate one unsmoothed flow sample into the rolling inspired
+            and expired volumes with the trapezoidal rule, using the actual
+            time between samples. A segment that crosses zero flow is split
+            at the crossing so each part goes to the right accumulator.
+            Also integrates positive pressure for the leak estimate.
+    @param q unsmoothed patient flow [l/min], positive toward the patient
+    @param p unsmoothed patient pressure [cm H2O]
+    @param t micros() when the sample was taken
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::integrateQ(double q, double p, unsigned long t){
+  static double qLast = 0.0;      // previous flow sample
+  static double pLast = 0.0;      // previous pressure sample
+  static unsigned long tLast = 0; // previous sample time
+  if(tLast != 0){
+    double dt = (unsigned long)(t - tLast) / 60000.;  // [ml / (l/min)] for this interval
+    if(qLast >= 0 && q >= 0) v_vr += (qLast + q) / 2 * dt;
+    else if(qLast <= 0 && q <= 0) v_ver -= (qLast + q) / 2 * dt;
+    else{                         // crossed zero at fraction f of the interval
+      double f = qLast / (qLast - q);
+      if(qLast > 0){
+        v_vr += qLast / 2 * f * dt;
+        v_ver -= q / 2 * (1 - f) * dt;
+      } else {
+        v_ver -= qLast / 2 * f * dt;
+        v_vr += q / 2 * (1 - f) * dt;
+      }
+    }
+    v_pint += max((pLast + p) / 2, 0.0) * dt / 1000.;
+  }
+  qLast = q;
+  pLast = p;
+  tLast = t;
 }
@@ -12,6 +12,17 @@
 #include <SdFat.h>                // https://github.com/adafruit/SdFat
 #include <Adafruit_SPIFlash.h>    // https://github.com/adafruit/Adafruit_SPIFlash
 
+#ifndef YGKMV_MODEL
+#define YGKMV_MODEL 3   ///< hardware model compiled in, see ygkmv_model_traits below
+#endif
+
+#define YGKMV_P_NONE     0  ///< pressure source: none, getP() reads 0
+#define YGKMV_P_PX137    1  ///< pressure source: PX137 analog patient pressure
+#define YGKMV_Q_NONE     0  ///< flow source: none, getQ() reads 0
+#define YGKMV_Q_VENTURI  1  ///< flow source: venturi pressure on the CPAP pin, Q = VENTURI_QSCALE * sqrt(p)
+#define YGKMV_Q_CAP2     2  ///< flow source: capillary elements on CPAP and PEEP feeds, difference is flow
+#define VENTURI_QSCALE 11.28  ///< (l/min) / cmH2O^0.5 for the model 2 venturi
+
 #define CPAP    0 ///< index number for the CPAP servo or flow pressure
 #define PEEP    1 ///< index number for the PEEP servo or flow pressure
 #define DUAL    2 ///< index number for the Dual servo
@@ -30,16 +41,274 @@
 #define YGKMV_EPH_ERROR  0b0000000000100000  ///<    32 Expiration Pressure High > p_eph
 #define YGKMV_ETS_ERROR  0b0000000001000000  ///<    64 Expiration Time Short < p_etl
 #define YGKMV_ETL_ERROR  0b0000000010000000  ///<   128 Expiration Time Long > p_eth
+#define YGKMV_MEM_ERROR  0b0000000100000000  ///<   256 Unused stack / heap headroom has dropped below MEM_LOW
 #define YGKMV_STOP_ERROR 0b0000100000000000  ///<  2048 We have been in stop mode longer than ALARM_STOP
 #define YGKMV_STOP_WARN  0b0001000000000000  ///<  4096 Going back to run mode soon
 #define YGKMV_SLOW_ERROR 0b0010000000000000  ///<  8192 Loop is not executing in under ALARM_DELAY_LOOP
 #define YGKMV_DISP_ERROR 0b0100000000000000  ///< 16384 Display/Console Incognito longer than ALARM_DELAY_DISPLAY
 #define YGKMV_EXT_ERROR  0b1000000000000000  ///< 32768 External Error
-#define YGKMV_BUZ_ERROR  0b1111100000000000  ///< Only make a local buzzer noise for these error states
+#define YGKMV_BUZ_ERROR  0b1111100100000000  ///< Only make a local buzzer noise for these error states
+// The buzzer is for the states the display unit may not be able to announce:
+// the controller itself failing (MEM, SLOW), the link to the display (DISP,
+// EXT) and ventilation stopped (STOP). MEM latches because the stack high
+// water mark never goes back up, so the margin is gone until a reset even
+// when the stack has since shrunk, and the next deep call chain can crash
+// the controller with no other warning.
+
+#define YGKMV_ALARM_RULES  13  ///< number of entries in the alarm rule table
+
+#define YGKMV_PROFILE 1     ///< set 0 to compile out the run() section profiler
+#define PROF_OTHER    0     ///< profiler section: everything in loop() outside run()
+#define PROF_FLASH    1     ///< profiler section: uno.run() and patient file writes
+#define PROF_CONSOLE  2     ///< profiler section: loopConsole() and stop checks
+#define PROF_SENSE    3     ///< profiler section: loopSamples(), getP() and getQ()
+#define PROF_BREATH   4     ///< profiler section: breath state machine
+#define PROF_VALVES   5     ///< profiler section: servo and blower writes
+#define PROF_ALARMS   6     ///< profiler section: buttons, alarms and buzzer
+#define PROF_OUT      7     ///< profiler section: loopOut()
+#define PROF_SECTIONS 8
+#define PROF_BUCKETS 24     ///< log2 buckets, the last one holds everything over 2^22 ticks
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3)
+  #define PROF_USE_DWT 1    ///< Cortex-M3 and up have a cycle counter
+  #define PROF_TICKS_PER_US (F_CPU / 1000000)
+#else
+  #define PROF_USE_DWT 0    ///< Cortex-M0+ (SAMD21) and others use micros()
+  #define PROF_TICKS_PER_US 1
+#endif
+
+#define TRACE_SIZE      256  ///< events in the trace ring, must be a power of 2
+#define TRACE_MAGIC  "YGKT"  ///< marks the start of a binary trace dump
+#define TRACE_PHASE       1  ///< trace event: v_ieEntered changed, arg is the new value
+#define TRACE_TRIGGER     2  ///< trace event: patient trigger detected, arg is TRIG_P or TRIG_Q
+#define TRACE_ALARM_SET   3  ///< trace event: alarm bit set, arg is the bit
+#define TRACE_ALARM_CLR   4  ///< trace event: alarm bit cleared, arg is the bit
+#define TRACE_COMMAND     5  ///< trace event: command received, arg is the command letter
+#define TRACE_FLASH_START 6  ///< trace event: flash file write started, arg 0 for cal, 1 for patient
+#define TRACE_FLASH_END   7  ///< trace event: flash file write finished, arg as for TRACE_FLASH_START
+#define TRACE_OUTPUT      8  ///< trace event: output line sent, arg is the length
+#define TRACE_BUTTON      9  ///< trace event: debounced button event, arg is button * 16 + BUTTON_EV_ type
+
+#define CAL_POINTS        8  ///< most measured calibration points per flow channel
+#define CAL_LUT_SIZE    128  ///< intervals in each flow lookup table, spread from 0 V to the ADC reference
+#define CAL_LUT_FRAC      8  ///< fraction bits in the lookup table position
+#define CAL_LUT_MAX 2000000  ///< largest table entry [ml/min], keeps the interpolation inside 32 bits
+#define CAL_FINE_SIZE    72  ///< intervals each side of the offset in the venturi fine table, 16 unit steps then 8 per octave
+#define CAL_FINE_SPAN  2048  ///< reach of the fine table each side of the offset [table position units], 8 main intervals
+
+#define CAL_IDLE          0  ///< calibration sequencer: not running
+#define CAL_ZERO          1  ///< calibration sequencer: blower off, valves open, average for offsets
+#define CAL_SWEEP         2  ///< calibration sequencer: stepping one servo toward closed, see calSweep
+#define CAL_MATCH         3  ///< calibration sequencer: stepping the blower to fit the scales to reference meter readings
+#define CAL_SWEEPS        4  ///< CPAP, PEEP, Dual closing CPAP, Dual closing PEEP
+#define CAL_ZERO_SETTLE 3000 ///< [ms] let the blower spin down before averaging for offsets
+#define CAL_SETTLE     1000  ///< [ms] wait after each valve or blower change before averaging
+#define CAL_AVERAGE     500  ///< [ms] average readings for this long at each step
+#define CAL_STEP_DEG      2  ///< servo sweep step [degrees]
+#define CAL_CLOSED     0.05  ///< a valve is closed once flow falls below this fraction of its open flow
+#define CAL_Q_MIN       2.0  ///< [lpm] open flow needed for a sweep to mean anything
+#define CAL_MATCH_STEPS   4  ///< blower speeds from BLOWER_MIN to BLOWER_MAX for the scale fits
+
+#ifndef YGKMV_SAMPLE_TIMER
+  #if defined(__SAMD21G18A__)
+    #define YGKMV_SAMPLE_TIMER 1  ///< take sensor samples from a TC3 interrupt, see YGKMVsample.cpp
+  #else
+    #define YGKMV_SAMPLE_TIMER 0  ///< no sample timer, run() takes one sample each time through
+  #endif
+#endif
+#define SAMPLE_US      2000  ///< [us] between timer samples, each one is up to three analogRead() conversions
+#define SAMPLE_US_MAX 20000  ///< [us] longest interval TC3 can time, 16 bits at 48 MHz / 16
+#define SAMPLE_LOAD      10  ///< setupSamples() lengthens the interval so sampleTick() takes at most 1 / SAMPLE_LOAD of the CPU
+#define SAMPLE_QUEUE     64  ///< samples held for run(), must be a power of 2, 64 covers 128 ms of loop()
+
+#define SNAP_MAGIC   "YGKS"  ///< marks the start of a binary snapshot dump
+#define SNAP_TRIES        8  ///< give up reading a snapshot after this many torn copies
+
+#ifndef YGKMV_SD_LOG
+#define YGKMV_SD_LOG      0  ///< set 1 on units with an SD socket to stream output lines to the card
+#endif
+#define LOG_CS_PIN        4  ///< SD card chip select, 4 on the Feather M0 Adalogger
+#define LOG_FILE "/ventlog.csv"  ///< SD log file, replaced every time the log starts
+#define LOG_BLOCKS   32768UL ///< [512 byte blocks] pre-erased for the log, 16 MB is about 3 h of output lines
+#define LOG_ERASE   262144UL ///< [blocks] most to erase with one command
+#define LOG_QUEUE         4  ///< 512 byte blocks that can wait for a busy card, at least 2, 4 covers a 500 ms stall
+#define LOG_OFF           0  ///< SD log state: not started or stopped
+#define LOG_RUN           1  ///< SD log state: card in multi-block write mode, taking lines
+#define LOG_FULL          2  ///< SD log state: all LOG_BLOCKS written
+#define LOG_ERROR         3  ///< SD log state: a card write failed
+
+/**************************************************************************/
+/*!
+    @brief  Measured calibration points for one flow channel, kept sorted by
+            voltage. Fewer than 2 points means use the offset and scale.
+*/
+/**************************************************************************/
+typedef struct {
+  uint8_t n;                ///< number of points in use
+  float v[CAL_POINTS];      ///< flow element voltage [V]
+  float q[CAL_POINTS];      ///< flow at that voltage [l/min]
+} ygkmv_cal_t;
+
+/**************************************************************************/
+/*!
+    @brief  Hardware model traits, picked at compile time by YGKMV_MODEL so
+            getP(), getQ() and the servo writes only contain the code for the
+            sensors and valves that model has. Branches on these constants
+            are folded away by the compiler. An undefined model will not
+            compile. begin() checks the model the sketch asks for and the
+            one stored in the calibration file against it, and the
+            ventilator stays stopped if either differs.
+*/
+/**************************************************************************/
+template <int model> struct ygkmv_model_traits;
+
+#if YGKMV_MODEL == 0 && defined(__arm__)
+#error "YGKMV_MODEL 0 is for host tests and simulation only, build for the hardware model fitted"
+#endif
+
+/// Model 0: host tests and simulation only, valves but no patient sensors
+template <> struct ygkmv_model_traits<0> {
+  static const int pSource = YGKMV_P_NONE;
+  static const int qSource = YGKMV_Q_NONE;
+  static const int servos = 0b111;      ///< bit mask of the CPAP, PEEP and DUAL servos fitted
+};
+
+/// Model 2: single Dual servo gate with a venturi flow meter
+template <> struct ygkmv_model_traits<2> {
+  static const int pSource = YGKMV_P_PX137;
+  static const int qSource = YGKMV_Q_VENTURI;
+  static const int servos = 0b100;
+};
+
+/// Model 3: single or double servo gates with flow elements in both feeds
+template <> struct ygkmv_model_traits<3> {
+  static const int pSource = YGKMV_P_PX137;
+  static const int qSource = YGKMV_Q_CAP2;
+  static const int servos = 0b111;
+};
+
+typedef ygkmv_model_traits<YGKMV_MODEL> ygkmv_model;  ///< traits of the model being built
+
+/**************************************************************************/
+/*!
+    @brief  One event in the trace ring
+*/
+/**************************************************************************/
+typedef struct {
+  uint32_t t;       ///< micros() when the event was recorded
+  uint8_t type;     ///< TRACE_ event type
+  uint8_t spare;    ///< keeps arg aligned
+  int16_t arg;      ///< event specific value
+} ygkmv_trace_t;
+
+/**************************************************************************/
+/*!
+    @brief  One set of raw sensor readings in the sample ring
+*/
+/**************************************************************************/
+typedef struct {
+  uint32_t t;       ///< micros() when the first conversion started
+  uint16_t a[3];    ///< analogRead() values for CPAP, PEEP and PATIENT
+} ygkmv_sample_t;
+
+/**************************************************************************/
+/*!
+    @brief  SD card log queue and timing, see YGKMVlog.cpp
+*/
+/**************************************************************************/
+typedef struct {
+  uint8_t state;                  ///< LOG_OFF, LOG_RUN, LOG_FULL or LOG_ERROR
+  uint8_t depthMax;               ///< most full blocks waiting at once
+  uint16_t fill;                  ///< bytes in the block being filled
+  unsigned long head;             ///< blocks ever filled, the one being filled is head % LOG_QUEUE
+  unsigned long tail;             ///< blocks ever sent to the card
+  unsigned long queued[LOG_QUEUE]; ///< micros() when each waiting block was filled
+  unsigned long lines;            ///< lines logged
+  unsigned long dropped;          ///< lines dropped because the queue was full
+  unsigned long busy;             ///< loopLog() calls that found a block waiting and the card busy
+  unsigned long waitTotal;        ///< [us] from blocks filling to being sent
+  unsigned long waitMax;          ///< [us] longest any block waited
+  unsigned long writeTotal;       ///< [us] in writeData()
+  unsigned long writeMax;         ///< [us] longest writeData()
+} ygkmv_log_t;
+
+/**************************************************************************/
+/*!
+    @brief  Published measurement state, copied from the v_ members once per
+            run() by publishSnapshot(). Read it with getSnapshot() rather
+            than the v_ members so an output never mixes two ticks.
+*/
+/**************************************************************************/
+typedef struct {
+  uint32_t seq;     ///< publication count, increases by one each run()
+  uint32_t t;       ///< millis() when published
+  float prog;       ///< progress through the current scheduled breath
+  float fracCPAP;   ///< target opening fraction for the CPAP valve
+  float fracPEEP;   ///< target opening fraction for the PEEP valve
+  float fracDual;   ///< target position for the Dual valve
+  float o2;         ///< v_o2
+  float p;          ///< v_p [cm H2O]
+  float pSet;       ///< v_pSet [cm H2O]
+  float q;          ///< v_q [l/min]
+  float vr;         ///< v_vr [ml]
+  float ipp;        ///< v_ipp [cm H2O]
+  float ipl;        ///< v_ipl [cm H2O]
+  float epp;        ///< v_epp [cm H2O]
+  float epl;        ///< v_epl [cm H2O]
+  float pp;         ///< v_pp [cm H2O]
+  float pl;         ///< v_pl [cm H2O]
+  float bpm;        ///< v_bpm
+  float v;          ///< v_v [ml]
+  float mv;         ///< v_mv [l/min]
+  float batv;       ///< v_batv [V]
+  float tl;         ///< v_tl [ms]
+  float ql;         ///< v_ql [l/min]
+  uint32_t alarm;   ///< v_alarm
+  int16_t it;       ///< v_it [ms]
+  int16_t et;       ///< v_et [ms]
+  int8_t ie;        ///< v_ie
+  int8_t spare[3];  ///< keeps the size a multiple of 4
+} ygkmv_snap_t;
+
+/**************************************************************************/
+/*!
+    @brief  Timing statistics for one section of run()
+*/
+/**************************************************************************/
+typedef struct {
+  unsigned long count;              ///< number of times through the section
+  unsigned long total;              ///< total ticks spent in the section
+  unsigned long max;                ///< longest time through the section [ticks]
+  unsigned long hist[PROF_BUCKETS]; ///< log2 histogram of times [ticks]
+} ygkmv_prof_t;
+
+/**************************************************************************/
+/*!
+    @brief  One entry in the alarm rule table. Conditions are evaluated in
+            run() as bits, the rule decides when the bit in v_alarm changes.
+*/
+/**************************************************************************/
+typedef struct {
+  unsigned long bit;      ///< YGKMV_*_ERROR bit for this alarm
+  unsigned int onDelay;   ///< [ms] condition must last this long before the bit is set
+  unsigned int offDelay;  ///< [ms] condition must be gone this long before the bit is cleared
+  uint8_t breaths;        ///< breaths that must start while the condition lasts before the bit is set
+  uint8_t priority;       ///< 1 is most urgent
+  bool latching;          ///< true to hold the bit until reset by the button or an A-1 command
+} ygkmv_alarm_rule_t;
 
 #define BLUE_BUTTON_PIN     12  ///< pin with blue button pulled low when pushed
 #define YELLOW_BUTTON_PIN    3  ///< pin with yellow button pulled low when pushed
-#define RED_BUTTON_PIN       4  ///< pin with red button pulled low when pushed
+#define RED_BUTTON_PIN       4  ///< pin with red button pulled low when pushed, no interrupt on the Feather M0 so run() polls it
+#define BUTTONS              3  ///< blue, yellow and red
+#define BUTTON_BLUE          0  ///< button index, main / only button, same pin as BUTTON_PIN
+#define BUTTON_YELLOW        1  ///< button index
+#define BUTTON_RED           2  ///< button index
+#define BUTTON_QUEUE        16  ///< raw edges held between run() calls, must be a power of 2
+#define BUTTON_DEBOUNCE     20  ///< [ms] a level must hold this long after the last edge to count
+#define BUTTON_LONG       1500  ///< [ms] held this long for a long press
+#define BUTTON_EV_PRESS      1  ///< button event: pushed
+#define BUTTON_EV_LONG       2  ///< button event: still held after BUTTON_LONG
+#define BUTTON_EV_RELEASE    3  ///< button event: let go
 #define BLOWER_SPEED_PIN    A0  ///< analogWrite() between about 350 and 750 for speed
 #define BLOWER_MIN         350
 #define BLOWER_MID         550
@@ -48,6 +317,14 @@
 #define BLOWER_GAIN        0.1  ///< proportional control gain 1.0 sounds unstable
 #define BLOWER_GAIN_I      0.001  ///< integral control gain
 #define MAX_COMMAND_LENGTH 200  ///< no lines longer than this for commands or output
+#define FLASH_READ_BUFFER  512  ///< [bytes] buffer for reading command files from flash
+
+#define SERVO_US_MIN       544  ///< writeMicroseconds() pulse width for 0 degrees, same as Servo.h MIN_PULSE_WIDTH
+#define SERVO_US_MAX      2400  ///< writeMicroseconds() pulse width for 180 degrees, same as Servo.h MAX_PULSE_WIDTH
+#define SLEW_STEP            1  ///< valve slew profile: jump straight to the new position
+#define SLEW_LINEAR          2  ///< valve slew profile: constant speed, a full move takes slewTime
+#define SLEW_SCURVE          3  ///< valve slew profile: constant acceleration then deceleration, a full move takes slewTime
+#define SLEW_TIME_MAX     1000  ///< [ms] longest permitted valve slew time
 
 #define PB_DEF 10000    ///< breathing rate default [ms / breath]
 #define PB_MAX 10000    ///< slowest breathing
@@ -64,6 +341,16 @@
 #define IP_MIN 2        ///< Inspiration pressure min
 #define EP_MIN 1        ///< Expiration pressure min
 #define EPLTOL_MAX 10   ///< Max value for the tolerance
+#define TRIGQ_MAX 20    ///< Max flow threshold for flow triggering [lpm]
+#define TRIGDQ_MAX 500  ///< Max rate of flow increase for flow triggering [lpm / s]
+
+#define LEAK_WEIGHT 0.25  ///< smoothing weight for each new breath in the leak conductance estimate
+#define LEAKK_MAX   5.0   ///< Max leak conductance [(l/min) / cm H2O]
+
+#define TRIG_NONE 0     ///< breath was not triggered by the patient
+#define TRIG_P    1     ///< breath was triggered by a pressure drop
+#define TRIG_Q    2     ///< breath was triggered by rising flow
+#define TRIG_SAMPLES 3  ///< consecutive samples that must meet a trigger condition, flow slope is taken over this many intervals
 
 #define IQ_MAX 50       ///< Inspiration flow max [lpm]
 #define EQ_MAX 50       ///< Expiration flow max [lpm]
@@ -80,21 +367,34 @@
 #define ALARM_AUTO_REPEAT  30000  ///< [ms] reset the alarm so it sounds again after about this long 
 #define ALARM_HOLIDAY      40000  ///< [ms] don't alarm if millis() is less than this, since display has not woken up
 #define ALARM_STOP         30000  ///< [ms] alarm if stopped for longer than this
+#define ALARM_ONSET_HIGH_P   100  ///< [ms] high pressure must last this long to alarm, so a cough doesn't
+#define ALARM_ONSET_LOW_P    500  ///< [ms] low pressure must last this long to alarm, keep it under one breath so a disconnect alarms in the first breath
+#define ALARM_ONSET_SLOW    1000  ///< [ms] loop time must stay over ALARM_DELAY_LOOP this long to alarm, one loop over 5 times that alarms at once
+#define ALARM_ONSET_BREATHS    0  ///< bad breaths after the first before a breath time alarm, 0 alarms on the first
+#define ALARM_CLEAR_HIGH_P  2000  ///< [ms] high inspiration pressure must be gone this long to clear
+#define ALARM_CLEAR_P       5000  ///< [ms] other pressure and loop time conditions must be gone this long to clear
+#define ALARM_CLEAR_BREATH 10000  ///< [ms] breath time conditions must be gone this long to clear
+#define ALARM_CLEAR_STATE   1000  ///< [ms] display and stop conditions must be gone this long to clear
 
 #define YGKMV_STARTUP      60000  ///< [ms] before we consider ourselves in normal operation
 
+#define MEM_LOW             2048  ///< [bytes] alarm if the stack has ever come this close to the heap
+#define MEM_CHECK_INTERVAL  1000  ///< [ms] between scans for the stack high water mark
+
 /**************************************************************************/
 /*!
     @brief  The YGKMV class
 */
 class YGKMV{
   public:
-    YGKMV(int model = 3, HardwareSerial *disp = NULL, unsigned long spd = 115200);
+    YGKMV(int model = YGKMV_MODEL, HardwareSerial *disp = NULL, unsigned long spd = 115200);
     virtual ~YGKMV();
     int begin();
     int status();
     int run(bool reset = false);  ///< execute every time through the loop, run or idling
+    bool getSnapshot(ygkmv_snap_t *s);  ///< consistent copy of the state published by run()
     void setRun();  ///< Switch to Run mode, breathing the ventilator
+    bool modelMatches();  ///< true if the sketch and calibration file agree with YGKMV_MODEL
     void listConsoleCommands();
     bool loopConsole();
     boolean doConsoleCommand(String cmd);
@@ -109,6 +409,12 @@ class YGKMV{
     double getQ();
     double getQCPAP();
     double getQPEEP();
+    void setupSamples();
+    void sampleTick();
+    void loopSamples();
+    double readV(int pin);
+    bool sampleTrigger(double p, double q, unsigned long t);
+    void integrateQ(double q, double p, unsigned long t);
     int setupFlash();
     int writeCalFlash();
     int readCalFlash();
@@ -118,12 +424,72 @@ class YGKMV{
     int readPatFlash();
     void delPatFlash();
     void wipePatFlash();
+    int doFlashCommands(File *f);
+    int echoFlashFile(StdioStream *f);
+    int setupLog();
+    void logLine(const char *s, size_t n);
+    void loopLog(bool wait = false);
+    void stopLog();
+    void showLog();
+    void setupButtons();
     void loopButtons();
+    void settleButton(int i, unsigned long t);
+    void buttonEvent(int button, int event);
     void loopOut();
+    void publishSnapshot();
+    void showSnapshot(bool binary);
+    void trace(uint8_t type, int16_t arg = 0);
+    void dumpTrace();
+    void profMark(int section);
+    void resetProfile();
+    double profPercentile(int section, double pc);
+    void showProfile();
+    void updateAlarms(unsigned long tested, unsigned long present, unsigned long urgent = 0);
+    unsigned long alarmTop();
+    void showAlarms();
+    void showMemory();
+    void buildCalTables();
+    double calFlow(int ch, double v);
+    bool addCalPoint(int ch, double v, double q);
+    void showCalTables();
+    void startCalibration();
+    void stopCalibration(const char *why);
+    bool calStep();
+    bool calReference(double q, double p);
+    void calFinish();
+    void calNextSweep();
+    void calPositions();
+    void writeServos(double posCPAP, double posPEEP, double posDual);
+    void resetServos();
     
   private:
     RWS_UNO uno = RWS_UNO();
     Servo servoCPAP, servoPEEP, servoDual;
+    Servo *servos[3] = {&servoCPAP, &servoPEEP, &servoDual}; ///< indexed by CPAP, PEEP, DUAL
+    static const ygkmv_alarm_rule_t alarmRules[YGKMV_ALARM_RULES];  ///< see YGKMValarm.cpp
+    int usLast[3] = {-1, -1, -1};     ///< last pulse width written to each servo [us], -1 forces a write
+    int usTarget[3] = {-1, -1, -1};   ///< pulse width at the end of the current trajectory [us]
+    double usPos[3] = {0};            ///< position along the trajectory [us]
+    double usVel[3] = {0};            ///< speed along the trajectory [us / ms], signed for SLEW_SCURVE
+    double usAcc[3] = {0};            ///< SLEW_SCURVE acceleration limit [us / ms^2]
+    unsigned long slewLast[3] = {0};  ///< micros() at the last trajectory update
+    int lastBlower = -1;              ///< last value written to BLOWER_SPEED_PIN, -1 forces a write
+    ygkmv_prof_t prof[PROF_SECTIONS]; ///< run() section timing statistics
+    ygkmv_trace_t traceRing[TRACE_SIZE];  ///< recent events, see trace()
+    unsigned long traceHead = 0;      ///< number of events ever recorded, next slot is traceHead % TRACE_SIZE
+    unsigned long profLast = 0;       ///< profiler timer at the last profMark()
+    volatile ygkmv_sample_t sampleRing[SAMPLE_QUEUE]; ///< raw readings waiting for loopSamples()
+    volatile unsigned long sampleHead = 0; ///< samples ever taken, the next goes in sampleHead % SAMPLE_QUEUE
+    unsigned long sampleTail = 0;     ///< samples ever taken out of the ring by loopSamples()
+    unsigned long sampleDropped = 0;  ///< samples overwritten before loopSamples() got to them
+    bool sampleTimer = false;         ///< true once the timer interrupt is taking samples
+    unsigned long samplePeriod = SAMPLE_US;  ///< [us] between timer samples, set by setupSamples()
+    volatile unsigned long sampleBusy = 0;    ///< [us] spent in sampleTick() since resetProfile()
+    volatile unsigned long sampleBusyN = 0;   ///< sampleTick() calls since resetProfile()
+    volatile unsigned long sampleBusyMax = 0; ///< [us] longest sampleTick() since resetProfile()
+    ygkmv_log_t logStat = {};         ///< SD log queue and timing, see loopLog()
+    ygkmv_snap_t snapBuf;             ///< latest published state, see publishSnapshot()
+    volatile uint32_t snapSeq = 0;    ///< seqlock count, odd while snapBuf is being written
     int dPins[10] = {11, 10, 9, 12, 5}; ///< pins for CPAP, PEEP, Dual Servos, Button, Alarm
     // Analog Inputs / Outputs as arrays replace individual variables.
     // Offsets are in volts measured from the analog input pins.
@@ -132,9 +498,39 @@ class YGKMV{
     int aPins[6] = {A3, A4, A5, A2};    ///< pins for CPAP, PEEP, Patient pressures, bat
     double scale[6] = {1.0, 1.0, 1.0, 5.0, 1.0, 1.0};  ///< scale factors for pressure, etc.
     double offset[6] = {1.0, 1.0, 1.0, 0.0, 1.0, 1.0}; ///< voltage offsets for pressure, etc
+    ygkmv_cal_t calPts[2] = {};          ///< measured flow calibration points for CPAP and PEEP
+    int32_t calLut[2][CAL_LUT_SIZE + 1]; ///< flow [ml/min] at equal voltage steps for CPAP and PEEP, see buildCalTables()
+    double calStepsPerV = CAL_LUT_SIZE * (1 << CAL_LUT_FRAC) / 3.3; ///< volts to fixed point table position
+    int32_t calFine[2][ygkmv_model::qSource == YGKMV_Q_VENTURI ? CAL_FINE_SIZE + 1 : 1]; ///< venturi flow [ml/min] above and below the CPAP offset
+    int32_t calFineAt = 0;            ///< CPAP offset as a table position
+    bool calFineOn = false;           ///< true while CPAP follows the venturi law and calFine applies
+    bool btnDown[BUTTONS] = {0};      ///< debounced state, true while pushed
+    bool btnRaw[BUTTONS] = {0};       ///< latest edge level, true for pushed
+    bool btnLong[BUTTONS] = {0};      ///< long press already reported for this push
+    bool btnPolled[BUTTONS] = {0};    ///< no pin interrupt available, so run() samples the pin
+    unsigned long btnFirst[BUTTONS] = {0}; ///< millis() of the first edge since the level was stable
+    unsigned long btnEdge[BUTTONS] = {0};  ///< millis() of the latest edge
+    unsigned long btnPressT[BUTTONS] = {0}; ///< millis() when the current push started
+    int calState = CAL_IDLE;          ///< calibration sequencer state, see calStep()
+    int calSweep = 0;                 ///< servo sweep in progress, 0 to CAL_SWEEPS - 1
+    int calAngle = 0;                 ///< servo angle for the current sweep step [degrees]
+    int calDir = 1;                   ///< sweep direction, +1 or -1 degrees
+    int calSteps = 0;                 ///< steps taken in the current sweep or blower match
+    double calOpenQ = 0.0;            ///< flow at the start of the current sweep [l/min]
+    double calSum[3] = {0};           ///< sums of patient, CPAP and PEEP voltages for averaging
+    unsigned long calN = 0;           ///< number of readings in calSum
+    unsigned long calT0 = 0;          ///< millis() at the start of the current step
+    double calSxy[3] = {0}, calSxx[3] = {0}; ///< least squares sums for the CPAP, PEEP and patient scale fits
+    double calRefV[3] = {0};          ///< averaged CPAP, PEEP and patient voltages waiting for a reference reading
+    bool calWaiting = false;          ///< holding a blower step until calReference() gets the meter readings
+    int calPos[3] = {90, 90, 90};     ///< servo angles while calibrating, indexed by CPAP, PEEP, DUAL
+    int calBlower = 0;                ///< blower output while calibrating
+    double calSaved[6] = {0};         ///< offsets and scales for patient, CPAP and PEEP to restore on abort
+    int calSavedAngles[6] = {0};      ///< servo angles to restore on abort
     int pinBlower = 5;
     int verbosity = 10;
-    int model = 3;
+    static const int model = YGKMV_MODEL;  ///< hardware model the firmware was built for
+    int modelAsked = YGKMV_MODEL;     ///< hardware model the sketch constructed this for
     HardwareSerial *display = NULL;
     unsigned long displaySpeed = 115200;
     unsigned long consoleSpeed = 115200;
@@ -150,6 +546,8 @@ class YGKMV{
     // We need to wait a little while before we say we are in the next phase.
     int ieTime = 400;   ///< transition between end of inspiration and start of expiration phase
     int eiTime = 400;   ///< transition time between end of expiration phase and start of inspiration phase
+    int slewProfile = SLEW_STEP;  ///< SLEW_STEP, SLEW_LINEAR or SLEW_SCURVE for valve moves
+    int slewTime = 0;   ///< time to move a valve to a new position [ms], ignored for SLEW_STEP
 
     double fracCPAP = 1.0;  ///< target opening fraction for the CPAP valve. 0 for closed, 1.0 for wide open
     double fracPEEP = 1.0;  ///< target opening fraction for the CPAP valve. 0 for closed, 1.0 for wide open
@@ -164,6 +562,12 @@ class YGKMV{
     double v_p = 0.0;             ///< current instantaneous pressure [cm H2O]
     double v_pSet = 0.0;          ///< current set point pressure for controls to target [cm H2O]
     double v_q = 0.0;             ///< current instantaneous flow to patient [l/min]
+    double v_pRaw = 0.0;          ///< latest unsmoothed patient pressure sample [cm H2O]
+    double v_qRaw = 0.0;          ///< latest unsmoothed patient flow sample [l/min]
+    unsigned long v_sampleTime = 0; ///< micros() when the latest sample was taken, see loopSamples()
+    unsigned long v_trigTime = 0; ///< micros() of the first sample of the effort that triggered the next breath, 0 if none yet
+    int v_trigSource = TRIG_NONE; ///< what triggered the last breath, TRIG_NONE, TRIG_P or TRIG_Q
+    double v_tl = 0.0;            ///< latency from the first triggering sample to the inspiration valve command [ms], 0 if not triggered
     double v_qSetHigh = IQ_MAX;   ///< current set point high limit for instantaneous flow to patient [l/min]
     double v_qCPAP = 0.0;         ///< current instantaneous flow returning on PEEP side [l/min]
     double v_qPEEP = 0.0;         ///< current instantaneous flow out on CPAP side [l/min]
@@ -187,21 +591,39 @@ class YGKMV{
     double v_bpms = 0.0;          ///< BPM averaged over recent breaths
     double v_v = 0.0;             ///< inspiration volume of last breath [ml]
     double v_vr = 0.0;            ///< rolling inspiration volume of current breath [ml]
+    double v_ve = 0.0;            ///< expiration volume of last breath [ml]
+    double v_ver = 0.0;           ///< rolling expiration volume of current breath [ml]
+    double v_vl = 0.0;            ///< inspired minus expired volume of last breath, leakage not compensated [ml]
+    double v_pint = 0.0;          ///< rolling integral of positive patient pressure this breath [cm H2O min]
+    double v_vlc = 0.0;           ///< rolling leak volume taken out of the flow samples this breath [ml]
+    double v_leakK = 0.0;         ///< estimated leak conductance, leak flow = v_leakK * pressure [(l/min) / cm H2O]
+    double v_qLeak = 0.0;         ///< current smoothed leak flow estimate [l/min]
+    double v_ql = 0.0;            ///< average leak flow estimate over last breath [l/min]
     double v_mv = 0.0;            ///< volume per minute averaged over recent breaths [l / min]
     unsigned long v_alarm = 0;    ///< status code, normally YGKMV_NO_ERROR, YGKMV_EXT_ERROR if externally imposed
     double v_batv = 0.;           ///< measured battery voltage, should be over 13 for powered, over 12 for charge remaining
+    unsigned long v_memUnused = 0;  ///< smallest gap there has been between heap and stack [bytes], from the last scan
     double v_venturiv = 0.;       ///< measured venturi voltage
     double v_px137v = 0.;         ///< measured patient pressure voltage
     double v_CPAPv = 0.;          ///< measured CPAP side flow element voltage
     double v_PEEPv = 0.;          ///< measured PEEP side flow element voltage
     int v_ie = 0;                 ///< set to 0 when between phases, 1 for inspiration phase, -1 for expiration phase
     int v_ieEntered = 0;          ///< like v_ie, except no transition. Always set to phase entering or in, only 0 on stop
+    unsigned long v_wr = 0;       ///< rolling count of servo and blower writes during current breath
+    unsigned long v_wpb = 0;      ///< servo and blower writes during last breath
+    unsigned long v_breaths = 0;  ///< breaths started since power up
     unsigned long v_alarmOnTime = 0;    ///< time of the first alarm state that occurred since all alarms were clear
     unsigned long v_alarmOffTime = 0;   ///< time that alarms were last cleared
+    unsigned long v_alarmRaw = 0;       ///< alarm conditions present when last tested, before delays
+    unsigned long v_alarmSince[YGKMV_ALARM_RULES] = {0};   ///< time each raw condition last changed
+    unsigned long v_alarmSinceBreath[YGKMV_ALARM_RULES] = {0}; ///< v_breaths when each raw condition last changed
+    unsigned long v_alarmSetTime[YGKMV_ALARM_RULES] = {0}; ///< time each alarm bit was last set
+    unsigned long v_alarmClrTime[YGKMV_ALARM_RULES] = {0}; ///< time each alarm bit was last cleared
+    unsigned int v_alarmCount[YGKMV_ALARM_RULES] = {0};    ///< number of times each alarm bit has been set
     unsigned long v_lastStop = 0; ///< set to millis() when the last Stop Command input was received
     unsigned long v_firstRun = 0; ///< set to millis() when the first setRun() call takes place
     unsigned long v_lastPatChange = 0; ///< set to millis() when the patient data changes, then set to zero when patient file written
-    double v_tauW = 0.001;        ///< the smoothing weight factor to use this cycle for time constant p_tau
+    double v_tauW = 0.001;        ///< the smoothing weight factor used for the latest sample, time constant p_tau
     bool v_patientSet = false;    ///< set true if a patient data file is found, or if patient parameters have been set
     bool v_justStarted = true;    ///< set true to start, then set false until power down
     bool v_calFile = false;       ///< set true if a calibration and configuration file exists
@@ -220,6 +642,10 @@ class YGKMV{
     int p_eth = ET_MAX;
     int p_etl = ET_MIN;
     bool p_trigEnabled = false;   ///< enable triggering on pressure limits
+    bool p_leakComp = false;      ///< set true to subtract estimated leak flow from patient flow
+    bool p_trigArmed = false;     ///< set by run() while a patient effort may start the next breath
+    double p_trigQ = 0.0;         ///< trigger when flow is over this [l/min] and rising, 0 for pressure only
+    double p_trigDQ = 30.0;       ///< and flow is rising faster than this [l/min / s]
     bool p_patFlashEnabled = false; ///< set true to enable saving patient settings to flash
     bool p_patFlashWritten = false; ///< patient flash has been written at least once this cycle
     bool p_closeCPAP = true;      ///< set true to close the CPAP valve, must be set false for normal running
@@ -230,9 +656,9 @@ class YGKMV{
     bool p_plotterMode = false;   ///< set true for output visualization using arduino ide plotter mode
     bool p_printConsole = true;   ///< set false to turn off console data output, notmally true
     double p_tau = 0.10;          ///< instrumentation smoothing time constant [s]
-    int p_modelNumber = 3;        ///< Hardware model number, 1 was abandoned, 2 was single servo and venturi, 
+    int p_modelNumber = YGKMV_MODEL; ///< Hardware model number, 1 was abandoned, 2 was single servo and venturi, 
                                   //   3 is single or double servo gates with flow elements in both feeds 
-    int p_serialNumber = 30000001;///< Hardware serial number is model number * 10000000 + unique integer
+    int p_serialNumber = YGKMV_MODEL * 10000000 + 1; ///< Hardware serial number is model number * 10000000 + unique integer
 
 
 
@@ -0,0 +1,131 @@
+/**************************************************************************/
+/*!
+  @file YGKMValarm.cpp
+
+  @section intro Introduction
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  MIT license
+*/
+/**************************************************************************/
+#include "YGKMV.h"
+
+// The alarm rule table, one entry per bit, with every priority different.
+// Pressure conditions are tested on every pass through their phase and
+// only have to last ALARM_ONSET_HIGH_P or ALARM_ONSET_LOW_P, so a cough
+// isn't an alarm and a disconnect is within its first breath. Breath time
+// conditions are tested once per breath, and alarm on the first bad breath
+// unless ALARM_ONSET_BREATHS asks for more. DISP and STOP already wait
+// ALARM_DELAY_DISPLAY and ALARM_STOP before they are raised, and MEM
+// latches on the first sighting. SLOW waits out a slow loop(), but one
+// five times too slow is urgent and alarms at once, as it always has. The clearing delays hold an alarm through
+// a brief recovery. The buzzer still waits ALARM_DELAY after v_alarmOnTime
+// as well.
+const ygkmv_alarm_rule_t YGKMV::alarmRules[YGKMV_ALARM_RULES] = {
+  // bit               onDelay             offDelay            breaths              priority latching
+  {YGKMV_IPH_ERROR,  ALARM_ONSET_HIGH_P, ALARM_CLEAR_HIGH_P, 0,                    1,  false},
+  {YGKMV_EPH_ERROR,  ALARM_ONSET_HIGH_P, ALARM_CLEAR_P,      0,                    2,  false},
+  {YGKMV_IPL_ERROR,  ALARM_ONSET_LOW_P,  ALARM_CLEAR_P,      0,                    3,  false},
+  {YGKMV_EPL_ERROR,  ALARM_ONSET_LOW_P,  ALARM_CLEAR_P,      0,                    4,  false},
+  {YGKMV_SLOW_ERROR, ALARM_ONSET_SLOW,   ALARM_CLEAR_P,      0,                    5,  false},
+  {YGKMV_MEM_ERROR,  0,                  0,                  0,                    6,  true},
+  {YGKMV_ITL_ERROR,  0,                  ALARM_CLEAR_BREATH, ALARM_ONSET_BREATHS,  7,  false},
+  {YGKMV_ETL_ERROR,  0,                  ALARM_CLEAR_BREATH, ALARM_ONSET_BREATHS,  8,  false},
+  {YGKMV_ITS_ERROR,  0,                  ALARM_CLEAR_BREATH, ALARM_ONSET_BREATHS,  9,  false},
+  {YGKMV_ETS_ERROR,  0,                  ALARM_CLEAR_BREATH, ALARM_ONSET_BREATHS, 10,  false},
+  {YGKMV_DISP_ERROR, 0,                  ALARM_CLEAR_STATE,  0,                   11,  false},
+  {YGKMV_STOP_ERROR, 0,                  ALARM_CLEAR_STATE,  0,                   12,  false},
+  {YGKMV_STOP_WARN,  0,                  0,                  0,                   13,  false},
+};
+
+/**************************************************************************/
+/*!
+    @brief Apply the alarm rule table to the conditions found this time
+            through run(). Alarms not tested this time keep their state, so
+            phase specific alarms hold through the other phase.
+    @param tested  alarm bits whose conditions were evaluated
+    @param present alarm bits whose conditions are currently true
+    @param urgent  present bits so far out that they skip the onset delay
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::updateAlarms(unsigned long tested, unsigned long present, unsigned long urgent){
+  unsigned long now = millis();
+  unsigned long changed = (v_alarmRaw ^ present) & tested;  // raw conditions that changed
+  v_alarmRaw = (v_alarmRaw & ~tested) | (present & tested);
+  unsigned long setBits = 0, clrBits = 0;
+  for(int i = 0; i < YGKMV_ALARM_RULES; i++){
+    const ygkmv_alarm_rule_t *r = &alarmRules[i];
+    if(!(tested & r->bit)) continue;
+    if(changed & r->bit){
+      v_alarmSince[i] = now;
+      v_alarmSinceBreath[i] = v_breaths;
+    }
+    if(v_alarmRaw & r->bit){
+      if((urgent & r->bit) || (now - v_alarmSince[i] >= r->onDelay
+        && v_breaths - v_alarmSinceBreath[i] >= r->breaths)) setBits |= r->bit;
+    } else if(!r->latching && now - v_alarmSince[i] >= r->offDelay) clrBits |= r->bit;
+  }
+  unsigned long rising = setBits & ~v_alarm;    // bits about to be set
+  unsigned long falling = clrBits & v_alarm;    // bits about to be cleared
+  v_alarm = (v_alarm | setBits) & ~clrBits;
+  if(setBits && !v_alarmOnTime) v_alarmOnTime = now;  // set alarm time if not already
+  if(!(rising | falling)) return;
+  for(int i = 0; i < YGKMV_ALARM_RULES; i++){
+    if(rising & alarmRules[i].bit){
+      v_alarmSetTime[i] = now;
+      v_alarmCount[i]++;
+      trace(TRACE_ALARM_SET, alarmRules[i].bit);
+    }
+    if(falling & alarmRules[i].bit){
+      v_alarmClrTime[i] = now;
+      trace(TRACE_ALARM_CLR, alarmRules[i].bit);
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Find the most urgent alarm that is currently set.
+    @param none
+    @return the YGKMV_*_ERROR bit with the best priority, YGKMV_EXT_ERROR if
+            only externally imposed, or YGKMV_NO_ERROR
+*/
+/**************************************************************************/
+unsigned long YGKMV::alarmTop(){
+  unsigned long top = v_alarm & YGKMV_EXT_ERROR;
+  int best = 256;
+  for(int i = 0; i < YGKMV_ALARM_RULES; i++){
+    if((v_alarm & alarmRules[i].bit) && alarmRules[i].priority < best){
+      best = alarmRules[i].priority;
+      top = alarmRules[i].bit;
+    }
+  }
+  return top;
+}
+
+/**************************************************************************/
+/*!
+    @brief Show the state, counts and last set/clear times for every alarm.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::showAlarms(){
+  char sc[MAX_COMMAND_LENGTH] = {0};
+  P("    Alarm  Set  Raw  Count    Last Set  Last Clear  Priority  Delays [ms], breaths\n");
+  for(int i = 0; i < YGKMV_ALARM_RULES; i++){
+    const ygkmv_alarm_rule_t *r = &alarmRules[i];
+    sprintf(sc, "    %5lu  %3d  %3d  %5u  %10lu  %10lu  %8u  %u / %u, %u%s\n", r->bit,
+      (v_alarm & r->bit) != 0, (v_alarmRaw & r->bit) != 0, v_alarmCount[i],
+      v_alarmSetTime[i], v_alarmClrTime[i], r->priority, r->onDelay, r->offDelay,
+      r->breaths, r->latching ? " latching" : "");
+    P(sc);
+  }
+  P("    Most urgent: "); PL(alarmTop());
+}
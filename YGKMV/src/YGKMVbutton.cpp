@@ -0,0 +1,195 @@
+/**************************************************************************/
+/*!
+  @file YGKMVbutton.cpp
+
+  @section intro Introduction
+
+  Pushbutton input. Pin change interrupts put timestamped raw edges in a
+  small single producer / single consumer queue, so no press is missed
+  however long loop() takes. run() drains the queue, debounces each button
+  and acts on press, long press and release events. Pins without an
+  external interrupt are sampled by run() into the same queue.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  MIT license
+*/
+/**************************************************************************/
+#include "YGKMV.h"
+
+typedef struct {
+  uint32_t t;       ///< millis() at the edge
+  uint8_t button;   ///< BUTTON_BLUE, BUTTON_YELLOW or BUTTON_RED
+  uint8_t down;     ///< 1 if the pin read pushed (low) after the edge
+} ygkmv_edge_t;
+
+static const uint8_t buttonPins[BUTTONS] = {BLUE_BUTTON_PIN, YELLOW_BUTTON_PIN, RED_BUTTON_PIN};
+static volatile ygkmv_edge_t edges[BUTTON_QUEUE];
+static volatile uint8_t edgeHead = 0;   // only changed by pushEdge()
+static volatile uint8_t edgeTail = 0;   // only changed by loopButtons()
+static volatile bool edgeLost = false;  // the queue was full, resample the pins
+
+/**************************************************************************/
+/*!
+    @brief Add an edge to the queue. Called from the interrupts, or from
+            run() with interrupts off for polled pins.
+    @param b button index
+    @return none
+*/
+/**************************************************************************/
+static void pushEdge(uint8_t b){
+  uint8_t h = edgeHead;
+  if((uint8_t)(h - edgeTail) >= BUTTON_QUEUE){
+    edgeLost = true;
+    return;
+  }
+  volatile ygkmv_edge_t *e = &edges[h & (BUTTON_QUEUE - 1)];
+  e->t = millis();
+  e->button = b;
+  e->down = digitalRead(buttonPins[b]) == LOW;
+  edgeHead = h + 1;       // publish after the entry is complete
+}
+
+static void blueEdge(){ pushEdge(BUTTON_BLUE); }
+static void yellowEdge(){ pushEdge(BUTTON_YELLOW); }
+static void redEdge(){ pushEdge(BUTTON_RED); }
+
+/**************************************************************************/
+/*!
+    @brief Set up the button pins and attach the edge interrupts.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::setupButtons(){
+  void (*isrs[BUTTONS])() = {blueEdge, yellowEdge, redEdge};
+  for(int i = 0; i < BUTTONS; i++){
+    pinMode(buttonPins[i], INPUT_PULLUP);
+    btnDown[i] = btnRaw[i] = digitalRead(buttonPins[i]) == LOW;
+    int irq = digitalPinToInterrupt(buttonPins[i]);
+#ifdef ARDUINO_ARCH_SAMD
+    // the SAMD core returns quietly from attachInterrupt() for these, and
+    // pin 4 on the Feather M0 is PA08, the NMI line
+    EExt_Interrupts in = g_APinDescription[buttonPins[i]].ulExtInt;
+    btnPolled[i] = (in == NOT_AN_INTERRUPT || in == EXTERNAL_INT_NMI);
+#else
+    btnPolled[i] = (irq == NOT_AN_INTERRUPT);
+#endif
+    if(!btnPolled[i]) attachInterrupt(irq, isrs[i], CHANGE);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Drain the edge queue, debounce, and turn the results into press,
+            long press and release events. A level only counts once it has
+            held for BUTTON_DEBOUNCE after the last edge, and the event is
+            timed from the first edge of the bounce. Levels are settled at
+            the time of each queued edge as well as now, so a whole push
+            made while run() was away still gives its press and release.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::loopButtons(){
+  unsigned long now = millis();
+  for(int i = 0; i < BUTTONS; i++){    // sample pins with no interrupt
+    if(btnPolled[i] && (digitalRead(buttonPins[i]) == LOW) != btnRaw[i]){
+      noInterrupts();
+      pushEdge(i);
+      interrupts();
+    }
+  }
+  while(edgeTail != edgeHead){
+    volatile ygkmv_edge_t *e = &edges[edgeTail & (BUTTON_QUEUE - 1)];
+    int b = e->button;
+    settleButton(b, e->t);  // the level before this edge may have held long enough
+    if(btnRaw[b] == btnDown[b] && e->t - btnEdge[b] >= BUTTON_DEBOUNCE) btnFirst[b] = e->t;  // first edge of a burst
+    btnRaw[b] = e->down;
+    btnEdge[b] = e->t;
+    edgeTail++;             // frees the slot for the producers
+  }
+  if(edgeLost){             // missed some edges, so trust the pins as they are now
+    edgeLost = false;
+    for(int i = 0; i < BUTTONS; i++){
+      bool down = digitalRead(buttonPins[i]) == LOW;
+      if(down != btnRaw[i]){
+        if(btnRaw[i] == btnDown[i] && now - btnEdge[i] >= BUTTON_DEBOUNCE) btnFirst[i] = now;
+        btnRaw[i] = down;
+        btnEdge[i] = now;
+      }
+    }
+  }
+  for(int i = 0; i < BUTTONS; i++){
+    settleButton(i, now);
+    if(btnDown[i] && !btnLong[i] && now - btnPressT[i] >= BUTTON_LONG){
+      btnLong[i] = true;
+      buttonEvent(i, BUTTON_EV_LONG);
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Make the latest edge level of a button its debounced state if it
+            has held for BUTTON_DEBOUNCE by time t, with the press or
+            release event. A push that had already lasted BUTTON_LONG gets
+            its long press event before the release.
+    @param i button index
+    @param t millis() to settle at, now or the time of the next edge
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::settleButton(int i, unsigned long t){
+  if(btnRaw[i] == btnDown[i] || t - btnEdge[i] < BUTTON_DEBOUNCE) return;
+  btnDown[i] = btnRaw[i];
+  if(btnDown[i]){
+    btnPressT[i] = btnFirst[i];
+    btnLong[i] = false;
+    buttonEvent(i, BUTTON_EV_PRESS);
+  } else {
+    if(!btnLong[i] && btnFirst[i] - btnPressT[i] >= BUTTON_LONG){
+      btnLong[i] = true;
+      buttonEvent(i, BUTTON_EV_LONG);
+    }
+    buttonEvent(i, BUTTON_EV_RELEASE);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Act on a debounced button event.
+    @param button BUTTON_BLUE, BUTTON_YELLOW or BUTTON_RED
+    @param event BUTTON_EV_PRESS, BUTTON_EV_LONG or BUTTON_EV_RELEASE
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::buttonEvent(int button, int event){
+  trace(TRACE_BUTTON, button * 16 + event);
+  if(button == BUTTON_BLUE && event == BUTTON_EV_PRESS){  // main / only button
+    setRun();
+    /************** turn on plotter mode  ***************************/
+    p_plotterMode = true;
+
+    /************** Decrease the peak pressure **********************/
+    p_iph = min(p_iph,24);
+
+    /******************* enable triggering ****************/
+    p_trigEnabled = true;
+
+    /******************* reset alarm conditions to turn off buzzer *******/
+    v_alarm = YGKMV_NO_ERROR;  // reset alarm conditions
+    v_alarmOffTime = millis();
+    v_alarmOnTime = 0;
+    p_alarm = false;
+  }
+  if(button == BUTTON_YELLOW && event == BUTTON_EV_PRESS){  // silence the buzzer without changing modes
+    v_alarm = YGKMV_NO_ERROR;
+    v_alarmOffTime = millis();
+    v_alarmOnTime = 0;
+  }
+}
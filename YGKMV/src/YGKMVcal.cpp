@@ -0,0 +1,466 @@
+/**************************************************************************/
+/*!
+  @file YGKMVcal.cpp
+
+  @section intro Introduction
+
+  Flow calibration curves. Each flow channel has a table of flows at equal
+  voltage steps from 0 V to the ADC reference, built once from either the
+  measured calibration points (piecewise linear, extrapolated from the end
+  segments), the venturi square root law, or the plain offset and scale.
+  Converting a sample is then one multiply to find the table position and
+  an integer interpolation between two entries.
+
+  The venturi square root law is steepest at the offset, where equal steps
+  would leave the largest error at the lowest flows. On model 2 a second
+  table covers the 8 main intervals each side of the CPAP offset, with 16
+  unit steps next to it and then 8 steps per doubling of the distance, so
+  the spacing grows with the flow. Its index is one count of leading zeros
+  and a shift, no square root or division.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  MIT license
+*/
+/**************************************************************************/
+#include "YGKMV.h"
+
+/**************************************************************************/
+/*!
+    @brief Flow at a voltage from the calibration that applies to a channel,
+            without the table. Only used to fill the table.
+    @param c measured calibration points for the channel
+    @param offset channel voltage offset [V]
+    @param scale channel scale factor
+    @param v flow element voltage [V]
+    @return flow [l/min]
+*/
+/**************************************************************************/
+static double curveFlow(const ygkmv_cal_t *c, double offset, double scale, double v){
+  if(c->n >= 2){
+    int i = 1;
+    while(i < c->n - 1 && v > c->v[i]) i++;   // segment from point i-1 to i, end segments extend
+    double dv = c->v[i] - c->v[i-1];
+    if(dv <= 0) return c->q[i];
+    return c->q[i-1] + (c->q[i] - c->q[i-1]) * (v - c->v[i-1]) / dv;
+  }
+  if(ygkmv_model::qSource == YGKMV_Q_VENTURI)
+    return sqrt(fabs((v - offset) * scale)) * VENTURI_QSCALE;
+  return (v - offset) * scale;
+}
+
+/**************************************************************************/
+/*!
+    @brief Rebuild the flow lookup tables. Call after changing offsets,
+            scales or calibration points.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::buildCalTables(){
+  double vRef = uno.getVRef();
+  if(vRef <= 0) vRef = 3.3;
+  calStepsPerV = CAL_LUT_SIZE * (1 << CAL_LUT_FRAC) / vRef;
+  int chs[2] = {CPAP, PEEP};
+  for(int j = 0; j < 2; j++){
+    for(int i = 0; i <= CAL_LUT_SIZE; i++){
+      double q = 1000. * curveFlow(&calPts[j], offset[chs[j]], scale[chs[j]], vRef * i / CAL_LUT_SIZE);
+      q = constrain(q, -CAL_LUT_MAX, CAL_LUT_MAX);
+      calLut[j][i] = lround(q);
+    }
+  }
+  if(ygkmv_model::qSource != YGKMV_Q_VENTURI) return;
+  calFineOn = calPts[0].n < 2;
+  calFineAt = lround(offset[CPAP] * calStepsPerV);
+  for(int side = 0; side < 2; side++){
+    for(int i = 0; i <= CAL_FINE_SIZE; i++){
+      int s = i < 16 ? 0 : i / 8 - 1;               // inverse of the index in calFlow()
+      int32_t d = (i - 8 * s) << s;
+      double v = offset[CPAP] + (side ? -d : d) / calStepsPerV;
+      double q = 1000. * curveFlow(&calPts[0], offset[CPAP], scale[CPAP], v);
+      calFine[side][i] = lround(constrain(q, -CAL_LUT_MAX, CAL_LUT_MAX));
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Convert a flow element voltage to flow using the lookup table.
+    @param ch CPAP or PEEP
+    @param v flow element voltage [V]
+    @return flow [l/min]
+*/
+/**************************************************************************/
+double YGKMV::calFlow(int ch, double v){
+  const int32_t *t = calLut[ch == PEEP ? 1 : 0];
+  int32_t x = v * calStepsPerV + 0.5;                 // nearest table position, CAL_LUT_FRAC fraction bits
+  if(ygkmv_model::qSource == YGKMV_Q_VENTURI && ch != PEEP && calFineOn){
+    int32_t d = x - calFineAt;                        // distance from the offset
+    const int32_t *u = calFine[d < 0 ? 1 : 0];
+    if(d < 0) d = -d;
+    if(d < CAL_FINE_SPAN){
+      int32_t s = d < 16 ? 0 : 28 - __builtin_clz(d); // d is in [8 << s, 16 << s)
+      int32_t i = 8 * s + (d >> s);
+      int32_t f = ((d & ((1 << s) - 1)) << CAL_LUT_FRAC) >> s;
+      return (u[i] + (((u[i+1] - u[i]) * f) >> CAL_LUT_FRAC)) * 0.001;
+    }
+  }
+  if(x < 0) x = 0;
+  int32_t i = x >> CAL_LUT_FRAC;
+  int32_t f = x & ((1 << CAL_LUT_FRAC) - 1);
+  if(i >= CAL_LUT_SIZE){                              // at or past the reference voltage
+    i = CAL_LUT_SIZE - 1;
+    f = 1 << CAL_LUT_FRAC;
+  }
+  int32_t q = t[i] + (((t[i+1] - t[i]) * f) >> CAL_LUT_FRAC);
+  return q * 0.001;
+}
+
+/**************************************************************************/
+/*!
+    @brief Add a measured calibration point to a flow channel, replacing any
+            point within 1 mV, and rebuild the tables.
+    @param ch CPAP or PEEP
+    @param v flow element voltage [V], negative to clear all the points
+    @param q measured flow at that voltage [l/min]
+    @return false if the channel already has CAL_POINTS points
+*/
+/**************************************************************************/
+bool YGKMV::addCalPoint(int ch, double v, double q){
+  ygkmv_cal_t *c = &calPts[ch == PEEP ? 1 : 0];
+  if(v < 0){
+    c->n = 0;
+  } else {
+    int i = 0;
+    while(i < c->n && c->v[i] < v - 0.001) i++;
+    if(i < c->n && c->v[i] <= v + 0.001){             // replace
+      c->v[i] = v;
+      c->q[i] = q;
+    } else {
+      if(c->n >= CAL_POINTS) return false;
+      for(int j = c->n; j > i; j--){                  // insert, keeping them sorted
+        c->v[j] = c->v[j-1];
+        c->q[j] = c->q[j-1];
+      }
+      c->v[i] = v;
+      c->q[i] = q;
+      c->n++;
+    }
+  }
+  buildCalTables();
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Show the calibration points and a coarse view of each table.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::showCalTables(){
+  const char *names[2] = {"CPAP", "PEEP"};
+  char sc[MAX_COMMAND_LENGTH] = {0};
+  for(int j = 0; j < 2; j++){
+    P("    "); P(names[j]); P(" flow: ");
+    if(calPts[j].n < 2) P(ygkmv_model::qSource == YGKMV_Q_VENTURI && j == 0 ? "venturi law from offset and scale" : "linear from offset and scale");
+    for(int i = 0; i < calPts[j].n; i++){
+      sprintf(sc, " %.4fV=%.3flpm", calPts[j].v[i], calPts[j].q[i]);
+      P(sc);
+    }
+    P("\n      table [lpm]:");
+    for(int i = 0; i <= CAL_LUT_SIZE; i += CAL_LUT_SIZE / 8){
+      sprintf(sc, " %.2f", calLut[j][i] * 0.001);
+      P(sc);
+    }
+    P("\n");
+    if(ygkmv_model::qSource == YGKMV_Q_VENTURI && j == 0 && calFineOn){
+      sprintf(sc, "      fine table within %.3f V of the offset\n", CAL_FINE_SPAN / calStepsPerV);
+      P(sc);
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Start the calibration sequencer. It runs a step at a time from
+            run(), so the loop keeps going. The patient port should be capped
+            so that all the flow in through CPAP leaves through PEEP.
+            Sequence: blower off with the valves open to find the offsets,
+            sweep each fitted servo from open toward closed until its flow
+            drops below CAL_CLOSED of the open flow, then step the blower
+            with both valves open and hold each speed for the readings of a
+            reference flow meter and manometer, entered with c2. The flow
+            and pressure scales are fitted to those readings, since with
+            the port capped the same flow passes both flow elements.
+            Results are written to cal.txt at the end.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::startCalibration(){
+  int chs[3] = {PATIENT, CPAP, PEEP};
+  for(int i = 0; i < 3; i++){
+    calSaved[i] = offset[chs[i]];
+    calSaved[i + 3] = scale[chs[i]];
+  }
+  int angles[6] = {aMinCPAP, aMaxCPAP, aMinPEEP, aMaxPEEP, aCloseCPAP, aClosePEEP};
+  for(int i = 0; i < 6; i++) calSavedAngles[i] = angles[i];
+  calState = CAL_ZERO;
+  calSum[0] = calSum[1] = calSum[2] = 0.0;
+  calN = 0;
+  for(int i = 0; i < 3; i++) calSxy[i] = calSxx[i] = 0.0;
+  calWaiting = false;
+  calT0 = millis();
+  calBlower = 0;
+  calPos[CPAP] = aMaxCPAP;
+  calPos[PEEP] = aMaxPEEP;
+  calPos[DUAL] = aMid;
+  P("    Calibration: blower off, valves open, measuring offsets\n");
+}
+
+/**************************************************************************/
+/*!
+    @brief Stop the calibration sequencer before it finishes and put back
+            the offsets, scales and servo angles it started with.
+    @param why reason to report
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::stopCalibration(const char *why){
+  if(calState == CAL_IDLE) return;
+  int chs[3] = {PATIENT, CPAP, PEEP};
+  for(int i = 0; i < 3; i++){
+    offset[chs[i]] = calSaved[i];
+    scale[chs[i]] = calSaved[i + 3];
+  }
+  aMinCPAP = calSavedAngles[0];   aMaxCPAP = calSavedAngles[1];
+  aMinPEEP = calSavedAngles[2];   aMaxPEEP = calSavedAngles[3];
+  aCloseCPAP = calSavedAngles[4]; aClosePEEP = calSavedAngles[5];
+  aMid = (aCloseCPAP + aClosePEEP) / 2.0;
+  buildCalTables();
+  calState = CAL_IDLE;
+  calWaiting = false;
+  P("    Calibration stopped, "); P(why); P(", previous values restored\n");
+}
+
+/**************************************************************************/
+/*!
+    @brief Set calPos for the current sweep: the swept servo at calAngle
+            and the others open.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::calPositions(){
+  calPos[CPAP] = aMaxCPAP;
+  calPos[PEEP] = aMaxPEEP;
+  calPos[DUAL] = aMid;
+  calPos[calSweep < DUAL ? calSweep : DUAL] = calAngle;
+}
+
+/**************************************************************************/
+/*!
+    @brief Move on to the next servo sweep that this model has a servo for,
+            or to the blower match once they are done.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::calNextSweep(){
+  calSteps = 0;
+  calT0 = millis();
+  calSum[0] = calSum[1] = calSum[2] = 0.0;
+  calN = 0;
+  if(calState == CAL_SWEEP) calSweep++;
+  else calSweep = 0;
+  calState = CAL_SWEEP;
+  while(calSweep < CAL_SWEEPS && !(ygkmv_model::servos & (1 << (calSweep < DUAL ? calSweep : DUAL)))) calSweep++;
+  if(calSweep >= CAL_SWEEPS){
+    calState = CAL_MATCH;
+    calPos[CPAP] = aMaxCPAP;
+    calPos[PEEP] = aMaxPEEP;
+    calPos[DUAL] = aMid;
+    calBlower = BLOWER_MIN;
+    P("    Calibration: both valves open, stepping the blower for reference readings\n");
+    return;
+  }
+  calBlower = BLOWER_MID;
+  switch(calSweep){ // start open and head away from the open position toward closed
+    case 0:
+      calAngle = aMaxCPAP;
+      calDir = (aMinCPAP < aMaxCPAP) ? -1 : 1;
+      break;
+    case 1:
+      calAngle = aMaxPEEP;
+      calDir = (aMinPEEP < aMaxPEEP) ? -1 : 1;
+      break;
+    case 2:
+      calAngle = aMid;
+      calDir = (aCloseCPAP < aMid) ? -1 : 1;
+      break;
+    default:
+      calAngle = aMid;
+      calDir = (aClosePEEP > aMid) ? 1 : -1;
+      break;
+  }
+  calPositions();
+  const char *names[CAL_SWEEPS] = {"CPAP valve", "PEEP valve", "Dual valve closing CPAP", "Dual valve closing PEEP"};
+  P("    Calibration: sweeping "); P(names[calSweep]); P(" from "); P(calAngle); P(" degrees\n");
+}
+
+/**************************************************************************/
+/*!
+    @brief Advance the calibration sequencer by one run() without waiting.
+            Averages the smoothed voltages once each step has settled, then
+            acts on the averages and sets up the next step.
+    @param none
+    @return true while calibrating, so run() uses calPos and calBlower
+*/
+/**************************************************************************/
+bool YGKMV::calStep(){
+  if(calState == CAL_IDLE) return false;
+  if(!p_stopped){       // never calibrate while ventilating
+    stopCalibration("left stop mode");
+    return false;
+  }
+  if(calWaiting) return true;   // holding this blower speed for calReference()
+  unsigned long t = millis() - calT0;
+  unsigned long settle = (calState == CAL_ZERO) ? CAL_ZERO_SETTLE : CAL_SETTLE;
+  if(t < settle) return true;
+  calSum[0] += v_px137v;
+  calSum[1] += v_CPAPv;
+  calSum[2] += v_PEEPv;
+  calN++;
+  if(t < settle + CAL_AVERAGE) return true;
+  double vP = calSum[0] / calN, vC = calSum[1] / calN, vE = calSum[2] / calN;
+  calSum[0] = calSum[1] = calSum[2] = 0.0;
+  calN = 0;
+  calT0 = millis();
+
+  if(calState == CAL_ZERO){
+    offset[PATIENT] = vP;
+    offset[CPAP] = vC;
+    offset[PEEP] = vE;
+    buildCalTables();
+    P("    Calibration: offsets "); P(vP, 4); P(", "); P(vC, 4); P(", "); P(vE, 4); P(" V\n");
+    calNextSweep();
+    return true;
+  }
+
+  if(calState == CAL_SWEEP){
+    int ch = CPAP;    // flow element that sees the valve, with the port capped either one sees them all
+    if((calSweep == 1 || calSweep == 3) && ygkmv_model::qSource == YGKMV_Q_CAP2) ch = PEEP;
+    double q = fabs(calFlow(ch, ch == CPAP ? vC : vE));
+    if(calSteps == 0){
+      calOpenQ = q;
+      if(q < CAL_Q_MIN){
+        P("    Calibration: only "); P(q); P(" lpm with the valve open, sweep skipped\n");
+        calNextSweep();
+        return true;
+      }
+    } else if(q < calOpenQ * CAL_CLOSED){
+      switch(calSweep){
+        case 0: aMinCPAP = calAngle; break;
+        case 1: aMinPEEP = calAngle; break;
+        case 2: aCloseCPAP = calAngle; break;
+        default: aClosePEEP = calAngle; break;
+      }
+      P("    Calibration: closed at "); P(calAngle); P(" degrees, "); P(q); P(" of "); P(calOpenQ); P(" lpm\n");
+      calNextSweep();
+      return true;
+    }
+    calSteps++;
+    calAngle += calDir * CAL_STEP_DEG;
+    if(calAngle < 0 || calAngle > 180){
+      P("    Calibration: no closed position found, angle unchanged\n");
+      calNextSweep();
+      return true;
+    }
+    calPositions();
+    return true;
+  }
+
+  // CAL_MATCH: hold this blower speed until the reference readings come in
+  calRefV[CPAP] = vC;
+  calRefV[PEEP] = vE;
+  calRefV[PATIENT] = vP;
+  calWaiting = true;
+  P("    Calibration: blower at "); P(calBlower);
+  P(", enter the reference flow [lpm] and pressure [cm H2O] as c2,<lpm>,<cm H2O>, or c3 to finish\n");
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Take the reference meter readings for the blower step the
+            sequencer is holding, add them to the scale fits and move on to
+            the next blower speed, or finish after CAL_MATCH_STEPS.
+    @param q reference flow through the capped circuit [l/min]
+    @param p reference pressure at the patient port [cm H2O], 0 if not read
+    @return false if the sequencer was not waiting for a reading
+*/
+/**************************************************************************/
+bool YGKMV::calReference(double q, double p){
+  if(calState != CAL_MATCH || !calWaiting) return false;
+  double x[3], y[3];    // sensor voltage above the offset and the value it should read
+  x[CPAP] = calRefV[CPAP] - offset[CPAP];
+  y[CPAP] = q;
+  if(ygkmv_model::qSource == YGKMV_Q_VENTURI){   // venturi pressure goes with flow squared
+    x[CPAP] = fabs(x[CPAP]);
+    y[CPAP] = q * q / (VENTURI_QSCALE * VENTURI_QSCALE);
+  }
+  x[PEEP] = calRefV[PEEP] - offset[PEEP];
+  y[PEEP] = q;
+  x[PATIENT] = calRefV[PATIENT] - offset[PATIENT];
+  y[PATIENT] = p;
+  for(int i = 0; i < 3; i++){
+    if(i == PATIENT && p == 0) continue;
+    calSxy[i] += x[i] * y[i];
+    calSxx[i] += x[i] * x[i];
+  }
+  calWaiting = false;
+  calSteps++;
+  calT0 = millis();
+  if(calSteps >= CAL_MATCH_STEPS) calFinish();
+  else calBlower = BLOWER_MIN + (BLOWER_MAX - BLOWER_MIN) * calSteps / (CAL_MATCH_STEPS - 1);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief End the calibration sequence: fit the scales to the reference
+            readings taken so far, keep the offsets and closed angles, and
+            write them all to cal.txt. A scale with no usable readings, or
+            a flow channel with measured calibration points, is unchanged.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::calFinish(){
+  if(calState == CAL_IDLE) return;
+  const char *names[3] = {"CPAP", "PEEP", "patient pressure"};
+  bool fit[3];
+  fit[CPAP] = ygkmv_model::qSource != YGKMV_Q_NONE && calPts[0].n < 2;
+  fit[PEEP] = ygkmv_model::qSource == YGKMV_Q_CAP2 && calPts[1].n < 2;
+  fit[PATIENT] = ygkmv_model::pSource != YGKMV_P_NONE;
+  for(int i = 0; i < 3; i++){
+    if(!fit[i]) continue;
+    P("    Calibration: "); P(names[i]);
+    if(calSxx[i] > 1e-6 && calSxy[i] / calSxx[i] > 0){
+      scale[i] = calSxy[i] / calSxx[i];
+      P(" scale "); P(scale[i]); P("\n");
+    } else P(" scale unchanged, no reference readings it follows\n");
+  }
+  aMid = (aCloseCPAP + aClosePEEP) / 2.0;
+  buildCalTables();
+  calState = CAL_IDLE;
+  calWaiting = false;
+  resetServos();
+  writeCalFlash();
+  P("    Calibration complete and written to cal.txt\n");
+}
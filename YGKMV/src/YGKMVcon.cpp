@@ -25,21 +25,30 @@ void YGKMV::listConsoleCommands() {
   P("\nApplication specific commands include:\n");
   P("  a - read and display (a)nalog voltages, averaging over n values, e.g. a10\n      Set offset values if n is less than 0, e.g. a-1\n");
   P("  A - set (A)larm condition on (positive argument),  off (negative argument),\n      or just show condition (0 argument), e.g. A-1\n");
+  P("  B - dump the event trace in (B)inary for extras/tracetojson, e.g. B\n");
+  P("  c - run the automatic (c)alibration sequence with the patient port capped (stopped only),\n      negative to abort, 0 to show progress, e.g. c1, then at each blower step give the\n      reference flow [lpm] and pressure [cm H2O], e.g. c2,45.2,12.5, or c3 to finish early\n");
   P("  C - set desired (C)alibration offsets and scale factors for patient pressure, CPAP flow, and PEEP flow\n      e.g. C1.2435,1.2532,1.3121,90.3,50.4,42.1\n");
   P("  D - set desired (D)amping time constant for noise reduction [s], e.g. D0.1\n");
   P("  e - set desired patient (e)xpiratory times target, high/low limits [ms], e.g. e2500,4500,1000\n");
   P("* E - set desired patient (E)xpiratory pressures high/low/trig tol [cm H2O], e.g. E28.2,6.3,1.0\n");
   P("  f - read and display (f)low values, averaging over n values, e.g. f10\n");
+  P("  g - (g)et the latest published state snapshot, positive argument for binary, e.g. g1\n");
   P("  i - set desired patient (i)nspiratory times target, high/low limits [ms], e.g. i2000,3500,1200\n");
   P("* I - set desired patient (I)nspiratory pressures high/low/trig tol [cm H2O], e.g. I38.2,16.3,1.0\n");
+  P("  K - add a flow calibration curve point for channel 1 CPAP or 2 PEEP at voltage [V], flow [lpm],\n      negative voltage clears the channel, no arguments shows the curves, e.g. K1,1.2532,0\n");
+  P("  L - set (L)eak compensation, positive for on, negative for off, e.g. L1, L alone shows the\n      leak estimate\n");
+  P("  l - show the SD (l)og queue and card wait times, negative to stop the log, positive to\n      erase and restart it, e.g. l-1\n");
+  P("  m - show (m)emory headroom, stack high water mark and heap usage, e.g. m\n");
   P("  M - set desired hardware (M)odel and serial numbers, e.g. M3,30000001\n");
+  P("  p - show the run() section (p)rofile timing, negative to reset after showing, e.g. p-1\n");
   P("  P - set print mode, positive for plotter mode on, negative for no console output, \n        0 for plotter mode off, e.g. P1\n");
   P("  r - (r)ead in the calibration, servo angles, and other settings from the file, e.g. r\n");
   P("* R - set to normal (R)un mode, e.g. R\n");
   P("  s - set closed/open settings for CPAP and PEEP valve (S)ervos interactively, e.g. s\n");
   P("  S - set closed/open settings for CPAP and PEEP valve (S)ervos, e.g. S130,180,90,140,66,98\n");
   P("* t - set desired inspiration/expiration (t)imes [ms], e.g. t1000,2000\n");
-  P("* T - set breath Triggering, positive for triggering on, negative for triggering off, e.g. T1\n");
+  P("* T - set breath Triggering, positive for triggering on, negative for triggering off, optional\n      flow trigger threshold [lpm] (negative for none) and rate of rise [lpm / s], e.g. T1 or T1,3.0,30,\n      T alone shows the settings and how the last breath was triggered\n");
+  P("  V - set (V)alve slew profile (1 step, 2 linear, 3 s-curve), slew time, and I/E, E/I\n      transition times [ms], e.g. V3,150,250,250\n      Out of range values reject the line with NOACK\n");
   P("  w - (w)rite out the calibration, servo angles, and other settings to the file, e.g. w\n");
   P("  W - (W)ipe out the calibration, servo angles, and other settings and return to defaults, e.g. W99\n");
   P("  x - open all valves and enter config mode, will not auto-return to run mode, e.g. x\n");
@@ -117,6 +126,7 @@ boolean YGKMV::doConsoleCommand(String cmd) {
   boolean ret = false;
   float val[10] = {0};
   char c = parseConsoleCommand(cmd, val, 10);
+  trace(TRACE_COMMAND, c);
   String s = cmd.substring(1); // the whole string after the command letter
   s.trim();                    // trimmed of white space
   int ival = val[0];           // an integer version of the first float arg
@@ -153,6 +163,45 @@ boolean YGKMV::doConsoleCommand(String cmd) {
     if(p_alarm) P("True, code: ");
     else P("False, code: ");
     PL(v_alarm);
+    showAlarms();
+    ret = true;
+    break;
+  case 'B': // Binary trace dump
+    P("ACK Event trace follows in binary, "); P(min(traceHead, (unsigned long) TRACE_SIZE)); P(" events\n");
+    dumpTrace();
+    ret = true;
+    break;
+  case 'c': // automatic calibration sequence
+    if (val[0] < 0){
+      P("ACK Calibration sequence abort\n");
+      stopCalibration("by command");
+    } else if (val[0] == 2 || val[0] == 3){
+      if(calState != CAL_MATCH || !calWaiting){
+        P("ACK Calibration sequence is not waiting for a reference reading\n");
+      } else if(val[0] == 3){
+        P("ACK Calibration sequence finishing with the reference readings so far\n");
+        calFinish();
+      } else if(val[1] <= 0){
+        P("ACK Reference flow must be more than 0, e.g. c2,45.2,12.5\n");
+      } else {
+        P("ACK Reference reading "); P(val[1]); P(" lpm, "); P(val[2]); P(" cm H2O\n");
+        calReference(val[1], val[2]);
+      }
+    } else if (val[0] > 0){
+      if(!p_stopped){ 
+        P("ACK You must be stopped to run this command! Use X or x to enter stop mode.\n");
+      } else if(calState != CAL_IDLE){
+        P("ACK Calibration sequence already running\n");
+      } else {
+        P("ACK Calibration sequence starting, make sure the patient port is capped\n");
+        startCalibration();
+      }
+    } else {
+      P("ACK Calibration sequence is "); P(calState == CAL_IDLE ? "idle" : "running");
+      if(calState == CAL_SWEEP){ P(", sweep "); P(calSweep); P(" at "); P(calAngle); P(" degrees"); }
+      if(calWaiting) P(", waiting for a reference reading");
+      P("\n");
+    }
     ret = true;
     break;
   case 'C': // Calibration Values
@@ -162,6 +211,7 @@ boolean YGKMV::doConsoleCommand(String cmd) {
     if (val[3] != 0) scale[PATIENT] = val[3];
     if (val[4] != 0) scale[CPAP] = val[4];
     if (val[5] != 0) scale[PEEP] = val[5];
+    buildCalTables();
     P("ACK Offsets and Scales set to\n");
     P("     Pressure: "); P(offset[PATIENT],4);     P("V / "); P(scale[PATIENT]);      P(" cmH2O / V\n"); 
     P("    CPAP Flow: "); P(offset[CPAP],4); P("V / "); P(scale[CPAP]);  P(" lpm / V\n");
@@ -203,6 +253,11 @@ boolean YGKMV::doConsoleCommand(String cmd) {
     showFlows(n);
     ret = true;
     break;
+  case 'g': // get snapshot
+    P("ACK State snapshot follows"); P(val[0] > 0 ? " in binary\n" : "\n");
+    showSnapshot(val[0] > 0);
+    ret = true;
+    break;
   case 'i': // Inspiratory Times
     if (val[0] >= IT_MIN) p_it = min(val[0], IT_MAX);
     if (val[1] >= IT_MIN) p_ith = min(val[1], IT_MAX);
@@ -221,6 +276,41 @@ boolean YGKMV::doConsoleCommand(String cmd) {
     v_lastPatChange = millis();
     ret = true;
     break;
+  case 'K': // flow calibration curve points
+    if (ival == CPAP + 1 || ival == PEEP + 1){
+      if (!addCalPoint(ival - 1, val[1], val[2])) P("    Too many points, clear them with K1,-1 or K2,-1\n");
+    }
+    P("ACK Flow calibration curves\n");
+    showCalTables();
+    ret = true;
+    break;
+  case 'L': // Leak compensation
+    if (val[0] > 0) p_leakComp = true;
+    if (val[0] < 0) p_leakComp = false;
+    P("ACK Leak Compensation set to: ");
+    if(p_leakComp) P("True");
+    else P("False");
+    P(", leak conductance "); P(v_leakK,4); P(" lpm / cm H2O, last breath leak "); P(v_ql); P(" lpm\n");
+    v_lastPatChange = millis();
+    ret = true;
+    break;
+  case 'l': // SD log status
+    P("ACK SD log status\n");
+    if (val[0] < 0){
+      stopLog();
+      P("    SD log stopped\n");
+    } else if (val[0] > 0){
+      stopLog();
+      P("    SD log restarted, setupLog() returns "); P(setupLog()); P("\n");
+    }
+    showLog();
+    ret = true;
+    break;
+  case 'm': // memory status
+    P("ACK Memory status\n");
+    showMemory();
+    ret = true;
+    break;
   case 'M': // Model / Serial numbers
     if (val[0] > 0 && val[0] < 100){ 
       p_modelNumber = val[0];
@@ -231,9 +321,22 @@ boolean YGKMV::doConsoleCommand(String cmd) {
     if (n > 0) p_serialNumber = 10000000 * p_modelNumber + n;
     PR("ACK Model / Serial Numbers set to: ");
     PR(p_modelNumber); PR(" / "); PL(p_serialNumber);
+    if(!modelMatches()){
+      PR("    Firmware built for hardware model "); PR(YGKMV_MODEL); PR(", will stay stopped\n");
+    }
     PR("YGK Modular Ventilator Library Version: "); PL(YGKMV_VERSION); 
     ret = true;
     break;
+  case 'p': // profile
+    P("ACK run() section timing since last reset\n");
+    showProfile();
+    if (val[0] < 0){
+      resetProfile();
+      uno.dtStats.reset();
+      P("    Profile reset\n");
+    }
+    ret = true;
+    break;
   case 'P': // plotter mode
     if (val[0] > 0){
       p_plotterMode = true;
@@ -261,6 +364,10 @@ boolean YGKMV::doConsoleCommand(String cmd) {
 //    if(p_stopped || p_closeCPAP || p_openAll) PL("ACK Taking all valves and operations to run mode.");
     PL("ACK Taking all valves and operations to run mode.");
     setRun();
+    if(!modelMatches()){
+      PR("    Refused, firmware built for hardware model "); PR(YGKMV_MODEL);
+      PR(", sketch asks for "); PR(modelAsked); PR(", model number is "); PL(p_modelNumber);
+    }
 //    p_closeCPAP = false;
 //    p_openAll = false;
 //    p_stopped = false;
@@ -321,6 +428,7 @@ boolean YGKMV::doConsoleCommand(String cmd) {
     }
     aMid = (aCloseCPAP + aClosePEEP) / 2.0;
     servoDual.write(aMid);
+    resetServos();    // servos were written directly, so make sure run() writes them again
 
     P("ACK Servo Angles set to\n");
     P("    CPAP Valve: "); P(aMinCPAP);   P(" / "); P(aMaxCPAP);  P(" degrees\n");
@@ -352,12 +460,43 @@ boolean YGKMV::doConsoleCommand(String cmd) {
   case 'T': // breath triggering
     if (val[0] > 0) p_trigEnabled = true;
     if (val[0] < 0) p_trigEnabled = false;
+    if (val[1] > 0) p_trigQ = min(val[1], TRIGQ_MAX);
+    if (val[1] < 0) p_trigQ = 0.0;  // pressure triggering only
+    if (val[2] > 0) p_trigDQ = min(val[2], TRIGDQ_MAX);
     P("ACK Pressure Triggering set to: ");
-    if(p_trigEnabled) P("True\n");
-    else P("False\n");
+    if(p_trigEnabled) P("True");
+    else P("False");
+    P(", flow trigger "); P(p_trigQ); P(" lpm rising "); P(p_trigDQ); P(" lpm / s\n");
+    P("    Last breath: ");
+    if(v_trigSource == TRIG_P) P("pressure");
+    else if(v_trigSource == TRIG_Q) P("flow");
+    else P("not");
+    P(" triggered, latency "); P(v_tl, 1); P(" ms\n");
     v_lastPatChange = millis();
     ret = true;
     break;
+  case 'V': // Valve slew profile and transition times
+    // 0 leaves a value unchanged, anything else out of range rejects the whole line.
+    // E/I is inside inspiration and I/E inside expiration, so each must fit the shortest phase.
+    if ((val[0] != 0 && (val[0] < SLEW_STEP || val[0] > SLEW_SCURVE))
+        || val[1] < 0 || val[1] > SLEW_TIME_MAX
+        || val[2] < 0 || val[2] > ET_MIN
+        || val[3] < 0 || val[3] > IT_MIN) {
+      P("NOACK Valve settings out of range, nothing changed. Profile 1 to 3, slew time 1 to ");
+      P(SLEW_TIME_MAX); P(" ms, I/E 1 to "); P(ET_MIN); P(" ms, E/I 1 to "); P(IT_MIN); P(" ms\n");
+      ret = true;
+      break;
+    }
+    if (val[0] != 0) slewProfile = val[0];
+    if (val[1] > 0) slewTime = val[1];
+    if (val[2] > 0) ieTime = val[2];
+    if (val[3] > 0) eiTime = val[3];
+    P("ACK Valve slew profile / time set to: ");
+    P(slewProfile); P(" / "); P(slewTime); P(" ms, I/E / E/I transitions: ");
+    P(ieTime); P(" / "); P(eiTime); P(" ms\n");
+    P("    Servo and blower writes during last breath: "); PL(v_wpb);
+    ret = true;
+    break;
   case 'w': // write current calibrations
     P("ACK writing calibration settings file.\n");
     writeCalFlash();
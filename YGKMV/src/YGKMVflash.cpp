@@ -35,6 +35,12 @@
     // file system object from SdFat
     FatFileSystem fatfs;
 
+    // free cluster bitmap, one bit per cluster, covers 2 MB of 512 byte clusters
+    #define FLASH_FREE_MAP_WORDS 128
+    #if USE_FREE_CLUSTER_BITMAP
+      uint32_t flashFreeMap[FLASH_FREE_MAP_WORDS];
+    #endif
+
 /**************************************************************************/
 /*!
     @brief Sets up the flash file system and checks for a calibration file.
@@ -64,6 +70,13 @@ int YGKMV::setupFlash(){
     return -2;
   }
 //  Serial.println("Mounted filesystem!");
+  #if USE_FREE_CLUSTER_BITMAP
+    // keeps file writes from scanning the FAT for free space, falls back
+    // to scanning if the volume has more clusters than the map covers
+    if (!fatfs.setFreeClusterBitmap(flashFreeMap, FLASH_FREE_MAP_WORDS)) {
+      Serial.println("Flash free cluster map too small, scanning the FAT instead");
+    }
+  #endif
 
   // Check if a directory called 'vent' exists and create it if not there.
   // Note you should _not_ add a trailing slash (like '/vent/') to directory names!
@@ -115,31 +128,57 @@ int YGKMV::setupFlash(){
 */
 /**************************************************************************/
 int YGKMV::writeCalFlash(){
+  trace(TRACE_FLASH_START, 0);
   delCalFlash();   // delete the old file
   // Create a calibration file in the vent directory and write data to it.
-  File writeFile = fatfs.open("/vent/cal.txt", FILE_WRITE);
-  if (!writeFile) {
+  // Fields are formatted straight into the stream buffer, no sprintf.
+  StdioStream writeFile;
+  if (!writeFile.fopen(&fatfs, "/vent/cal.txt", "w+")) {  // not the cwd, SD log may own it
     Serial.println("Error, failed to open cal.txt for writing!");
+    trace(TRACE_FLASH_END, 0);
     return -8;
   }
   Serial.println("Opened file /vent/cal.txt for writing/appending...");
-  char sc[MAX_COMMAND_LENGTH] = {0};
+  float c[6];
+  int32_t n[6];
   // write a calibration constants line
-  sprintf(sc,"C%7.4f,%7.4f,%7.4f,%7.2f,%7.2f,%7.2f\n",
-    offset[PATIENT], offset[CPAP], offset[PEEP],
-    scale[PATIENT],  scale[CPAP],  scale[PEEP]);
-  writeFile.print(sc);
-  PR(sc);
+  c[0] = offset[PATIENT]; c[1] = offset[CPAP]; c[2] = offset[PEEP];
+  c[3] = scale[PATIENT];  c[4] = scale[CPAP];  c[5] = scale[PEEP];
+  writeFile.putc('C');
+  writeFile.printFields(c, 3, 4, ',', ',');
+  writeFile.printFields(c + 3, 3, 2, ',', '\n');
+  // write a line for each flow calibration point, clearing the curves first
+  for(int j = 0; j < 2; j++){
+    n[0] = (j ? PEEP : CPAP) + 1;
+    n[1] = -1;
+    writeFile.putc('K');
+    writeFile.printFields(n, 2, ',', '\n');
+    for(int i = 0; i < calPts[j].n; i++){
+      writeFile.putc('K');
+      writeFile.printFields(n, 1, ',', ',');
+      writeFile.printFields(&calPts[j].v[i], 1, 4, ',', ',');
+      writeFile.printFields(&calPts[j].q[i], 1, 3, ',', '\n');
+    }
+  }
   // write a servo angles line
-  sprintf(sc,"S%d,%d,%d,%d,%d,%d\n", aMinCPAP, aMaxCPAP, aMinPEEP, aMaxPEEP, aCloseCPAP, aClosePEEP);
-  writeFile.print(sc);
-  PR(sc);
+  n[0] = aMinCPAP; n[1] = aMaxCPAP; n[2] = aMinPEEP;
+  n[3] = aMaxPEEP; n[4] = aCloseCPAP; n[5] = aClosePEEP;
+  writeFile.putc('S');
+  writeFile.printFields(n, 6, ',', '\n');
+  // write a valve slew and transition times line
+  n[0] = slewProfile; n[1] = slewTime; n[2] = ieTime; n[3] = eiTime;
+  writeFile.putc('V');
+  writeFile.printFields(n, 4, ',', '\n');
   // write a model / serial numbers line
-  sprintf(sc,"M%d,%d\n", p_modelNumber, p_serialNumber);
-  writeFile.print(sc);
-  PR(sc);
-  // Close the file when finished writing.
-  writeFile.close();
+  n[0] = p_modelNumber; n[1] = p_serialNumber;
+  writeFile.putc('M');
+  writeFile.printFields(n, 2, ',', '\n');
+  int ret = echoFlashFile(&writeFile);
+  trace(TRACE_FLASH_END, 0);
+  if (ret) {
+    Serial.println("Error, failed writing /vent/cal.txt!");
+    return ret;
+  }
   v_calFile = true;
   Serial.println("Wrote to file /vent/cal.txt!");
   return 0;
@@ -160,14 +199,60 @@ int YGKMV::readCalFlash(){
     return -16;
   }
   P("Reading and executing lines from calibration file.\n");
-  String line = "";
-  line = readFile.readStringUntil('\n');
-  while(line != ""){
+  doFlashCommands(&readFile);
+  readFile.close();
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief Execute each line of an open file as a console command. Lines are
+            read a buffer at a time, blank lines are skipped, and so are
+            lines too long for the buffer rather than running their pieces
+            as commands. doConsoleCommand() still makes a String of each.
+    @param f the file, open for reading
+    @return the number of commands executed 
+*/
+/**************************************************************************/
+int YGKMV::doFlashCommands(File *f){
+  char buf[FLASH_READ_BUFFER];
+  FatLineReader lines(f, buf, sizeof(buf));
+  const char *line;
+  size_t len;
+  int n = 0;
+  bool skip = false;
+  unsigned long t0 = millis();
+  while((line = lines.next(&len))){
+    if(skip || lines.partial()){
+      if(!skip){ P("Skipping a line longer than "); P(FLASH_READ_BUFFER - 1); P(" characters\n"); }
+      skip = lines.partial();
+      continue;
+    }
+    if(len == 0) continue;
     P("From File: "); PL(line);
     doConsoleCommand(line);
-    line = readFile.readStringUntil('\n');
+    n++;
   }
-  return 0;
+  P("Executed "); P(n); P(" lines in "); P(millis() - t0); P(" ms\n");
+  return n;
+}
+
+/**************************************************************************/
+/*!
+    @brief Read back the lines just written to a stream, print them, and
+            close it.
+    @param f the stream, opened for update and written
+    @return negative error code, 0 for success. 
+*/
+/**************************************************************************/
+int YGKMV::echoFlashFile(StdioStream *f){
+  char sc[MAX_COMMAND_LENGTH];
+  int ret = f->ferror() ? -32 : 0;
+  if(f->rewind()){
+    while(f->fgets(sc, sizeof(sc))) PR(sc);
+  }
+  if(f->fclose()) ret = -32;
+  return ret;
 }
 
 /**************************************************************************/
@@ -200,7 +285,8 @@ void YGKMV::wipeCalFlash(){
   offset[CPAP] = 0.0;
   scale[PEEP] = 1.0;
   offset[PEEP] = 0.0;
-  
+  calPts[0].n = calPts[1].n = 0;
+  buildCalTables();
 }
 
 /**************************************************************************/
@@ -211,39 +297,50 @@ void YGKMV::wipeCalFlash(){
 */
 /**************************************************************************/
 int YGKMV::writePatFlash(){
+  trace(TRACE_FLASH_START, 1);
   delPatFlash();   // delete the old file
-  File writeFile = fatfs.open("/vent/patient.txt", FILE_WRITE);
-  if (!writeFile) {
+  StdioStream writeFile;
+  if (!writeFile.fopen(&fatfs, "/vent/patient.txt", "w+")) {  // not the cwd, SD log may own it
     Serial.println("Error, failed to open patient.txt for writing!");
+    trace(TRACE_FLASH_END, 1);
     return -8;
   }
   Serial.println("Opened file /vent/patient.txt for writing/appending...");
-  char sc[MAX_COMMAND_LENGTH] = {0};
+  float c[3];
+  int32_t n[3];
   // write an inspiration pressure line
-  sprintf(sc,"I%7.2f,%7.2f,%7.2f\n", p_iph, p_ipl, p_iphTol);
-  writeFile.print(sc);
-  PR(sc);
+  c[0] = p_iph; c[1] = p_ipl; c[2] = p_iphTol;
+  writeFile.putc('I');
+  writeFile.printFields(c, 3, 2, ',', '\n');
   // write an expiration pressure line
-  sprintf(sc,"E%7.2f,%7.2f,%7.2f\n", p_eph, p_epl, p_eplTol);
-  writeFile.print(sc);
-  PR(sc);
+  c[0] = p_eph; c[1] = p_epl; c[2] = p_eplTol;
+  writeFile.putc('E');
+  writeFile.printFields(c, 3, 2, ',', '\n');
   // write an inspiration time line
-  sprintf(sc,"i%d,%d,%d\n", p_it, p_ith, p_itl);
-  writeFile.print(sc);
-  PR(sc);
+  n[0] = p_it; n[1] = p_ith; n[2] = p_itl;
+  writeFile.putc('i');
+  writeFile.printFields(n, 3, ',', '\n');
   // write an expiration time line
-  sprintf(sc,"e%d,%d,%d\n", p_et, p_eth, p_etl);
-  writeFile.print(sc);
-  PR(sc);
+  n[0] = p_et; n[1] = p_eth; n[2] = p_etl;
+  writeFile.putc('e');
+  writeFile.printFields(n, 3, ',', '\n');
   // write a Triggering setting line
-  int i = -1;
-  if(p_trigEnabled) i = 1; 
-  sprintf(sc,"T%d\n", i);
-  writeFile.print(sc);
-  PR(sc);
+  n[0] = p_trigEnabled ? 1 : -1;
+  c[0] = p_trigQ; c[1] = p_trigDQ;
+  writeFile.putc('T');
+  writeFile.printFields(n, 1, ',', ',');
+  writeFile.printFields(c, 2, 2, ',', '\n');
+  // write a leak compensation line
+  n[0] = p_leakComp ? 1 : -1;
+  writeFile.putc('L');
+  writeFile.printFields(n, 1, ',', '\n');
   v_lastPatChange = 0;
-  // Close the file when finished writing.
-  writeFile.close();
+  int ret = echoFlashFile(&writeFile);
+  trace(TRACE_FLASH_END, 1);
+  if (ret) {
+    Serial.println("Error, failed writing /vent/patient.txt!");
+    return ret;
+  }
   Serial.println("Wrote to file /vent/patient.txt!");
   return 0;
 }
@@ -262,13 +359,8 @@ int YGKMV::readPatFlash(){
     return -16;
   }
   P("Reading and executing lines from patient file.\n");
-  String line = "";
-  line = readFile.readStringUntil('\n');
-  while(line != ""){
-    P("From File: "); PL(line);
-    doConsoleCommand(line);
-    line = readFile.readStringUntil('\n');
-  }
+  doFlashCommands(&readFile);
+  readFile.close();
   v_lastPatChange = 0;  // don't need to update values just read from flash
   return 0;
 }
@@ -308,4 +400,7 @@ void YGKMV::wipePatFlash(){
   p_eth = ET_MAX;
   p_etl = ET_MIN;
   p_trigEnabled = false;   ///< enable triggering on pressure limits
+  p_trigQ = 0.0;
+  p_trigDQ = 30.0;
+  p_leakComp = false;
 }
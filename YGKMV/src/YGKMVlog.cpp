@@ -0,0 +1,214 @@
+/**************************************************************************/
+/*!
+  @file YGKMVlog.cpp
+
+  @section intro Introduction
+
+  Streams the output lines to an SD card on units that have a socket.
+  setupLog() creates a contiguous LOG_FILE, erases it, and leaves the card
+  in multi-block write mode, so each 512 byte block is one writeData() with
+  no FAT or directory updates. logLine() copies lines into a small queue of
+  blocks, and loopLog() sends at most one full block per run(), and only
+  when the card is not busy programming the last one, so the control loop
+  never waits on the card. Compiled out unless YGKMV_SD_LOG is 1.
+
+  If power is lost while logging the file keeps its full pre-allocated
+  size, with the erased blocks after the last line.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  MIT license
+*/
+/**************************************************************************/
+#include "YGKMV.h"
+
+#if YGKMV_SD_LOG
+  SdFat logSd;                              // SD card and volume, separate from the flash fatfs
+  SdBaseFile logFile;                       // contiguous, pre-erased log file
+  static uint8_t logQueue[LOG_QUEUE][512];  // blocks being filled or waiting for the card
+  extern FatFileSystem fatfs;               // flash volume, in YGKMVflash.cpp
+#endif
+
+/**************************************************************************/
+/*!
+    @brief Start the SD card log. Replaces LOG_FILE with a contiguous file of
+            LOG_BLOCKS blocks, erases them, and starts a multi-block write at
+            the first one. Takes a few seconds on a large card.
+    @param none
+    @return negative error code, 0 for success or when compiled out
+*/
+/**************************************************************************/
+int YGKMV::setupLog(){
+#if YGKMV_SD_LOG
+  uint32_t bgn, end;
+  memset(&logStat, 0, sizeof(logStat));
+  if(!logSd.begin(LOG_CS_PIN, SD_SCK_MHZ(12))){
+    P("SD log: no card found\n");
+    return -1;
+  }
+  fatfs.chdir(true);                // begin() made the card the cwd, give it back to flash
+  logFile.close();
+  logSd.remove(LOG_FILE);
+  if(!logFile.createContiguous(logSd.vwd(), LOG_FILE, 512 * LOG_BLOCKS)
+    || !logFile.contiguousRange(&bgn, &end)){
+    P("SD log: could not create " LOG_FILE "\n");
+    return -2;
+  }
+  unsigned long t0 = millis();
+  for(uint32_t b = bgn; b <= end; b += LOG_ERASE){
+    uint32_t e = end - b < LOG_ERASE ? end : b + LOG_ERASE - 1;
+    if(!logSd.card()->erase(b, e)){
+      P("SD log: erase failed\n");
+      return -4;
+    }
+  }
+  if(!logSd.card()->writeStart(bgn)){
+    P("SD log: writeStart failed\n");
+    return -8;
+  }
+  logStat.state = LOG_RUN;
+  P("SD log: erased "); P(LOG_BLOCKS / 2048); P(" MB in "); P(millis() - t0);
+  P(" ms, logging to " LOG_FILE "\n");
+#endif
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief Add a line to the SD log queue. The whole line is dropped and
+            counted if there is not room for it, so the file only ever
+            holds complete lines.
+    @param s the line, including its newline
+    @param n length of the line
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::logLine(const char *s, size_t n){
+#if YGKMV_SD_LOG
+  if(logStat.state != LOG_RUN) return;
+  uint8_t full = logStat.head - logStat.tail;
+  if(n > (LOG_QUEUE - full) * 512UL - logStat.fill){
+    logStat.dropped++;
+    return;
+  }
+  while(n){
+    uint8_t i = logStat.head % LOG_QUEUE;
+    size_t k = 512 - logStat.fill;
+    if(k > n) k = n;
+    memcpy(logQueue[i] + logStat.fill, s, k);
+    s += k;
+    n -= k;
+    logStat.fill += k;
+    if(logStat.fill == 512){          // block is full, queue it for the card
+      logStat.queued[i] = micros();
+      logStat.head++;
+      logStat.fill = 0;
+      full = logStat.head - logStat.tail;
+      if(full > logStat.depthMax) logStat.depthMax = full;
+    }
+  }
+  logStat.lines++;
+#else
+  (void)s;
+  (void)n;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Send the oldest full block to the card if it is ready for one.
+            Called every run(), so it costs one busy check when the card is
+            still programming.
+    @param wait true to wait for a busy card instead of returning
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::loopLog(bool wait){
+#if YGKMV_SD_LOG
+  if(logStat.state != LOG_RUN || logStat.head == logStat.tail) return;
+  if(!wait && logSd.card()->isBusy()){
+    logStat.busy++;
+    return;
+  }
+  uint8_t i = logStat.tail % LOG_QUEUE;
+  unsigned long t = micros();
+  unsigned long dt = t - logStat.queued[i];
+  logStat.waitTotal += dt;
+  if(dt > logStat.waitMax) logStat.waitMax = dt;
+  if(!logSd.card()->writeData(logQueue[i])){
+    logStat.state = LOG_ERROR;
+    return;
+  }
+  dt = micros() - t;
+  logStat.writeTotal += dt;
+  if(dt > logStat.writeMax) logStat.writeMax = dt;
+  logStat.tail++;
+  if(logStat.tail >= LOG_BLOCKS){     // file is full, leave it at its full size
+    logStat.state = logSd.card()->writeStop() ? LOG_FULL : LOG_ERROR;
+    logFile.close();
+  }
+#else
+  (void)wait;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Stop the SD log. Pads out and sends the partly filled block,
+            ends the multi-block write, and truncates the file to the
+            lines actually logged.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::stopLog(){
+#if YGKMV_SD_LOG
+  if(logStat.state != LOG_RUN) return;
+  uint16_t pad = 0;
+  if(logStat.fill){                 // logLine() always leaves room for this block
+    pad = 512 - logStat.fill;
+    memset(logQueue[logStat.head % LOG_QUEUE] + logStat.fill, ' ', pad);
+    logStat.queued[logStat.head % LOG_QUEUE] = micros();
+    logStat.head++;
+    logStat.fill = 0;
+  }
+  while(logStat.state == LOG_RUN && logStat.head != logStat.tail) loopLog(true);
+  if(logStat.state != LOG_RUN) return;  // full or failed, already closed or unusable
+  bool ok = logSd.card()->writeStop();
+  ok = logFile.truncate(512 * logStat.tail - pad) && ok;
+  logFile.close();
+  logStat.state = ok ? LOG_OFF : LOG_ERROR;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Show the SD log state, queue depth and how long blocks waited
+            for a busy card.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::showLog(){
+#if YGKMV_SD_LOG
+  static const char *names[] = {"off", "logging", "full", "error"};
+  char sc[MAX_COMMAND_LENGTH] = {0};
+  ygkmv_log_t *l = &logStat;
+  unsigned long n = l->tail ? l->tail : 1;
+  sprintf(sc, "    SD log %s, %lu lines, %lu of %lu blocks written, %lu lines dropped\n",
+    names[l->state], l->lines, l->tail, LOG_BLOCKS, l->dropped);
+  P(sc);
+  sprintf(sc, "    Queue depth now %lu, max %d of %d blocks, card busy %lu times\n",
+    l->head - l->tail, l->depthMax, LOG_QUEUE, l->busy);
+  P(sc);
+  sprintf(sc, "    Block wait for the card [us] mean %.0f max %lu, writeData() [us] mean %.0f max %lu\n",
+    l->waitTotal / (double) n, l->waitMax, l->writeTotal / (double) n, l->writeMax);
+  P(sc);
+#else
+  P("    SD log compiled out, set YGKMV_SD_LOG 1\n");
+#endif
+}
@@ -27,7 +27,7 @@ void YGKMV::showVoltages(int n, bool setOffsets)
   double vs[6] = {0};
   for(int j = 0; j < n; j++){
     for(int i = 0; i < 6; i++){
-      v[i] = uno.getV(i);
+      v[i] = readV(i);
       vs[i] += v[i];
     }
   }
@@ -47,13 +47,37 @@ void YGKMV::showVoltages(int n, bool setOffsets)
   P("PEEP Flow on A"); P(i); P(": "); P(vs[i],4); 
   P(" ("); P(v[i],4); P(")  ");
   P("\n");
+  if(setOffsets) buildCalTables();
+}
+
+/**************************************************************************/
+/*!
+    @brief Show memory headroom: the smallest gap there has ever been between
+            the heap and the stack, the gap right now, heap usage and the
+            RAM taken by this object.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::showMemory()
+{
+  unsigned long used, free, chunks;
+  v_memUnused = uno.stackUnused();
+  P("    Never used stack / heap headroom [bytes]: "); PL(v_memUnused);
+  P("    Current gap between heap and stack [bytes]: "); PL(uno.bytesFree());
+  if(uno.heapStats(&used, &free, &chunks)){
+    P("    Heap in use [bytes]: "); PL(used);
+    P("    Heap free [bytes] / free chunks: "); P(free); P(" / "); PL(chunks);
+  }
+  P("    Low memory alarm below [bytes]: "); PL(MEM_LOW);
+  P("    Ventilator object [bytes]: "); PL(sizeof(YGKMV));
 }
 
 void YGKMV::showFlows(int n)
 {
   double ps = 0, qcs = 0, qps = 0;
   for(int j = 0; j < n; j++){
-    ps += getP();
+    if(ygkmv_model::pSource != YGKMV_P_NONE) ps += (readV(aPins[PATIENT]) - offset[PATIENT]) * scale[PATIENT];
     qcs += getQCPAP();
     qps += getQPEEP();
   }
@@ -65,3 +89,107 @@ void YGKMV::showFlows(int n)
   P("\n     PEEP Flow [litres / min]: "); P(qps,6); 
   P("\n");
 }
+
+/**************************************************************************/
+/*!
+    @brief Publish the measurement state for getSnapshot(). Called once per
+            run() after the alarms are updated. The seqlock count is odd
+            while the copy is being written, so a reader interrupted by the
+            writer (or running in an interrupt during it) knows to retry.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::publishSnapshot()
+{
+  snapSeq++;                                    // odd, copy in progress
+  __asm__ __volatile__("" ::: "memory");        // keep the stores inside the count changes
+  snapBuf.seq = snapSeq / 2 + 1;
+  snapBuf.t = millis();
+  snapBuf.prog = prog;
+  snapBuf.fracCPAP = fracCPAP;
+  snapBuf.fracPEEP = fracPEEP;
+  snapBuf.fracDual = fracDual;
+  snapBuf.o2 = v_o2;
+  snapBuf.p = v_p;
+  snapBuf.pSet = v_pSet;
+  snapBuf.q = v_q;
+  snapBuf.vr = v_vr;
+  snapBuf.ipp = v_ipp;
+  snapBuf.ipl = v_ipl;
+  snapBuf.epp = v_epp;
+  snapBuf.epl = v_epl;
+  snapBuf.pp = v_pp;
+  snapBuf.pl = v_pl;
+  snapBuf.bpm = v_bpm;
+  snapBuf.v = v_v;
+  snapBuf.mv = v_mv;
+  snapBuf.batv = v_batv;
+  snapBuf.tl = v_tl;
+  snapBuf.ql = v_ql;
+  snapBuf.alarm = v_alarm;
+  snapBuf.it = v_it;
+  snapBuf.et = v_et;
+  snapBuf.ie = v_ie;
+  __asm__ __volatile__("" ::: "memory");
+  snapSeq++;                                    // even, copy complete
+}
+
+/**************************************************************************/
+/*!
+    @brief Get a consistent copy of the state last published by run(),
+            without locking or disabling interrupts.
+    @param s where to put the copy
+    @return true if the copy is consistent, false if it was torn every
+            time in SNAP_TRIES attempts or nothing has been published
+*/
+/**************************************************************************/
+bool YGKMV::getSnapshot(ygkmv_snap_t *s)
+{
+  for(int i = 0; i < SNAP_TRIES; i++){
+    uint32_t before = snapSeq;
+    if(before == 0) return false;               // nothing published yet
+    if(before & 1) continue;                    // writer is part way through
+    __asm__ __volatile__("" ::: "memory");
+    memcpy(s, &snapBuf, sizeof(ygkmv_snap_t));
+    __asm__ __volatile__("" ::: "memory");
+    if(snapSeq == before) return true;
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief Show the latest snapshot, either as labelled text or as the
+            SNAP_MAGIC bytes, a uint16 size, the raw ygkmv_snap_t and a
+            newline, for binary telemetry.
+    @param binary true for the binary form
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::showSnapshot(bool binary)
+{
+  ygkmv_snap_t s;
+  if(!getSnapshot(&s)){
+    P("    No consistent snapshot available\n");
+    return;
+  }
+  if(binary){
+    uint16_t n = sizeof(ygkmv_snap_t);
+    Serial.write((const uint8_t *) SNAP_MAGIC, 4);
+    Serial.write((const uint8_t *) &n, sizeof(n));
+    Serial.write((const uint8_t *) &s, n);
+    Serial.write('\n');
+    return;
+  }
+  char sc[MAX_COMMAND_LENGTH] = {0};
+  sprintf(sc, "    Snapshot %lu at %lu ms, phase %d, alarm %lu\n",
+    (unsigned long) s.seq, (unsigned long) s.t, s.ie, (unsigned long) s.alarm);
+  P(sc);
+  sprintf(sc, "    p %.2f (set %.2f) cm H2O, q %.1f lpm, rolling volume %.0f ml, o2 %.3f\n",
+    s.p, s.pSet, s.q, s.vr, s.o2);
+  P(sc);
+  sprintf(sc, "    Last breath: %.1f bpm, %.0f ml, %.2f l/min, insp %d ms %.2f-%.2f, exp %d ms %.2f-%.2f\n",
+    s.bpm, s.v, s.mv, s.it, s.ipl, s.ipp, s.et, s.epl, s.epp);
+  P(sc);
+}
@@ -0,0 +1,137 @@
+/**************************************************************************/
+/*!
+  @file YGKMVprof.cpp
+
+  @section intro Introduction
+
+  Section timing for run(). Each profMark() charges the time since the
+  previous mark to one section and adds it to a log2 bucketed histogram,
+  so the cost is one timer read and a few integer operations per section.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  MIT license
+*/
+/**************************************************************************/
+#include "YGKMV.h"
+
+static const char *profNames[PROF_SECTIONS] = {
+  "other", "flash", "console", "sense", "breath", "valves", "alarms", "out"
+};
+
+/**************************************************************************/
+/*!
+    @brief Read the profiling timer. Uses the DWT cycle counter where the
+            core has one (Cortex-M3 and up, e.g. SAMD51), otherwise micros().
+    @param none
+    @return timer ticks, PROF_TICKS_PER_US ticks per microsecond
+*/
+/**************************************************************************/
+static inline uint32_t profTicks(){
+#if PROF_USE_DWT
+  return DWT->CYCCNT;
+#else
+  return micros();
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Charge the time since the last mark to a section of run().
+    @param section one of the PROF_ section index numbers
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::profMark(int section){
+#if YGKMV_PROFILE
+  uint32_t t = profTicks();
+  uint32_t dt = t - profLast;
+  profLast = t;
+  ygkmv_prof_t *s = &prof[section];
+  int b = dt ? 32 - __builtin_clz(dt) : 0;  // bucket b holds [2^(b-1), 2^b) ticks
+  if(b >= PROF_BUCKETS) b = PROF_BUCKETS - 1;
+  s->hist[b]++;
+  s->count++;
+  s->total += dt;
+  if(dt > s->max) s->max = dt;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Clear all the section histograms and restart the timer.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::resetProfile(){
+#if PROF_USE_DWT
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;   // turn on the cycle counter
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+  memset(prof, 0, sizeof(prof));
+  profLast = profTicks();
+  sampleBusy = sampleBusyN = sampleBusyMax = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief Estimate a percentile from a section histogram.
+    @param section one of the PROF_ section index numbers
+    @param pc percentile [0 to 100]
+    @return upper bound of the bucket holding the percentile [us]
+*/
+/**************************************************************************/
+double YGKMV::profPercentile(int section, double pc){
+  ygkmv_prof_t *s = &prof[section];
+  unsigned long n = s->count * pc / 100. + 0.5;
+  unsigned long sum = 0;
+  for(int b = 0; b < PROF_BUCKETS; b++){
+    sum += s->hist[b];
+    if(sum >= n && sum > 0) return (1UL << b) / (double) PROF_TICKS_PER_US;
+  }
+  return s->max / (double) PROF_TICKS_PER_US;
+}
+
+/**************************************************************************/
+/*!
+    @brief Show count, mean, p50, p99 and max time for each section of run(),
+            the measured cost of a profMark() call, and the cost of the
+            sensor samples.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::showProfile(){
+  char sc[MAX_COMMAND_LENGTH] = {0};
+  uint32_t t = profTicks();   // measure the probe overhead on a spare copy of the stats
+  ygkmv_prof_t save = prof[PROF_OTHER];
+  unsigned long saveLast = profLast;
+  for(int i = 0; i < 100; i++) profMark(PROF_OTHER);
+  double over = (profTicks() - t) / 100. / PROF_TICKS_PER_US;
+  prof[PROF_OTHER] = save;
+  profLast = saveLast;
+  P("    Section     Count   Mean[us]    p50[us]    p99[us]    Max[us]\n");
+  for(int i = 0; i < PROF_SECTIONS; i++){
+    ygkmv_prof_t *s = &prof[i];
+    double mean = s->count ? s->total / (double) s->count / PROF_TICKS_PER_US : 0.0;
+    sprintf(sc, "    %-7s %9lu %10.1f %10.1f %10.1f %10.1f\n", profNames[i], s->count, mean,
+      profPercentile(i, 50), profPercentile(i, 99), s->max / (double) PROF_TICKS_PER_US);
+    P(sc);
+  }
+  P("    Probe overhead: "); P(over, 2); P(" us per section\n");
+  sprintf(sc, "    loop() window of %lu [us] min %.0f mean %.1f max %.0f, since reset p50 %.0f p99 %.0f\n",
+    uno.dtStats.windowCount(), uno.dtStats.min(), uno.dtStats.mean(), uno.dtStats.max(),
+    uno.dtStats.percentile(50), uno.dtStats.percentile(99));
+  P(sc);
+  P("    Sensor samples: "); P(sampleHead); P(sampleTimer ? " from the timer" : " one per run()");
+  P(", dropped "); P(sampleDropped); P("\n");
+  double busy = sampleBusyN ? sampleBusy / (double) sampleBusyN : 0.0;
+  sprintf(sc, "    sampleTick() mean %.1f max %lu [us], every %lu [us] from the timer, %.1f%% of the CPU\n",
+    busy, sampleBusyMax, samplePeriod, 100. * busy / samplePeriod);
+  P(sc);
+}
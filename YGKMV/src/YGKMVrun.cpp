@@ -38,11 +38,18 @@ int YGKMV::run(bool reset){
   static bool startedInspiration = false;       // set false at start of breath, then true once we have inspiration at pressure
   static bool stoppedInspiration = false;       // set false at start of breath, then true once inspiration is stopped
   static double dpI = 0.0;                      // the integrated pressure error in cmH2O seconds
+  static int lastIE = 0;                        // v_ieEntered last time through, to trace phase changes
+  static unsigned long lastMemCheck = 0;        // set to millis() when the stack was last scanned
+  unsigned long alarmTested = 0;                // alarm bits with conditions evaluated this time through
+  unsigned long alarmPresent = 0;               // alarm bits with conditions present this time through
+  unsigned long alarmUrgent = 0;                // present alarm bits to raise without their onset delay
+  unsigned long trigTime = 0;                   // first sample of the effort if this pass starts a triggered breath
 
 /*********************UPDATE MEASUREMENTS AND PARAMETERS************************/ 
 
   // if(millis() < 10000) delay(2000);  // force a slow loop() error on startup as a test
  
+  profMark(PROF_OTHER);   // time spent in loop() since the end of the last run()
   uno.run();    // keep track of things
 
   // If things are running well after startup and there has been a patient change, 
@@ -54,6 +61,8 @@ int YGKMV::run(bool reset){
     && v_lastPatChange != 0    // there is an unrecorded patient change
     && millis() - v_lastPatChange > YGKMV_STARTUP * 10  // but not recently
     ) writePatFlash();
+  loopLog();    // send a queued block if the SD card is ready for it
+  profMark(PROF_FLASH);
 
   if(millis() > YGKMV_STARTUP && !p_stopped) v_justStarted = false; // out of startup phase
 
@@ -61,36 +70,41 @@ int YGKMV::run(bool reset){
 
   if(millis() > ALARM_HOLIDAY && v_patientSet) setRun(); // there's a patient to get back to and display is sleeping
 
-  if (millis() - v_lastStop > ALARM_STOP && p_stopped){
-      if(!v_alarmOnTime) v_alarmOnTime = millis();    // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_STOP_ERROR;            // set the appropriate alarm bit
-  } else v_alarm = v_alarm & ~YGKMV_STOP_ERROR;        // reset the alarm bit
-
+  // Alarm conditions are collected as bits and applied once by updateAlarms()
+  alarmTested |= YGKMV_STOP_ERROR | YGKMV_STOP_WARN | YGKMV_DISP_ERROR | YGKMV_SLOW_ERROR;
+  if (millis() - v_lastStop > ALARM_STOP && p_stopped) alarmPresent |= YGKMV_STOP_ERROR;
   if (millis() - v_lastStop > STOP_MAX - 2 * ALARM_DELAY_DISPLAY
-      && p_stopped){  // back to run mode soon
-      if(!v_alarmOnTime) v_alarmOnTime = millis();    // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_STOP_WARN;            // set the appropriate alarm bit
-  } else v_alarm = v_alarm & ~YGKMV_STOP_WARN;        // reset the alarm bit
+      && p_stopped) alarmPresent |= YGKMV_STOP_WARN;  // back to run mode soon
 
   if(loopConsole()) lastCommand = millis();           // check for console input and note time
-  if (millis() - lastCommand > ALARM_DELAY_DISPLAY){  // display is incognito
-      if(!v_alarmOnTime) v_alarmOnTime = millis();    // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_DISP_ERROR;            // set the appropriate alarm bit
-  } else v_alarm = v_alarm & ~YGKMV_DISP_ERROR;        // reset the alarm bit
-
-  if (uno.dtAvg()/1000 > ALARM_DELAY_LOOP             // check for rolling average loop() rate too slow 
-    || uno.dt()/1000 > ALARM_DELAY_LOOP * 5){         // be more tolerant of one slow loop()
-      if(!v_alarmOnTime) v_alarmOnTime = millis();    // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_SLOW_ERROR;            // set the appropriate alarm bit
-  } else v_alarm = v_alarm & ~YGKMV_SLOW_ERROR;        // reset the alarm bit
+  profMark(PROF_CONSOLE);
+  if (millis() - lastCommand > ALARM_DELAY_DISPLAY)   // display is incognito
+      alarmPresent |= YGKMV_DISP_ERROR;
+
+  if (uno.dtStats.mean()/1000 > ALARM_DELAY_LOOP     // check for windowed average loop() rate too slow 
+    || uno.dt()/1000 > ALARM_DELAY_LOOP)              // or this loop(), the rule's onDelay ignores a single one
+      alarmPresent |= YGKMV_SLOW_ERROR;
+  if (uno.dt()/1000 > ALARM_DELAY_LOOP * 5){          // unless it is far too slow
+      alarmPresent |= YGKMV_SLOW_ERROR;
+      alarmUrgent |= YGKMV_SLOW_ERROR;                // alarm without waiting for ALARM_ONSET_SLOW
+  }
 
-  v_tauW = min(1.,(double) uno.dt() / p_tau / 1000000.);   // weight to give the latest reading of a in smoothing
+  if (millis() - lastMemCheck > MEM_CHECK_INTERVAL){ // scan for the stack high water mark
+    lastMemCheck = millis();
+    v_memUnused = uno.stackUnused();
+    alarmTested |= YGKMV_MEM_ERROR;
+    if (v_memUnused > 0 && v_memUnused < MEM_LOW) alarmPresent |= YGKMV_MEM_ERROR;
+  }
 
   // Measure current state
-  v_batv = (uno.getV(aPins[BATTERY]) - offset[BATTERY]) * scale[BATTERY];   // Battery voltage from a voltage divider circuit
+  v_batv = (readV(aPins[BATTERY]) - offset[BATTERY]) * scale[BATTERY];   // Battery voltage from a voltage divider circuit
+  // Look for patient effort in the raw samples once we have been inspiring and expiring long enough
+  p_trigArmed = p_trigEnabled && startedInspiration && v_etr > p_etl;
+  loopSamples();                        // smooth, trigger on and integrate every sample since last time
   v_p = getP();                         // Current pressure to the patient in cm H2O
   v_q = getQ();                         // Current flow rate to the patient in litres per minute
   v_o2 = 0.21;                          // No sensor, so assume it is room air
+  profMark(PROF_SENSE);
 
   
 /********************NEW BREATH?********************************/   
@@ -98,9 +112,7 @@ int YGKMV::run(bool reset){
   endBreath = startBreath + perBreath;  // scheduled end of the current breath
   if( endBreath - millis() > 60000      // if we are past the projected end of the scheduled breath
       || v_etr >= p_et                  // or we have been on expiration too long
-          // or we have a pressure and are below inspiration trigger and it's enabled
-      || ((v_p > 1.0) && (v_p < p_epl - p_eplTol) && p_trigEnabled 
-          && startedInspiration && v_etr > p_etl) // and we have been inspiring and expiring long enough
+      || (v_trigTime && p_trigArmed)    // or the patient has triggered a breath
       ) {
 
     // Record Pressures from last breath and reset accumulated min/max values for next breath    
@@ -111,6 +123,15 @@ int YGKMV::run(bool reset){
 /**************UGLY UGLY FIX LATER**************************/
 //v_epl = v_pl; v_ipp = v_pp;
 
+    // Trigger latency for this breath is measured once the valves are commanded below
+    if(v_trigTime && p_trigArmed) trigTime = v_trigTime;
+    else{
+      v_tl = 0.0;
+      v_trigSource = TRIG_NONE;
+    }
+    v_trigTime = 0;
+    p_trigArmed = false;
+
     // Record Times for last breath, and rest rolling times
     v_it = v_itr;  v_itr = 0;   // store times for last breath and reset rolling times
     v_et = v_etr;  v_etr = 0;
@@ -125,31 +146,37 @@ int YGKMV::run(bool reset){
     else v_bpm = 0;                   // set to zero if times are stupid
 
     // Record Volumes for last breath, and reset rolling volume
+    // v_vr and v_ver are integrated sample by sample in loopSamples()
     v_v  = v_vr;   v_vr = 0;  // restart rolling estimate
+    v_ve = v_ver;  v_ver = 0;
+    v_vl = v_v - v_ve;        // whatever went in and didn't come back out
+    // Update the leak conductance from this breath. Add back what compensation actually
+    // took out so the estimate is the same with or without it, even if it was switched mid breath.
+    double vLeak = 1000. * v_leakK * v_pint;     // leak volume from the model [ml]
+    if(v_pint > 0){
+      double k = (v_vl + v_vlc) / (1000. * v_pint);
+      k = max(k, 0.0); k = min(k, LEAKK_MAX);
+      v_leakK += LEAK_WEIGHT * (k - v_leakK);
+    }
+    if(v_it + v_et > 0) v_ql = vLeak * 60. / (v_it + v_et);  // ml/ms to l/min
+    else v_ql = 0;
+    v_pint = 0;
+    v_vlc = 0;
     double mv = v_v * v_bpm / 1000.; // the latest minute volume
     double w = 0.5;
     if(v_mv > 0) v_mv = w * mv + (1-w) * v_mv;    // smoothed minute ventilation
     else v_mv = mv;
     if(v_bpms > 0 && v_bpms < 10000) v_bpms = w * v_bpm + (1-w) * v_bpms;    // smoothed bpm
     else v_bpms = v_bpm;
+    v_wpb = v_wr;  v_wr = 0;  // output writes during last breath
+    v_breaths++;
 
     // test for v_it, v_et error conditions
-    if (v_it < p_itl){                              // inspiration time is too short
-      if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_ITS_ERROR;           // set the appropriate alarm bit
-    } else v_alarm = v_alarm & ~YGKMV_ITS_ERROR;     // reset the alarm bit
-    if (v_it > p_ith){                              // inspiration time is too long
-      if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_ITL_ERROR;           // set the appropriate alarm bit
-    } else v_alarm = v_alarm & ~YGKMV_ITL_ERROR;     // reset the alarm bit
-    if (v_et < p_etl){                              // expiration time is too short
-      if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_ETS_ERROR;           // set the appropriate alarm bit
-    } else v_alarm = v_alarm & ~YGKMV_ETS_ERROR;     // reset the alarm bit
-    if (v_et > p_eth){                              // expiration time is too long
-      if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-      v_alarm = v_alarm | YGKMV_ETL_ERROR;           // set the appropriate alarm bit
-    } else v_alarm = v_alarm & ~YGKMV_ETL_ERROR;     // reset the alarm bit
+    alarmTested |= YGKMV_ITS_ERROR | YGKMV_ITL_ERROR | YGKMV_ETS_ERROR | YGKMV_ETL_ERROR;
+    if (v_it < p_itl) alarmPresent |= YGKMV_ITS_ERROR;  // inspiration time is too short
+    if (v_it > p_ith) alarmPresent |= YGKMV_ITL_ERROR;  // inspiration time is too long
+    if (v_et < p_etl) alarmPresent |= YGKMV_ETS_ERROR;  // expiration time is too short
+    if (v_et > p_eth) alarmPresent |= YGKMV_ETL_ERROR;  // expiration time is too long
    }
   // progress through the breath sequence from 0 to 1.0 on the timed sequence
 //  double prog = (millis() - startBreath) / (double) perBreath;
@@ -166,10 +193,6 @@ int YGKMV::run(bool reset){
     stoppedInspiration = true;
   if (v_itr > p_it)             // normal time limit is up
     stoppedInspiration = true;  
-  // Count all positive flow, regardless of phase
-  double newVol = v_q * 1000. / 60.;  // convert to ml/s
-  newVol *= uno.dt() / 1000000.;      // dt is in microseconds since last time through
-  if(newVol > 0) v_vr += newVol;
 
 /**************************INSPIRATION PHASE********************************/  
   if (!stoppedInspiration) {    // inspiration until we stop
@@ -191,14 +214,9 @@ int YGKMV::run(bool reset){
       v_ieEntered = v_ie = 1;
       v_ipmax = max(v_p,v_ipmax);
       v_ipmin = min(v_p,v_ipmin);
-      if (v_p < p_ipl){                               // pressure is too low
-        if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-        v_alarm = v_alarm | YGKMV_IPL_ERROR;           //set the appropriate alarm bit
-      } else v_alarm = v_alarm & ~YGKMV_IPL_ERROR;     //reset the alarm bit
-      if (v_p > p_iph){                               // pressure is too high
-        if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-        v_alarm = v_alarm | YGKMV_IPH_ERROR;           //set the appropriate alarm bit
-      } else v_alarm = v_alarm & ~YGKMV_IPH_ERROR;     //reset the alarm bit
+      alarmTested |= YGKMV_IPL_ERROR | YGKMV_IPH_ERROR;
+      if (v_p < p_ipl) alarmPresent |= YGKMV_IPL_ERROR; // pressure is too low
+      if (v_p > p_iph) alarmPresent |= YGKMV_IPH_ERROR; // pressure is too high
     }
     v_itr = phaseTime;
   } 
@@ -222,14 +240,9 @@ int YGKMV::run(bool reset){
       v_ieEntered = v_ie = -1;
       v_epmax = max(v_p,v_epmax);
       v_epmin = min(v_p,v_epmin);
-      if (v_p < p_epl){                               // pressure is too low
-        if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-        v_alarm = v_alarm | YGKMV_EPL_ERROR;           //set the appropriate alarm bit
-      } else v_alarm = v_alarm & ~YGKMV_EPL_ERROR;     //reset the alarm bit
-      if (v_p > p_eph){                               // pressure is too high
-        if(!v_alarmOnTime) v_alarmOnTime = millis();  // set alarm time if not already
-        v_alarm = v_alarm | YGKMV_EPH_ERROR;           //set the appropriate alarm bit
-      } else v_alarm = v_alarm & ~YGKMV_EPH_ERROR;     //reset the alarm bit
+      alarmTested |= YGKMV_EPL_ERROR | YGKMV_EPH_ERROR;
+      if (v_p < p_epl) alarmPresent |= YGKMV_EPL_ERROR; // pressure is too low
+      if (v_p > p_eph) alarmPresent |= YGKMV_EPH_ERROR; // pressure is too high
     }
     v_etr = -phaseTime;
   }
@@ -251,31 +264,49 @@ int YGKMV::run(bool reset){
     v_ieEntered = v_ie = 0;
   }
 
+  if(v_ieEntered != lastIE){
+    trace(TRACE_PHASE, v_ieEntered);
+    lastIE = v_ieEntered;
+  }
+  profMark(PROF_BREATH);
+
 /***TRANSLATE TO SERVO POSITIONS AND CHECK, THEN WRITE SERVOS AND BLOWER*****/  
   // force fractions in range and translate to servo positions
   fracCPAP = max(fracCPAP,0.0); fracCPAP = min(fracCPAP,1.0);
-  int posCPAP = aMinCPAP + (aMaxCPAP - aMinCPAP) * fracCPAP;
+  double posCPAP = aMinCPAP + (aMaxCPAP - aMinCPAP) * fracCPAP;
   fracPEEP = max(fracPEEP,0.0); fracPEEP = min(fracPEEP,1.0);
-  int posPEEP = aMinPEEP + (aMaxPEEP - aMinPEEP) * fracPEEP;
+  double posPEEP = aMinPEEP + (aMaxPEEP - aMinPEEP) * fracPEEP;
   fracDual = max(fracDual,-1.0); fracDual = min(fracDual,1.0);
-  int posDual = aMid + ((aClosePEEP - aCloseCPAP) / 2.0) * fracDual;
-  // write the latest servo positions
-  servoDual.write(posDual);
-  servoCPAP.write(posCPAP);
-  servoPEEP.write(posPEEP);
+  double posDual = aMid + ((aClosePEEP - aCloseCPAP) / 2.0) * fracDual;
+  bool calibrating = calStep();         // the calibration sequencer takes over the valves and blower
+  if(calibrating){
+    posCPAP = calPos[CPAP];
+    posPEEP = calPos[PEEP];
+    posDual = calPos[DUAL];
+  }
+  // write the latest servo positions, only if they have changed
+  writeServos(posCPAP, posPEEP, posDual);
+  if(trigTime) v_tl = (micros() - trigTime) / 1000.;  // first triggering sample to inspiration valve command
   // set the blower speed in accord with v_pSet and current measured pressure and write
   dpI += (v_pSet - v_p) * uno.dt() / 1000000.;      // dt is in microseconds since last time through
   blowerSpeed += (BLOWER_MAX - BLOWER_MIN) * (v_pSet - v_p) * BLOWER_GAIN;  // proportional control signal
   blowerSpeed += (BLOWER_MAX - BLOWER_MIN) * dpI * BLOWER_GAIN_I;           // integral gain signal
   blowerSpeed = min(blowerSpeed,BLOWER_MAX);
   blowerSpeed = max(blowerSpeed,BLOWER_MIN);
-  analogWrite(BLOWER_SPEED_PIN,blowerSpeed);
+  if(calibrating) blowerSpeed = calBlower;  // may be 0 for off
+  if(blowerSpeed != lastBlower){
+    analogWrite(BLOWER_SPEED_PIN,blowerSpeed);
+    lastBlower = blowerSpeed;
+    v_wr++;
+  }
+  profMark(PROF_VALVES);
 
 
 /***************************RESPOND TO BUTTON(S)*******************************/  
   loopButtons();
 
 /*****************************RESPOND TO ALARM CONDITIONS********************/
+  updateAlarms(alarmTested, alarmPresent, alarmUrgent);
   if(!v_alarm){
     if(v_alarmOnTime){    // cancel an alarm that has recovered
       v_alarmOffTime = millis();
@@ -294,54 +325,87 @@ int YGKMV::run(bool reset){
   }
 
 /***********************SEND DATA TO CONSOLE / PLOTTER / DISPLAY UNIT**************/  
+  publishSnapshot();
+  profMark(PROF_ALARMS);
   loopOut();
+  profMark(PROF_OUT);
 
   return status();
   }
 
 /**************************************************************************/
 /*!
-    @brief Handle pushbutton input
-    @param none
+    @brief Move the servos toward new positions along the trajectory set by
+            slewProfile and slewTime, writing in microseconds and only when
+            the pulse width has actually changed. A new target carries on
+            from the current position and speed rather than starting over,
+            and only ever raises the speed (SLEW_LINEAR) or acceleration
+            (SLEW_SCURVE) limit of a move in progress, so a target that
+            changes every pass is still reached in about slewTime.
+    @param posCPAP target CPAP valve servo position [degrees]
+    @param posPEEP target PEEP valve servo position [degrees]
+    @param posDual target Dual valve servo position [degrees]
     @return none
 */
 /**************************************************************************/
-void YGKMV::loopButtons(){
-  static unsigned long lastButton = 0;    // set to millis() at the end of the last button press
-  static double pDelta = 1;
-  static double epDelta = 1;
-  if(digitalRead(BUTTON_PIN) == LOW) setRun();
-  
-  if (millis()-lastButton > 500){
-    lastButton = millis();
-    if(digitalRead(BUTTON_PIN) == LOW) {  // main / only button
-      /************** turn on plotter mode  ***************************/
-      p_plotterMode = true;
-
-      /************** Decrease the peak pressure **********************/
-      p_iph = min(p_iph,24);
-//      if(p_iph > 20) pDelta = -abs(pDelta);
-//      if(p_iph < 10) pDelta = abs(pDelta);
-//      p_iph += pDelta;
-      /************** Increase the min pressure **********************/
-//      if(p_epl > 12) epDelta = -abs(epDelta);
-//      if(p_epl < 4) epDelta = abs(epDelta);
-//      p_epl += epDelta;
-      
-      /******************* toggle enable / disable triggering ****************/
-      if (p_trigEnabled) p_trigEnabled = false; // toggle trigger mode
-      else p_trigEnabled = true;
-
-      /******************* enable triggering ****************/
-      p_trigEnabled = true;
-
-      /******************* reset alarm conditions to turn off buzzer *******/
-      v_alarm = YGKMV_NO_ERROR;  // reset alarm conditions
-      v_alarmOffTime = millis();
-      v_alarmOnTime = 0;
-      p_alarm = false;
+void YGKMV::writeServos(double posCPAP, double posPEEP, double posDual){
+  double pos[3] = {posCPAP, posPEEP, posDual};  // indexed by CPAP, PEEP, DUAL
+  unsigned long now = micros();
+  for(int i = 0; i < 3; i++){
+    if(!(ygkmv_model::servos & (1 << i))) continue;  // not fitted on this model
+    int us = SERVO_US_MIN + (SERVO_US_MAX - SERVO_US_MIN) * pos[i] / 180.;
+    double dt = (unsigned long)(now - slewLast[i]) / 1000.;  // [ms] since the last update
+    slewLast[i] = now;
+    double e = us - usPos[i];   // [us] still to go
+    if(usLast[i] < 0 || slewProfile == SLEW_STEP || slewTime <= 0){
+      usPos[i] = us;            // nowhere known to start from, or no slew wanted
+      usVel[i] = usAcc[i] = 0.0;
+    } else if(slewProfile == SLEW_LINEAR){
+      if(us != usTarget[i] || usVel[i] <= 0.0) usVel[i] = max(usVel[i], fabs(e) / slewTime);
+      double step = usVel[i] * dt;
+      if(step >= fabs(e)){      // arrived
+        usPos[i] = us;
+        usVel[i] = 0.0;
+      } else usPos[i] += (e > 0) ? step : -step;
+    } else {                    // SLEW_SCURVE, accelerate at usAcc until it is time to brake
+      if(us != usTarget[i] || usAcc[i] <= 0.0)
+        usAcc[i] = max(usAcc[i], 4. * fabs(e) / ((double)slewTime * slewTime));
+      double a = usAcc[i] * dt;
+      double vStop = sqrt(2. * usAcc[i] * fabs(e) + a * a / 4.) - a / 2.;  // fastest speed that can still stop at the target
+      double v = constrain((e > 0) ? vStop : -vStop, usVel[i] - a, usVel[i] + a);
+      double step = v * dt;
+      if(step * e >= 0.0 && fabs(step) >= fabs(e)){  // arrived
+        usPos[i] = us;
+        usVel[i] = usAcc[i] = 0.0;
+      } else {
+        usPos[i] += step;
+        usVel[i] = v;
+      }
     }
-  }  
+    usTarget[i] = us;
+    us = lround(usPos[i]);
+    if(us != usLast[i]){      // don't touch the hardware unless it changes
+      servos[i]->writeMicroseconds(us);
+      usLast[i] = us;
+      v_wr++;
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Forget the last written servo and blower values so the next call
+            to run() writes them all. Use after writing servos directly.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::resetServos(){
+  for(int i = 0; i < 3; i++){
+    usLast[i] = usTarget[i] = -1;
+    usVel[i] = usAcc[i] = 0.0;
+  }
+  lastBlower = -1;
 }
 
 /**************************************************************************/
@@ -360,30 +424,34 @@ void YGKMV::loopOut()
 /***********************SEND DATA TO CONSOLE / PLOTTER / DISPLAY UNIT**************/  
   if (millis()-lastPrint > OUTPUT_INTERVAL) {  // 50 ms for 20 Hz
     lastPrint = millis();
+    ygkmv_snap_t s;
+    if(!getSnapshot(&s)) return;                 // being rewritten, try again next time
     char sc[MAX_COMMAND_LENGTH] = {0};
-    sprintf(sc, "%10lu, %5.3f, %5.2f, %5.2f, %5.2f", millis(), prog, fracCPAP, fracPEEP, fracDual);
-    sprintf(sc, "%s, %5.3f, %5.2f, %5.1f", sc, v_o2, v_p, v_q);
-    sprintf(sc, "%s, %5.2f, %5.2f, %5u", sc, v_ipp, v_ipl, v_it);
-    sprintf(sc, "%s, %5.2f, %5.2f, %5u", sc, v_epp, v_epl, v_et);
-    sprintf(sc, "%s, %5.2f, %5.2f, %5.2f, %lu", sc, v_bpm, v_v, v_mv, v_alarm);
-    sprintf(sc, "%s, %2d", sc, v_ie);
-    sprintf(sc, "%s, %5.2f, %5.2f", sc, v_pp, v_pl);
-    sprintf(sc, "%s, %5.2f", sc, v_batv); // could be added on the end
+    sprintf(sc, "%10lu, %5.3f, %5.2f, %5.2f, %5.2f", (unsigned long) s.t, s.prog, s.fracCPAP, s.fracPEEP, s.fracDual);
+    sprintf(sc, "%s, %5.3f, %5.2f, %5.1f", sc, s.o2, s.p, s.q);
+    sprintf(sc, "%s, %5.2f, %5.2f, %5u", sc, s.ipp, s.ipl, s.it);
+    sprintf(sc, "%s, %5.2f, %5.2f, %5u", sc, s.epp, s.epl, s.et);
+    sprintf(sc, "%s, %5.2f, %5.2f, %5.2f, %lu", sc, s.bpm, s.v, s.mv, (unsigned long) s.alarm);
+    sprintf(sc, "%s, %2d", sc, s.ie);
+    sprintf(sc, "%s, %5.2f, %5.2f", sc, s.pp, s.pl);
+    sprintf(sc, "%s, %5.2f", sc, s.batv); // could be added on the end
     sprintf(sc, "%s\n", sc);
     if(display) display->print(sc);
+    trace(TRACE_OUTPUT, strlen(sc));
+    logLine(sc, strlen(sc));
     if(p_printConsole){
       lastConsole = millis();
       if(p_plotterMode){
         PL("pSet, Pressure[cmH2O], Phase, v_q/10, v_vr/100");
-        P(v_pSet);
-        PCS(v_p);    // use with Serial plotter to visualize the pressure output
+        P(s.pSet);
+        PCS(s.p);    // use with Serial plotter to visualize the pressure output
 //        PCS(p_iph - p_iphTol);
 //        PCS(p_epl + p_eplTol);
 //        PCS(v_itr/1000.);
 //        PCS(v_etr/1000.);
-        PCS(v_ie + 10);
-        PCS(v_q/10);
-        PCS(v_vr/100);
+        PCS(s.ie + 10);
+        PCS(s.q/10);
+        PCS(s.vr/100);
 //        PCS(v_mv);
 //        PCS(v_bpms);
         PL();
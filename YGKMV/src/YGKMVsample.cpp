@@ -0,0 +1,198 @@
+/**************************************************************************/
+/*!
+  @file YGKMVsample.cpp
+
+  @section intro Introduction
+
+  Sensor sampling at a fixed rate, independent of how long loop() takes.
+  On the SAMD21 a TC3 interrupt reads the flow and pressure channels every
+  SAMPLE_US into a ring with the time of each reading. run() empties the
+  ring with loopSamples(), so smoothing, trigger detection and the volume
+  integrals see every sample at its own time. Without the timer, run()
+  takes one sample each time through and everything else is the same.
+
+  TC3 is free on the Feather M0, Servo uses TC4 and tone() uses TC5. The
+  interrupt runs at the lowest priority so it never delays the servo
+  pulses, and main code that calls analogRead() must go through readV()
+  so a conversion is never interrupted by the timer starting another. A
+  tick held off by readV() runs as soon as it finishes, and is still timed
+  from when its readings were taken.
+
+  Each tick is up to three blocking analogRead() calls, and what they cost
+  depends on the ADC clock and sample time the core sets up: tens of us
+  with a fast prescaler, several hundred with the slowest. setupSamples()
+  times a few ticks on the board it is running on and lengthens the
+  interval from SAMPLE_US until the interrupt takes at most 1 / SAMPLE_LOAD
+  of the CPU. The p command shows the interval and the measured cost.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  MIT license
+*/
+/**************************************************************************/
+#include "YGKMV.h"
+
+static YGKMV *sampleVent = NULL;  ///< the instance the timer interrupt samples for
+
+#if YGKMV_SAMPLE_TIMER
+/**************************************************************************/
+/*!
+    @brief TC3 match interrupt, takes one sample every SAMPLE_US
+*/
+/**************************************************************************/
+void TC3_Handler(){
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  if(sampleVent) sampleVent->sampleTick();
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief Start the sample timer where there is one. Call after setupP()
+            and setupQ() have primed the smoothed voltages.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::setupSamples(){
+  sampleVent = this;
+  sampleTimer = false;
+  unsigned long cost = 0;   // [us] longest of a few samples taken here
+  for(int i = 0; i < 4; i++){
+    unsigned long t = micros();
+    sampleTick();
+    cost = max(cost, micros() - t);
+  }
+  samplePeriod = constrain(cost * SAMPLE_LOAD, (unsigned long) SAMPLE_US, (unsigned long) SAMPLE_US_MAX);
+  sampleTail = sampleHead;
+  sampleBusy = sampleBusyN = sampleBusyMax = 0;
+  v_sampleTime = 0;
+#if YGKMV_SAMPLE_TIMER
+  GCLK->CLKCTRL.reg = (uint16_t)(GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3);
+  while(GCLK->STATUS.bit.SYNCBUSY);
+  TcCount16 *tc = &TC3->COUNT16;
+  tc->CTRLA.reg &= ~TC_CTRLA_ENABLE;
+  while(tc->STATUS.bit.SYNCBUSY);
+  tc->CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV16;
+  while(tc->STATUS.bit.SYNCBUSY);
+  tc->CC[0].reg = (uint16_t)(F_CPU / 16 / 1000000 * samplePeriod - 1);
+  while(tc->STATUS.bit.SYNCBUSY);
+  tc->INTENSET.reg = TC_INTENSET_MC0;
+  NVIC_SetPriority(TC3_IRQn, (1 << __NVIC_PRIO_BITS) - 1);  // lowest, below Servo on TC4
+  NVIC_EnableIRQ(TC3_IRQn);
+  tc->CTRLA.reg |= TC_CTRLA_ENABLE;
+  while(tc->STATUS.bit.SYNCBUSY);
+  sampleTimer = true;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Read the flow and pressure channels into the next ring entry.
+            Called from the timer interrupt, or from run() without one.
+            Unfitted sensors are not read. Its own time is added to
+            sampleBusy for the p command.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::sampleTick(){
+  volatile ygkmv_sample_t *s = &sampleRing[sampleHead & (SAMPLE_QUEUE - 1)];
+  unsigned long t = micros();
+  s->t = t;
+  if(ygkmv_model::qSource != YGKMV_Q_NONE) s->a[CPAP] = analogRead(aPins[CPAP]);
+  if(ygkmv_model::qSource == YGKMV_Q_CAP2) s->a[PEEP] = analogRead(aPins[PEEP]);
+  if(ygkmv_model::pSource != YGKMV_P_NONE) s->a[PATIENT] = analogRead(aPins[PATIENT]);
+  sampleHead = sampleHead + 1;
+  t = micros() - t;
+  sampleBusy = sampleBusy + t;
+  sampleBusyN = sampleBusyN + 1;
+  if(t > sampleBusyMax) sampleBusyMax = t;
+}
+
+/**************************************************************************/
+/*!
+    @brief Read a voltage from the main code without colliding with a
+            timer sample.
+    @param pin analog input pin
+    @return voltage
+*/
+/**************************************************************************/
+double YGKMV::readV(int pin){
+#if YGKMV_SAMPLE_TIMER
+  NVIC_DisableIRQ(TC3_IRQn);
+  double v = uno.getV(pin);
+  NVIC_EnableIRQ(TC3_IRQn);
+  return v;
+#else
+  return uno.getV(pin);
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Process every sample taken since the last call, in order. Each
+            one updates the smoothed voltages with a weight for its own
+            interval, sets v_pRaw, v_qRaw and v_sampleTime, and goes to
+            sampleTrigger() and integrateQ(). Leak flow taken out of the
+            samples is added up in v_vlc for the next leak estimate. Takes a sample first if there
+            is no timer. Call once per run() after p_trigArmed is set.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::loopSamples(){
+  static double leakLast = 0.0;   // leak flow taken out of the previous sample [l/min]
+  if(!sampleTimer) sampleTick();
+  double vPerCount = uno.getVRef() / ((1UL << ADC_RESOLUTION) - 1);
+  unsigned long head = sampleHead;
+  if(head - sampleTail > SAMPLE_QUEUE){   // run() was away too long, lose the oldest
+    sampleDropped += head - sampleTail - SAMPLE_QUEUE;
+    sampleTail = head - SAMPLE_QUEUE;
+  }
+  while(sampleTail != head){
+    volatile ygkmv_sample_t *r = &sampleRing[sampleTail & (SAMPLE_QUEUE - 1)];
+    ygkmv_sample_t s;
+    s.t = r->t;
+    for(int i = 0; i < 3; i++) s.a[i] = r->a[i];
+    if(sampleHead - sampleTail >= SAMPLE_QUEUE){   // overwritten while it was copied
+      sampleDropped++;
+      sampleTail++;
+      continue;
+    }
+    sampleTail++;
+    unsigned long dt = v_sampleTime ? s.t - v_sampleTime : 0;   // [us] since the last sample
+    double w = 1.0;   // weighting factor for exponential smoothing over this interval
+    if(dt) w = min(1., dt / p_tau / 1000000.);
+    v_tauW = w;
+    v_sampleTime = s.t;
+    if(ygkmv_model::pSource != YGKMV_P_NONE){
+      double v = s.a[PATIENT] * vPerCount;
+      v_px137v = v_px137v * (1-w) + v * w;    // smoothed voltage
+      v_pRaw = (v - offset[PATIENT]) * scale[PATIENT];
+    } else v_pRaw = 0.0;
+    v_qRaw = 0.0;
+    if(ygkmv_model::qSource != YGKMV_Q_NONE){
+      double v = s.a[CPAP] * vPerCount;
+      v_CPAPv = v_CPAPv * (1-w) + v * w;      // smoothed voltage
+      v_qRaw = calFlow(CPAP, v);
+      if(ygkmv_model::qSource == YGKMV_Q_CAP2){
+        v = s.a[PEEP] * vPerCount;
+        v_PEEPv = v_PEEPv * (1-w) + v * w;    // smoothed voltage
+        v_qRaw -= calFlow(PEEP, v);
+      }
+      double leak = v_leakK * max(v_pRaw, 0.0);   // leak flow at this pressure
+      v_qLeak = v_qLeak * (1-w) + leak * w;       // smoothed leak flow
+      if(!p_leakComp) leak = 0.0;
+      v_qRaw -= leak;
+      v_vlc += (leakLast + leak) / 2 * dt / 60000.;   // same trapezoid as integrateQ()
+      leakLast = leak;
+    }
+    sampleTrigger(v_pRaw, v_qRaw, s.t);
+    integrateQ(v_qRaw, v_pRaw, s.t);
+  }
+}
@@ -0,0 +1,55 @@
+/**************************************************************************/
+/*!
+  @file YGKMVtrace.cpp
+
+  @section intro Introduction
+
+  A fixed size ring of timestamped events in RAM. Recording an event is a
+  micros() call and three stores, so it can stay on all the time. Dump it
+  in binary with the B command, then convert the captured console output
+  with extras/tracetojson for chrome://tracing or ui.perfetto.dev.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  MIT license
+*/
+/**************************************************************************/
+#include "YGKMV.h"
+
+/**************************************************************************/
+/*!
+    @brief Record an event in the trace ring, overwriting the oldest.
+    @param type one of the TRACE_ event types
+    @param arg event specific value, e.g. phase, alarm bit or command letter
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::trace(uint8_t type, int16_t arg){
+  ygkmv_trace_t *e = &traceRing[traceHead++ & (TRACE_SIZE - 1)];
+  e->t = micros();
+  e->type = type;
+  e->arg = arg;
+}
+
+/**************************************************************************/
+/*!
+    @brief Write the trace ring to the console in binary, oldest first. The
+            block starts with TRACE_MAGIC, the entry size and the number of
+            entries as 16 bit little endian values, then the entries.
+    @param none
+    @return none
+*/
+/**************************************************************************/
+void YGKMV::dumpTrace(){
+  uint16_t n = min(traceHead, (unsigned long) TRACE_SIZE);
+  uint16_t hdr[2] = {sizeof(ygkmv_trace_t), n};
+  Serial.write((const uint8_t *) TRACE_MAGIC, 4);
+  Serial.write((const uint8_t *) hdr, sizeof(hdr));
+  for(unsigned long i = traceHead - n; i != traceHead; i++)
+    Serial.write((const uint8_t *) &traceRing[i & (TRACE_SIZE - 1)], sizeof(ygkmv_trace_t));
+  Serial.write('\n');
+}
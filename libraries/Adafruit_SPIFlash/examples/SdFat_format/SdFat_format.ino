@@ -27,6 +27,15 @@
 #include "ff.h"
 #include "diskio.h"
 
+// Set ERASE_ALIGNED to 1 to make each cluster one flash erase sector, with
+// the FAT, root directory and every cluster starting on an erase sector.
+// Each cluster write then erases one sector, instead of rewriting a
+// sector shared with other clusters.  Set to 0 for the generic FAT
+// layout, which packs more small files into the flash.
+#ifndef ERASE_ALIGNED
+#define ERASE_ALIGNED 1
+#endif
+
 #if defined(__SAMD51__) || defined(NRF52840_XXAA)
   Adafruit_FlashTransport_QSPI flashTransport(PIN_QSPI_SCK, PIN_QSPI_CS, PIN_QSPI_IO0, PIN_QSPI_IO1, PIN_QSPI_IO2, PIN_QSPI_IO3);
 #else
@@ -73,7 +82,7 @@ void setup() {
 
   // Make filesystem.
   uint8_t buf[512] = {0};          // Working buffer for f_fdisk function.    
-  FRESULT r = f_mkfs("", FM_FAT | FM_SFD, 0, buf, sizeof(buf));
+  FRESULT r = f_mkfs("", FM_FAT | FM_SFD, ERASE_ALIGNED ? SFLASH_SECTOR_SIZE : 0, buf, sizeof(buf));
   if (r != FR_OK) {
     Serial.print("Error, f_mkfs failed with error code: "); Serial.println(r, DEC);
     while(1);
@@ -90,10 +99,44 @@ void setup() {
     while(1) delay(1);
   }
 
+  printLayout();
+
   // Done!
   Serial.println("Flash chip successfully formatted with new empty filesystem!");
 }
 
+// Print where a block falls relative to the flash erase sectors.
+void printBlock(const char* name, uint32_t block) {
+  const uint32_t eraseBlocks = SFLASH_SECTOR_SIZE/512;
+  Serial.print(name); Serial.print(" block "); Serial.print(block);
+  Serial.println(block % eraseBlocks ? ", not erase aligned" : ", erase aligned");
+}
+
+// Report the layout of the new volume and the flash erases it costs to
+// write and sync one cluster: the erase sectors the cluster touches plus
+// one each for the FAT and directory entry updates.
+void printLayout() {
+  const uint32_t eraseBlocks = SFLASH_SECTOR_SIZE/512;
+  FatVolume* vol = fatfs.vol();
+  uint32_t bpc = vol->blocksPerCluster();
+  Serial.print("FAT"); Serial.print(vol->fatType());
+  Serial.print(", "); Serial.print(vol->clusterCount());
+  Serial.print(" clusters of "); Serial.print(bpc*512); Serial.println(" bytes");
+  printBlock("FAT start", vol->fatStartBlock());
+  if (vol->fatType() != 32) printBlock("Root directory", vol->rootDirStart());
+  printBlock("Data start", vol->dataStartBlock());
+  uint32_t offset = vol->dataStartBlock() % eraseBlocks;
+  uint32_t span = (offset + bpc + eraseBlocks - 1)/eraseBlocks;
+  if (bpc % eraseBlocks) {
+    // clusters start at different offsets, use the worst case
+    span = (eraseBlocks - 1 + bpc + eraseBlocks - 1)/eraseBlocks;
+  }
+  Serial.print("Expected erases per cluster write: "); Serial.print(span + 2);
+  Serial.print(" ("); Serial.print(span); Serial.println(" data + 1 FAT + 1 directory)");
+  Serial.print("Expected erases per 4 KB written: ");
+  Serial.println((span + 2.0)*eraseBlocks/bpc, 1);
+}
+
 void loop() {
   // Nothing to be done in the main loop.
 }
@@ -162,7 +205,7 @@ DRESULT disk_ioctl (
       return RES_OK;
 
     case GET_BLOCK_SIZE:
-      *((DWORD*) buff) = 8;    // erase block size in units of sector size
+      *((DWORD*) buff) = SFLASH_SECTOR_SIZE/512;    // erase block size in units of sector size
       return RES_OK;
 
     default:
@@ -5811,7 +5811,11 @@ FRESULT f_mkfs (
 					n = (n_clst * 3 + 1) / 2 + 3;	/* FAT size [byte] */
 				}
 				sz_fat = (n + ss - 1) / ss;		/* FAT size [sector] */
+#if FF_MKFS_ALIGN
+				sz_rsv = sz_blk;				/* Number of reserved sectors, FAT on an erase block */
+#else
 				sz_rsv = 1;						/* Number of reserved sectors */
+#endif
 				sz_dir = (DWORD)n_rootdir * SZDIRE / ss;	/* Rootdir size [sector] */
 			}
 			b_fat = b_vol + sz_rsv;						/* FAT base */
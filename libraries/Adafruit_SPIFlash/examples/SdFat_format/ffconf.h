@@ -42,6 +42,12 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
+#define FF_MKFS_ALIGN	1
+/* This option makes f_mkfs() start the FAT of a FAT12/16 volume on an erase
+/  block boundary, as it already does for the data area, so that FAT updates
+/  do not erase the boot sector. (0:Disable or 1:Enable) */
+
+
 #define FF_USE_FASTSEEK	0
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
@@ -111,13 +111,6 @@ static void write_i2c_register(uint8_t addr, uint8_t reg, uint8_t val) {
 // utility code, some of this could be exposed in the DateTime API if needed
 /**************************************************************************/
 
-/**
-  Number of days in each month, from January to November. December is not
-  needed. Omitting it avoids an incompatibility with Paul Stoffregen's Time
-  library. C.f. https://github.com/adafruit/RTClib/issues/114
-*/
-const uint8_t daysInMonth [] PROGMEM = { 31,28,31,30,31,30,31,31,30,31,30 };
-
 /**************************************************************************/
 /*!
     @brief  Given a date, return number of days since 2000/01/01, valid for 2001..2099
@@ -131,10 +124,10 @@ static uint16_t date2days(uint16_t y, uint8_t m, uint8_t d) {
     if (y >= 2000)
         y -= 2000;
     uint16_t days = d;
-    for (uint8_t i = 1; i < m; ++i)
-        days += pgm_read_byte(daysInMonth + i - 1);
-    if (m > 2 && y % 4 == 0)
-        ++days;
+    if (m > 2)      // days before the month, counting from March 1
+        days += (153 * (m - 3) + 2) / 5 + 59 + (y % 4 == 0);
+    else if (m == 2)
+        days += 31;
     return days + 365 * y + (y + 3) / 4 - 1;
 }
 
@@ -169,20 +162,25 @@ DateTime::DateTime (uint32_t t) {
   t /= 60;
   hh = t % 24;
   uint16_t days = t / 24;
-  uint8_t leap;
-  for (yOff = 0; ; ++yOff) {
-    leap = yOff % 4 == 0;
-    if (days < 365 + leap)
-      break;
-    days -= 365 + leap;
+  // every 4th year is a leap year from 2000, as in date2days()
+  yOff = 4 * (days / 1461);
+  days %= 1461;
+  uint8_t leap = days < 366;
+  if (!leap) {
+    days -= 366;
+    yOff += 1 + days / 365;
+    days %= 365;
   }
-  for (m = 1; m < 12; ++m) {
-    uint8_t daysPerMonth = pgm_read_byte(daysInMonth + m - 1);
-    if (leap && m == 2)
-      ++daysPerMonth;
-    if (days < daysPerMonth)
-      break;
-    days -= daysPerMonth;
+  if (days < 31) {
+    m = 1;
+  } else if (days < 59 + leap) {
+    m = 2;
+    days -= 31;
+  } else {          // March based month from the day of the year
+    days -= 59 + leap;
+    uint8_t mp = (5 * days + 2) / 153;
+    m = mp + 3;
+    days -= (153 * mp + 2) / 5;
   }
   d = days + 1;
 }
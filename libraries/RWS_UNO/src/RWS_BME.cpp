@@ -0,0 +1,176 @@
+/**************************************************************************/
+/*!
+  @file RWS_BME.cpp
+
+  @section intro Introduction
+
+  Lightweight BME280 / BMP280 pressure and temperature reading.
+
+  The sensor free runs in normal mode, so a read never has to start a
+  conversion and wait for it. Pressure and temperature come from one burst
+  read of the data registers, instead of the separate transactions made by
+  readTemperature() and readPressure(), and poll() skips the bus entirely
+  until the next measurement cycle should be complete. Compensation uses
+  the integer formulas from the Bosch datasheet.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  CCBY license
+*/
+/**************************************************************************/
+#include "RWS_UNO.h"
+
+/**************************************************************************/
+/*!
+    @brief Burst read consecutive registers.
+    @param addr the I2C address of the device
+    @param reg the first register
+    @param buf where to put the bytes
+    @param n number of bytes
+    @return true if all the bytes arrived
+*/
+/**************************************************************************/
+static bool bmeRead(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t n) {
+  Wire.beginTransmission(addr);
+  Wire.write(reg);
+  if (Wire.endTransmission() != 0)
+    return false;
+  if (Wire.requestFrom(addr, n) != n)
+    return false;
+  for (uint8_t i = 0; i < n; i++)
+    buf[i] = Wire.read();
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Write one register.
+    @param addr the I2C address of the device
+    @param reg the register
+    @param data the value to write
+    @return none
+*/
+/**************************************************************************/
+static void bmeWrite(uint8_t addr, uint8_t reg, uint8_t data) {
+  Wire.beginTransmission(addr);
+  Wire.write(reg);
+  Wire.write(data);
+  Wire.endTransmission();
+}
+
+/**************************************************************************/
+/*!
+    @brief Find the sensor, read its calibration and start it free running.
+    @param addr the I2C address, BMX_ADDRESS_A or BMX_ADDRESS_B
+    @return true if a BMP280 or BME280 was found
+*/
+/**************************************************************************/
+bool RWS_BME280::begin(uint8_t addr) {
+  uint8_t c[24];
+  _addr = addr;
+  _id = 0;
+  Wire.begin();
+  if (!bmeRead(_addr, BMX_REGISTER_CHIPID, c, 1))
+    return false;
+  if (c[0] != 0x60 && (c[0] < 0x56 || c[0] > 0x58))
+    return false;
+  _id = c[0];
+  if (!bmeRead(_addr, BMX_REGISTER_CALIB, c, 24)) {
+    _id = 0;
+    return false;
+  }
+  _T1 = c[0] | (c[1] << 8);
+  _T2 = c[2] | (c[3] << 8);
+  _T3 = c[4] | (c[5] << 8);
+  _P1 = c[6] | (c[7] << 8);
+  _P2 = c[8] | (c[9] << 8);
+  _P3 = c[10] | (c[11] << 8);
+  _P4 = c[12] | (c[13] << 8);
+  _P5 = c[14] | (c[15] << 8);
+  _P6 = c[16] | (c[17] << 8);
+  _P7 = c[18] | (c[19] << 8);
+  _P8 = c[20] | (c[21] << 8);
+  _P9 = c[22] | (c[23] << 8);
+  if (_id == 0x60)
+    bmeWrite(_addr, BMX_REGISTER_CTRL_HUM, 0x00); // humidity off, takes effect with ctrl_meas
+  bmeWrite(_addr, BMX_REGISTER_CONFIG, BMX_CONFIG_FAST);
+  bmeWrite(_addr, BMX_REGISTER_CTRL_MEAS, BMX_CTRL_MEAS_NORMAL);
+  _last = micros() - BMX_PERIOD_US;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Read the latest measurement, but only if a new one should be
+    ready, so most calls return without touching the bus.
+    @return true if a new measurement was read
+*/
+/**************************************************************************/
+bool RWS_BME280::poll() {
+  if (!_id || micros() - _last < BMX_PERIOD_US)
+    return false;
+  uint8_t d[6];
+  _last = micros();
+  if (!bmeRead(_addr, BMX_REGISTER_DATA, d, 6))
+    return false;
+  int32_t adcP = ((uint32_t)d[0] << 12) | ((uint32_t)d[1] << 4) | (d[2] >> 4);
+  int32_t adcT = ((uint32_t)d[3] << 12) | ((uint32_t)d[4] << 4) | (d[5] >> 4);
+  if (adcP == 0x80000 || adcT == 0x80000) // measurement skipped, not ready yet
+    return false;
+  compensate(adcT, adcP);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Convert raw readings with the integer formulas from the Bosch
+    datasheet, 32 bit for temperature and 64 bit for pressure.
+    @param adcT raw 20 bit temperature
+    @param adcP raw 20 bit pressure
+    @return none
+*/
+/**************************************************************************/
+void RWS_BME280::compensate(int32_t adcT, int32_t adcP) {
+  int32_t v1 = ((((adcT >> 3) - ((int32_t)_T1 << 1))) * ((int32_t)_T2)) >> 11;
+  int32_t v2 = (((((adcT >> 4) - ((int32_t)_T1)) * ((adcT >> 4) - ((int32_t)_T1))) >> 12) *
+                ((int32_t)_T3)) >> 14;
+  int32_t tFine = v1 + v2;
+  _t = (tFine * 5 + 128) >> 8;
+
+  int64_t w1 = ((int64_t)tFine) - 128000;
+  int64_t w2 = w1 * w1 * (int64_t)_P6;
+  w2 = w2 + ((w1 * (int64_t)_P5) << 17);
+  w2 = w2 + (((int64_t)_P4) << 35);
+  w1 = ((w1 * w1 * (int64_t)_P3) >> 8) + ((w1 * (int64_t)_P2) << 12);
+  w1 = (((((int64_t)1) << 47) + w1)) * ((int64_t)_P1) >> 33;
+  if (w1 == 0)
+    return; // avoid dividing by zero, keep the last pressure
+  int64_t p = 1048576 - adcP;
+  p = (((p << 31) - w2) * 3125) / w1;
+  w1 = (((int64_t)_P9) * (p >> 13) * (p >> 13)) >> 25;
+  w2 = (((int64_t)_P8) * p) >> 19;
+  _p = ((p + w1 + w2) >> 8) + (((int64_t)_P7) << 4);
+}
+
+/*!
+    @brief Latest readings
+    @return pressure [Pa]
+*/
+double RWS_BME280::pressure() { return _p / 256.0; }
+
+/*!
+    @brief Latest readings
+    @return temperature [C]
+*/
+double RWS_BME280::temperature() { return _t / 100.0; }
+
+/*!
+    @brief Sensor identification
+    @return chip ID found by begin(), 0x60 for a BME280, 0x56 to 0x58 for
+    a BMP280, or 0 if there is no sensor
+*/
+unsigned RWS_BME280::sensorID() { return _id; }
@@ -123,6 +123,7 @@ int RWS_UNO::run(bool reset){
     _dt = 0.0;             // most recent time between calls [us]
     _dtAvg = 0.0;          // average time between calls [us]
     _dtMax = 0.0;          // largest time between calls [us]
+    dtStats.reset();
   }
   if(timeLast != 0) 
     _dt = timeNow - timeLast;
@@ -131,6 +132,7 @@ int RWS_UNO::run(bool reset){
   else 
     _dtAvg = _dt;
   _dtMax = max(_dtMax,_dt);
+  if(timeLast != 0) dtStats.add(_dt);
   timeLast = timeNow;
   return 0;
   }
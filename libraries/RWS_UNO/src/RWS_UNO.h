@@ -35,6 +35,14 @@
 #define BMX_ADDRESS_A             0x76
 #define BMX_ADDRESS_B             0x77
 #define BMX_REGISTER_CHIPID       0xD0
+#define BMX_REGISTER_CALIB        0x88     ///< dig_T1 to dig_P9, 24 bytes little endian
+#define BMX_REGISTER_CTRL_HUM     0xF2
+#define BMX_REGISTER_CTRL_MEAS    0xF4
+#define BMX_REGISTER_CONFIG       0xF5
+#define BMX_REGISTER_DATA         0xF7     ///< pressure then temperature, 6 bytes
+#define BMX_CTRL_MEAS_NORMAL      0x2F     ///< temperature x1, pressure x4 oversampling, normal mode
+#define BMX_CONFIG_FAST           0x08     ///< 0.5 ms standby, IIR filter x4
+#define BMX_PERIOD_US            14000     ///< measurement cycle for the settings above [us]
 #define BNO_ADDRESS_A             0x28
 #define BNO_ADDRESS_B             0x29
 #define BNO_REGISTER_CHIPID       0x00
@@ -94,6 +102,60 @@ typedef enum {
   TIME_SOURCE_GPS         ///< Time set from GPS
 } rws_uno_time_source_t;
 
+#define RWS_STATS_BLOCKS_MAX 16  ///< most blocks in a RWS_Stats rolling window
+#define RWS_STATS_BUCKETS    64  ///< log histogram buckets, two per power of 2
+
+// Streaming statistics in fixed memory. Min, max and mean cover a rolling
+// window of the most recent blocks of samples. Percentiles come from a log
+// histogram covering everything since the last reset().
+class RWS_Stats{
+  public:
+    RWS_Stats(unsigned blockSize = 100, uint8_t blocks = 10);
+    void setWindow(unsigned blockSize, uint8_t blocks); // also resets
+    void add(double x);             // add a sample, negative values count as 0
+    void reset();                   // clear the window and the histogram
+    double min();                   // smallest sample in the window
+    double max();                   // largest sample in the window
+    double mean();                  // mean of the samples in the window
+    unsigned long windowCount();    // number of samples in the window
+    double percentile(double pc);   // estimate from samples since reset(), pc from 0 to 100
+    unsigned long count();          // number of samples since reset()
+
+  private:
+    unsigned _blockSize = 100;      // samples per block
+    uint8_t _blocks = 10;           // blocks in the window
+    uint8_t _cur = 0;               // index of the block being filled
+    float _bMin[RWS_STATS_BLOCKS_MAX];
+    float _bMax[RWS_STATS_BLOCKS_MAX];
+    float _bSum[RWS_STATS_BLOCKS_MAX];
+    unsigned _bN[RWS_STATS_BLOCKS_MAX];
+    uint32_t _hist[RWS_STATS_BUCKETS];
+    unsigned long _count = 0;
+    double _max = 0.0;              // largest sample since reset, tops the last bucket
+};
+
+// A BME280 / BMP280 pressure sensor left running in normal mode, so there is
+// no waiting for conversions. poll() does at most one 6 byte burst read, and
+// only once a new measurement should be ready, then compensates in integers.
+class RWS_BME280{
+  public:
+    bool begin(uint8_t addr = BMX_ADDRESS_B); // true if a BMP280 or BME280 is found
+    bool poll();                    // read if a new measurement is due, true if one was read
+    double pressure();              // latest pressure [Pa]
+    double temperature();           // latest temperature [C]
+    unsigned sensorID();            // chip ID from begin(), 0 if none found
+    void compensate(int32_t adcT, int32_t adcP); // public so it can be checked against the datasheet
+
+  private:
+    uint8_t _addr = BMX_ADDRESS_B;
+    unsigned _id = 0;
+    unsigned long _last = 0;        // micros() of the last read
+    uint16_t _T1, _P1;
+    int16_t _T2, _T3, _P2, _P3, _P4, _P5, _P6, _P7, _P8, _P9;
+    int32_t _t = 0;                 // temperature [0.01 C]
+    uint32_t _p = 0;                // pressure [Pa / 256]
+};
+
 // A class with miscellaneous support functions created by Rick Sellens (RWS)
 class RWS_UNO{
   public:
@@ -107,10 +169,14 @@ class RWS_UNO{
     double dt();                    // most recent time between calls [us]
     double dtAvg();                 // average time between calls [us]
     double dtMax();                 // maximum time between calls [us]
+    RWS_Stats dtStats = RWS_Stats(100, 10); // windowed time between calls [us], reset with run(true)
   
     // i2c and misc
     void i2cScan();                 // display details of everything connected to i2c
     unsigned long bytesFree();      // return an approximate number of bytes between the stack and the heap
+    void paintStack();              // fill the space between heap and stack with a pattern
+    unsigned long stackUnused();    // smallest gap between heap and stack since paintStack()
+    bool heapStats(unsigned long *used, unsigned long *free, unsigned long *chunks);
     double normPulseTS(double t, double tMean, double tStd);
     double normpdf(double x);
     double randn();
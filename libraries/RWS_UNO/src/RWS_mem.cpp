@@ -0,0 +1,93 @@
+/**************************************************************************/
+/*!
+  @file RWS_mem.cpp
+
+  @section intro Introduction
+
+  Memory Management functions - stack painting and heap statistics so a
+  sketch can prove how much headroom it really has, not just what is free
+  at the moment bytesFree() is called.
+
+  paintStack() fills the space between the heap and the stack with a
+  pattern. stackUnused() counts how much of that pattern is still intact,
+  which is the smallest gap there has ever been since painting. Heap
+  statistics come from newlib mallinfo() on ARM boards.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  CCBY license
+*/
+/**************************************************************************/
+#include "RWS_UNO.h"
+#ifdef __arm__
+#include <malloc.h>
+extern "C" char *sbrk(int incr);
+#endif
+
+#define STACK_PAINT        0xA5A5A5A5UL  ///< pattern for unused stack
+#define STACK_PAINT_MARGIN 64            ///< bytes below the current stack to leave alone
+
+/**************************************************************************/
+/*!
+    @brief Memory Management functions - fill the gap between the heap and
+   the stack with a pattern. Call once, early in setup().
+    @return none
+*/
+void RWS_UNO::paintStack() {
+#ifdef __arm__
+  char here;                  // a variable on the stack at about the current depth
+  uint32_t *p = (uint32_t *) (((uintptr_t) sbrk(0) + 3) & ~3UL);
+  uint32_t *top = (uint32_t *) (&here - STACK_PAINT_MARGIN);
+  while (p < top) *p++ = STACK_PAINT;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Memory Management functions - scan up from the top of the heap for
+   painted stack. Takes a few hundred microseconds per 10 kB of headroom.
+    @return Bytes that have never been used by the stack or the heap since
+   paintStack(), 0 if not supported on this board.
+*/
+unsigned long RWS_UNO::stackUnused() {
+#ifdef __arm__
+  char here;
+  uint32_t *p = (uint32_t *) (((uintptr_t) sbrk(0) + 3) & ~3UL);
+  uint32_t *top = (uint32_t *) &here;
+  unsigned long n = 0;
+  while (p < top && *p == STACK_PAINT) {
+    p++;
+    n += 4;
+  }
+  return n;
+#else
+  return 0;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief Memory Management functions - heap statistics from malloc.
+    @param used set to bytes allocated and in use
+    @param free set to bytes free inside the heap, not counting the gap
+   to the stack
+    @param chunks set to the number of free chunks inside the heap, more
+   chunks for the same free bytes means more fragmentation
+    @return true on boards with mallinfo(), otherwise false and all 0
+*/
+bool RWS_UNO::heapStats(unsigned long *used, unsigned long *free, unsigned long *chunks) {
+#ifdef __arm__
+  struct mallinfo mi = mallinfo();
+  *used = mi.uordblks;
+  *free = mi.fordblks;
+  *chunks = mi.ordblks;
+  return true;
+#else
+  *used = *free = *chunks = 0;
+  return false;
+#endif
+}
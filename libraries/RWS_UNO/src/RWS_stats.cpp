@@ -0,0 +1,199 @@
+/**************************************************************************/
+/*!
+  @file RWS_stats.cpp
+
+  @section intro Introduction
+
+  Streaming statistics in fixed memory, e.g. for loop timing.
+
+  The rolling window is a ring of blocks, each holding the min, max, sum
+  and count of blockSize samples. The window is the current partial block
+  plus the previous blocks - 1 full ones, so old samples drop out a block
+  at a time with no per-sample storage.
+
+  Percentiles use a histogram with two buckets per power of 2, so the
+  estimate is within about 25% of the true value over the whole range of
+  an unsigned long, interpolating linearly inside the bucket.
+
+  @subsection author Author
+
+  Written by Rick Sellens.
+
+  @subsection license License
+
+  CCBY license
+*/
+/**************************************************************************/
+#include "RWS_UNO.h"
+
+/**************************************************************************/
+/*!
+    @brief Bucket number for a sample.
+    @param v sample value, rounded down to an integer
+    @return histogram bucket from 0 to RWS_STATS_BUCKETS - 1
+*/
+static uint8_t statsBucket(uint32_t v) {
+  if (v < 2) return v;
+  uint8_t o = 31 - __builtin_clz(v);          // position of the top bit
+  return 2 * o + ((v >> (o - 1)) & 1);        // and the next bit down
+}
+
+/**************************************************************************/
+/*!
+    @brief Smallest value that goes in a bucket.
+    @param b histogram bucket
+    @return lower bound of the bucket
+*/
+static double statsBucketLow(uint8_t b) {
+  if (b < 2) return b;
+  uint8_t o = b / 2;
+  return (double) ((2UL + (b & 1)) << (o - 1));
+}
+
+/**************************************************************************/
+/*!
+    @brief Create a statistics object
+    @param blockSize samples per block in the rolling window
+    @param blocks number of blocks in the rolling window, up to
+   RWS_STATS_BLOCKS_MAX
+*/
+RWS_Stats::RWS_Stats(unsigned blockSize, uint8_t blocks) {
+  setWindow(blockSize, blocks);
+}
+
+/**************************************************************************/
+/*!
+    @brief Change the size of the rolling window and reset everything.
+    @param blockSize samples per block
+    @param blocks number of blocks, the window holds between blocks - 1 and
+   blocks full blocks of samples
+    @return none
+*/
+void RWS_Stats::setWindow(unsigned blockSize, uint8_t blocks) {
+  _blockSize = blockSize > 0 ? blockSize : 1;
+  _blocks = constrain(blocks, 1, RWS_STATS_BLOCKS_MAX);
+  reset();
+}
+
+/**************************************************************************/
+/*!
+    @brief Clear the rolling window and the percentile histogram.
+    @return none
+*/
+void RWS_Stats::reset() {
+  for (int i = 0; i < RWS_STATS_BLOCKS_MAX; i++) {
+    _bN[i] = 0;
+    _bSum[i] = _bMin[i] = _bMax[i] = 0.0;
+  }
+  for (int i = 0; i < RWS_STATS_BUCKETS; i++) _hist[i] = 0;
+  _cur = 0;
+  _count = 0;
+  _max = 0.0;
+}
+
+/**************************************************************************/
+/*!
+    @brief Add a sample to the window and the histogram.
+    @param x the sample, negative values are counted as 0
+    @return none
+*/
+void RWS_Stats::add(double x) {
+  if (x < 0) x = 0;
+  if (_bN[_cur] >= _blockSize) {              // start the next block
+    _cur = (_cur + 1) % _blocks;
+    _bN[_cur] = 0;
+    _bSum[_cur] = 0.0;
+  }
+  if (_bN[_cur] == 0) _bMin[_cur] = _bMax[_cur] = x;
+  if (x < _bMin[_cur]) _bMin[_cur] = x;
+  if (x > _bMax[_cur]) _bMax[_cur] = x;
+  _bSum[_cur] += x;
+  _bN[_cur]++;
+  _hist[statsBucket(x < 4294967295. ? (uint32_t) x : 0xFFFFFFFFUL)]++;
+  if (x > _max) _max = x;
+  _count++;
+}
+
+/**************************************************************************/
+/*!
+    @brief Window statistics
+    @return smallest sample in the rolling window, 0 if empty
+*/
+double RWS_Stats::min() {
+  double m = 0.0;
+  bool found = false;
+  for (int i = 0; i < _blocks; i++) {
+    if (_bN[i] && (!found || _bMin[i] < m)) m = _bMin[i];
+    if (_bN[i]) found = true;
+  }
+  return m;
+}
+
+/*!
+    @brief Window statistics
+    @return largest sample in the rolling window, 0 if empty
+*/
+double RWS_Stats::max() {
+  double m = 0.0;
+  for (int i = 0; i < _blocks; i++)
+    if (_bN[i] && _bMax[i] > m) m = _bMax[i];
+  return m;
+}
+
+/*!
+    @brief Window statistics
+    @return mean of the samples in the rolling window, 0 if empty
+*/
+double RWS_Stats::mean() {
+  double s = 0.0;
+  unsigned long n = 0;
+  for (int i = 0; i < _blocks; i++) {
+    s += _bSum[i];
+    n += _bN[i];
+  }
+  return n ? s / n : 0.0;
+}
+
+/*!
+    @brief Window statistics
+    @return number of samples in the rolling window
+*/
+unsigned long RWS_Stats::windowCount() {
+  unsigned long n = 0;
+  for (int i = 0; i < _blocks; i++) n += _bN[i];
+  return n;
+}
+
+/**************************************************************************/
+/*!
+    @brief Estimate a percentile from the histogram of every sample since
+   the last reset().
+    @param pc percentile from 0 to 100, e.g. 50 for the median
+    @return estimated value, 0 if there are no samples
+*/
+double RWS_Stats::percentile(double pc) {
+  if (_count == 0) return 0.0;
+  pc = constrain(pc, 0.0, 100.0);
+  double target = pc / 100.0 * _count;        // samples at or below the answer
+  double below = 0;
+  for (int b = 0; b < RWS_STATS_BUCKETS; b++) {
+    if (_hist[b] == 0) continue;
+    if (below + _hist[b] >= target) {
+      double lo = statsBucketLow(b);
+      double hi = (b + 1 < RWS_STATS_BUCKETS) ? statsBucketLow(b + 1) : _max;
+      if (hi > _max) hi = _max;               // no point going past the largest sample
+      if (hi < lo) hi = lo;
+      return lo + (hi - lo) * (target - below) / _hist[b];
+    }
+    below += _hist[b];
+  }
+  return _max;
+}
+
+/*!
+    @brief Histogram statistics
+    @return number of samples since the last reset()
+*/
+unsigned long RWS_Stats::count() {
+  return _count;
+}
@@ -76,6 +76,128 @@ bool FatFile::addDirCluster() {
 fail:
   return false;
 }
+#if USE_FILE_BUFFER
+//------------------------------------------------------------------------------
+// Return the buffered copy of block for a write.  The block must be in the
+// buffer or follow it, otherwise the buffer is flushed and restarted.
+// load is true if the block has file data that will not all be replaced.
+uint8_t* FatFile::bufBlock(uint32_t block, bool load) {
+  uint32_t i = block - m_bufBlock;
+  uint8_t* dst;
+  if (m_vol->cacheBlockNumber() == block) {
+    // The buffer will hold the current data for this block.
+    if (!m_vol->cacheSyncData()) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    m_vol->cacheInvalidate();
+  }
+  if (!m_bufCount || i > m_bufCount || i >= m_bufBlocks) {
+    if (!bufFlush()) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    m_bufBlock = block;
+    m_bufCount = 0;
+    i = 0;
+  }
+  dst = m_buf + 512*i;
+  if (i == m_bufCount) {
+    if (load && !m_vol->readBlock(block, dst)) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    m_bufCount++;
+  }
+  m_flags |= F_BUF_DIRTY;
+  return dst;
+
+fail:
+  return 0;
+}
+//------------------------------------------------------------------------------
+// Read ahead from block, which is at the current position, to the end of
+// the buffer, the file or a contiguous run of clusters.
+bool FatFile::bufFill(uint32_t block, uint8_t blockOfCluster) {
+  uint32_t cluster = m_curCluster;
+  uint32_t fb = (m_fileSize - (m_curPosition & ~0X1FFUL) + 511) >> 9;
+  uint32_t nb = m_vol->blocksPerCluster() - blockOfCluster;
+  if (!bufFlush()) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  m_bufCount = 0;
+  while (nb < m_bufBlocks && nb < fb) {
+    uint32_t next;
+    int8_t fg = m_vol->fatGet(cluster, &next);
+    if (fg < 0) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    if (fg == 0 || next != (cluster + 1)) {
+      break;
+    }
+    cluster = next;
+    nb += m_vol->blocksPerCluster();
+  }
+  if (nb > m_bufBlocks) {
+    nb = m_bufBlocks;
+  }
+  if (nb > fb) {
+    nb = fb;
+  }
+  if ((m_vol->cacheBlockNumber() - block) < nb) {
+    // flush cache if a block is in the cache
+    if (!m_vol->cacheSyncData()) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+  }
+#if USE_MULTI_BLOCK_IO
+  if (!m_vol->readBlocks(block, m_buf, nb)) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+#else  // USE_MULTI_BLOCK_IO
+  for (uint8_t i = 0; i < nb; i++) {
+    if (!m_vol->readBlock(block + i, m_buf + 512*i)) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+  }
+#endif  // USE_MULTI_BLOCK_IO
+  m_bufBlock = block;
+  m_bufCount = nb;
+  return true;
+
+fail:
+  return false;
+}
+//------------------------------------------------------------------------------
+bool FatFile::bufFlush() {
+  if (m_buf && (m_flags & F_BUF_DIRTY)) {
+#if USE_MULTI_BLOCK_IO
+    if (!m_vol->writeBlocks(m_bufBlock, m_buf, m_bufCount)) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+#else  // USE_MULTI_BLOCK_IO
+    for (uint8_t i = 0; i < m_bufCount; i++) {
+      if (!m_vol->writeBlock(m_bufBlock + i, m_buf + 512*i)) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+    }
+#endif  // USE_MULTI_BLOCK_IO
+    m_flags &= ~F_BUF_DIRTY;
+  }
+  return true;
+
+fail:
+  m_error |= WRITE_ERROR;
+  return false;
+}
+#endif  // USE_FILE_BUFFER
 //------------------------------------------------------------------------------
 // cache a file's directory entry
 // return pointer to cached entry or null for failure
@@ -95,6 +217,9 @@ fail:
 bool FatFile::close() {
   bool rtn = sync();
   m_attr = FILE_ATTR_CLOSED;
+#if USE_FILE_BUFFER
+  m_buf = 0;
+#endif  // USE_FILE_BUFFER
   return rtn;
 }
 //------------------------------------------------------------------------------
@@ -787,6 +912,20 @@ int FatFile::read(void* buf, size_t nbyte) {
       }
       block = m_vol->clusterFirstBlock(m_curCluster) + blockOfCluster;
     }
+#if USE_FILE_BUFFER
+    if (m_buf) {
+      if ((block - m_bufBlock) >= m_bufCount &&
+          !bufFill(block, blockOfCluster)) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      n = 512 - offset;
+      if (n > toRead) {
+        n = toRead;
+      }
+      memcpy(dst, m_buf + 512*(block - m_bufBlock) + offset, n);
+    } else
+#endif  // USE_FILE_BUFFER
     if (offset != 0 || toRead < 512 || block == m_vol->cacheBlockNumber()) {
       // amount to be read from current block
       n = 512 - offset;
@@ -1130,6 +1269,23 @@ bool FatFile::rmRfStar() {
 fail:
   return false;
 }
+#if USE_FILE_BUFFER
+//------------------------------------------------------------------------------
+bool FatFile::setBuffer(void* buf, uint8_t blocks) {
+  if (!isFile() || !bufFlush()) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  m_buf = blocks ? reinterpret_cast<uint8_t*>(buf) : 0;
+  m_bufBlocks = blocks;
+  m_bufCount = 0;
+  m_flags &= ~F_BUF_DIRTY;
+  return true;
+
+fail:
+  return false;
+}
+#endif  // USE_FILE_BUFFER
 //------------------------------------------------------------------------------
 bool FatFile::seekSet(uint32_t pos) {
   uint32_t nCur;
@@ -1197,6 +1353,12 @@ bool FatFile::sync() {
   if (!isOpen()) {
     return true;
   }
+#if USE_FILE_BUFFER
+  if (!bufFlush()) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+#endif  // USE_FILE_BUFFER
   if (m_flags & F_FILE_DIR_DIRTY) {
     dir_t* dir = cacheDirEntry(FatCache::CACHE_FOR_WRITE);
     // check for deleted by another open file object
@@ -1334,6 +1496,14 @@ bool FatFile::truncate(uint32_t length) {
 
   // remember position for seek after truncation
   newPos = m_curPosition > length ? length : m_curPosition;
+#if USE_FILE_BUFFER
+  // Freed clusters may be reused.
+  if (!bufFlush()) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  m_bufCount = 0;
+#endif  // USE_FILE_BUFFER
 
   // position to last cluster in truncated file
   if (!seekSet(length)) {
@@ -1442,6 +1612,22 @@ int FatFile::write(const void* buf, size_t nbyte) {
     // block for data write
     uint32_t block = m_vol->clusterFirstBlock(m_curCluster) + blockOfCluster;
 
+#if USE_FILE_BUFFER
+    if (m_buf) {
+      n = 512 - blockOffset;
+      if (n > nToWrite) {
+        n = nToWrite;
+      }
+      // Keep old data unless the whole block is new.
+      uint8_t* dst = bufBlock(block, n < 512 &&
+                              (m_curPosition - blockOffset) < m_fileSize);
+      if (!dst) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      memcpy(dst + blockOffset, src, n);
+    } else
+#endif  // USE_FILE_BUFFER
     if (blockOffset != 0 || nToWrite < 512) {
       // partial block - must use cache
       // max space in block
@@ -828,6 +828,23 @@ class FatFile {
    * the value false is returned for failure.
    */
   bool seekSet(uint32_t pos);
+#if USE_FILE_BUFFER
+  /** Use a buffer of whole blocks for this file.  A read outside the
+   * buffer fills it with the following blocks of the file, up to the
+   * end of the file or of a contiguous run of clusters.  Writes are held
+   * in the buffer while they are to consecutive blocks and written when
+   * it is full, the file is synced or closed.  Other file objects do not
+   * see buffered data until it is written.
+   *
+   * \param[in] buf Buffer of \a blocks 512 byte blocks, zero to stop
+   * using a buffer.
+   * \param[in] blocks Size of \a buf in blocks.
+   *
+   * \return The value true is returned for success and
+   * the value false is returned for failure.
+   */
+  bool setBuffer(void* buf, uint8_t blocks);
+#endif  // USE_FILE_BUFFER
   /** Set the current working directory.
    *
    * \param[in] dir New current working directory.
@@ -988,7 +1005,15 @@ class FatFile {
   // private functions
   bool addCluster();
   bool addDirCluster();
+#if USE_FILE_BUFFER
+  uint8_t* bufBlock(uint32_t block, bool load);
+  bool bufFill(uint32_t block, uint8_t blockOfCluster);
+  bool bufFlush();
+#endif  // USE_FILE_BUFFER
   dir_t* cacheDirEntry(uint8_t action);
+#if USE_DIR_NAME_INDEX
+  dir_index_t* nameIndex();
+#endif  // USE_DIR_NAME_INDEX
   static uint8_t lfnChecksum(uint8_t* name);
   bool lfnUniqueSfn(fname_t* fname);
   bool openCluster(FatFile* file);
@@ -1006,6 +1031,7 @@ class FatFile {
   static const uint8_t F_WRITE          = 0X02;
   static const uint8_t F_FILE_DIR_DIRTY = 0X04;
   static const uint8_t F_APPEND         = 0X08;
+  static const uint8_t F_BUF_DIRTY      = 0X10;  // m_buf not written
   static const uint8_t F_SYNC           = 0X80;
 
 
@@ -1028,5 +1054,14 @@ class FatFile {
   uint32_t   m_dirBlock;         // block for this files directory entry
   uint32_t   m_fileSize;         // file size in bytes
   uint32_t   m_firstCluster;     // first cluster of file
+#if USE_FILE_BUFFER
+  uint8_t*   m_buf;              // optional read-ahead/write-behind buffer
+  uint32_t   m_bufBlock;         // device block of first buffered block
+  // 16-bit so the class has no tail padding.  A derived class such as
+  // StdioStream could place members there and open() would clear them
+  // with memset(this, 0, sizeof(FatFile)).
+  uint16_t   m_bufBlocks;        // size of m_buf in blocks
+  uint16_t   m_bufCount;         // blocks held in m_buf
+#endif  // USE_FILE_BUFFER
 };
 #endif  // FatFile_h
@@ -289,6 +289,118 @@ bool FatFile::parsePathName(const char* path,
   }
   return true;
 }
+#if USE_DIR_NAME_INDEX
+//------------------------------------------------------------------------------
+// Hash of a long name that can be built from LFN entries in any order.
+// Character c at position k adds a multiplicative hash of both, mixed so
+// names that differ in a few digits don't collide.
+static uint16_t lfnHashChar(uint16_t hash, size_t k, uint8_t c) {
+  uint32_t h = ((uint32_t)k << 8 | c)*0X9E3779B1UL;
+  h ^= h >> 15;
+  h *= 0X85EBCA6BUL;
+  return hash + (h >> 16);
+}
+//------------------------------------------------------------------------------
+static uint16_t lfnHash(const char* name, size_t len) {
+  uint16_t hash = 0;
+  for (size_t k = 0; k < len; k++) {
+    hash = lfnHashChar(hash, k, lfnToLower(name[k]));
+  }
+  return hash;
+}
+//------------------------------------------------------------------------------
+static bool dirIndexAdd(dir_index_t* dx, uint16_t hash, uint16_t index) {
+  if (dx->count >= DIR_INDEX_DIM) {
+    dx->state = DIR_INDEX_FULL;
+    return false;
+  }
+  dx->key[dx->count++] = (uint32_t)hash << 16 | index;
+  return true;
+}
+//------------------------------------------------------------------------------
+// Return the name index for this directory, scanning it if needed.
+// Return zero if the directory is too big to index or on a read error.
+dir_index_t* FatFile::nameIndex() {
+  uint8_t ord = 0;
+  uint8_t chksum = 0;
+  uint16_t hash = 0;
+  uint16_t start = 0;
+  dir_index_t* dx = m_vol->dirIndexFind(m_firstCluster);
+  if (dx) {
+    return dx->state == DIR_INDEX_VALID ? dx : 0;
+  }
+  dx = m_vol->dirIndexNew(m_firstCluster);
+  rewind();
+  while (1) {
+    uint16_t index = m_curPosition/32;
+    dir_t* dir = readDirCache(true);
+    if (!dir) {
+      if (getError()) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      break;
+    }
+    if (dir->name[0] == DIR_NAME_FREE) {
+      break;
+    }
+    if (dir->name[0] == DIR_NAME_DELETED || dir->name[0] == '.') {
+      ord = 0;
+    } else if (DIR_IS_LONG_NAME(dir)) {
+      ldir_t* ldir = reinterpret_cast<ldir_t*>(dir);
+      if (ldir->ord & LDIR_ORD_LAST_LONG_ENTRY) {
+        ord = ldir->ord & 0X1F;
+        chksum = ldir->chksum;
+        start = index;
+        hash = 0;
+      } else if (!ord || ldir->ord != ord - 1 || chksum != ldir->chksum) {
+        ord = 0;
+        continue;
+      } else {
+        ord--;
+      }
+      size_t k = 13*(ord - 1);
+      for (uint8_t i = 0; i < 13; i++) {
+        uint16_t u = lfnGetChar(ldir, i);
+        if (u == 0 || u == 0XFFFF) {
+          break;
+        }
+        if (u > 255) {
+          // Can't match an 8-bit name.
+          ord = 0;
+          break;
+        }
+        hash = lfnHashChar(hash, k++, lfnToLower(u));
+      }
+    } else if (DIR_IS_FILE_OR_SUBDIR(dir)) {
+      if (ord == 1 && lfnChecksum(dir->name) == chksum) {
+        if (!dirIndexAdd(dx, hash, start)) {
+          break;
+        }
+      } else {
+        start = index;
+      }
+      if (!dirIndexAdd(dx, Bernstein(0, reinterpret_cast<char*>(dir->name),
+                                     sizeof(dir->name)), start)) {
+        break;
+      }
+      ord = 0;
+    } else {
+      ord = 0;
+    }
+  }
+  rewind();
+  if (dx->state == DIR_INDEX_FULL) {
+    return 0;
+  }
+  dx->state = DIR_INDEX_VALID;
+  return dx;
+
+fail:
+  rewind();
+  return 0;
+}
+#endif  // USE_DIR_NAME_INDEX
 //------------------------------------------------------------------------------
 bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
   bool fnameFound = false;
@@ -302,6 +414,12 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
   dir_t* dir;
   ldir_t* ldir;
   size_t len = fname->len;
+#if USE_DIR_NAME_INDEX
+  dir_index_t* dx = 0;
+  uint16_t probe = 0;
+  uint16_t lfnKey = 0;
+  uint16_t sfnKey = 0;
+#endif  // USE_DIR_NAME_INDEX
 
   if (!dirFile->isDir() || isOpen()) {
     DBG_FAIL_MACRO;
@@ -310,18 +428,74 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
   // Number of directory entries needed.
   freeNeed = fname->flags & FNAME_FLAG_NEED_LFN ? 1 + (len + 12)/13 : 1;
 
+#if USE_DIR_NAME_INDEX
+  dx = dirFile->nameIndex();
+  if (dx) {
+    lfnKey = lfnHash(fname->lfn, len);
+    sfnKey = Bernstein(0, reinterpret_cast<char*>(fname->sfn),
+                       sizeof(fname->sfn));
+  }
+
+nextProbe:
+  if (dx) {
+    // Check entries with a matching hash before scanning the directory.
+    while (probe < dx->count) {
+      uint32_t key = dx->key[probe++];
+      if ((key >> 16) == lfnKey || ((key >> 16) == sfnKey &&
+          !(fname->flags & FNAME_FLAG_LOST_CHARS))) {
+        if (!dirFile->seekSet(32UL*(key & 0XFFFF))) {
+          DBG_FAIL_MACRO;
+          goto fail;
+        }
+        lfnOrd = 0;
+        goto scan;
+      }
+    }
+    if (!(oflag & O_CREAT)) {
+      // Not in the directory.
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    // Scan for free entries.
+    dx = 0;
+    lfnOrd = 0;
+    freeFound = 0;
+    fnameFound = false;
+  }
+#endif  // USE_DIR_NAME_INDEX
   dirFile->rewind();
+#if USE_DIR_NAME_INDEX
+
+scan:
+#endif  // USE_DIR_NAME_INDEX
   while (1) {
     curIndex = dirFile->m_curPosition/32;
+#if USE_DIR_NAME_INDEX
+    // The cache may not hold the block of a probed entry.
+    dir = dirFile->readDirCache(!dx);
+#else  // USE_DIR_NAME_INDEX
     dir = dirFile->readDirCache(true);
+#endif  // USE_DIR_NAME_INDEX
     if (!dir) {
       if (dirFile->getError()) {
         DBG_FAIL_MACRO;
         goto fail;
       }
+#if USE_DIR_NAME_INDEX
+      if (dx) {
+        goto nextProbe;
+      }
+#endif  // USE_DIR_NAME_INDEX
       // At EOF
       goto create;
     }
+#if USE_DIR_NAME_INDEX
+    if (dx && (dir->name[0] == DIR_NAME_FREE ||
+               dir->name[0] == DIR_NAME_DELETED)) {
+      // Stale index entry.
+      goto nextProbe;
+    }
+#endif  // USE_DIR_NAME_INDEX
     if (dir->name[0] == DIR_NAME_DELETED || dir->name[0] == DIR_NAME_FREE) {
       if (freeFound == 0) {
         freeIndex = curIndex;
@@ -390,6 +564,12 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
     } else {
       lfnOrd = 0;
     }
+#if USE_DIR_NAME_INDEX
+    if (dx && !DIR_IS_LONG_NAME(dir)) {
+      // End of the probed entry.
+      goto nextProbe;
+    }
+#endif  // USE_DIR_NAME_INDEX
   }
 
 found:
@@ -406,6 +586,10 @@ create:
     DBG_FAIL_MACRO;
     goto fail;
   }
+#if USE_DIR_NAME_INDEX
+  // Names in the directory are about to change.
+  dirFile->m_vol->dirIndexClear(dirFile->m_firstCluster);
+#endif  // USE_DIR_NAME_INDEX
   // If at EOF start in next cluster.
   if (freeFound == 0) {
     freeIndex = curIndex;
@@ -564,6 +748,10 @@ bool FatFile::remove() {
     DBG_FAIL_MACRO;
     goto fail;
   }
+#if USE_FILE_BUFFER
+  // Discard buffered data.
+  m_buf = 0;
+#endif  // USE_FILE_BUFFER
   // Free any clusters.
   if (m_firstCluster && !m_vol->freeChain(m_firstCluster)) {
     DBG_FAIL_MACRO;
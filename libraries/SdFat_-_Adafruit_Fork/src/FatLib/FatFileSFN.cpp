@@ -252,6 +252,10 @@ bool FatFile::remove() {
     DBG_FAIL_MACRO;
     goto fail;
   }
+#if USE_FILE_BUFFER
+  // Discard buffered data.
+  m_buf = 0;
+#endif  // USE_FILE_BUFFER
   // Free any clusters.
   if (m_firstCluster && !m_vol->freeChain(m_firstCluster)) {
     DBG_FAIL_MACRO;
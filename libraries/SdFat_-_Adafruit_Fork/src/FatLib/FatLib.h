@@ -29,6 +29,7 @@
 #include "FatLibConfig.h"
 #include "FatVolume.h"
 #include "FatFile.h"
+#include "FatLineReader.h"
 #include "StdioStream.h"
 //------------------------------------------------------------------------------
 /** FatFileSystem version YYYYMMDD */
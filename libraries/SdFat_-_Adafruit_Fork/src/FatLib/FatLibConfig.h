@@ -93,6 +93,37 @@
 #define MAINTAIN_FREE_CLUSTER_COUNT 0
 #endif  // MAINTAIN_FREE_CLUSTER_COUNT
 //------------------------------------------------------------------------------
+/**
+ * Set USE_FREE_CLUSTER_BITMAP nonzero to allow a bitmap of free clusters
+ * in a buffer supplied by setFreeClusterBitmap().
+ */
+#ifndef USE_FREE_CLUSTER_BITMAP
+#define USE_FREE_CLUSTER_BITMAP 0
+#endif  // USE_FREE_CLUSTER_BITMAP
+//------------------------------------------------------------------------------
+/**
+ * Set USE_DIR_NAME_INDEX nonzero to index the names in up to DIR_INDEX_DIRS
+ * directories.  A directory with more than DIR_INDEX_DIM names is searched
+ * without the index.
+ */
+#ifndef USE_DIR_NAME_INDEX
+#define USE_DIR_NAME_INDEX 0
+#endif  // USE_DIR_NAME_INDEX
+#ifndef DIR_INDEX_DIRS
+#define DIR_INDEX_DIRS 2
+#endif  // DIR_INDEX_DIRS
+#ifndef DIR_INDEX_DIM
+#define DIR_INDEX_DIM 32
+#endif  // DIR_INDEX_DIM
+//------------------------------------------------------------------------------
+/**
+ * Set USE_FILE_BUFFER nonzero to allow a read-ahead and write-behind
+ * buffer supplied by FatFile::setBuffer().
+ */
+#ifndef USE_FILE_BUFFER
+#define USE_FILE_BUFFER 0
+#endif  // USE_FILE_BUFFER
+//------------------------------------------------------------------------------
 /**
  * Set DESTRUCTOR_CLOSES_FILE non-zero to close a file in its destructor.
  *
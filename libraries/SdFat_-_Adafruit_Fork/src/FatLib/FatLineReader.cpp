@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2011-2018 Bill Greiman
+ * This file is part of the SdFat library for SD memory cards.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <string.h>
+#include "FatLineReader.h"
+//------------------------------------------------------------------------------
+const char* FatLineReader::next(size_t* len) {
+  char* line;
+  char* nl;
+  size_t n;
+  if (m_size < 2) {
+    return 0;
+  }
+  if (m_heldCr) {
+    m_buf[m_begin] = '\r';
+    m_heldCr = false;
+  }
+  m_partial = false;
+  while (1) {
+    line = m_buf + m_begin;
+    nl = reinterpret_cast<char*>(memchr(line, '\n', m_end - m_begin));
+    if (nl) {
+      m_begin = nl - m_buf + 1;
+      break;
+    }
+    if (m_eof) {
+      // Last line, without a newline.
+      if (m_begin == m_end) {
+        return 0;
+      }
+      nl = m_buf + m_end;
+      m_begin = m_end = 0;
+      break;
+    }
+    if (m_begin == 0 && m_end == (m_size - 1)) {
+      // A piece of a line too long for the buffer.  A CR at its end may
+      // start the line's CR/LF, so it is held back for the next call.
+      m_partial = true;
+      nl = m_buf + m_end;
+      if (m_end > 1 && nl[-1] == '\r') {
+        nl--;
+        m_heldCr = true;
+      }
+      m_begin = nl - m_buf;
+      if (m_begin == m_end) {
+        m_begin = m_end = 0;
+      }
+      break;
+    }
+    // Keep the partial line and fill the rest of the buffer.
+    memmove(m_buf, line, m_end - m_begin);
+    m_end -= m_begin;
+    m_begin = 0;
+    int nr = m_file->read(m_buf + m_end, m_size - 1 - m_end);
+    if (nr < 0) {
+      DBG_FAIL_MACRO;
+      return 0;
+    }
+    if (nr == 0) {
+      m_eof = true;
+    }
+    m_end += nr;
+  }
+  // Remove CR and terminate.
+  n = nl - line;
+  if (!m_partial && n && line[n - 1] == '\r') {
+    n--;
+  }
+  line[n] = 0;
+  if (len) {
+    *len = n;
+  }
+  return line;
+}
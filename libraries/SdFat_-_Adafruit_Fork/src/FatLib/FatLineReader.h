@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2011-2018 Bill Greiman
+ * This file is part of the SdFat library for SD memory cards.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef FatLineReader_h
+#define FatLineReader_h
+/**
+ * \file
+ * \brief FatLineReader class
+ */
+#include "FatFile.h"
+//==============================================================================
+/**
+ * \class FatLineReader
+ * \brief Read lines of a file through a caller supplied buffer.
+ *
+ * The file is read in large pieces and each line is returned as a
+ * pointer into the buffer, so no characters are copied to the caller and
+ * no heap is used.
+ */
+class FatLineReader {
+ public:
+  /** Create a line reader.
+   *
+   * \param[in] file Open file to read from its current position.
+   * \param[in] buf Buffer for file data, 512 bytes or more is best.
+   * \param[in] size Size of \a buf, at least 3.  Lines longer than
+   * size - 1 are returned in pieces, see partial().
+   */
+  FatLineReader(FatFile* file, char* buf, size_t size)
+    : m_file(file), m_buf(buf), m_size(size), m_begin(0), m_end(0),
+      m_eof(false), m_partial(false), m_heldCr(false) {}
+  /** \return true if a read error has occurred. */
+  bool getError() const {
+    return m_file->getError();
+  }
+  /** Read the next line.
+   *
+   * \param[out] len Length of the line if not zero.
+   *
+   * \return The line, zero terminated and without the end of line
+   * characters, or zero at end of file or for an error.  The line is
+   * valid until the next call.
+   */
+  const char* next(size_t* len = 0);
+  /** \return true if the last line returned by next() was a piece of a
+   * line too long for the buffer, which the next call continues.
+   */
+  bool partial() const {
+    return m_partial;
+  }
+
+ private:
+  FatFile* m_file;
+  char* m_buf;
+  size_t m_size;
+  size_t m_begin;  // start of unreturned data in m_buf
+  size_t m_end;    // end of data in m_buf
+  bool m_eof;
+  bool m_partial;  // last line returned is continued by the next
+  bool m_heldCr;   // CR at m_begin was overwritten by a terminator
+};
+#endif  // FatLineReader_h
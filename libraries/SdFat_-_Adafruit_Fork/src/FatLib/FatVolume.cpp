@@ -25,6 +25,80 @@
 #include <string.h>
 #include "FatVolume.h"
 //------------------------------------------------------------------------------
+// Word-parallel scans of a cached FAT block.  FAT16 entries are tested two
+// at a time as halfwords of an aligned 32-bit word.
+//
+// Return 0X8000 in each halfword of w that is zero.
+static inline uint32_t zeroHalfwords(uint32_t w) {
+  return ~(((w & 0X7FFF7FFF) + 0X7FFF7FFF) | w | 0X7FFF7FFF);
+}
+//------------------------------------------------------------------------------
+// Count free entries in the first n entries of a FAT16 or FAT32 block.
+static uint16_t fatCountFree(const cache_t* pc, uint8_t fatType, uint16_t n) {
+  if (fatType == 16) {
+    // Bit 15 of each halfword of ((w & 0X7FFF7FFF) + 0X7FFF7FFF) | w is set
+    // if that entry is in use.  used counts them in its two halfwords.
+    const uint32_t* p = pc->fat32;
+    const uint32_t* end = p + (n >> 1);
+    uint32_t used = 0;
+    while (p + 4 <= end) {
+      uint32_t a = p[0], b = p[1], c = p[2], d = p[3];
+      a = ((a & 0X7FFF7FFF) + 0X7FFF7FFF) | a;
+      b = ((b & 0X7FFF7FFF) + 0X7FFF7FFF) | b;
+      c = ((c & 0X7FFF7FFF) + 0X7FFF7FFF) | c;
+      d = ((d & 0X7FFF7FFF) + 0X7FFF7FFF) | d;
+      used += ((a >> 15) & 0X00010001) + ((b >> 15) & 0X00010001) +
+              ((c >> 15) & 0X00010001) + ((d >> 15) & 0X00010001);
+      p += 4;
+    }
+    while (p < end) {
+      uint32_t w = *p++;
+      used += ((((w & 0X7FFF7FFF) + 0X7FFF7FFF) | w) >> 15) & 0X00010001;
+    }
+    uint16_t free = (n & ~1) - (used & 0XFFFF) - (used >> 16);
+    if ((n & 1) && pc->fat16[n - 1] == 0) {
+      free++;
+    }
+    return free;
+  }
+  uint16_t free = 0;
+  for (const uint32_t* p = pc->fat32; p < pc->fat32 + n; p++) {
+    free += (*p & FAT32MASK) == 0;
+  }
+  return free;
+}
+//------------------------------------------------------------------------------
+// Return the index of the first free entry, if free is true, or the first
+// used entry, if free is false, in entries [i, n) of a FAT16 or FAT32 block.
+// Return n if there is no such entry.
+static uint16_t fatScan(const cache_t* pc, uint8_t fatType,
+                        uint16_t i, uint16_t n, bool free) {
+  if (fatType == 16) {
+    if (i < n && (i & 1)) {
+      if ((pc->fat16[i] == 0) == free) {
+        return i;
+      }
+      i++;
+    }
+    for (; i + 1 < n; i += 2) {
+      uint32_t z = zeroHalfwords(pc->fat32[i >> 1]);
+      if (free ? z : z != 0X80008000) {
+        return (pc->fat16[i] == 0) == free ? i : i + 1;
+      }
+    }
+    if (i < n && (pc->fat16[i] == 0) == free) {
+      return i;
+    }
+  } else {
+    for (; i < n; i++) {
+      if (((pc->fat32[i] & FAT32MASK) == 0) == free) {
+        return i;
+      }
+    }
+  }
+  return n;
+}
+//------------------------------------------------------------------------------
 cache_t* FatCache::read(uint32_t lbn, uint8_t option) {
   if (m_lbn != lbn) {
     if (!sync()) {
@@ -81,6 +155,21 @@ bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
     find = m_allocSearchStart;
     setStart = true;
   }
+#if USE_FREE_CLUSTER_BITMAP
+  if (m_freeMap) {
+    // Same search order as the FAT scan below.
+    find = freeMapFind(find + 1, m_lastCluster);
+    if (!find && !setStart) {
+      find = freeMapFind(m_allocSearchStart + 1, current - 1);
+      setStart = true;
+    }
+    if (!find) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    goto found;
+  }
+#endif  // USE_FREE_CLUSTER_BITMAP
   while (1) {
     find++;
     if (find > m_lastCluster) {
@@ -108,6 +197,9 @@ bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
       break;
     }
   }
+#if USE_FREE_CLUSTER_BITMAP
+found:
+#endif  // USE_FREE_CLUSTER_BITMAP
   if (setStart) {
     m_allocSearchStart = find;
   }
@@ -149,6 +241,61 @@ bool FatVolume::allocContiguous(uint32_t count,
     setStart = true;
   }
   endCluster = bgnCluster;
+  if (fatType() == 16 || fatType() == 32) {
+    // search the FAT a block at a time, endCluster is the next to check
+    uint8_t shift = fatType() == 16 ? 8 : 7;
+    uint16_t mask = (1 << shift) - 1;
+    while (1) {
+      if (endCluster > m_lastCluster) {
+        // Can't find space.
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      cache_t* pc = cacheFetchFat(m_fatStartBlock + (endCluster >> shift),
+                                  FatCache::CACHE_FOR_READ);
+      if (!pc) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      uint16_t i = endCluster & mask;
+      uint16_t n = mask + 1;
+      if ((m_lastCluster - endCluster) < (uint32_t)(n - i)) {
+        n = i + m_lastCluster - endCluster + 1;
+      }
+      if (bgnCluster == endCluster) {
+        // Not in a group, skip clusters in use.
+        uint16_t k = fatScan(pc, fatType(), i, n, true);
+        if (k != i) {
+          if (startCluster) {
+            DBG_FAIL_MACRO;
+            goto fail;
+          }
+          bgnCluster = endCluster = endCluster + k - i;
+          continue;
+        }
+      }
+      // extend group over free clusters
+      uint16_t k = fatScan(pc, fatType(), i, n, false);
+      endCluster += k - i;
+      if ((endCluster - bgnCluster) >= count) {
+        // done - found space
+        endCluster = bgnCluster + count - 1;
+        goto found;
+      }
+      if (k < n) {
+        if (startCluster) {
+          DBG_FAIL_MACRO;
+          goto fail;
+        }
+        // don't update search start if unallocated clusters before endCluster.
+        if (bgnCluster != endCluster) {
+          setStart = false;
+        }
+        // cluster in use try next cluster as bgnCluster
+        bgnCluster = endCluster = endCluster + 1;
+      }
+    }
+  }
   // search the FAT for free clusters
   while (1) {
     if (endCluster > m_lastCluster) {
@@ -179,6 +326,8 @@ bool FatVolume::allocContiguous(uint32_t count,
     }
     endCluster++;
   }
+
+found:
   // Remember possible next free cluster.
   if (setStart) {
     m_allocSearchStart = endCluster;
@@ -300,6 +449,7 @@ bool FatVolume::fatPut(uint32_t cluster, uint32_t value) {
       goto fail;
     }
     pc->fat32[cluster & 0X7F] = value;
+    freeMapUpdate(cluster, value);
     return true;
   }
 
@@ -311,6 +461,7 @@ bool FatVolume::fatPut(uint32_t cluster, uint32_t value) {
       goto fail;
     }
     pc->fat16[cluster & 0XFF] = value;
+    freeMapUpdate(cluster, value);
     return true;
   }
 
@@ -345,6 +496,7 @@ bool FatVolume::fatPut(uint32_t cluster, uint32_t value) {
       tmp = ((pc->data[index] & 0XF0)) | tmp >> 4;
     }
     pc->data[index] = tmp;
+    freeMapUpdate(cluster, value);
     return true;
   } else {
     DBG_FAIL_MACRO;
@@ -391,6 +543,11 @@ int32_t FatVolume::freeClusterCount() {
     return m_freeClusterCount;
   }
 #endif  // MAINTAIN_FREE_CLUSTER_COUNT
+#if USE_FREE_CLUSTER_BITMAP
+  if (m_freeMap) {
+    return m_freeMapCount;
+  }
+#endif  // USE_FREE_CLUSTER_BITMAP
   uint32_t free = 0;
   uint32_t lba;
   uint32_t todo = m_lastCluster + 1;
@@ -420,19 +577,7 @@ int32_t FatVolume::freeClusterCount() {
       if (todo < n) {
         n = todo;
       }
-      if (fatType() == 16) {
-        for (uint16_t i = 0; i < n; i++) {
-          if (pc->fat16[i] == 0) {
-            free++;
-          }
-        }
-      } else {
-        for (uint16_t i = 0; i < n; i++) {
-          if (pc->fat32[i] == 0) {
-            free++;
-          }
-        }
-      }
+      free += fatCountFree(pc, fatType(), n);
       todo -= n;
     }
   } else {
@@ -447,6 +592,83 @@ fail:
   return -1;
 }
 //------------------------------------------------------------------------------
+#if USE_FREE_CLUSTER_BITMAP
+// Return the first free cluster in [first, last] or zero if none.
+uint32_t FatVolume::freeMapFind(uint32_t first, uint32_t last) {
+  if (first > last) {
+    return 0;
+  }
+  uint32_t w = first >> 5;
+  uint32_t lastW = last >> 5;
+  uint32_t bits = m_freeMap[w] & (0XFFFFFFFF << (first & 31));
+  while (!bits) {
+    if (++w > lastW) {
+      return 0;
+    }
+    bits = m_freeMap[w];
+  }
+  uint32_t cluster = (w << 5) + __builtin_ctz(bits);
+  return cluster <= last ? cluster : 0;
+}
+//------------------------------------------------------------------------------
+bool FatVolume::setFreeClusterBitmap(uint32_t* map, uint32_t words) {
+  uint32_t lba;
+  uint32_t todo = m_lastCluster + 1;
+  uint32_t cluster = 0;
+  uint16_t n;
+  m_freeMap = 0;
+  if (!map || !fatType() || words < (todo + 31)/32) {
+    return false;
+  }
+  memset(map, 0, 4*((todo + 31)/32));
+  m_freeMapCount = 0;
+  if (FAT12_SUPPORT && fatType() == 12) {
+    for (cluster = 2; cluster < todo; cluster++) {
+      uint32_t c;
+      int8_t fg = fatGet(cluster, &c);
+      if (fg < 0) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      if (fg && c == 0) {
+        map[cluster >> 5] |= (uint32_t)1 << (cluster & 31);
+        m_freeMapCount++;
+      }
+    }
+  } else if (fatType() == 16 || fatType() == 32) {
+    lba = m_fatStartBlock;
+    while (todo) {
+      cache_t* pc = cacheFetchFat(lba++, FatCache::CACHE_FOR_READ);
+      if (!pc) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      n = fatType() == 16 ? 256 : 128;
+      if (todo < n) {
+        n = todo;
+      }
+      for (uint16_t i = 0; i < n; i++, cluster++) {
+        uint32_t f = fatType() == 16 ? pc->fat16[i] : pc->fat32[i] & FAT32MASK;
+        if (f == 0 && cluster >= 2) {
+          map[cluster >> 5] |= (uint32_t)1 << (cluster & 31);
+          m_freeMapCount++;
+        }
+      }
+      todo -= n;
+    }
+  } else {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  m_freeMap = map;
+  setFreeClusterCount(m_freeMapCount);
+  return true;
+
+fail:
+  return false;
+}
+#endif  // USE_FREE_CLUSTER_BITMAP
+//------------------------------------------------------------------------------
 bool FatVolume::init(uint8_t part) {
   uint32_t clusterCount;
   uint32_t totalBlocks;
@@ -456,6 +678,15 @@ bool FatVolume::init(uint8_t part) {
   uint8_t tmp;
   m_fatType = 0;
   m_allocSearchStart = 1;
+#if USE_FREE_CLUSTER_BITMAP
+  m_freeMap = 0;
+#endif  // USE_FREE_CLUSTER_BITMAP
+#if USE_DIR_NAME_INDEX
+  for (uint8_t i = 0; i < DIR_INDEX_DIRS; i++) {
+    m_dirIndex[i].state = DIR_INDEX_FREE;
+  }
+  m_dirIndexNext = 0;
+#endif  // USE_DIR_NAME_INDEX
   m_cache.init(this);
 #if USE_SEPARATE_FAT_CACHE
   m_fatCache.init(this);
@@ -155,6 +155,29 @@ class FatCache {
   uint32_t m_lbn;
   cache_t m_block;
 };
+#if USE_DIR_NAME_INDEX
+//==============================================================================
+/** Index state - slot not in use. */
+const uint8_t DIR_INDEX_FREE = 0;
+/** Index state - all names in the directory are indexed. */
+const uint8_t DIR_INDEX_VALID = 1;
+/** Index state - directory has more than DIR_INDEX_DIM names. */
+const uint8_t DIR_INDEX_FULL = 2;
+/**
+ * \struct dir_index_t
+ * \brief Name hashes of the entries in one directory.
+ */
+struct dir_index_t {
+  /** First cluster of the directory, zero for a FAT16 root. */
+  uint32_t cluster;
+  /** DIR_INDEX_FREE, DIR_INDEX_VALID or DIR_INDEX_FULL. */
+  uint8_t  state;
+  /** Number of keys. */
+  uint16_t count;
+  /** Name hash in the high half, first directory entry index in the low. */
+  uint32_t key[DIR_INDEX_DIM];
+};
+#endif  // USE_DIR_NAME_INDEX
 //==============================================================================
 /**
  * \class FatVolume
@@ -221,6 +244,22 @@ class FatVolume {
    * \return Count of free clusters for success or -1 if an error occurs.
    */
   int32_t freeClusterCount();
+#if USE_FREE_CLUSTER_BITMAP
+  /** Keep a bitmap of free clusters so allocation and freeClusterCount()
+   * do not scan the FAT.  Call after the volume is initialized, the
+   * bitmap is built from the FAT now and then maintained by every FAT
+   * update.  Initializing the volume again stops using the bitmap.
+   *
+   * \param[in] map Buffer of at least (clusterCount() + 33)/32 words, or
+   * zero to stop using a bitmap.
+   * \param[in] words Size of \a map in 32-bit words.
+   *
+   * \return The value true is returned if the bitmap is in use and
+   * the value false is returned if \a map is too small or the FAT
+   * could not be read.
+   */
+  bool setFreeClusterBitmap(uint32_t* map, uint32_t words);
+#endif  // USE_FREE_CLUSTER_BITMAP
   /** Initialize a FAT volume.  Try partition one first then try super
    * floppy format.
    *
@@ -338,6 +377,58 @@ class FatVolume {
   }
 #endif  // MAINTAIN_FREE_CLUSTER_COUNT
 
+#if USE_FREE_CLUSTER_BITMAP
+  uint32_t* m_freeMap;             // One bit per cluster, set if free.
+  uint32_t  m_freeMapCount;        // Number of bits set in m_freeMap.
+  uint32_t freeMapFind(uint32_t first, uint32_t last);
+  void freeMapUpdate(uint32_t cluster, uint32_t value) {
+    if (m_freeMap) {
+      uint32_t* w = &m_freeMap[cluster >> 5];
+      uint32_t bit = (uint32_t)1 << (cluster & 31);
+      if (value == 0 && !(*w & bit)) {
+        *w |= bit;
+        m_freeMapCount++;
+      } else if (value != 0 && (*w & bit)) {
+        *w &= ~bit;
+        m_freeMapCount--;
+      }
+    }
+  }
+#else  // USE_FREE_CLUSTER_BITMAP
+  void freeMapUpdate(uint32_t cluster, uint32_t value) {
+    (void)cluster;
+    (void)value;
+  }
+#endif  // USE_FREE_CLUSTER_BITMAP
+
+#if USE_DIR_NAME_INDEX
+  dir_index_t m_dirIndex[DIR_INDEX_DIRS];
+  uint8_t m_dirIndexNext;          // Next slot to replace.
+  dir_index_t* dirIndexFind(uint32_t cluster) {
+    for (uint8_t i = 0; i < DIR_INDEX_DIRS; i++) {
+      if (m_dirIndex[i].state != DIR_INDEX_FREE &&
+          m_dirIndex[i].cluster == cluster) {
+        return &m_dirIndex[i];
+      }
+    }
+    return 0;
+  }
+  dir_index_t* dirIndexNew(uint32_t cluster) {
+    dir_index_t* dx = &m_dirIndex[m_dirIndexNext];
+    m_dirIndexNext = (m_dirIndexNext + 1) % DIR_INDEX_DIRS;
+    dx->cluster = cluster;
+    dx->state = DIR_INDEX_FREE;
+    dx->count = 0;
+    return dx;
+  }
+  void dirIndexClear(uint32_t cluster) {
+    dir_index_t* dx = dirIndexFind(cluster);
+    if (dx) {
+      dx->state = DIR_INDEX_FREE;
+    }
+  }
+#endif  // USE_DIR_NAME_INDEX
+
 // block caches
   FatCache m_cache;
 #if USE_SEPARATE_FAT_CACHE
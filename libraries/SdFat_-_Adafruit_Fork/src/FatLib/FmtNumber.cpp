@@ -154,7 +154,47 @@ unsigned divu10(unsigned n) {
 }
 */
 //------------------------------------------------------------------------------
+// Divide n by ten in place and return the remainder.
+static inline uint8_t divmod10(uint32_t* n) {
+#ifdef USE_STIMMER
+  uint32_t q = *n;
+  uint8_t tmp8, r;
+  divmod10_asm32(q, r, tmp8);
+  *n = q;
+  return r;
+#else  // USE_STIMMER
+  uint32_t t = *n;
+  uint32_t q = (t >> 1) + (t >> 2);
+  q = q + (q >> 4);
+  q = q + (q >> 8);
+  q = q + (q >> 16);
+  q = q >> 3;
+  uint8_t r = t - (((q << 2) + q) << 1);
+  if (r > 9) {
+    q++;
+    r -= 10;
+  }
+  *n = q;
+  return r;
+#endif  // USE_STIMMER
+}
+//------------------------------------------------------------------------------
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
+// Powers of ten up to 1e9 are exact as float so one multiply or divide by
+// them is correctly rounded.
+#ifdef __AVR__
+static const uint32_t powTen[] PROGMEM = {
+#else  // __AVR__
+static const uint32_t powTen[] = {
+#endif  // __AVR__
+  1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+  100000000UL, 1000000000UL
+};
+#ifdef __AVR__
+#define POW10(i) pgm_read_dword(&powTen[i])
+#else  // __AVR__
+#define POW10(i) powTen[i]
+#endif  // __AVR__
 #ifdef __AVR__
 static const float m[] PROGMEM = {1e-1, 1e-2, 1e-4, 1e-8, 1e-16, 1e-32};
 static const float p[] PROGMEM = {1e+1, 1e+2, 1e+4, 1e+8, 1e+16, 1e+32};
@@ -236,6 +276,82 @@ char* fmtDec(uint32_t n, char* p) {
   return fmtDec((uint16_t)n, p);
 }
 //------------------------------------------------------------------------------
+// Format unsigned n scaled by 10^prec with prec fraction digits.
+char* fmtScaled(uint32_t n, char* p, uint8_t prec) {
+  if (prec) {
+    for (uint8_t i = 0; i < prec; i++) {
+      *--p = divmod10(&n) + '0';
+    }
+    *--p = '.';
+  }
+  return fmtDec(n, p);
+}
+//------------------------------------------------------------------------------
+// Length of fmtScaled(n, p, prec) output.
+uint8_t scaledLen(uint32_t n, uint8_t prec) {
+  uint8_t len = 1;
+  while (len < 10 && n >= POW10(len)) {
+    len++;
+  }
+  if (prec) {
+    len = len > prec ? len + 1 : prec + 2;
+  }
+  return len;
+}
+//------------------------------------------------------------------------------
+// Exact round half up of value*10^prec from the float's mantissa and
+// exponent, ignoring sign. Return false if not finite or too large.
+bool floatScaled(float value, uint8_t prec, uint32_t* n) {
+  union {
+    float f;
+    uint32_t u;
+  } b;
+  b.f = value;
+  int16_t e = (b.u >> 23) & 0XFF;
+  uint64_t m = b.u & 0X7FFFFF;
+  if (e == 0XFF) {
+    return false;
+  }
+  if (e) {
+    m |= 0X800000;
+  } else {
+    e = 1;
+  }
+  e -= 150;
+  m *= POW10(prec);
+  if (e >= 0) {
+    if (e > 8 || (m << e) >> 32) {
+      return false;
+    }
+    *n = m << e;
+    return true;
+  }
+  e = -e;
+  if (e > 62) {
+    *n = 0;
+    return true;
+  }
+  m = (m + (1ULL << (e - 1))) >> e;
+  if (m >> 32) {
+    return false;
+  }
+  *n = m;
+  return true;
+}
+//------------------------------------------------------------------------------
+char* fmtFixed(int32_t value, char* p, uint8_t prec) {
+  bool neg = value < 0;
+  uint32_t n = neg ? 0UL - (uint32_t)value : value;
+  if (prec > 9) {
+    prec = 9;
+  }
+  p = fmtScaled(n, p, prec);
+  if (neg) {
+    *--p = '-';
+  }
+  return p;
+}
+//------------------------------------------------------------------------------
 char* fmtFloat(float value, char* p, uint8_t prec) {
   char sign = value < 0 ? '-' : 0;
   if (sign) {
@@ -263,19 +379,23 @@ char* fmtFloat(float value, char* p, uint8_t prec) {
   if (prec > 9) {
     prec = 9;
   }
-  value += scale10(0.5, -prec);
-
-  uint32_t whole = value;
-  if (prec) {
-    char* tmp = p - prec;
-    uint32_t fraction = scale10(value - whole, prec);
-    p = fmtDec(fraction, p);
-    while (p > tmp) {
-      *--p = '0';
+  uint32_t scaled;
+  if (floatScaled(value, prec, &scaled)) {
+    p = fmtScaled(scaled, p, prec);
+  } else {
+    value += scale10(0.5, -prec);
+    uint32_t whole = value;
+    if (prec) {
+      char* tmp = p - prec;
+      uint32_t fraction = scale10(value - whole, prec);
+      p = fmtDec(fraction, p);
+      while (p > tmp) {
+        *--p = '0';
+      }
+      *--p = '.';
     }
-    *--p = '.';
+    p = fmtDec(whole, p);
   }
-  p = fmtDec(whole, p);
   if (sign) {
     *--p = sign;
   }
@@ -317,6 +437,14 @@ char* fmtFloat(float value, char* ptr, uint8_t prec, char expChar) {
   if (prec > 9) {
     prec = 9;
   }
+  uint32_t scaled;
+  if (!expChar && floatScaled(value, prec, &scaled)) {
+    ptr = fmtScaled(scaled, ptr, prec);
+    if (neg) {
+      *--ptr = '-';
+    }
+    return ptr;
+  }
   float round = scale10(0.5, -prec);
   if (expChar) {
     int8_t exp = 0;
@@ -450,7 +578,17 @@ float scanFloat(const char* str, char** ptr) {
   if (ptr) {
     *ptr = const_cast<char*>(successPtr);
   }
-  v = scale10(static_cast<float>(fract), fracExp);
+  // Exact integer and power of ten give a correctly rounded result.
+  if (fract < (1UL << 24) && -9 <= fracExp && fracExp <= 9) {
+    v = static_cast<float>(fract);
+    if (fracExp < 0) {
+      v /= static_cast<float>(POW10(-fracExp));
+    } else {
+      v *= static_cast<float>(POW10(fracExp));
+    }
+  } else {
+    v = scale10(static_cast<float>(fract), fracExp);
+  }
   return neg ? -v : v;
 
 fail:
@@ -35,9 +35,13 @@ inline bool isSpace(char c) {
 #include <stdint.h>
 char* fmtDec(uint16_t n, char* p);
 char* fmtDec(uint32_t n, char* p);
+char* fmtFixed(int32_t value, char* p, uint8_t prec);
+char* fmtScaled(uint32_t n, char* p, uint8_t prec);
 char* fmtFloat(float value, char* p, uint8_t prec);
 char* fmtFloat(float value, char* ptr, uint8_t prec, char expChar);
 char* fmtHex(uint32_t n, char* p);
+bool floatScaled(float value, uint8_t prec, uint32_t* n);
 float scale10(float v, int8_t n);
+uint8_t scaledLen(uint32_t n, uint8_t prec);
 float scanFloat(const char* str, char** ptr);
 #endif  // FmtNumber_h
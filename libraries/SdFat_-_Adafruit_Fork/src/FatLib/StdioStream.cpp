@@ -24,6 +24,7 @@
  */
 #include "StdioStream.h"
 #include "FmtNumber.h"
+#include "FatFileSystem.h"
 //------------------------------------------------------------------------------
 int StdioStream::fclose() {
   int rtn = 0;
@@ -94,7 +95,8 @@ char* StdioStream::fgets(char* str, size_t num, size_t* len) {
   return str;
 }
 //------------------------------------------------------------------------------
-bool StdioStream::fopen(const char* path, const char* mode) {
+bool StdioStream::fopen(FatFile* dirFile, const char* path,
+                        const char* mode) {
   oflag_t oflag;
   uint8_t m;
   switch (*mode++) {
@@ -139,7 +141,7 @@ bool StdioStream::fopen(const char* path, const char* mode) {
   }
   oflag |= m;
 
-  if (!FatFile::open(path, oflag)) {
+  if (!FatFile::open(dirFile, path, oflag)) {
     goto fail;
   }
   m_r = 0;
@@ -152,6 +154,10 @@ fail:
   return false;
 }
 //------------------------------------------------------------------------------
+bool StdioStream::fopen(FatFileSystem* fs, const char* path, const char* mode) {
+  return fopen(fs->vwd(), path, mode);
+}
+//------------------------------------------------------------------------------
 int StdioStream::fputs(const char* str) {
   size_t len = strlen(str);
   return fwrite(str, 1, len) == len ? len : EOF;
@@ -365,6 +371,73 @@ int StdioStream::printDec(uint32_t n) {
 #endif
 }
 //------------------------------------------------------------------------------
+int StdioStream::printFields(const float* value, uint8_t count, uint8_t prec,
+                             char sep, char term) {
+  int rtn = 0;
+  if (prec > 9) {
+    prec = 9;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t n;
+    int s;
+    if (i && putc(sep) < 0) {
+      return -1;
+    }
+    if (floatScaled(value[i], prec, &n)) {
+      bool neg = value[i] < 0;
+      uint8_t len = scaledLen(n, prec) + neg;
+      char* str = fmtSpace(len);
+      if (!str) {
+        return -1;
+      }
+      str = fmtScaled(n, str, prec);
+      if (neg) {
+        *--str = '-';
+      }
+      s = len;
+    } else if ((s = printDec(value[i], prec)) < 0) {
+      return -1;
+    }
+    rtn += s + (i != 0);
+  }
+  if (term) {
+    if (putc(term) < 0) {
+      return -1;
+    }
+    rtn++;
+  }
+  return rtn;
+}
+//------------------------------------------------------------------------------
+int StdioStream::printFields(const int32_t* value, uint8_t count,
+                             char sep, char term) {
+  int rtn = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (i && putc(sep) < 0) {
+      return -1;
+    }
+    bool neg = value[i] < 0;
+    uint32_t n = neg ? 0UL - (uint32_t)value[i] : value[i];
+    uint8_t len = scaledLen(n, 0) + neg;
+    char* str = fmtSpace(len);
+    if (!str) {
+      return -1;
+    }
+    str = fmtDec(n, str);
+    if (neg) {
+      *--str = '-';
+    }
+    rtn += len + (i != 0);
+  }
+  if (term) {
+    if (putc(term) < 0) {
+      return -1;
+    }
+    rtn++;
+  }
+  return rtn;
+}
+//------------------------------------------------------------------------------
 int StdioStream::printHex(uint32_t n) {
 #ifdef NEW_WAY
   char buf[8];
@@ -259,7 +259,31 @@ class StdioStream : private FatFile {
    *
    * \return true for success or false for failure.
    */
-  bool fopen(const char* path, const char * mode);
+  bool fopen(const char* path, const char * mode) {
+    return fopen(cwd(), path, mode);
+  }
+  //----------------------------------------------------------------------------
+  /** Open a stream, with \a path relative to a directory.
+   *
+   * \param[in] dirFile An open FatFile instance for the directory.
+   * \param[in] path location of the file to be opened.
+   * \param[in] mode open mode string, see fopen(const char*, const char*).
+   *
+   * \return true for success or false for failure.
+   */
+  bool fopen(FatFile* dirFile, const char* path, const char * mode);
+  //----------------------------------------------------------------------------
+  /** Open a stream in the volume working directory of a FatFileSystem,
+   * not the current working directory.  Use this when more than one
+   * volume is mounted.
+   *
+   * \param[in] fs File System where the file is located.
+   * \param[in] path location of the file to be opened.
+   * \param[in] mode open mode string, see fopen(const char*, const char*).
+   *
+   * \return true for success or false for failure.
+   */
+  bool fopen(FatFileSystem* fs, const char* path, const char * mode);
   //----------------------------------------------------------------------------
   /** Write a byte to a stream.
    *
@@ -599,6 +623,31 @@ class StdioStream : private FatFile {
     return rtn < 0 || putc(term) < 0 ? -1 : rtn + 1;
   }
   //----------------------------------------------------------------------------
+  /** Print an array of numbers as fields.
+   *
+   * Each number is formatted directly into the stream buffer.
+   *
+   * \param[in] value The numbers to be printed.
+   * \param[in] count The number of values.
+   * \param[in] prec Number of digits after decimal point.
+   * \param[in] sep The separator written between fields.
+   * \param[in] term Written after the last field if non zero.
+   * \return The number of bytes written or -1 if an error occurs.
+   */
+  int printFields(const float* value, uint8_t count, uint8_t prec,
+                  char sep = ',', char term = 0);
+  //----------------------------------------------------------------------------
+  /** Print an array of integers as fields.
+   *
+   * \param[in] value The numbers to be printed.
+   * \param[in] count The number of values.
+   * \param[in] sep The separator written between fields.
+   * \param[in] term Written after the last field if non zero.
+   * \return The number of bytes written or -1 if an error occurs.
+   */
+  int printFields(const int32_t* value, uint8_t count,
+                  char sep = ',', char term = 0);
+  //----------------------------------------------------------------------------
   /** Print HEX
    * \param[in] n number to be printed as HEX.
    *
@@ -120,6 +120,47 @@
  */
 #define MAINTAIN_FREE_CLUSTER_COUNT 0
 //------------------------------------------------------------------------------
+/**
+ * Set USE_FREE_CLUSTER_BITMAP nonzero to allow FatVolume to keep a bitmap
+ * of free clusters in a buffer supplied by setFreeClusterBitmap().  Cluster
+ * allocation and freeClusterCount() then avoid scanning the FAT.  The
+ * bitmap needs one bit per cluster.  May be set on the compiler command
+ * line.
+ */
+#ifndef USE_FREE_CLUSTER_BITMAP
+#ifdef __arm__
+#define USE_FREE_CLUSTER_BITMAP 1
+#else  // __arm__
+#define USE_FREE_CLUSTER_BITMAP 0
+#endif  // __arm__
+#endif  // USE_FREE_CLUSTER_BITMAP
+//------------------------------------------------------------------------------
+/**
+ * Set USE_DIR_NAME_INDEX nonzero to keep an in-memory index of name hashes
+ * for recently searched directories.  Repeated opens of files in these
+ * directories then read only the matching entries.  Requires long file
+ * names.  Uses about 4*DIR_INDEX_DIM*DIR_INDEX_DIRS bytes of RAM.  May be
+ * set on the compiler command line.
+ */
+#ifndef USE_DIR_NAME_INDEX
+#ifdef __arm__
+#define USE_DIR_NAME_INDEX USE_LONG_FILE_NAMES
+#else  // __arm__
+#define USE_DIR_NAME_INDEX 0
+#endif  // __arm__
+#endif  // USE_DIR_NAME_INDEX
+//------------------------------------------------------------------------------
+/**
+ * Set USE_FILE_BUFFER nonzero to allow a multi-block buffer for a file,
+ * supplied by FatFile::setBuffer().  Sequential reads are read ahead into
+ * the buffer and writes are held in it until it is full or the file is
+ * synced.  Adds about ten bytes to every file object.  May be set on the
+ * compiler command line.
+ */
+#ifndef USE_FILE_BUFFER
+#define USE_FILE_BUFFER 0
+#endif  // USE_FILE_BUFFER
+//------------------------------------------------------------------------------
 /**
  * To enable SD card CRC checking set USE_SD_CRC nonzero.
  *
@@ -181,11 +222,13 @@
  * for FAT table entries.  This improves performance for large writes
  * that are not a multiple of 512 bytes.
  */
+#ifndef USE_SEPARATE_FAT_CACHE
 #ifdef __arm__
 #define USE_SEPARATE_FAT_CACHE 1
 #else  // __arm__
 #define USE_SEPARATE_FAT_CACHE 0
 #endif  // __arm__
+#endif  // USE_SEPARATE_FAT_CACHE
 //------------------------------------------------------------------------------
 /**
  * Set USE_MULTI_BLOCK_IO nonzero to use multi-block SD read/write.
@@ -143,20 +143,16 @@ int year(time_t t) { // the year for the given time
 /* functions to convert to and from system time */
 /* These are for interfacing with time serivces and are not normally needed in a sketch */
 
-// leap year calulator expects year argument as years offset from 1970
-#define LEAP_YEAR(Y)     ( ((1970+(Y))>0) && !((1970+(Y))%4) && ( ((1970+(Y))%100) || !((1970+(Y))%400) ) )
+// days since 1970 are converted with the March based civil calendar formulas
+// of H. Hinnant, in 400 year eras of 146097 days, instead of year and month loops
+#define DAYS_0000_TO_1970 719468UL  // from 0000-03-01, the start of era 0
 
-static  const uint8_t monthDays[]={31,28,31,30,31,30,31,31,30,31,30,31}; // API starts months from 1, this array starts from 0
- 
 void breakTime(time_t timeInput, tmElements_t &tm){
 // break the given time_t into time components
 // this is a more compact version of the C library localtime function
 // note that year is offset from 1970 !!!
 
-  uint8_t year;
-  uint8_t month, monthLength;
-  uint32_t time;
-  unsigned long days;
+  uint32_t time, era, doe, yoe, doy, mp;
 
   time = (uint32_t)timeInput;
   tm.Second = time % 60;
@@ -166,39 +162,16 @@ void breakTime(time_t timeInput, tmElements_t &tm){
   tm.Hour = time % 24;
   time /= 24; // now it is days
   tm.Wday = ((time + 4) % 7) + 1;  // Sunday is day 1 
-  
-  year = 0;  
-  days = 0;
-  while((unsigned)(days += (LEAP_YEAR(year) ? 366 : 365)) <= time) {
-    year++;
-  }
-  tm.Year = year; // year is offset from 1970 
-  
-  days -= LEAP_YEAR(year) ? 366 : 365;
-  time  -= days; // now it is days in this year, starting at 0
-  
-  days=0;
-  month=0;
-  monthLength=0;
-  for (month=0; month<12; month++) {
-    if (month==1) { // february
-      if (LEAP_YEAR(year)) {
-        monthLength=29;
-      } else {
-        monthLength=28;
-      }
-    } else {
-      monthLength = monthDays[month];
-    }
-    
-    if (time >= monthLength) {
-      time -= monthLength;
-    } else {
-        break;
-    }
-  }
-  tm.Month = month + 1;  // jan is month 1  
-  tm.Day = time + 1;     // day of month
+
+  time += DAYS_0000_TO_1970;
+  era = time / 146097;
+  doe = time - era * 146097;                                    // day of era [0, 146096]
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // year of era [0, 399]
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);                // day of year from March 1
+  mp = (5 * doy + 2) / 153;                                     // month from March [0, 11]
+  tm.Day = doy - (153 * mp + 2) / 5 + 1;     // day of month
+  tm.Month = mp < 10 ? mp + 3 : mp - 9;      // jan is month 1
+  tm.Year = era * 400 + yoe + (mp >= 10) - 1970; // year is offset from 1970 
 }
 
 time_t makeTime(const tmElements_t &tm){   
@@ -206,26 +179,17 @@ time_t makeTime(const tmElements_t &tm){
 // note year argument is offset from 1970 (see macros in time.h to convert to other formats)
 // previous version used full four digit year (or digits since 2000),i.e. 2009 was 2009 or 9
   
-  int i;
+  uint32_t y, era, yoe, doy, days;
   uint32_t seconds;
 
-  // seconds from 1970 till 1 jan 00:00:00 of the given year
-  seconds= tm.Year*(SECS_PER_DAY * 365);
-  for (i = 0; i < tm.Year; i++) {
-    if (LEAP_YEAR(i)) {
-      seconds +=  SECS_PER_DAY;   // add extra days for leap years
-    }
-  }
-  
-  // add days for this year, months start from 1
-  for (i = 1; i < tm.Month; i++) {
-    if ( (i == 2) && LEAP_YEAR(tm.Year)) { 
-      seconds += SECS_PER_DAY * 29;
-    } else {
-      seconds += SECS_PER_DAY * monthDays[i-1];  //monthDay array starts from 0
-    }
-  }
-  seconds+= (tm.Day-1) * SECS_PER_DAY;
+  // days from 1970 till the given date, with the year starting March 1
+  y = tm.Year + 1970 - (tm.Month <= 2);
+  era = y / 400;
+  yoe = y - era * 400;
+  doy = (153 * (tm.Month > 2 ? tm.Month - 3 : tm.Month + 9) + 2) / 5 + tm.Day - 1;
+  days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - DAYS_0000_TO_1970;
+
+  seconds= days * SECS_PER_DAY;
   seconds+= tm.Hour * SECS_PER_HOUR;
   seconds+= tm.Minute * SECS_PER_MIN;
   seconds+= tm.Second;